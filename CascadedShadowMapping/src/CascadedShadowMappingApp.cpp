@@ -3,8 +3,13 @@
 #include "cinder/gl/gl.h"
 #include "cinder/CameraUi.h"
 #include "cinder/ObjLoader.h"
+#include "cinder/Log.h"
 
 #include "CinderImGui.h"
+#include "MeshSimplifier.h"
+
+#include <thread>
+#include <atomic>
 
 using namespace ci;
 using namespace ci::app;
@@ -84,8 +89,15 @@ class CascadedShadowMappingApp : public App {
 	void userInterface();
 	
 	
-	// Scene Objects
-	using Object = std::tuple<gl::BatchRef,gl::BatchRef,AxisAlignedBox>;
+	// Scene Objects, each level of detail shares the vertex buffer of the full detail mesh
+	struct Object {
+		vector<gl::BatchRef>	mBatches, mShadowBatches;
+		vector<float>			mErrors;
+		AxisAlignedBox			mBounds;
+	};
+	//! returns the coarsest level of \a object whose error stays under \a maxPixels on screen
+	size_t selectLod( const Object &object, float maxPixels ) const;
+	
 	CameraPersp		mCamera;
 	CameraUi		mCameraUi;
 	vector<Object>		mScene;
@@ -98,6 +110,9 @@ class CascadedShadowMappingApp : public App {
 	// options
 	bool			mPolygonOffset, mFiltering, mShowCascades, mShowUi, mShowShadowMaps;
 	int			mShadowMapSize;
+	bool			mLod;
+	float			mLodPixels, mShadowLodBias;
+	int			mNumTriangles, mNumFullTriangles, mNumShadowTriangles, mNumFullShadowTriangles;
 };
 
 
@@ -110,15 +125,45 @@ CascadedShadowMappingApp::CascadedShadowMappingApp()
 	auto shader = gl::GlslProg::create( loadAsset( "shader.vert" ), loadAsset( "shader.frag" ) );
 	auto shadowShader = gl::GlslProg::create( loadAsset( "shadowmap.vert" ), loadAsset( "shadowmap.frag" ), loadAsset( "shadowmap.geom" ) );
 	
-	// parse obj and split into gl::Batch
+	// parse obj and split into gl::Batch, each group is reordered for the vertex cache, overdraw and vertex fetch
+	// and simplified into levels of detail first. the groups are independent and spread over the threads
 	auto source = ObjLoader( loadAsset( "terrain.obj" ) );
+	vector<TriMesh> trimeshes;
 	for( size_t i = 0; i < source.getNumGroups(); ++i ) {
-		auto trimesh = TriMesh( source.groupIndex( i ) );
-		mScene.push_back( make_tuple(
-			gl::Batch::create( source, shader ),
-			gl::Batch::create( source, shadowShader ),
-			trimesh.calcBoundingBox()
-		) );
+		trimeshes.push_back( TriMesh( source.groupIndex( i ) ) );
+	}
+	vector<MeshOptimizer::Report> reports( trimeshes.size() );
+	vector<vector<MeshSimplifier::Lod>> lods( trimeshes.size() );
+	std::atomic<size_t> nextGroup( 0 );
+	auto worker = [&]() {
+		size_t i;
+		while( ( i = nextGroup++ ) < trimeshes.size() ) {
+			reports[i]	= MeshOptimizer::optimize( &trimeshes[i] );
+			lods[i]		= MeshSimplifier::buildLods( trimeshes[i], MeshSimplifier::Options().lods( 4 ) );
+		}
+	};
+	vector<std::thread> threads;
+	for( size_t i = 1; i < std::max( 1u, std::thread::hardware_concurrency() ); ++i ) {
+		threads.push_back( std::thread( worker ) );
+	}
+	worker();
+	for( auto &thread : threads ) thread.join();
+	
+	for( size_t i = 0; i < trimeshes.size(); ++i ) {
+		CI_LOG_I( "Optimized " << source.getGroups()[i].mName << ", ACMR " << reports[i].mBefore.mAcmr << " -> " << reports[i].mAfter.mAcmr << ", ATVR " << reports[i].mBefore.mAtvr << " -> " << reports[i].mAfter.mAtvr << ", " << lods[i].size() << " lods" );
+		
+		// the simplified levels only have their own indices
+		Object object;
+		auto mesh = gl::VboMesh::create( trimeshes[i] );
+		for( size_t l = 0; l < lods[i].size(); ++l ) {
+			const auto &indices = lods[i][l].mIndices;
+			auto lodMesh = l == 0 ? mesh : gl::VboMesh::create( mesh->getNumVertices(), GL_TRIANGLES, mesh->getVertexArrayLayoutVbos(), static_cast<uint32_t>( indices.size() ), GL_UNSIGNED_INT, gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof( uint32_t ), indices.data(), GL_STATIC_DRAW ) );
+			object.mBatches.push_back( gl::Batch::create( lodMesh, shader ) );
+			object.mShadowBatches.push_back( gl::Batch::create( lodMesh, shadowShader ) );
+			object.mErrors.push_back( lods[i][l].mError );
+		}
+		object.mBounds = trimeshes[i].calcBoundingBox();
+		mScene.push_back( object );
 	}
 	
 	// load baked ao texture
@@ -137,6 +182,10 @@ CascadedShadowMappingApp::CascadedShadowMappingApp()
 	mShowCascades	= false;
 	mPolygonOffset	= true;
 	mFiltering	= true;
+	mLod		= true;
+	mLodPixels	= 1.0f;
+	mShadowLodBias	= 4.0f;
+	mNumTriangles = mNumFullTriangles = mNumShadowTriangles = mNumFullShadowTriangles = 0;
 }
 void CascadedShadowMappingApp::resize()
 {
@@ -166,9 +215,14 @@ void CascadedShadowMappingApp::update()
 		
 		gl::clear( Color( 1.0f, 0.0f, 0.0f ) );
 		
+		// the geometry shader draws each object once for all the cascades, so its level can't follow the texel size of each
+		// cascade. the shadow maps are coarser than the screen and blurred, they get away with a larger error instead
+		mNumShadowTriangles = mNumFullShadowTriangles = 0;
 		for( const auto &obj : mScene ) {
-			auto batch	= std::get<1>( obj );
+			auto batch	= obj.mShadowBatches[selectLod( obj, mLodPixels * mShadowLodBias )];
 			auto shader = batch->getGlslProg();
+			mNumShadowTriangles	+= batch->getVboMesh()->getNumIndices() / 3;
+			mNumFullShadowTriangles	+= obj.mShadowBatches.front()->getVboMesh()->getNumIndices() / 3;
 			shader->uniform( "uCascadesViewMatrices", mCascadedShadows->getViewMatrices().data(), mCascadedShadows->getViewMatrices().size() );
 			shader->uniform( "uCascadesProjMatrices", mCascadedShadows->getProjMatrices().data(), mCascadedShadows->getProjMatrices().size() );
 			shader->uniform( "uCascadesNear", mCascadedShadows->getNearPlanes().data(), mCascadedShadows->getNearPlanes().size() );
@@ -201,10 +255,13 @@ void CascadedShadowMappingApp::draw()
 	gl::setMatrices( mCamera );
 	
 	Frustumf frustum( mCamera );
+	mNumTriangles = mNumFullTriangles = 0;
 	for( const auto &obj : mScene ) {
-		if( frustum.intersects( std::get<2>( obj ) ) ) {
-			auto batch	= std::get<0>( obj );
+		if( frustum.intersects( obj.mBounds ) ) {
+			auto batch	= obj.mBatches[selectLod( obj, mLodPixels )];
 			auto shader = batch->getGlslProg();
+			mNumTriangles		+= batch->getVboMesh()->getNumIndices() / 3;
+			mNumFullTriangles	+= obj.mBatches.front()->getVboMesh()->getNumIndices() / 3;
 			
 			vec3 lightDir = normalize( vec3( mCamera.getViewMatrix() * vec4( mLightDir, 0.0f ) ) );
 			
@@ -262,6 +319,15 @@ void CascadedShadowMappingApp::userInterface()
 		if( ui::DragFloat( "SplitLambda", &splitLambda, 0.001f, 0.0f ) ) mCascadedShadows->setSplitLambda( splitLambda );
 	}
 	
+	// level of detail options
+	if( ui::CollapsingHeader( "Level of Detail", nullptr, true, true ) ) {
+		ui::Checkbox( "LOD", &mLod );
+		ui::DragFloat( "LOD Error (px)", &mLodPixels, 0.05f, 0.0f, 16.0f );
+		ui::DragFloat( "Shadow LOD Bias", &mShadowLodBias, 0.05f, 1.0f, 16.0f );
+		ui::Text( "%d / %d triangles", mNumTriangles, mNumFullTriangles );
+		ui::Text( "%d / %d shadow triangles", mNumShadowTriangles, mNumFullShadowTriangles );
+	}
+	
 	// debug options
 	if( ui::CollapsingHeader( "Debug", nullptr, true, true ) ) {
 		ui::Checkbox( "Show Cascades", &mShowCascades );
@@ -272,6 +338,19 @@ void CascadedShadowMappingApp::userInterface()
 	getWindow()->setTitle( "Cascaded Shadow Mapping | " + to_string( (int) getAverageFps() ) + " fps" );
 }
 
+size_t CascadedShadowMappingApp::selectLod( const Object &object, float maxPixels ) const
+{
+	if( ! mLod ) {
+		return 0;
+	}
+	
+	// the error is projected at the closest point of the bounding box
+	vec3 eye		= mCamera.getEyePoint();
+	float distance		= glm::max( glm::distance( eye, glm::clamp( eye, object.mBounds.getMin(), object.mBounds.getMax() ) ), mCamera.getNearClip() );
+	float pixelsPerUnit	= getWindowHeight() / ( 2.0f * tan( toRadians( mCamera.getFov() ) * 0.5f ) * distance );
+	return MeshSimplifier::selectLod( object.mErrors, pixelsPerUnit, maxPixels );
+}
+
 CascadedShadowsRef CascadedShadows::create()
 {
 	return make_shared<CascadedShadows>();
@@ -2,6 +2,8 @@
 
 uniform sampler2D 	uSource;
 uniform sampler3D 	uColorGradingLUT;
+uniform sampler3D 	uPreviousColorGradingLUT;
+uniform float		uCrossFade;
 uniform float		uDiagonal;
 
 in vec2           	vUv;
@@ -10,6 +12,6 @@ out vec4          	oColor;
 void main(){
     vec3 color  = texture( uSource, vUv ).rgb;
 	if( vUv.x + vUv.y > uDiagonal )
-		color	= texture( uColorGradingLUT, color ).rgb;
+		color	= mix( texture( uPreviousColorGradingLUT, color ).rgb, texture( uColorGradingLUT, color ).rgb, uCrossFade );
     oColor      = vec4( color, 1.0f );
 }
\ No newline at end of file
@@ -24,11 +24,27 @@
 #pragma once
 
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include <string>
 #include <thread>
 #include <memory>
 #include <atomic>
 #include <mutex>
+#include <set>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <limits>
+
+#if ! defined(_WIN32) && ! defined(__WIN32__) && ! defined(WIN32)
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <dirent.h>
+#endif
 
 #ifdef CINDER_CINDER
     #include "cinder/Filesystem.h"
@@ -49,6 +65,16 @@
     #endif
 #endif
 
+// On linux the file system is watched with inotify instead of polling every watched path
+// twice a second. Define WATCHDOG_DISABLE_INOTIFY to force the polling backend. The polling
+// backend is also used as a fallback if inotify can't be initialized.
+#if defined( __linux__ ) && ! defined( WATCHDOG_DISABLE_INOTIFY )
+    #define WATCHDOG_INOTIFY
+    #include <poll.h>
+    #include <sys/inotify.h>
+    #include <sys/eventfd.h>
+#endif
+
 // Windows Issue :
 // For the moment the overloaded version of wd::watch has a different name on windows
 // platforms because of some issues with visual studio lambda support (see above)
@@ -89,20 +115,36 @@ public:
 class Watchdog {
 public:
     
+    //! Per watch options
+    class Options {
+    public:
+        Options() : mDebounce( 0 ), mVerifyContent( false ) {}
+        
+        //! Waits for \a milliseconds without any new change before calling back. All the changes detected during that window are coalesced into a single callback. Defaults to 0.
+        Options& debounce( int milliseconds ) { mDebounce = std::chrono::milliseconds( milliseconds ); return *this; }
+        //! Compares the content hash of the modified files and ignores the changes that don't modify the content of the file. Defaults to false.
+        Options& verifyContent( bool verify = true ) { mVerifyContent = verify; return *this; }
+        
+    protected:
+        std::chrono::milliseconds   mDebounce;
+        bool                        mVerifyContent;
+        friend class Watchdog;
+    };
+    
     //! Watches a file or directory for modification and call back the specified std::function. The path specified is passed as argument of the callback even if there is multiple files. Use the second watch method if you want to receive a list of all the files that have been modified.
-    static void watch( const ci::fs::path &path, const std::function<void(const ci::fs::path&)> &callback )
+    static void watch( const ci::fs::path &path, const std::function<void(const ci::fs::path&)> &callback, const Options &options = Options() )
     {
-        watchImpl( path, callback, std::function<void(const std::vector<ci::fs::path>&)>() );
+        watchImpl( path, callback, std::function<void(const std::vector<ci::fs::path>&)>(), options );
     }
     
     //! Watches a file or directory for modification and call back the specified std::function. A list of modified files or directory is passed as argument of the callback. Use this version only if you are watching multiple files or a directory.
 #ifdef WIN_AMBIGUITY_FIX
-    static void watchMany( const ci::fs::path &path, const std::function<void(const std::vector<ci::fs::path>&)> &callback )
+    static void watchMany( const ci::fs::path &path, const std::function<void(const std::vector<ci::fs::path>&)> &callback, const Options &options = Options() )
 #else
-    static void watch( const ci::fs::path &path, const std::function<void(const std::vector<ci::fs::path>&)> &callback )
+    static void watch( const ci::fs::path &path, const std::function<void(const std::vector<ci::fs::path>&)> &callback, const Options &options = Options() )
 #endif
     {
-        watchImpl( path, std::function<void(const ci::fs::path&)>(), callback );
+        watchImpl( path, std::function<void(const ci::fs::path&)>(), callback, options );
     }
     //! Unwatches a previously registrated file or directory
     static void unwatch( const ci::fs::path &path )
@@ -135,48 +177,107 @@ public:
             throw WatchedFileSystemExc( path );
         }
     }
+    //! Returns the number of changes that didn't trigger a callback, either because they were coalesced by the debounce window or because the content of the file didn't change
+    static size_t getNumSuppressedChanges()
+    {
+        return numSuppressedChanges();
+    }
     
 protected:
     
+    class Watcher;
+    
+    //! A pending watch or unwatch request. A null watcher means unwatch, an empty key with a null watcher means unwatch all
+    struct Registration {
+        std::string                 mKey;
+        std::shared_ptr<Watcher>    mWatcher;
+    };
+    
     Watchdog()
     : mWatching(false)
+#ifdef WATCHDOG_INOTIFY
+    , mInotify(-1), mWakeUp(-1)
+#endif
     {
     }
+    ~Watchdog()
+    {
+        // outside of Cinder nothing closes the static instance before it is destroyed at exit
+        if( mWatching ) close();
+    }
     
     void close()
     {
-        // remove all watchers
-        unwatchAll();
-        
         // stop the thread
         mWatching = false;
+        wakeUp();
         if( mThread->joinable() ) mThread->join();
+        
+        // remove all watchers
+        mQueue.clear();
+        mWatchedKeys.clear();
+        mFileWatchers.clear();
+        mPendingWatchers.clear();
+#ifdef WATCHDOG_INOTIFY
+        if( mInotify >= 0 ) ::close( mInotify );
+        if( mWakeUp >= 0 ) ::close( mWakeUp );
+        mInotify = mWakeUp = -1;
+        mDirectoryDescriptors.clear();
+        mInotifyWatchers.clear();
+#endif
     }
     
+    //! Wakes up the watching thread so it can process the registrations or see that we stopped watching
+    void wakeUp()
+    {
+#ifdef WATCHDOG_INOTIFY
+        if( mWakeUp >= 0 ) {
+            uint64_t wakeUp = 1;
+            ssize_t written = ::write( mWakeUp, &wakeUp, sizeof( wakeUp ) );
+            (void) written;
+        }
+#endif
+    }
     
     void start()
     {
         mWatching   = true;
+#ifdef WATCHDOG_INOTIFY
+        // try to use inotify first, the thread will sleep until the kernel notifies a change
+        mInotify    = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+        mWakeUp     = mInotify >= 0 ? eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) : -1;
+        if( mInotify >= 0 && mWakeUp >= 0 ) {
+            mThread = std::unique_ptr<std::thread>( new std::thread( [this](){ inotifyLoop(); } ) );
+            return;
+        }
+        // otherwise fall back to polling
+        if( mInotify >= 0 ) ::close( mInotify );
+        mInotify    = -1;
+#endif
         mThread     = std::unique_ptr<std::thread>( new std::thread( [this](){
             // keep watching for modifications every ms milliseconds
             auto ms = std::chrono::milliseconds( 500 );
             while( mWatching ) {
-                do {
-                    // iterate through each watcher and check for modification
-                    std::lock_guard<std::mutex> lock( mMutex );
-                    auto end = mFileWatchers.end();
-                    for( auto it = mFileWatchers.begin(); it != end; ++it ) {
-                        it->second.watch();
+                // add and remove the watchers registered since the last iteration
+                processRegistrations();
+                
+                // iterate through each watcher and check for modification
+                for( auto it = mFileWatchers.begin(); it != mFileWatchers.end(); ++it ) {
+                    try {
+                        if( it->second->watch() ) mPendingWatchers.insert( it->first );
                     }
-                    // lock will be released before this thread goes to sleep
-                } while( false );
+                    catch( const std::exception & ) {}
+                }
+                auto nextDeadline = dispatchPending();
                 
-                // make this thread sleep for a while
-                std::this_thread::sleep_for( ms );
+                // make this thread sleep for a while, or until the next debounced callback is due
+                auto now = std::chrono::steady_clock::now();
+                if( nextDeadline < now + ms ) std::this_thread::sleep_until( nextDeadline );
+                else std::this_thread::sleep_for( ms );
             }
         } ) );
     }
-    static void watchImpl( const ci::fs::path &path, const std::function<void(const ci::fs::path&)> &callback = std::function<void(const ci::fs::path&)>(), const std::function<void(const std::vector<ci::fs::path>&)> &listCallback = std::function<void(const std::vector<ci::fs::path>&)>() )
+    static void watchImpl( const ci::fs::path &path, const std::function<void(const ci::fs::path&)> &callback = std::function<void(const ci::fs::path&)>(), const std::function<void(const std::vector<ci::fs::path>&)> &listCallback = std::function<void(const std::vector<ci::fs::path>&)>(), const Options &options = Options() )
     {
         // create the static Watchdog instance
         static Watchdog wd;
@@ -194,7 +295,8 @@ protected:
             #endif
         }
         
-        const std::string key = path.string();
+        Registration registration;
+        registration.mKey = path.string();
         
         // add a new watcher
         if( callback || listCallback ){
@@ -230,32 +332,352 @@ protected:
                 throw WatchedFileSystemExc( path );
             }
 #endif
-            
-            std::lock_guard<std::mutex> lock( wd.mMutex );
-            if( wd.mFileWatchers.find( key ) == wd.mFileWatchers.end() ){
-                wd.mFileWatchers.emplace( make_pair( key, Watcher( p, filter, callback, listCallback ) ) );
+            // a path that is already watched keeps its watcher, the snapshot and the initial callback only happen for new ones
+            {
+                std::lock_guard<std::mutex> lock( wd.mQueueMutex );
+                if( ! wd.mWatchedKeys.insert( registration.mKey ).second ) return;
+            }
+            // the watcher takes its initial snapshot here, on the calling thread, the content hashes are left to the watching thread
+            // along with the initial callback of a single file
+            try {
+                registration.mWatcher = std::make_shared<Watcher>( p, filter, callback, listCallback, options );
+            }
+            catch( ... ) {
+                std::lock_guard<std::mutex> lock( wd.mQueueMutex );
+                wd.mWatchedKeys.erase( registration.mKey );
+                throw;
             }
         }
-        // if there is no callback that means that we are unwatching
-        else {
-            // if the path is empty we unwatch all files
-            if( path.empty() ){
-                std::lock_guard<std::mutex> lock( wd.mMutex );
-                for( auto it = wd.mFileWatchers.begin(); it != wd.mFileWatchers.end(); ) {
-                    it = wd.mFileWatchers.erase( it );
+        // if there is no callback that means that we are unwatching, and if the path is empty we unwatch all files
+        
+        // the registration is only queued, the watching thread is never blocked by the caller and vice versa
+        {
+            std::lock_guard<std::mutex> lock( wd.mQueueMutex );
+            if( ! registration.mWatcher ) {
+                if( registration.mKey.empty() ) wd.mWatchedKeys.clear();
+                else wd.mWatchedKeys.erase( registration.mKey );
+            }
+            wd.mQueue.push_back( registration );
+        }
+        wd.wakeUp();
+    }
+    
+    //! Applies the queued watch and unwatch requests. Only called from the watching thread
+    void processRegistrations()
+    {
+        std::vector<Registration> queue;
+        {
+            std::lock_guard<std::mutex> lock( mQueueMutex );
+            queue.swap( mQueue );
+        }
+        
+        for( auto &registration : queue ) {
+            // add a new watcher
+            if( registration.mWatcher ) {
+                if( mFileWatchers.find( registration.mKey ) == mFileWatchers.end() ){
+                    registration.mWatcher->hashContents();
+                    mFileWatchers.emplace( registration.mKey, registration.mWatcher );
+                    if( registration.mWatcher->hasPending() ) mPendingWatchers.insert( registration.mKey );
+#ifdef WATCHDOG_INOTIFY
+                    addDirectoryWatch( registration.mKey, registration.mWatcher->getDirectory() );
+#endif
+                }
+            }
+            // unwatch all files
+            else if( registration.mKey.empty() ) {
+#ifdef WATCHDOG_INOTIFY
+                for( const auto &watcher : mFileWatchers ) {
+                    removeDirectoryWatch( watcher.first, watcher.second->getDirectory() );
                 }
+#endif
+                mFileWatchers.clear();
+                mPendingWatchers.clear();
             }
             // or the specified file or directory
             else {
-                std::lock_guard<std::mutex> lock( wd.mMutex );
-                auto watcher = wd.mFileWatchers.find( key );
-                if( watcher != wd.mFileWatchers.end() ){
-                    wd.mFileWatchers.erase( watcher );
+                auto watcher = mFileWatchers.find( registration.mKey );
+                if( watcher != mFileWatchers.end() ){
+#ifdef WATCHDOG_INOTIFY
+                    removeDirectoryWatch( registration.mKey, watcher->second->getDirectory() );
+#endif
+                    mFileWatchers.erase( watcher );
+                    mPendingWatchers.erase( registration.mKey );
                 }
             }
         }
     }
     
+#ifdef WATCHDOG_INOTIFY
+    //! Registers the directory of a watcher to inotify. Files are watched through their parent directory because most editors save by replacing the file, which would invalidate a watch on the file itself.
+    void addDirectoryWatch( const std::string &key, const ci::fs::path &directory )
+    {
+        if( mInotify < 0 ) return;
+        
+        const std::string dir = directory.string();
+        auto it = mDirectoryDescriptors.find( dir );
+        if( it == mDirectoryDescriptors.end() ){
+            int descriptor = inotify_add_watch( mInotify, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ATTRIB );
+            if( descriptor < 0 ) return;
+            it = mDirectoryDescriptors.emplace( dir, descriptor ).first;
+        }
+        mInotifyWatchers[it->second].insert( key );
+    }
+    //! Unregisters a watcher and removes the inotify watch if its directory isn't used anymore.
+    void removeDirectoryWatch( const std::string &key, const ci::fs::path &directory )
+    {
+        if( mInotify < 0 ) return;
+        
+        auto it = mDirectoryDescriptors.find( directory.string() );
+        if( it == mDirectoryDescriptors.end() ) return;
+        auto &watchers = mInotifyWatchers[it->second];
+        watchers.erase( key );
+        if( watchers.empty() ){
+            inotify_rm_watch( mInotify, it->second );
+            mInotifyWatchers.erase( it->second );
+            mDirectoryDescriptors.erase( it );
+        }
+    }
+    //! Sleeps until inotify reports a change and only checks the files named by the events
+    void inotifyLoop()
+    {
+        // buffer aligned for inotify_event, big enough to read a burst of events at once
+        union { inotify_event mEvent; char mData[16384]; } buffer;
+        pollfd fds[2] = { { mInotify, POLLIN, 0 }, { mWakeUp, POLLIN, 0 } };
+        std::vector<std::pair<int,std::string>> events;
+        int timeout = -1;
+        while( mWatching ) {
+            int ready = poll( fds, 2, timeout );
+            if( ready < 0 ) {
+                continue;
+            }
+            // woken up by a registration or by close()
+            if( fds[1].revents & POLLIN ) {
+                uint64_t value;
+                ssize_t read = ::read( mWakeUp, &value, sizeof( value ) );
+                (void) read;
+                processRegistrations();
+            }
+            // nothing happened, only the debounced callbacks might be due
+            if( ! ( fds[0].revents & POLLIN ) ) {
+                timeout = getPollTimeout( dispatchPending() );
+                continue;
+            }
+            
+            // drain the events
+            events.clear();
+            bool overflow = false;
+            ssize_t length;
+            while( ( length = ::read( mInotify, buffer.mData, sizeof( buffer ) ) ) > 0 ) {
+                for( char *ptr = buffer.mData; ptr < buffer.mData + length; ) {
+                    const inotify_event *event = reinterpret_cast<const inotify_event*>( ptr );
+                    if( event->mask & IN_Q_OVERFLOW ) overflow = true;
+                    else events.push_back( std::make_pair( event->wd, event->len ? std::string( event->name ) : std::string() ) );
+                    ptr += sizeof( inotify_event ) + event->len;
+                }
+            }
+            
+            // let the watchers concerned by the events check the files that changed
+            for( const auto &event : events ){
+                auto watchers = overflow ? mInotifyWatchers.end() : mInotifyWatchers.find( event.first );
+                if( watchers == mInotifyWatchers.end() ) continue;
+                for( const auto &key : watchers->second ){
+                    auto watcher = mFileWatchers.find( key );
+                    // the file might be in the middle of being replaced, the next event will catch up
+                    try {
+                        if( watcher != mFileWatchers.end() && watcher->second->matches( event.second ) && watcher->second->watch( event.second ) ) mPendingWatchers.insert( key );
+                    }
+                    catch( const std::exception & ) {}
+                }
+            }
+            // some events were dropped by the kernel, rescan everything
+            if( overflow ){
+                for( const auto &watcher : mFileWatchers ){
+                    try {
+                        if( watcher.second->watch() ) mPendingWatchers.insert( watcher.first );
+                    }
+                    catch( const std::exception & ) {}
+                }
+            }
+            timeout = getPollTimeout( dispatchPending() );
+        }
+    }
+    //! Converts a deadline to a poll timeout
+    static int getPollTimeout( const std::chrono::steady_clock::time_point &deadline )
+    {
+        if( deadline == std::chrono::steady_clock::time_point::max() ) return -1;
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>( deadline - std::chrono::steady_clock::now() ).count() + 1;
+        return static_cast<int>( std::max<long long>( ms, 0 ) );
+    }
+#endif
+    
+    //! Calls back the watchers whose debounce window is over and returns the closest remaining deadline
+    std::chrono::steady_clock::time_point dispatchPending()
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto nextDeadline = std::chrono::steady_clock::time_point::max();
+        for( auto it = mPendingWatchers.begin(); it != mPendingWatchers.end(); ) {
+            auto watcher = mFileWatchers.find( *it );
+            if( watcher == mFileWatchers.end() || watcher->second->dispatch( now ) ){
+                it = mPendingWatchers.erase( it );
+            }
+            else {
+                nextDeadline = std::min( nextDeadline, watcher->second->getDeadline() );
+                ++it;
+            }
+        }
+        return nextDeadline;
+    }
+    
+    //! A sorted list of file names and their modification time
+    typedef std::vector<std::pair<std::string,int64_t>> Snapshot;
+    
+    //! Returns whether a file name matches a wildcard filter
+    static bool matchesFilter( const std::string &filename, const std::string &filter )
+    {
+        size_t wildcardPos  = filter.find( "*" );
+        if( wildcardPos == std::string::npos ) return filename == filter;
+        size_t afterSize    = filter.size() - wildcardPos - 1;
+        return filename.size() >= wildcardPos + afterSize
+            && filename.compare( 0, wildcardPos, filter, 0, wildcardPos ) == 0
+            && filename.compare( filename.size() - afterSize, afterSize, filter, wildcardPos + 1, afterSize ) == 0;
+    }
+    
+#if defined( __APPLE__ ) || defined( __linux__ )
+    static int64_t getModificationTime( const struct stat &st )
+    {
+    #if defined( __APPLE__ )
+        return static_cast<int64_t>( st.st_mtimespec.tv_sec ) * 1000000000LL + st.st_mtimespec.tv_nsec;
+    #else
+        return static_cast<int64_t>( st.st_mtim.tv_sec ) * 1000000000LL + st.st_mtim.tv_nsec;
+    #endif
+    }
+#endif
+    //! Returns the last modification time of a file in nanoseconds, time_t's one second resolution misses quick successive saves
+    static int64_t getModificationTime( const ci::fs::path &path )
+    {
+#if defined( __APPLE__ ) || defined( __linux__ )
+        struct stat st;
+        if( ::stat( path.string().c_str(), &st ) != 0 ) throw WatchedFileSystemExc( path );
+        return getModificationTime( st );
+#else
+        return static_cast<int64_t>( ci::fs::last_write_time( path ) ) * 1000000000LL;
+#endif
+    }
+    
+    //! Lists the files of \a directory whose name matches \a filter along with their modification time. Done with a single readdir/fstatat pass on posix systems instead of building and stat'ing each path.
+    static void listDirectory( const ci::fs::path &directory, const std::string &filter, Snapshot *snapshot )
+    {
+        snapshot->clear();
+#if defined( __APPLE__ ) || defined( __linux__ )
+        DIR *dir = opendir( directory.string().c_str() );
+        if( ! dir ) throw WatchedFileSystemExc( directory );
+        int fd = dirfd( dir );
+        while( dirent *entry = readdir( dir ) ){
+            if( entry->d_name[0] == '.' && ( entry->d_name[1] == '\0' || ( entry->d_name[1] == '.' && entry->d_name[2] == '\0' ) ) ) continue;
+            std::string name( entry->d_name );
+            if( ! matchesFilter( name, filter ) ) continue;
+            struct stat st;
+            if( fstatat( fd, entry->d_name, &st, 0 ) != 0 || S_ISDIR( st.st_mode ) ) continue;
+            snapshot->push_back( std::make_pair( name, getModificationTime( st ) ) );
+        }
+        closedir( dir );
+#else
+        ci::fs::directory_iterator end;
+        for( ci::fs::directory_iterator it( directory ); it != end; ++it ){
+            std::string name = it->path().filename().string();
+            if( matchesFilter( name, filter ) && ! ci::fs::is_directory( it->path() ) ){
+                snapshot->push_back( std::make_pair( name, static_cast<int64_t>( ci::fs::last_write_time( it->path() ) ) * 1000000000LL ) );
+            }
+        }
+#endif
+        std::sort( snapshot->begin(), snapshot->end() );
+    }
+    
+    //! Updates the modification times of an existing snapshot without listing the directory again, removed files get a time of -1
+    static void refreshSnapshot( const ci::fs::path &directory, Snapshot *snapshot )
+    {
+#if defined( __APPLE__ ) || defined( __linux__ )
+        int fd = ::open( directory.string().c_str(), O_RDONLY | O_DIRECTORY );
+        if( fd < 0 ) throw WatchedFileSystemExc( directory );
+        for( auto &file : *snapshot ){
+            struct stat st;
+            file.second = fstatat( fd, file.first.c_str(), &st, 0 ) == 0 ? getModificationTime( st ) : -1;
+        }
+        ::close( fd );
+#else
+        for( auto &file : *snapshot ){
+            ci::fs::path p = directory / file.first;
+            file.second = ci::fs::exists( p ) ? static_cast<int64_t>( ci::fs::last_write_time( p ) ) * 1000000000LL : -1;
+        }
+#endif
+    }
+    
+    static std::atomic<size_t>& numSuppressedChanges()
+    {
+        static std::atomic<size_t> sNumSuppressedChanges( 0 );
+        return sNumSuppressedChanges;
+    }
+    
+    //! 64 bits xxHash of a buffer, see https://github.com/Cyan4973/xxHash
+    static uint64_t hash( const uint8_t *data, size_t size, uint64_t seed = 0 )
+    {
+        static const uint64_t P1 = 11400714785074694791ULL, P2 = 14029467366897019727ULL, P3 = 1609587929392839161ULL, P4 = 9650029242287828579ULL, P5 = 2870177450012600261ULL;
+        auto rotl   = []( uint64_t x, int r ) { return ( x << r ) | ( x >> ( 64 - r ) ); };
+        auto read64 = []( const uint8_t *p ) { uint64_t v; memcpy( &v, p, 8 ); return v; };
+        auto read32 = []( const uint8_t *p ) { uint32_t v; memcpy( &v, p, 4 ); return v; };
+        auto round  = [&]( uint64_t acc, uint64_t input ) { return rotl( acc + input * P2, 31 ) * P1; };
+        auto merge  = [&]( uint64_t acc, uint64_t val ) { return ( acc ^ round( 0, val ) ) * P1 + P4; };
+        
+        const uint8_t *p = data, *end = data + size;
+        uint64_t h;
+        if( size >= 32 ){
+            uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+            for( ; p + 32 <= end; p += 32 ){
+                v1 = round( v1, read64( p ) );
+                v2 = round( v2, read64( p + 8 ) );
+                v3 = round( v3, read64( p + 16 ) );
+                v4 = round( v4, read64( p + 24 ) );
+            }
+            h = rotl( v1, 1 ) + rotl( v2, 7 ) + rotl( v3, 12 ) + rotl( v4, 18 );
+            h = merge( merge( merge( merge( h, v1 ), v2 ), v3 ), v4 );
+        }
+        else {
+            h = seed + P5;
+        }
+        h += static_cast<uint64_t>( size );
+        for( ; p + 8 <= end; p += 8 ) h = rotl( h ^ round( 0, read64( p ) ), 27 ) * P1 + P4;
+        if( p + 4 <= end ){ h = rotl( h ^ ( read32( p ) * P1 ), 23 ) * P2 + P3; p += 4; }
+        for( ; p < end; ++p ) h = rotl( h ^ ( *p * P5 ), 11 ) * P1;
+        h ^= h >> 33; h *= P2;
+        h ^= h >> 29; h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+    
+    //! Hashes the content of a file, memory mapping it when possible
+    static uint64_t hashFile( const ci::fs::path &path )
+    {
+#if ! defined(_WIN32) && ! defined(__WIN32__) && ! defined(WIN32)
+        int fd = ::open( path.string().c_str(), O_RDONLY | O_CLOEXEC );
+        if( fd < 0 ) return 0;
+        struct stat st;
+        uint64_t result = 0;
+        if( fstat( fd, &st ) == 0 && st.st_size > 0 ){
+            void *data = mmap( nullptr, static_cast<size_t>( st.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+            if( data != MAP_FAILED ){
+                result = hash( static_cast<const uint8_t*>( data ), static_cast<size_t>( st.st_size ) );
+                munmap( data, static_cast<size_t>( st.st_size ) );
+            }
+        }
+        ::close( fd );
+        return result;
+#else
+        std::ifstream file( path.string(), std::ios::binary );
+        std::vector<uint8_t> data( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+        return hash( data.data(), data.size() );
+#endif
+    }
+    
     static std::pair<ci::fs::path,std::string> getPathFilterPair( const ci::fs::path &path )
     {
         // extract wildcard and parent path
@@ -317,111 +739,265 @@ protected:
     
     class Watcher {
     public:
-        Watcher( const ci::fs::path &path, const std::string &filter, const std::function<void(const ci::fs::path&)> &callback, const std::function<void(const std::vector<ci::fs::path>&)> &listCallback )
-        : mPath(path), mFilter(filter), mCallback(callback), mListCallback(listCallback)
+        Watcher( const ci::fs::path &path, const std::string &filter, const std::function<void(const ci::fs::path&)> &callback, const std::function<void(const std::vector<ci::fs::path>&)> &listCallback, const Options &options )
+        : mPath(path), mFilter(filter), mCallback(callback), mListCallback(listCallback), mIsDirectory( ci::fs::is_directory( path ) ), mOptions( options ), mTime( -1 ), mDirectoryTime( -1 )
         {
             // make sure we store all initial write time
+            std::vector<ci::fs::path> paths;
             if( !mFilter.empty() ) {
-                std::vector<ci::fs::path> paths;
-                visitWildCardPath( path / filter, [this,&paths]( const ci::fs::path &p ){
-                    hasChanged( p );
-                    paths.push_back( p );
-                    return false;
-                } );
-                // this means that the first watch won't call the callback function
-                // so we have to manually call it here
-                if( mCallback ){
-                    mCallback( mPath / mFilter );
+                mDirectoryTime = getModificationTime( mPath );
+                listDirectory( mPath, mFilter, &mSnapshot );
+                for( const auto &file : mSnapshot ) {
+                    paths.push_back( mPath / file.first );
                 }
-                else {
-                    mListCallback( paths );
+            }
+            else {
+                mTime = getModificationTime( mPath );
+            }
+            
+            // this means that the first watch won't call the callback function so we have to manually call it here.
+            // like the original Watchdog a single file is called back asynchronously once the watching thread registers it
+            if( mFilter.empty() ){
+                addPending( mPath );
+            }
+            else if( mCallback ){
+                mCallback( mPath / mFilter );
+            }
+            else {
+                mListCallback( paths );
+            }
+        }
+        
+        //! Hashes the content of the files of the initial snapshot when verifyContent is set. Called from the watching thread before the first watch so the caller never waits on a large tree
+        void hashContents()
+        {
+            if( ! mOptions.mVerifyContent || mIsDirectory ) return;
+            
+            // a file written since the snapshot gets no hash, its new modification time then always counts as a change.
+            // its time is checked after hashing so a write during the hash can't be mistaken for the snapshot content
+            if( mFilter.empty() ){
+                uint64_t contentHash = hashFile( mPath );
+                try {
+                    if( getModificationTime( mPath ) == mTime ) mContentHashes[ std::string() ] = contentHash;
                 }
+                catch( const std::exception & ) {}
+                return;
+            }
+            Snapshot snapshot( mSnapshot );
+            std::vector<uint64_t> contentHashes;
+            contentHashes.reserve( snapshot.size() );
+            for( const auto &file : snapshot ) {
+                contentHashes.push_back( hashFile( mPath / file.first ) );
+            }
+            try {
+                refreshSnapshot( mPath, &snapshot );
+            }
+            catch( const std::exception & ) { return; }
+            for( size_t i = 0; i < snapshot.size(); ++i ) {
+                if( snapshot[i].second == mSnapshot[i].second ) mContentHashes[ snapshot[i].first ] = contentHashes[i];
             }
         }
         
-        void watch()
+        //! Checks for modifications and returns true if some changes are waiting to be dispatched. When \a filename is specified only that file of the watched directory is checked.
+        bool watch( const std::string &filename = std::string() )
         {
             // if there's no filter we just check for one item
-            if( mFilter.empty() && hasChanged( mPath ) && mCallback ){
+            if( mFilter.empty() ){
+                int64_t time = getModificationTime( mPath );
+                if( time != mTime ){
+                    mTime = time;
+                    if( isModified( std::string() ) ) addPending( mPath );
+                }
+            }
+            // we know which file changed, no need to look at the others
+            else if( ! filename.empty() ){
+                if( matchesFilter( filename, mFilter ) ) watchFile( filename );
+            }
+            // otherwise compare the directory with its last snapshot
+            else {
+                watchDirectory();
+            }
+            
+            // without debounce window the changes are dispatched right away
+            if( mPending.size() && mOptions.mDebounce.count() == 0 ){
+                dispatch( mDeadline );
+            }
+            return ! mPending.empty();
+        }
+        
+        //! Calls back the coalesced changes if the debounce window is over. Returns true if there's nothing left to dispatch
+        bool dispatch( const std::chrono::steady_clock::time_point &now )
+        {
+            if( mPending.empty() ) return true;
+            if( now < mDeadline ) return false;
+            
+            // copy everything needed by the callbacks, the watcher might be gone by the time they are called
+            std::vector<ci::fs::path> paths( mPending.begin(), mPending.end() );
+            ci::fs::path path = mFilter.empty() ? mPath : mPath / mFilter;
+            auto callback = mCallback;
+            auto listCallback = mListCallback;
+            mPending.clear();
+            
+            std::function<void()> dispatchFn = [=](){
+                if( callback ) callback( path );
+                else if( listCallback ) listCallback( paths );
+            };
 #ifdef CINDER_CINDER
-                ci::app::App::get()->dispatchAsync( [this](){
-                    mCallback( mPath );
-                } );
+            ci::app::App::get()->dispatchAsync( dispatchFn );
 #else
-                mCallback( mPath );
-                //#error TODO: still have to figure out an elegant way to do this without cinder
+            dispatchFn();
+            //#error TODO: still have to figure out an elegant way to do this without cinder
 #endif
+            return true;
+        }
+        
+        //! Returns the time at which the pending changes will be dispatched
+        const std::chrono::steady_clock::time_point& getDeadline() const { return mDeadline; }
+        //! Returns whether some changes are waiting to be dispatched
+        bool hasPending() const { return ! mPending.empty(); }
+        
+        //! Returns the directory containing the watched files
+        ci::fs::path getDirectory() const
+        {
+            if( !mFilter.empty() || mIsDirectory ) return mPath;
+            return mPath.parent_path();
+        }
+        //! Returns whether a file of the watcher directory concerns this watcher
+        bool matches( const std::string &filename ) const
+        {
+            return filename.empty() || mIsDirectory || ( !mFilter.empty() && matchesFilter( filename, mFilter ) ) || ( mFilter.empty() && mPath.filename().string() == filename );
+        }
+        
+    protected:
+        //! Checks a single file of the snapshot
+        void watchFile( const std::string &filename )
+        {
+            ci::fs::path p = mPath / filename;
+            auto file = std::lower_bound( mSnapshot.begin(), mSnapshot.end(), std::make_pair( filename, std::numeric_limits<int64_t>::min() ) );
+            bool known = file != mSnapshot.end() && file->first == filename;
+            // the file was removed
+            if( ! ci::fs::exists( p ) || ci::fs::is_directory( p ) ){
+                if( known ){
+                    mContentHashes.erase( filename );
+                    mSnapshot.erase( file );
+                }
+                return;
+            }
+            int64_t time = getModificationTime( p );
+            if( ! known ){
+                mSnapshot.insert( file, std::make_pair( filename, time ) );
+                if( isModified( filename ) ) addPending( p );
+            }
+            else if( file->second != time ){
+                file->second = time;
+                if( isModified( filename ) ) addPending( p );
+            }
+        }
+        //! Compares the directory with its last snapshot. The directory is only listed again if files were added, removed or renamed, otherwise the known files are stat'ed in place
+        void watchDirectory()
+        {
+            int64_t directoryTime = getModificationTime( mPath );
+#if defined( __APPLE__ ) || defined( __linux__ )
+            if( directoryTime == mDirectoryTime ){
+                Snapshot previous( mSnapshot );
+                refreshSnapshot( mPath, &mSnapshot );
+                size_t removed = 0;
+                for( size_t i = 0; i < mSnapshot.size(); ++i ){
+                    if( mSnapshot[i].second < 0 ) ++removed;
+                    else if( mSnapshot[i].second != previous[i].second && isModified( mSnapshot[i].first ) ) addPending( mPath / mSnapshot[i].first );
+                }
+                // a removed file should have changed the directory time but we don't want to rely on it
+                if( removed == 0 ) return;
             }
-            // otherwise we check the whole parent directory
-            else if( !mFilter.empty() ){
-                
-                std::vector<ci::fs::path> paths;
-                visitWildCardPath( mPath / mFilter, [this,&paths]( const ci::fs::path &p ){
-                    bool pathHasChanged = hasChanged( p );
-                    if( pathHasChanged && mCallback ){
-#ifdef CINDER_CINDER
-                        ci::app::App::get()->dispatchAsync( [this](){
-                            mCallback( mPath / mFilter );
-                        } );
-#else
-                        mCallback( mPath / mFilter );
-                        //#error TODO: still have to figure out an elegant way to do this without cinder
 #endif
-                        return true;
-                    }
-                    else if( pathHasChanged && mListCallback ){
-                        paths.push_back( p );
-                    }
-                    return false;
-                } );
-                if( paths.size() && mListCallback ){
-                    mListCallback( paths );
+            mDirectoryTime = directoryTime;
+            
+            // list the directory and merge it with the previous snapshot, both are sorted by name
+            Snapshot snapshot;
+            listDirectory( mPath, mFilter, &snapshot );
+            auto previous = mSnapshot.begin();
+            for( const auto &file : snapshot ){
+                while( previous != mSnapshot.end() && previous->first < file.first ){
+                    mContentHashes.erase( previous->first );
+                    ++previous;
                 }
+                bool known = previous != mSnapshot.end() && previous->first == file.first;
+                if( ( ! known || previous->second != file.second ) && isModified( file.first ) ){
+                    addPending( mPath / file.first );
+                }
+                if( known ) ++previous;
+            }
+            for( ; previous != mSnapshot.end(); ++previous ){
+                mContentHashes.erase( previous->first );
             }
+            mSnapshot.swap( snapshot );
+        }
+        //! Returns false if the file has a new modification time but the same content (touch, metadata only save, ...)
+        bool isModified( const std::string &filename )
+        {
+            if( ! mOptions.mVerifyContent || mIsDirectory ) return true;
             
+            uint64_t contentHash = hashFile( filename.empty() ? mPath : mPath / filename );
+            auto inserted = mContentHashes.insert( std::make_pair( filename, contentHash ) );
+            if( ! inserted.second ){
+                if( inserted.first->second == contentHash ){
+                    ++numSuppressedChanges();
+                    return false;
+                }
+                inserted.first->second = contentHash;
+            }
+            return true;
         }
-        
-        bool hasChanged( const ci::fs::path &path )
+        //! Adds a change to the list of changes to dispatch and restarts the debounce window
+        void addPending( const ci::fs::path &path )
         {
-            // get the last modification time
-            std::time_t time = ci::fs::last_write_time( path );
-            // add a new modification time to the map
-            std::string key = path.string();
-            if( mModificationTimes.find( key ) == mModificationTimes.end() ) {
-                mModificationTimes[ key ] = time;
-                return true;
-            }
-            // or compare with an older one
-            auto &prev = mModificationTimes[ key ];
-            if( prev < time ) {
-                prev = time;
-                return true;
-            }
-            return false;
-        };
+            // every change beyond the first one of the window is coalesced
+            if( ! mPending.empty() ) ++numSuppressedChanges();
+            mPending.insert( path.string() );
+            mDeadline = std::chrono::steady_clock::now() + mOptions.mDebounce;
+        }
         
-    protected:
         ci::fs::path                                            mPath;
         std::string                                             mFilter;
         std::function<void(const ci::fs::path&)>                mCallback;
         std::function<void(const std::vector<ci::fs::path>&)>   mListCallback;
-        std::map< std::string, time_t >                         mModificationTimes;
+        bool                                                    mIsDirectory;
+        Options                                                 mOptions;
+        // modification time of a single watched file
+        int64_t                                                 mTime;
+        // modification time of the directory and its matching files
+        int64_t                                                 mDirectoryTime;
+        Snapshot                                                mSnapshot;
+        std::unordered_map< std::string, uint64_t >             mContentHashes;
+        std::set< std::string >                                 mPending;
+        std::chrono::steady_clock::time_point                   mDeadline;
     };
     
     friend class SleepyWatchdog;
     
-    std::mutex                      mMutex;
-    std::atomic<bool>               mWatching;
-    std::unique_ptr<std::thread>    mThread;
-    std::map<std::string,Watcher>   mFileWatchers;
+    std::atomic<bool>                                           mWatching;
+    std::unique_ptr<std::thread>                                mThread;
+    // only accessed by the watching thread
+    std::unordered_map<std::string,std::shared_ptr<Watcher>>    mFileWatchers;
+    std::unordered_set<std::string>                             mPendingWatchers;
+    // the only state shared with the callers, the keys are the ones watched as seen from the callers once the queue is processed
+    std::mutex                                                  mQueueMutex;
+    std::vector<Registration>                                   mQueue;
+    std::unordered_set<std::string>                             mWatchedKeys;
+#ifdef WATCHDOG_INOTIFY
+    int                                                         mInotify, mWakeUp;
+    std::unordered_map<std::string,int>                         mDirectoryDescriptors;
+    std::unordered_map<int,std::unordered_set<std::string>>     mInotifyWatchers;
+#endif
 };
 
 //! this class is only used in release mode when WATCHDOG_ONLY_IN_DEBUG is defined
 class SleepyWatchdog {
 public:
+    typedef Watchdog::Options Options;
     
     //! executes the callback once
-    static void watch( const ci::fs::path &path, const std::function<void(const ci::fs::path&)> &callback )
+    static void watch( const ci::fs::path &path, const std::function<void(const ci::fs::path&)> &callback, const Watchdog::Options &options = Watchdog::Options() )
     {
         auto pathFilter = Watchdog::visitWildCardPath( path, []( const ci::fs::path &p ){ return false; } );
         if( pathFilter.first.empty() ){
@@ -432,9 +1008,9 @@ public:
         }
     }
 #ifdef WIN_AMBIGUITY_FIX
-    static void watchMany( const ci::fs::path &path, const std::function<void(const std::vector<ci::fs::path>&)> &callback )
+    static void watchMany( const ci::fs::path &path, const std::function<void(const std::vector<ci::fs::path>&)> &callback, const Watchdog::Options &options = Watchdog::Options() )
 #else
-    static void watch( const ci::fs::path &path, const std::function<void(const std::vector<ci::fs::path>&)> &callback )
+    static void watch( const ci::fs::path &path, const std::function<void(const std::vector<ci::fs::path>&)> &callback, const Watchdog::Options &options = Watchdog::Options() )
 #endif
     {
         auto pathFilter = Watchdog::visitWildCardPath( path, []( const ci::fs::path &p ){ return false; } );
@@ -454,6 +1030,9 @@ public:
     
     //! does nothing
     static void touch( const ci::fs::path &path, std::time_t time = std::time( nullptr ) ) {}
+    
+    //! always returns 0
+    static size_t getNumSuppressedChanges() { return 0; }
 };
 
 // defines the macro that allow to change the RELEASE/DEBUG behavior
@@ -1,7 +1,12 @@
 #include "cinder/app/App.h"
 #include "cinder/app/RendererGl.h"
 #include "cinder/gl/gl.h"
+#include "cinder/Timer.h"
+#include "cinder/Log.h"
 
+#include <future>
+
+#include "LookupTable.h"
 #include "Watchdog.h"
 
 using namespace ci;
@@ -12,27 +17,45 @@ class ColorGradingApp : public App {
 public:
 	ColorGradingApp();
 	~ColorGradingApp();
+	void update() override;
 	void draw() override;
 	void keyDown( KeyEvent event ) override;
 	void mouseDrag( MouseEvent event ) override;
 	void mouseUp( MouseEvent event ) override;
+	void fileDrop( FileDropEvent event ) override;
 	
-	//! Loads the color grading lookup table content from a file
+	//! Loads the color grading lookup table content from a file. Supports .cube, .3dl and horizontal strip images
 	void readLookupTable( const ci::DataSourceRef &lutImage, const ci::ivec3 &lutSize = ci::ivec3( 32 ) );
+	//! Loads the color grading lookup table on a worker thread. The new table is swapped in at the start of the frame following its decoding
+	void readLookupTableAsync( const ci::DataSourceRef &lutImage, const ci::ivec3 &lutSize = ci::ivec3( 32 ) );
+	//! Uploads a lookup table to the inactive 3d texture and makes it the active one
+	void readLookupTable( const LookupTable &lut );
+	//! Decodes and re-layouts a .cube, .3dl or horizontal strip lookup table. Doesn't use any gl resource and can be called from any thread
+	static LookupTable decodeLookupTable( const ci::DataSourceRef &lutImage, const ci::ivec3 &lutSize );
 	//! Exports the color grading lookup table to a file
 	void writeLookupTable( const ci::DataTargetRef &lutImage, const ci::ivec3 &lutSize = ci::ivec3( 32 ), const ci::ImageSourceRef &sourceImage = ci::ImageSourceRef(), bool tryToOpenInPhotoshop = true );
+	//! Writes the lookup table currently in use to a .cube or .3dl file
+	void exportLookupTable( const ci::DataTargetRef &lutFile );
 	//! Creates a base color grading lookup table
 	ci::Surface8u createLut( const ci::ivec3 &size );
 	
 	
 	gl::Texture2dRef	mSourceTexture;
-	gl::Texture3dRef	mColorGradingLut;
+	gl::Texture3dRef	mColorGradingLuts[2];
 	gl::GlslProgRef		mColorGradingProg;
 	float			mDiagonal, mDiagonalTarget;
+	
+	// double buffered lookup tables and background decoding
+	int			mActiveLut;
+	LookupTable		mLookupTable;
+	float			mLutCrossFade, mLutCrossFadeDuration;
+	double			mLastFrameTime;
+	std::future<LookupTable>	mPendingLut;
+	std::function<void()>	mQueuedReload;
 };
 
 ColorGradingApp::ColorGradingApp()
-: mDiagonal( 1.0f ), mDiagonalTarget( 1.0f )
+: mDiagonal( 1.0f ), mDiagonalTarget( 1.0f ), mActiveLut( 0 ), mLutCrossFade( 1.0f ), mLutCrossFadeDuration( 0.35f ), mLastFrameTime( 0.0 )
 {
 	// load the source image and the glsl prog
 	mSourceTexture		= gl::Texture2d::create( loadImage( loadAsset( "iceland.jpg" ) ) );
@@ -50,6 +73,33 @@ ColorGradingApp::~ColorGradingApp()
 	}
 }
 
+void ColorGradingApp::update()
+{
+	// swap the lookup tables at the start of the frame once the worker is done decoding
+	if( mPendingLut.valid() && mPendingLut.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready ) {
+		try {
+			readLookupTable( mPendingLut.get() );
+		}
+		catch( const std::exception &exc ) {
+			// the file is most likely still being written, the next save will trigger a new reload
+			CI_LOG_E( exc.what() );
+		}
+		// start the reload that came in while decoding
+		if( mQueuedReload ) {
+			auto reload = mQueuedReload;
+			mQueuedReload = nullptr;
+			reload();
+		}
+	}
+	
+	// cross-fade between the previous and the new lookup table
+	double time = getElapsedSeconds();
+	if( mLutCrossFade < 1.0f ) {
+		mLutCrossFade = mLutCrossFadeDuration > 0.0f ? std::min( 1.0f, mLutCrossFade + static_cast<float>( time - mLastFrameTime ) / mLutCrossFadeDuration ) : 1.0f;
+	}
+	mLastFrameTime = time;
+}
+
 void ColorGradingApp::draw()
 {
 	// interpolate diagonal value
@@ -61,34 +111,56 @@ void ColorGradingApp::draw()
 	// render a fullscreen quad with the color grading program
 	gl::ScopedGlslProg scopedShader( mColorGradingProg );
 	gl::ScopedTextureBind scopedTexBind0( mSourceTexture, 0 );
-	gl::ScopedTextureBind scopedTexBind1( mColorGradingLut, 1 );
+	gl::ScopedTextureBind scopedTexBind1( mColorGradingLuts[mActiveLut], 1 );
+	gl::ScopedTextureBind scopedTexBind2( mColorGradingLuts[1 - mActiveLut] ? mColorGradingLuts[1 - mActiveLut] : mColorGradingLuts[mActiveLut], 2 );
 	mColorGradingProg->uniform( "uSource", 0 );
 	mColorGradingProg->uniform( "uColorGradingLUT", 1 );
+	mColorGradingProg->uniform( "uPreviousColorGradingLUT", 2 );
+	mColorGradingProg->uniform( "uCrossFade", mLutCrossFade );
 	mColorGradingProg->uniform( "uDiagonal", mDiagonal );
 	
 	gl::drawSolidRect( getWindowBounds() );
 
-#if defined( CINDER_COCOA )
 	gl::ScopedBlendAlpha alphaBlending;
+#if defined( CINDER_COCOA )
 	gl::drawString( "Press 'e' to edit the color grading lut", vec2( 15 ) );
 #endif
+	if( wd::getNumSuppressedChanges() ) {
+		gl::drawString( to_string( wd::getNumSuppressedChanges() ) + " redundant reloads suppressed", vec2( 15, 30 ) );
+	}
 }
 
 void ColorGradingApp::keyDown( KeyEvent event )
 {
-#if defined( CINDER_COCOA )
 	switch ( event.getCode() ) {
+#if defined( CINDER_COCOA )
 		case KeyEvent::KEY_e:
 			// export a new lut file to be edited in photoshop/gimp
 			writeLookupTable( writeFile( getAssetPath( "" ) / "tempColorGrading.png" ), vec3(32), loadImage( loadAsset( "iceland.jpg" ) ) );
 			
-			// watch our lookup table for change
+			// watch our lookup table for change, photoshop writes the file several times per save
+			// so wait for the saves to settle and ignore the ones that don't change the content
 			wd::watch( "tempColorGrading.png", [this]( const fs::path &path ){
-				readLookupTable( loadAsset( "tempColorGrading.png" ), vec3(32) );
-			} );
+				readLookupTableAsync( loadAsset( "tempColorGrading.png" ), vec3(32) );
+			}, wd::Options().debounce( 250 ).verifyContent() );
 			break;
-	}
 #endif
+		case KeyEvent::KEY_x:
+			// export the current grading to the formats used by other grading tools
+			exportLookupTable( writeFile( getAssetPath( "" ) / "colorGrading.cube" ) );
+			exportLookupTable( writeFile( getAssetPath( "" ) / "colorGrading.3dl" ) );
+			break;
+	}
+}
+void ColorGradingApp::fileDrop( FileDropEvent event )
+{
+	// load any .cube, .3dl or strip image dropped on the window
+	try {
+		readLookupTable( loadFile( event.getFile( 0 ) ) );
+	}
+	catch( const std::exception &exc ) {
+		CI_LOG_E( exc.what() );
+	}
 }
 void ColorGradingApp::mouseDrag( MouseEvent event )
 {
@@ -101,11 +173,59 @@ void ColorGradingApp::mouseUp( MouseEvent event )
 
 void ColorGradingApp::readLookupTable( const ci::DataSourceRef &lutImage, const ci::ivec3 &lutSize )
 {
-	mColorGradingLut = gl::Texture3d::create( lutSize.z, lutSize.z, lutSize.z );
-	auto surface = Surface( loadImage( lutImage ) );
-	for( int i = 0; i < lutSize.z; i++ ){
-		mColorGradingLut->update( surface.clone( Area( ivec2( i * lutSize.z, 0 ), ivec2( i * lutSize.z + lutSize.x, lutSize.y ) ) ), i );
+	Timer timer( true );
+	readLookupTable( decodeLookupTable( lutImage, lutSize ) );
+	CI_LOG_I( "Loaded " << lutImage->getFilePathHint() << " in " << timer.getSeconds() * 1000.0 << " ms" );
+	
+	// no need to fade when loading synchronously
+	mLutCrossFade = 1.0f;
+}
+void ColorGradingApp::readLookupTableAsync( const ci::DataSourceRef &lutImage, const ci::ivec3 &lutSize )
+{
+	// only one decode at a time, the latest request is kept and started when the current one is done
+	if( mPendingLut.valid() ) {
+		mQueuedReload = [this, lutImage, lutSize]() { readLookupTableAsync( lutImage, lutSize ); };
+		return;
+	}
+	mPendingLut = std::async( std::launch::async, &ColorGradingApp::decodeLookupTable, lutImage, lutSize );
+}
+LookupTable ColorGradingApp::decodeLookupTable( const ci::DataSourceRef &lutImage, const ci::ivec3 &lutSize )
+{
+	// .cube and .3dl files skip the image decoding and the 8 bits quantization
+	if( LookupTable::isSupported( lutImage->getFilePathHint() ) ) {
+		return LookupTable::load( lutImage );
 	}
+	return LookupTable( Surface8u( loadImage( lutImage ) ), lutSize );
+}
+void ColorGradingApp::readLookupTable( const LookupTable &lut )
+{
+	if( lut.getDomainMin() != 0.0f || lut.getDomainMax() != 1.0f ) {
+		CI_LOG_W( "Lookup table domain [" << lut.getDomainMin() << ", " << lut.getDomainMax() << "] is ignored" );
+	}
+	
+	// upload into the texture that is not currently used, the active one stays
+	// untouched and is still used for the cross-fade
+	int inactive = 1 - mActiveLut;
+	auto &texture = mColorGradingLuts[inactive];
+	if( ! texture || texture->getWidth() != lut.getSize() ) {
+		auto format = gl::Texture3d::Format().internalFormat( GL_RGB16F ).dataType( GL_FLOAT ).minFilter( GL_LINEAR ).magFilter( GL_LINEAR ).wrap( GL_CLAMP_TO_EDGE );
+		texture = gl::Texture3d::create( lut.getData(), GL_RGB, lut.getSize(), lut.getSize(), lut.getSize(), format );
+	}
+	else {
+		// the table layout already matches the 3d texture one so it can be uploaded as is
+		gl::ScopedTextureBind scopedTexBind( texture );
+		glTexSubImage3D( GL_TEXTURE_3D, 0, 0, 0, 0, lut.getSize(), lut.getSize(), lut.getSize(), GL_RGB, GL_FLOAT, lut.getData() );
+	}
+	
+	// make it the active one and keep its data for the exports
+	mActiveLut		= inactive;
+	mLookupTable	= lut;
+	mLutCrossFade	= mColorGradingLuts[1 - inactive] ? 0.0f : 1.0f;
+}
+void ColorGradingApp::exportLookupTable( const ci::DataTargetRef &lutFile )
+{
+	// the table is kept at the precision it was loaded with, a .cube or .3dl dropped on the window is written back without going through 8 bits
+	mLookupTable.write( lutFile );
 }
 ci::Surface8u ColorGradingApp::createLut( const ci::ivec3 &size )
 {
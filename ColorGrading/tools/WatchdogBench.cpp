@@ -0,0 +1,296 @@
+/*
+ Headless benchmark of Watchdog.h. Outside of Cinder the header only needs boost::filesystem:
+
+	g++ -std=c++11 -O2 -I../include WatchdogBench.cpp -o WatchdogBench -lboost_filesystem -lboost_system -lpthread
+	g++ -std=c++11 -O2 -DWATCHDOG_DISABLE_INOTIFY -I../include WatchdogBench.cpp -o WatchdogBenchPolling -lboost_filesystem -lboost_system -lpthread
+
+ The backend is chosen at compile time, the second line builds the polling one on linux. The cpu time
+ is read with getrusage so the tool is limited to linux and macOS.
+
+ Usage:
+	WatchdogBench [options]
+
+	--dir <path>		where the files are written, a WatchdogBench folder of the temporary directory by default. Removed at exit
+	--files <n>			number of files watched one by one, 10000 by default
+	--tree <n>			number of files of the nested tree watched by directory, 100000 by default
+	--idle <s>			seconds during which the idle cpu time is measured, 3 by default
+	--changes <n>		number of files modified to measure the latency, 10 by default
+
+ Writes the files in directories of 100 and watches each of them with its own wd::watch. Prints the time
+ taken by the registrations, the cpu time used by the process while nothing changes and the average and
+ worst delay between the write of a file and its callback.
+
+ The tree is laid out as tree/<0-9>/<0-99>/<n>.glsl for the default size. Its directories are first scanned
+ the way the original Watchdog did on each tick, a directory_iterator and a last_write_time per file kept
+ in a std::map, then listed and refreshed with the snapshots of Watchdog.h. It is then watched with one
+ "*.glsl" wildcard per directory, and the worst time spent in a wd::watch + wd::unwatch of another file
+ is printed along with the same measures as above.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/resource.h>
+
+#include "Watchdog.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// number of callbacks and time of the last one, written by the watching thread
+static atomic<size_t>	sNumCallbacks( 0 );
+static atomic<int64_t>	sLastCallback( 0 );
+
+static int64_t getMicroseconds()
+{
+	return duration_cast<microseconds>( steady_clock::now().time_since_epoch() ).count();
+}
+
+static void onChange()
+{
+	sLastCallback = getMicroseconds();
+	++sNumCallbacks;
+}
+
+// cpu time used by all the threads of the process, in milliseconds
+static double getCpuMilliseconds()
+{
+	rusage usage;
+	getrusage( RUSAGE_SELF, &usage );
+	return ( usage.ru_utime.tv_sec + usage.ru_stime.tv_sec ) * 1e3 + ( usage.ru_utime.tv_usec + usage.ru_stime.tv_usec ) * 1e-3;
+}
+
+// writes \a count small files, \a directory gives the directory of each file
+static vector<ci::fs::path> createFiles( size_t count, const function<ci::fs::path(size_t)> &directory, const string &extension )
+{
+	vector<ci::fs::path> files;
+	ci::fs::path current;
+	for( size_t i = 0; i < count; ++i ) {
+		ci::fs::path dir = directory( i );
+		if( dir != current ) {
+			ci::fs::create_directories( dir );
+			current = dir;
+		}
+		files.push_back( dir / ( to_string( i ) + extension ) );
+		ofstream( files.back().string().c_str() ) << i;
+	}
+	return files;
+}
+
+// gives access to the snapshots of Watchdog without going through its thread
+class WatchdogSnapshots : public Watchdog {
+public:
+	using Watchdog::Snapshot;
+	using Watchdog::listDirectory;
+	using Watchdog::refreshSnapshot;
+};
+
+// the per tick work of the original Watchdog for a wildcard watch: the directory is iterated, the
+// full path matched against the filter and its one second modification time compared in a std::map
+static size_t scanLikeBaseline( const ci::fs::path &directory, const string &filter, map<string,time_t> *times )
+{
+	string full		= ( directory / filter ).string();
+	size_t wildcard	= full.find( "*" );
+	string before	= full.substr( 0, wildcard );
+	string after	= full.substr( wildcard + 1 );
+	size_t changes	= 0;
+	ci::fs::directory_iterator end;
+	for( ci::fs::directory_iterator it( directory ); it != end; ++it ) {
+		string current = it->path().string();
+		if( current.find( before ) != string::npos && current.find( after ) != string::npos ) {
+			time_t time = ci::fs::last_write_time( it->path() );
+			auto previous = times->find( current );
+			if( previous == times->end() ) {
+				( *times )[current] = time;
+				++changes;
+			}
+			else if( previous->second < time ) {
+				previous->second = time;
+				++changes;
+			}
+		}
+	}
+	return changes;
+}
+
+// leaves the watching thread the time to apply the registrations and to take its first look at the files
+static void settle()
+{
+	this_thread::sleep_for( milliseconds( 1000 ) );
+}
+
+static void measureIdle( double seconds )
+{
+	double cpu = getCpuMilliseconds();
+	this_thread::sleep_for( duration<double>( seconds ) );
+	cout << "  idle cpu time over " << seconds << " s: " << getCpuMilliseconds() - cpu << " ms" << endl;
+}
+
+static void measureLatency( const vector<ci::fs::path> &files, int changes )
+{
+	double total = 0.0, worst = 0.0;
+	int received = 0;
+	for( int i = 0; i < changes; ++i ) {
+		// spread the modified files over the whole set, the file is closed at the end of the statement
+		const ci::fs::path &file = files[( static_cast<size_t>( i ) * 7919 ) % files.size()];
+		size_t callbacks	= sNumCallbacks;
+		int64_t start		= getMicroseconds();
+		ofstream( file.string().c_str() ) << "change " << i;
+
+		// polling should answer within 500 ms, anything later than 5 s counts as missed
+		while( sNumCallbacks == callbacks && getMicroseconds() - start < 5000000 ) {
+			this_thread::sleep_for( microseconds( 100 ) );
+		}
+		if( sNumCallbacks != callbacks ) {
+			double latency = ( sLastCallback - start ) * 1e-3;
+			total += latency;
+			worst = max( worst, latency );
+			++received;
+		}
+		this_thread::sleep_for( milliseconds( 50 ) );
+	}
+	cout << "  change latency: " << ( received ? total / received : 0.0 ) << " ms average, " << worst << " ms worst";
+	if( received < changes ) {
+		cout << ", " << changes - received << " changes missed";
+	}
+	cout << endl;
+}
+
+static void benchmarkFiles( const ci::fs::path &root, size_t count, double idle, int changes )
+{
+	cout << count << " files watched one by one" << endl;
+	auto files = createFiles( count, [&root]( size_t i ) { return root / "files" / to_string( i / 100 ); }, ".txt" );
+
+	int64_t start = getMicroseconds();
+	for( const auto &file : files ) {
+		wd::watch( file, []( const ci::fs::path & ) { onChange(); } );
+	}
+	cout << "  registration: " << ( getMicroseconds() - start ) * 1e-3 << " ms" << endl;
+
+	settle();
+	measureIdle( idle );
+	measureLatency( files, changes );
+	wd::unwatchAll();
+}
+
+static void benchmarkTree( const ci::fs::path &root, size_t count, double idle, int changes )
+{
+	cout << count << " files in nested directories, one \"*.glsl\" watch per directory" << endl;
+	auto files = createFiles( count, [&root]( size_t i ) { return root / "tree" / to_string( i / 10000 ) / to_string( ( i / 100 ) % 100 ); }, ".glsl" );
+	set<ci::fs::path> directorySet;
+	for( const auto &file : files ) {
+		directorySet.insert( file.parent_path() );
+	}
+	vector<ci::fs::path> directories( directorySet.begin(), directorySet.end() );
+
+	// one pass over the tree is what the polling backend does twice a second, the first pass of each method fills its state
+	const int passes = 5;
+	vector<map<string,time_t>> times( directories.size() );
+	vector<WatchdogSnapshots::Snapshot> snapshots( directories.size() );
+	for( size_t i = 0; i < directories.size(); ++i ) {
+		scanLikeBaseline( directories[i], "*.glsl", &times[i] );
+		WatchdogSnapshots::listDirectory( directories[i], "*.glsl", &snapshots[i] );
+	}
+	int64_t start = getMicroseconds();
+	for( int pass = 0; pass < passes; ++pass ) {
+		for( size_t i = 0; i < directories.size(); ++i ) {
+			scanLikeBaseline( directories[i], "*.glsl", &times[i] );
+		}
+	}
+	cout << "  baseline scan: " << ( getMicroseconds() - start ) * 1e-3 / passes << " ms per pass" << endl;
+	start = getMicroseconds();
+	for( int pass = 0; pass < passes; ++pass ) {
+		for( size_t i = 0; i < directories.size(); ++i ) {
+			WatchdogSnapshots::listDirectory( directories[i], "*.glsl", &snapshots[i] );
+		}
+	}
+	cout << "  snapshot listing: " << ( getMicroseconds() - start ) * 1e-3 / passes << " ms per pass" << endl;
+	start = getMicroseconds();
+	for( int pass = 0; pass < passes; ++pass ) {
+		for( size_t i = 0; i < directories.size(); ++i ) {
+			WatchdogSnapshots::refreshSnapshot( directories[i], &snapshots[i] );
+		}
+	}
+	cout << "  snapshot refresh: " << ( getMicroseconds() - start ) * 1e-3 / passes << " ms per pass" << endl;
+
+	start = getMicroseconds();
+	for( const auto &directory : directories ) {
+		wd::watch( directory / "*.glsl", []( const vector<ci::fs::path> & ) { onChange(); } );
+	}
+	cout << "  registration: " << ( getMicroseconds() - start ) * 1e-3 << " ms" << endl;
+	settle();
+	measureIdle( idle );
+	measureLatency( files, changes );
+
+	// the callers shouldn't wait on the watching thread, whatever it is busy with
+	ci::fs::path single = root / "single.txt";
+	ofstream( single.string().c_str() ) << "single";
+	double worst = 0.0;
+	for( int i = 0; i < 200; ++i ) {
+		int64_t callStart = getMicroseconds();
+		wd::watch( single, []( const ci::fs::path & ) {} );
+		wd::unwatch( single );
+		worst = max( worst, ( getMicroseconds() - callStart ) * 1e-3 );
+		this_thread::sleep_for( milliseconds( 5 ) );
+	}
+	cout << "  worst wd::watch + wd::unwatch: " << worst << " ms" << endl;
+	wd::unwatchAll();
+}
+
+int main( int argc, char **argv )
+{
+	ci::fs::path root	= ci::fs::temp_directory_path() / "WatchdogBench";
+	size_t numFiles		= 10000;
+	size_t numTreeFiles	= 100000;
+	double idle			= 3.0;
+	int changes			= 10;
+	for( int i = 1; i < argc; ++i ) {
+		string arg = argv[i];
+		if( arg == "--dir" && i + 1 < argc ) root = argv[++i];
+		else if( arg == "--files" && i + 1 < argc ) numFiles = strtoul( argv[++i], nullptr, 10 );
+		else if( arg == "--tree" && i + 1 < argc ) numTreeFiles = strtoul( argv[++i], nullptr, 10 );
+		else if( arg == "--idle" && i + 1 < argc ) idle = atof( argv[++i] );
+		else if( arg == "--changes" && i + 1 < argc ) changes = atoi( argv[++i] );
+		else {
+			cerr << "Unknown option " << arg << ", see the top of WatchdogBench.cpp" << endl;
+			return 1;
+		}
+	}
+
+#if defined( WATCHDOG_INOTIFY )
+	cout << "inotify backend, polling if it can't be initialized" << endl;
+#else
+	cout << "polling backend" << endl;
+#endif
+	cout << fixed << setprecision( 2 );
+
+	try {
+		ci::fs::remove_all( root );
+		if( numFiles ) {
+			benchmarkFiles( root, numFiles, idle, changes );
+		}
+		if( numTreeFiles ) {
+			benchmarkTree( root, numTreeFiles, idle, changes );
+		}
+	}
+	catch( const exception &exc ) {
+		cerr << exc.what() << endl;
+		return 1;
+	}
+
+	// the unwatch requests are applied by the watching thread before the files go away
+	settle();
+	ci::fs::remove_all( root );
+	return 0;
+}
@@ -2,8 +2,10 @@
 #include "cinder/app/RendererGl.h"
 #include "cinder/gl/gl.h"
 #include "cinder/CameraUi.h"
+#include "cinder/Log.h"
 
 #include "CinderImGui.h"
+#include "MeshOptimizer.h"
 
 using namespace ci;
 using namespace ci::app;
@@ -135,13 +137,17 @@ void ExponentialShadowMapApp::createScene()
 		make_tuple( Color( 1.0f, 1.0f, 1.0f ), 0.5f, 0.0f )			// Rough Floor
 	};
 	
-	// for each source create gl::Batch for regular rendering and another gl::Batch for rendering the shadow map
+	// for each source create gl::Batch for regular rendering and another gl::Batch for rendering the shadow map,
+	// both from a mesh reordered for the vertex cache, overdraw and vertex fetch
 	auto shader = gl::GlslProg::create( gl::GlslProg::Format().vertex( loadAsset( "shader.vert" ) ).fragment( loadAsset( "shader.frag" ) ) );
 	auto shadowMapShader = gl::GlslProg::create( gl::GlslProg::Format().vertex( loadAsset( "shadowmap.vert" ) ).fragment( loadAsset( "shadowmap.frag" ) ) );
 	for( size_t i = 0; i < sources.size(); ++i ) {
+		TriMesh mesh( sources[i] );
+		auto report = MeshOptimizer::optimize( &mesh );
+		CI_LOG_I( "Optimized source " << i << ", ACMR " << report.mBefore.mAcmr << " -> " << report.mAfter.mAcmr << ", ATVR " << report.mBefore.mAtvr << " -> " << report.mAfter.mAtvr );
 		mSceneObjects.push_back( make_tuple(
-			gl::Batch::create( sources[i], shader ),
-			gl::Batch::create( sources[i], shadowMapShader ),
+			gl::Batch::create( mesh, shader ),
+			gl::Batch::create( mesh, shadowMapShader ),
 			materials[i]
 		) );
 	}
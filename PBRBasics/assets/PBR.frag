@@ -12,12 +12,30 @@ uniform float		uSpecular;
 uniform float		uExposure;
 uniform float		uGamma;
 
+#ifdef CLUSTERED
+uniform samplerBuffer	uLights;			// view space position and radius followed by the color of each light
+uniform usamplerBuffer	uClusters;			// offset in the index list and number of lights of each cluster
+uniform usamplerBuffer	uClusterIndices;	// light indices of all clusters
+uniform ivec3			uClusterGrid;
+uniform vec2			uClusterDepth;		// slice = log( depth ) * scale - bias
+uniform vec2			uViewportSize;
+#endif
+
 in vec3             vNormal;
 in vec3             vLightPosition;
 in vec3             vPosition;
+#ifdef INSTANCED
+in vec2				vMaterial;
+#endif
 
 out vec4            oColor;
 
+#ifdef TEMPORAL
+in vec4				vClipPosition;
+in vec4				vPrevClipPosition;
+out vec2			oVelocity;
+#endif
+
 #define saturate(x) clamp(x, 0.0, 1.0)
 #define PI 3.14159265359
 
@@ -88,11 +106,11 @@ float getAttenuation( vec3 lightPosition, vec3 vertexPosition, float lightRadius
 	return attenuation;
 }
 
-void main() {
-	// get the normal, light, position and half vector normalized
-	vec3 N                  = normalize( vNormal );
-	vec3 L                  = normalize( vLightPosition - vPosition );
-	vec3 V                  = normalize( -vPosition );
+// Shading of a single point light
+vec3 getLight( vec3 N, vec3 V, vec3 lightPosition, vec3 lightColor, float lightRadius, vec3 diffuseColor, vec3 specularColor, float roughness )
+{
+	// get the light and half vector normalized
+	vec3 L                  = normalize( lightPosition - vPosition );
 	vec3 H					= normalize(V + L);
 	
 	// get all the usefull dot products and clamp them between 0 and 1 just to be safe
@@ -101,24 +119,58 @@ void main() {
 	float VoH				= saturate( dot( V, H ) );
 	float NoH				= saturate( dot( N, H ) );
 	
-	// deduce the diffuse and specular color from the baseColor and how metallic the material is
-	vec3 diffuseColor		= uBaseColor - uBaseColor * uMetallic;
-	vec3 specularColor		= mix( vec3( 0.08 * uSpecular ), uBaseColor, uMetallic );
-	
 	// compute the brdf terms
-	float distribution		= getNormalDistribution( uRoughness, NoH );
+	float distribution		= getNormalDistribution( roughness, NoH );
 	vec3 fresnel			= getFresnel( specularColor, VoH );
-	float geom				= getGeometricShadowing( uRoughness, NoV, NoL, VoH, L, V );
+	float geom				= getGeometricShadowing( roughness, NoV, NoL, VoH, L, V );
 
 	// get the specular and diffuse and combine them
-	vec3 diffuse			= getDiffuse( diffuseColor, uRoughness, NoV, NoL, VoH );
+	vec3 diffuse			= getDiffuse( diffuseColor, roughness, NoV, NoL, VoH );
 	vec3 specular			= NoL * ( distribution * fresnel * geom );
-	vec3 color				= uLightColor * ( diffuse + specular );
+	vec3 color				= lightColor * ( diffuse + specular );
 	
 	// get the light attenuation from its radius
-	float attenuation		= getAttenuation( vLightPosition, vPosition, uLightRadius );
-	color					*= attenuation;
+	return color * getAttenuation( lightPosition, vPosition, lightRadius );
+}
+
+void main() {
+	// get the normal and view vector normalized
+	vec3 N                  = normalize( vNormal );
+	vec3 V                  = normalize( -vPosition );
 	
+	// when instanced the roughness and metallic values come from the grid and are scaled by the uniforms
+#ifdef INSTANCED
+	float roughness			= pow( vMaterial.x * uRoughness, 4.0 );
+	float metallic			= vMaterial.y * uMetallic;
+#else
+	float roughness			= uRoughness;
+	float metallic			= uMetallic;
+#endif
+	
+	// deduce the diffuse and specular color from the baseColor and how metallic the material is
+	vec3 diffuseColor		= uBaseColor - uBaseColor * metallic;
+	vec3 specularColor		= mix( vec3( 0.08 * uSpecular ), uBaseColor, metallic );
+	
+#ifdef CLUSTERED
+	// find the cluster of the fragment and only shade the lights assigned to it
+	ivec2 tile				= ivec2( gl_FragCoord.xy / uViewportSize * vec2( uClusterGrid.xy ) );
+	int slice				= int( log( -vPosition.z ) * uClusterDepth.x - uClusterDepth.y );
+	tile					= clamp( tile, ivec2( 0 ), uClusterGrid.xy - ivec2( 1 ) );
+	slice					= clamp( slice, 0, uClusterGrid.z - 1 );
+	uvec2 cluster			= texelFetch( uClusters, ( slice * uClusterGrid.y + tile.y ) * uClusterGrid.x + tile.x ).xy;
+	
+	vec3 color				= vec3( 0.0 );
+	for( uint i = 0u; i < cluster.y; i++ ) {
+		int light			= int( texelFetch( uClusterIndices, int( cluster.x + i ) ).x );
+		vec4 position		= texelFetch( uLights, light * 2 );
+		vec3 lightColor		= texelFetch( uLights, light * 2 + 1 ).rgb;
+		color				+= getLight( N, V, position.xyz, lightColor, position.w, diffuseColor, specularColor, roughness );
+	}
+#else
+	vec3 color				= getLight( N, V, vLightPosition, uLightColor, uLightRadius, diffuseColor, specularColor, roughness );
+#endif
+	
+#ifndef HDR_TARGET
 	// apply the tone-mapping
 	color					= Uncharted2Tonemap( color * uExposure );
 	
@@ -129,7 +181,13 @@ void main() {
 	
 	// gamma correction
 	color					= pow( color, vec3( 1.0f / uGamma ) );
+#endif
 	
 	// output the fragment color
     oColor                  = vec4( color, 1.0 );
+	
+#ifdef TEMPORAL
+	// motion since the previous frame in texture coordinates
+	oVelocity				= ( vClipPosition.xy / vClipPosition.w - vPrevClipPosition.xy / vPrevClipPosition.w ) * 0.5;
+#endif
 }
\ No newline at end of file
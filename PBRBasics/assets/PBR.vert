@@ -10,18 +10,46 @@ uniform vec3    uLightPosition;
 in vec4         ciPosition;
 in vec3         ciNormal;
 
+#ifdef INSTANCED
+in mat4			aInstanceMatrix;
+in vec2			aInstanceMaterial;
+out vec2		vMaterial;
+#endif
+
 out vec3		vNormal;
 out vec3		vLightPosition;
 out vec3		vPosition;
 
+#ifdef TEMPORAL
+uniform mat4	uViewProjection;		// the view projection of this frame and the previous one, without the jitter
+uniform mat4	uPrevViewProjection;
+out vec4		vClipPosition;
+out vec4		vPrevClipPosition;
+#endif
+
 
 void main(){
-    vec4 worldSpacePosition	= ciModelMatrix * ciPosition;
+#ifdef INSTANCED
+	// the grid only uses translations so the upper 3x3 can be used as the normal matrix
+	mat4 modelMatrix		= aInstanceMatrix;
+	mat3 normalMatrix		= mat3( ciViewMatrix * aInstanceMatrix );
+	vMaterial				= aInstanceMaterial;
+#else
+	mat4 modelMatrix		= ciModelMatrix;
+	mat3 normalMatrix		= ciNormalMatrix;
+#endif
+    vec4 worldSpacePosition	= modelMatrix * ciPosition;
     vec4 viewSpacePosition	= ciViewMatrix * worldSpacePosition;
 	
-    vNormal					= ciNormalMatrix * ciNormal;
+    vNormal					= normalMatrix * ciNormal;
     vLightPosition			= ( ciViewMatrix * vec4( uLightPosition, 1.0 ) ).xyz;
     vPosition				= viewSpacePosition.xyz;
 	
     gl_Position				= ciProjectionMatrix * viewSpacePosition;
+	
+#ifdef TEMPORAL
+	// the spheres don't move, only the camera does
+	vClipPosition			= uViewProjection * worldSpacePosition;
+	vPrevClipPosition		= uPrevViewProjection * worldSpacePosition;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,14 @@
+#version 150
+
+uniform sampler2D	uAtlas;
+
+in vec2				vTexCoord;
+in vec4				vColor;
+
+out vec4			oColor;
+
+void main()
+{
+	// the glyph coverage is in the alpha of the atlas
+	oColor = vec4( vColor.rgb, vColor.a * texture( uAtlas, vTexCoord ).a );
+}
@@ -0,0 +1,17 @@
+#version 150
+
+uniform mat4	ciModelViewProjection;
+
+in vec4			ciPosition;
+in vec2			ciTexCoord0;
+in vec4			ciColor;
+
+out vec2		vTexCoord;
+out vec4		vColor;
+
+void main()
+{
+	vTexCoord	= ciTexCoord0;
+	vColor		= ciColor;
+	gl_Position	= ciModelViewProjection * ciPosition;
+}
@@ -0,0 +1,269 @@
+/*
+
+ LightClusters
+
+ Copyright (c) 2015, Simon Geilfus
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+	#define LIGHT_CLUSTERS_SSE
+	#include <emmintrin.h>
+#endif
+
+//! Assigns point lights to the clusters of a view frustum split in tiles on x and y and in exponential slices on z.
+//! Doesn't depend on OpenGL so it can be used and benchmarked without a window.
+class LightClusters {
+public:
+	//! Creates a grid of \a tilesX * \a tilesY * \a slices clusters. The assignment is split between \a numThreads threads, including the calling one.
+	LightClusters( int tilesX = 16, int tilesY = 9, int slices = 24, size_t numThreads = std::max( 1u, std::thread::hardware_concurrency() ) )
+	: mTilesX( tilesX ), mTilesY( tilesY ), mSlices( slices ), mPaddedTilesX( ( tilesX + 3 ) & ~3 ), mLights( nullptr ), mGeneration( 0 ), mNumBusy( 0 ), mQuit( false )
+	{
+		mClusterLights.resize( getNumClusters() );
+		mSliceLights.resize( mSlices );
+		mTileMinX.resize( mSlices * mPaddedTilesX );
+		mTileMaxX.resize( mSlices * mPaddedTilesX );
+		mRowMinY.resize( mSlices * mTilesY );
+		mRowMaxY.resize( mSlices * mTilesY );
+		mSliceMinZ.resize( mSlices );
+		mSliceMaxZ.resize( mSlices );
+		setProjection( 50.0f, 1.0f, 1.0f, 100.0f );
+
+		for( size_t i = 1; i < numThreads; ++i ) {
+			mThreads.push_back( std::thread( [this](){ workerLoop(); } ) );
+		}
+	}
+	~LightClusters()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mQuit = true;
+		}
+		mStart.notify_all();
+		for( auto &thread : mThreads ) thread.join();
+	}
+
+	//! Sets the perspective projection the clusters are built from, \a fovY is in degrees
+	void setProjection( float fovY, float aspectRatio, float nearClip, float farClip )
+	{
+		mNear				= nearClip;
+		mFar				= farClip;
+		mDepthScale			= mSlices / std::log( farClip / nearClip );
+		mDepthBias			= mDepthScale * std::log( nearClip );
+		float tanHalfFovY	= std::tan( fovY * 3.14159265f / 360.0f );
+		float tanHalfFovX	= tanHalfFovY * aspectRatio;
+
+		// the bounding box of each cluster in view space, the camera looks down -z
+		for( int z = 0; z < mSlices; ++z ) {
+			float depth0 = getSliceDepth( z );
+			float depth1 = getSliceDepth( z + 1 );
+			mSliceMinZ[z] = -depth1;
+			mSliceMaxZ[z] = -depth0;
+			for( int x = 0; x < mPaddedTilesX; ++x ) {
+				// padding tiles never overlap anything
+				if( x >= mTilesX ) {
+					mTileMinX[z * mPaddedTilesX + x] = 1e30f;
+					mTileMaxX[z * mPaddedTilesX + x] = -1e30f;
+					continue;
+				}
+				float ndc0 = -1.0f + 2.0f * x / mTilesX;
+				float ndc1 = -1.0f + 2.0f * ( x + 1 ) / mTilesX;
+				mTileMinX[z * mPaddedTilesX + x] = std::min( ndc0 * tanHalfFovX * depth0, ndc0 * tanHalfFovX * depth1 );
+				mTileMaxX[z * mPaddedTilesX + x] = std::max( ndc1 * tanHalfFovX * depth0, ndc1 * tanHalfFovX * depth1 );
+			}
+			for( int y = 0; y < mTilesY; ++y ) {
+				float ndc0 = -1.0f + 2.0f * y / mTilesY;
+				float ndc1 = -1.0f + 2.0f * ( y + 1 ) / mTilesY;
+				mRowMinY[z * mTilesY + y] = std::min( ndc0 * tanHalfFovY * depth0, ndc0 * tanHalfFovY * depth1 );
+				mRowMaxY[z * mTilesY + y] = std::max( ndc1 * tanHalfFovY * depth0, ndc1 * tanHalfFovY * depth1 );
+			}
+		}
+	}
+
+	//! Assigns the lights to the clusters. \a lights contains \a numLights view space positions and radius packed as x, y, z, radius
+	void assign( const float *lights, size_t numLights )
+	{
+		// bin the lights by depth slice first, this is cheap and keeps the per cluster tests to the lights that can touch them
+		for( auto &slice : mSliceLights ) slice.clear();
+		for( size_t i = 0; i < numLights; ++i ) {
+			const float *light = lights + i * 4;
+			float depth = -light[2];
+			if( depth + light[3] < mNear || depth - light[3] > mFar ) continue;
+			int first	= getSlice( depth - light[3] );
+			int last	= getSlice( depth + light[3] );
+			for( int z = first; z <= last; ++z ) {
+				mSliceLights[z].push_back( static_cast<uint32_t>( i ) );
+			}
+		}
+
+		// then let the threads process the slices
+		mLights		= lights;
+		mNextSlice	= 0;
+		if( mThreads.size() ) {
+			{
+				std::lock_guard<std::mutex> lock( mMutex );
+				mNumBusy = mThreads.size();
+				++mGeneration;
+			}
+			mStart.notify_all();
+		}
+		processSlices();
+		if( mThreads.size() ) {
+			std::unique_lock<std::mutex> lock( mMutex );
+			mDone.wait( lock, [this](){ return mNumBusy == 0; } );
+		}
+
+		// and pack the per cluster lists in a single index list
+		mClusters.resize( getNumClusters() * 2 );
+		mIndices.clear();
+		for( size_t i = 0; i < mClusterLights.size(); ++i ) {
+			mClusters[i * 2]		= static_cast<uint32_t>( mIndices.size() );
+			mClusters[i * 2 + 1]	= static_cast<uint32_t>( mClusterLights[i].size() );
+			mIndices.insert( mIndices.end(), mClusterLights[i].begin(), mClusterLights[i].end() );
+		}
+	}
+
+	//! Returns the offset in the index list and the number of lights of each cluster, x varies first, then y and z
+	const std::vector<uint32_t>& getClusters() const { return mClusters; }
+	//! Returns the light indices of all clusters
+	const std::vector<uint32_t>& getIndices() const { return mIndices; }
+
+	int getNumTilesX() const { return mTilesX; }
+	int getNumTilesY() const { return mTilesY; }
+	int getNumSlices() const { return mSlices; }
+	int getNumClusters() const { return mTilesX * mTilesY * mSlices; }
+
+	//! Returns the values used to compute the slice of a view space depth: slice = log( depth ) * scale - bias
+	float getDepthScale() const { return mDepthScale; }
+	float getDepthBias() const { return mDepthBias; }
+
+protected:
+	float getSliceDepth( int slice ) const
+	{
+		return mNear * std::pow( mFar / mNear, static_cast<float>( slice ) / mSlices );
+	}
+	int getSlice( float depth ) const
+	{
+		if( depth <= mNear ) return 0;
+		return std::min( mSlices - 1, static_cast<int>( std::log( depth ) * mDepthScale - mDepthBias ) );
+	}
+
+	void workerLoop()
+	{
+		size_t generation = 0;
+		while( true ) {
+			{
+				std::unique_lock<std::mutex> lock( mMutex );
+				mStart.wait( lock, [this,&generation](){ return mQuit || mGeneration != generation; } );
+				if( mQuit ) return;
+				generation = mGeneration;
+			}
+			processSlices();
+			{
+				std::lock_guard<std::mutex> lock( mMutex );
+				if( --mNumBusy == 0 ) mDone.notify_one();
+			}
+		}
+	}
+
+	void processSlices()
+	{
+		int z;
+		while( ( z = mNextSlice++ ) < mSlices ) {
+			processSlice( z );
+		}
+	}
+
+	//! Tests the lights of a slice against its clusters, four tiles of a row at a time
+	void processSlice( int z )
+	{
+		const int rowStart = z * mTilesX * mTilesY;
+		for( int i = 0; i < mTilesX * mTilesY; ++i ) {
+			mClusterLights[rowStart + i].clear();
+		}
+
+		const float minZ = mSliceMinZ[z], maxZ = mSliceMaxZ[z];
+		const float *minX = &mTileMinX[z * mPaddedTilesX];
+		const float *maxX = &mTileMaxX[z * mPaddedTilesX];
+		for( uint32_t index : mSliceLights[z] ) {
+			const float *light	= mLights + index * 4;
+			const float r2		= light[3] * light[3];
+			const float dz		= std::max( 0.0f, std::max( minZ - light[2], light[2] - maxZ ) );
+			const float dz2		= dz * dz;
+			if( dz2 > r2 ) continue;
+#ifdef LIGHT_CLUSTERS_SSE
+			const __m128 cx = _mm_set1_ps( light[0] );
+			const __m128 zero = _mm_setzero_ps();
+#endif
+			for( int y = 0; y < mTilesY; ++y ) {
+				// the y extent is shared by the whole row
+				const float dy		= std::max( 0.0f, std::max( mRowMinY[z * mTilesY + y] - light[1], light[1] - mRowMaxY[z * mTilesY + y] ) );
+				const float dyz2	= dy * dy + dz2;
+				if( dyz2 > r2 ) continue;
+
+				std::vector<uint32_t> *row = &mClusterLights[rowStart + y * mTilesX];
+#ifdef LIGHT_CLUSTERS_SSE
+				const __m128 remaining = _mm_set1_ps( r2 - dyz2 );
+				for( int x = 0; x < mPaddedTilesX; x += 4 ) {
+					__m128 dx = _mm_max_ps( zero, _mm_max_ps( _mm_sub_ps( _mm_loadu_ps( minX + x ), cx ), _mm_sub_ps( cx, _mm_loadu_ps( maxX + x ) ) ) );
+					int mask = _mm_movemask_ps( _mm_cmple_ps( _mm_mul_ps( dx, dx ), remaining ) );
+					while( mask ) {
+						int bit = 0;
+						while( ! ( mask & ( 1 << bit ) ) ) ++bit;
+						mask &= ~( 1 << bit );
+						row[x + bit].push_back( index );
+					}
+				}
+#else
+				const float remaining = r2 - dyz2;
+				for( int x = 0; x < mTilesX; ++x ) {
+					float dx = std::max( 0.0f, std::max( minX[x] - light[0], light[0] - maxX[x] ) );
+					if( dx * dx <= remaining ) row[x].push_back( index );
+				}
+#endif
+			}
+		}
+	}
+
+	int										mTilesX, mTilesY, mSlices, mPaddedTilesX;
+	float									mNear, mFar, mDepthScale, mDepthBias;
+	// cluster bounds, x per tile, y per row and z per slice
+	std::vector<float>						mTileMinX, mTileMaxX, mRowMinY, mRowMaxY, mSliceMinZ, mSliceMaxZ;
+
+	const float*							mLights;
+	std::vector<std::vector<uint32_t>>		mSliceLights, mClusterLights;
+	std::vector<uint32_t>					mClusters, mIndices;
+
+	std::vector<std::thread>				mThreads;
+	std::mutex								mMutex;
+	std::condition_variable					mStart, mDone;
+	size_t									mGeneration, mNumBusy;
+	bool									mQuit;
+	std::atomic<int>						mNextSlice;
+};
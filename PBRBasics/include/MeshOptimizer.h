@@ -0,0 +1,334 @@
+/*
+
+ MeshOptimizer
+
+ Copyright (c) 2015, Simon Geilfus
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+
+//! Reorders the triangles and the vertices of an indexed mesh for the gpu, in three stages:
+//! - the triangles are reordered for the post transform vertex cache with Tipsify ( Sander, Nehab and Barczak, "Fast Triangle
+//!   Reordering for Vertex Locality and Reduced Overdraw" ),
+//! - the clusters of triangles it produces are sorted from the outside of the mesh to its inside, so the first triangles drawn
+//!   tend to occlude the next ones from any point of view,
+//! - the vertices are renumbered in the order the index buffer first uses them, so the vertex fetches read memory sequentially.
+//! The core works on plain arrays, optimize( TriMesh* ) runs the three stages on a ci::TriMesh and all its attributes.
+class MeshOptimizer {
+public:
+	struct Options {
+		Options() : mCacheSize( 16 ), mOverdraw( true ), mOverdrawThreshold( 1.05f ) {}
+
+		//! Size of the fifo vertex cache the triangles are ordered and measured for
+		Options& cacheSize( size_t cacheSize ) { mCacheSize = std::max<size_t>( 3, cacheSize ); return *this; }
+		//! Whether the clusters are sorted to reduce overdraw
+		Options& overdraw( bool overdraw = true ) { mOverdraw = overdraw; return *this; }
+		//! How much the vertex cache efficiency can be traded for smaller clusters, that sort better. 1.05 allows 5% more cache misses
+		Options& overdrawThreshold( float threshold ) { mOverdrawThreshold = std::max( 1.0f, threshold ); return *this; }
+
+		size_t	mCacheSize;
+		bool	mOverdraw;
+		float	mOverdrawThreshold;
+	};
+
+	//! Vertex cache efficiency of an index buffer
+	struct Statistics {
+		Statistics() : mAcmr( 0.0f ), mAtvr( 0.0f ) {}
+
+		//! Average cache miss ratio, the number of vertices transformed per triangle. 3 at worst, around 0.5 at best for a regular grid
+		float	mAcmr;
+		//! Average transformed to vertex ratio, 1 means that each vertex is transformed once
+		float	mAtvr;
+	};
+	//! Statistics before and after the optimization
+	struct Report {
+		Report() : mNumClusters( 0 ) {}
+
+		Statistics	mBefore, mAfter;
+		size_t		mNumClusters;
+	};
+
+	//! Runs the three stages on \a mesh, a ci::TriMesh, and remaps all its attributes. Meshes without indices are left as is
+	template<typename TriMeshT>
+	static Report optimize( TriMeshT *mesh, const Options &options = Options() )
+	{
+		auto &indices		= mesh->getIndices();
+		size_t numVertices	= mesh->getNumVertices();
+		if( indices.empty() || numVertices == 0 ) {
+			return Report();
+		}
+		const float *positions = mesh->getPositionsDims() == 3 ? reinterpret_cast<const float*>( mesh->template getPositions<3>() ) : nullptr;
+		std::vector<uint32_t> remap;
+		Report report = optimize( indices.data(), indices.size(), positions, 3, numVertices, &remap, options );
+		for( auto attrib : mesh->getAvailableAttribs() ) {
+			remapVertices( mesh->getBufferForAttrib( attrib ).data(), mesh->getAttribDims( attrib ), numVertices, remap );
+		}
+		return report;
+	}
+
+	//! Runs the three stages on an index buffer. \a positions has \a positionStride floats per vertex and can be null to skip the overdraw
+	//! stage. \a remap receives the new index of each vertex, the vertex attributes are reordered with remapVertices
+	static Report optimize( uint32_t *indices, size_t numIndices, const float *positions, size_t positionStride, size_t numVertices, std::vector<uint32_t> *remap, const Options &options = Options() )
+	{
+		Report report;
+		report.mBefore = analyzeVertexCache( indices, numIndices, numVertices, options.mCacheSize );
+
+		std::vector<uint32_t> clusters;
+		optimizeVertexCache( indices, numIndices, numVertices, options.mCacheSize, &clusters );
+		if( options.mOverdraw && positions ) {
+			optimizeOverdraw( indices, numIndices, positions, positionStride, numVertices, &clusters, options.mCacheSize, options.mOverdrawThreshold );
+		}
+		report.mNumClusters = clusters.size();
+		*remap = optimizeVertexFetch( indices, numIndices, numVertices );
+
+		report.mAfter = analyzeVertexCache( indices, numIndices, numVertices, options.mCacheSize );
+		return report;
+	}
+
+	//! Simulates a fifo vertex cache of \a cacheSize entries
+	static Statistics analyzeVertexCache( const uint32_t *indices, size_t numIndices, size_t numVertices, size_t cacheSize = 16 )
+	{
+		Statistics stats;
+		std::vector<uint32_t> timestamps( numVertices, 0 );
+		std::vector<bool> used( numVertices, false );
+		uint32_t time = static_cast<uint32_t>( cacheSize ) + 1;
+		size_t misses = 0, numUsed = 0;
+		for( size_t i = 0; i < numIndices; ++i ) {
+			uint32_t v = indices[i];
+			if( time - timestamps[v] > cacheSize ) {
+				timestamps[v] = time++;
+				++misses;
+			}
+			if( ! used[v] ) {
+				used[v] = true;
+				++numUsed;
+			}
+		}
+		stats.mAcmr = numIndices ? static_cast<float>( misses ) / ( numIndices / 3 ) : 0.0f;
+		stats.mAtvr = numUsed ? static_cast<float>( misses ) / numUsed : 0.0f;
+		return stats;
+	}
+
+	//! Tipsify: walks the mesh from vertex to vertex, emitting all the remaining triangles around the current one, and picks the next
+	//! vertex among the ones just emitted that will still be in the cache once its triangles are emitted. \a clusters receives the
+	//! first triangle of each run, a new run starts when the walk reaches a dead end and jumps elsewhere on the mesh
+	static void optimizeVertexCache( uint32_t *indices, size_t numIndices, size_t numVertices, size_t cacheSize, std::vector<uint32_t> *clusters )
+	{
+		size_t numTriangles = numIndices / 3;
+		clusters->clear();
+		if( numTriangles == 0 ) {
+			return;
+		}
+
+		// triangles around each vertex, and how many of them are still to emit
+		std::vector<uint32_t> offsets( numVertices + 1, 0 ), adjacency( numTriangles * 3 ), live( numVertices, 0 );
+		for( size_t i = 0; i < numTriangles * 3; ++i ) {
+			live[indices[i]]++;
+		}
+		for( size_t v = 0; v < numVertices; ++v ) {
+			offsets[v + 1] = offsets[v] + live[v];
+		}
+		std::vector<uint32_t> fill( offsets.begin(), offsets.end() - 1 );
+		for( size_t i = 0; i < numTriangles * 3; ++i ) {
+			adjacency[fill[indices[i]]++] = static_cast<uint32_t>( i / 3 );
+		}
+
+		std::vector<uint32_t> timestamps( numVertices, 0 ), deadEnds, candidates, output;
+		std::vector<bool> emitted( numTriangles, false );
+		output.reserve( numTriangles * 3 );
+		uint32_t time = static_cast<uint32_t>( cacheSize ) + 1, k = static_cast<uint32_t>( cacheSize );
+		size_t cursor = 0;
+		int64_t vertex = 0;
+		while( live[vertex] == 0 && ++vertex < static_cast<int64_t>( numVertices ) );
+		clusters->push_back( 0 );
+
+		while( vertex >= 0 && vertex < static_cast<int64_t>( numVertices ) ) {
+			candidates.clear();
+			for( uint32_t a = offsets[vertex]; a < offsets[vertex + 1]; ++a ) {
+				uint32_t t = adjacency[a];
+				if( emitted[t] ) continue;
+				emitted[t] = true;
+				for( int c = 0; c < 3; ++c ) {
+					uint32_t v = indices[t * 3 + c];
+					output.push_back( v );
+					deadEnds.push_back( v );
+					candidates.push_back( v );
+					live[v]--;
+					if( time - timestamps[v] > k ) {
+						timestamps[v] = time++;
+					}
+				}
+			}
+
+			// the candidate that stays in the cache after its remaining triangles are emitted and has been there the longest
+			int64_t next = -1, best = -1;
+			for( uint32_t v : candidates ) {
+				if( live[v] == 0 ) continue;
+				int64_t priority = 0;
+				if( time - timestamps[v] + 2 * live[v] <= k ) {
+					priority = time - timestamps[v];
+				}
+				if( priority > best ) {
+					best = priority;
+					next = v;
+				}
+			}
+			if( next < 0 ) {
+				// dead end, go back to a recently emitted vertex or scan for any vertex with triangles left
+				while( ! deadEnds.empty() && next < 0 ) {
+					uint32_t v = deadEnds.back();
+					deadEnds.pop_back();
+					if( live[v] > 0 ) next = v;
+				}
+				while( next < 0 && cursor < numVertices ) {
+					if( live[cursor] > 0 ) next = static_cast<int64_t>( cursor );
+					++cursor;
+				}
+				if( next >= 0 && output.size() < numTriangles * 3 ) {
+					clusters->push_back( static_cast<uint32_t>( output.size() / 3 ) );
+				}
+			}
+			vertex = next;
+		}
+		std::copy( output.begin(), output.end(), indices );
+	}
+
+	//! Splits the \a clusters of optimizeVertexCache further where the cache efficiency allows it, then sorts them by how much they face
+	//! away from the center of the mesh. The clusters on the outside are drawn first and occlude the ones behind them from most views
+	static void optimizeOverdraw( uint32_t *indices, size_t numIndices, const float *positions, size_t positionStride, size_t numVertices, std::vector<uint32_t> *clusters, size_t cacheSize, float threshold )
+	{
+		size_t numTriangles = numIndices / 3;
+		if( numTriangles == 0 || clusters->empty() ) {
+			return;
+		}
+
+		// cut each cluster as soon as the cache misses of its beginning fall under the threshold of the whole cluster
+		std::vector<uint32_t> timestamps( numVertices, 0 ), splits;
+		uint32_t time = static_cast<uint32_t>( cacheSize ) + 1;
+		auto misses = [&]( size_t triangle ) {
+			int count = 0;
+			for( int c = 0; c < 3; ++c ) {
+				uint32_t v = indices[triangle * 3 + c];
+				if( time - timestamps[v] > cacheSize ) {
+					timestamps[v] = time++;
+					++count;
+				}
+			}
+			return count;
+		};
+		for( size_t i = 0; i < clusters->size(); ++i ) {
+			size_t begin = ( *clusters )[i], end = i + 1 < clusters->size() ? ( *clusters )[i + 1] : numTriangles;
+			time += static_cast<uint32_t>( cacheSize ) + 1;
+			size_t clusterMisses = 0;
+			for( size_t t = begin; t < end; ++t ) clusterMisses += misses( t );
+			float clusterThreshold = threshold * clusterMisses / ( end - begin );
+
+			splits.push_back( static_cast<uint32_t>( begin ) );
+			time += static_cast<uint32_t>( cacheSize ) + 1;
+			size_t runMisses = 0, runTriangles = 0;
+			for( size_t t = begin; t < end; ++t ) {
+				runMisses += misses( t );
+				runTriangles++;
+				if( t + 1 < end && runMisses <= clusterThreshold * runTriangles ) {
+					splits.push_back( static_cast<uint32_t>( t + 1 ) );
+					time += static_cast<uint32_t>( cacheSize ) + 1;
+					runMisses = runTriangles = 0;
+				}
+			}
+		}
+
+		// area weighted centroid and normal of each cluster, relative to the centroid of the mesh
+		auto position = [&]( uint32_t v ) { return positions + v * positionStride; };
+		double meshCentroid[3] = { 0.0, 0.0, 0.0 };
+		for( size_t i = 0; i < numTriangles * 3; ++i ) {
+			for( int c = 0; c < 3; ++c ) meshCentroid[c] += position( indices[i] )[c];
+		}
+		for( int c = 0; c < 3; ++c ) meshCentroid[c] /= numTriangles * 3;
+
+		std::vector<std::pair<float,uint32_t>> sorted( splits.size() );
+		for( size_t i = 0; i < splits.size(); ++i ) {
+			size_t begin = splits[i], end = i + 1 < splits.size() ? splits[i + 1] : numTriangles;
+			double centroid[3] = { 0.0, 0.0, 0.0 }, normal[3] = { 0.0, 0.0, 0.0 }, area = 0.0;
+			for( size_t t = begin; t < end; ++t ) {
+				const float *p0 = position( indices[t * 3] ), *p1 = position( indices[t * 3 + 1] ), *p2 = position( indices[t * 3 + 2] );
+				double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] }, e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+				double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+				double a = std::sqrt( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+				for( int c = 0; c < 3; ++c ) {
+					centroid[c] += ( p0[c] + p1[c] + p2[c] ) * a / 3.0;
+					normal[c] += n[c];
+				}
+				area += a;
+			}
+			double length = std::sqrt( normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2] ), dot = 0.0;
+			if( area > 0.0 && length > 0.0 ) {
+				for( int c = 0; c < 3; ++c ) dot += ( centroid[c] / area - meshCentroid[c] ) * normal[c] / length;
+			}
+			sorted[i] = std::make_pair( static_cast<float>( -dot ), static_cast<uint32_t>( i ) );
+		}
+		std::stable_sort( sorted.begin(), sorted.end(), []( const std::pair<float,uint32_t> &a, const std::pair<float,uint32_t> &b ) { return a.first < b.first; } );
+
+		std::vector<uint32_t> output;
+		output.reserve( numTriangles * 3 );
+		clusters->clear();
+		for( const auto &cluster : sorted ) {
+			size_t begin = splits[cluster.second], end = cluster.second + 1 < splits.size() ? splits[cluster.second + 1] : numTriangles;
+			clusters->push_back( static_cast<uint32_t>( output.size() / 3 ) );
+			output.insert( output.end(), indices + begin * 3, indices + end * 3 );
+		}
+		std::copy( output.begin(), output.end(), indices );
+	}
+
+	//! Renumbers the vertices in the order of their first use by \a indices and returns the new index of each vertex.
+	//! The unused vertices are moved after the used ones
+	static std::vector<uint32_t> optimizeVertexFetch( uint32_t *indices, size_t numIndices, size_t numVertices )
+	{
+		const uint32_t unassigned = ~0u;
+		std::vector<uint32_t> remap( numVertices, unassigned );
+		uint32_t next = 0;
+		for( size_t i = 0; i < numIndices; ++i ) {
+			uint32_t &index = remap[indices[i]];
+			if( index == unassigned ) {
+				index = next++;
+			}
+			indices[i] = index;
+		}
+		for( auto &index : remap ) {
+			if( index == unassigned ) {
+				index = next++;
+			}
+		}
+		return remap;
+	}
+
+	//! Moves each vertex of \a data, \a dims interleaved floats per vertex, to its index in \a remap
+	static void remapVertices( float *data, size_t dims, size_t numVertices, const std::vector<uint32_t> &remap )
+	{
+		std::vector<float> copy( data, data + numVertices * dims );
+		for( size_t v = 0; v < numVertices; ++v ) {
+			std::copy( &copy[v * dims], &copy[v * dims] + dims, data + remap[v] * dims );
+		}
+	}
+};
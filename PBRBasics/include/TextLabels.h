@@ -0,0 +1,217 @@
+/*
+
+ TextLabels
+
+ Copyright (c) 2015, Simon Geilfus
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "cinder/Font.h"
+#include "cinder/gl/gl.h"
+#include "cinder/gl/TextureFont.h"
+
+//! Draws short strings from a glyph atlas baked once per Font. The glyphs of a label are only laid out again when its text changes,
+//! the labels of a frame are transformed on the cpu into one streamed vertex buffer and drawn with one call per atlas texture.
+class TextLabels {
+public:
+	TextLabels() {}
+	//! Uses the atlas of \a font and draws with \a shader, see assets/Text.vert and assets/Text.frag
+	TextLabels( const ci::Font &font, const ci::gl::GlslProgRef &shader )
+	: mAtlas( Atlas::get( font ) ), mShader( shader ), mNumVertices( 0 ), mCapacity( 0 )
+	{
+	}
+
+	//! Shows the label \a id until the next draw, centered horizontally on \a position with its top at \a position and rotated by \a angle radians
+	void set( size_t id, const std::string &text, const ci::vec2 &position, float angle, const ci::ColorA &color )
+	{
+		if( id >= mLabels.size() ) {
+			mLabels.resize( id + 1 );
+		}
+		Label &label = mLabels[id];
+		if( text != label.mText ) {
+			label.mText = text;
+			layout( &label );
+		}
+		label.mPosition	= position;
+		label.mAngle	= angle;
+		label.mColor	= color;
+		label.mVisible	= true;
+	}
+
+	//! Draws the labels set since the last draw with the current matrices, window coordinates being the usual choice
+	void draw()
+	{
+		if( ! mAtlas ) {
+			return;
+		}
+
+		// fill the vertices page by page so each atlas texture is a single range of the buffer
+		const auto &textures = mAtlas->getTextures();
+		mVertices.clear();
+		std::vector<std::pair<size_t,size_t>> ranges;
+		for( size_t page = 0; page < textures.size(); ++page ) {
+			size_t first = mVertices.size();
+			for( auto &label : mLabels ) {
+				if( ! label.mVisible ) {
+					continue;
+				}
+				float c = std::cos( label.mAngle ), s = std::sin( label.mAngle );
+				for( const auto &glyph : label.mGlyphs ) {
+					if( glyph.mPage != page ) {
+						continue;
+					}
+					const ci::vec2 corners[4] = { glyph.mRect.getUpperLeft(), glyph.mRect.getUpperRight(), glyph.mRect.getLowerRight(), glyph.mRect.getLowerLeft() };
+					const ci::vec2 texCoords[4] = { glyph.mTexCoords.getUpperLeft(), glyph.mTexCoords.getUpperRight(), glyph.mTexCoords.getLowerRight(), glyph.mTexCoords.getLowerLeft() };
+					static const int quad[6] = { 0, 1, 2, 0, 2, 3 };
+					for( int i : quad ) {
+						Vertex vertex;
+						vertex.mPosition	= label.mPosition + ci::vec2( c * corners[i].x - s * corners[i].y, s * corners[i].x + c * corners[i].y );
+						vertex.mTexCoord	= texCoords[i];
+						vertex.mColor		= label.mColor;
+						mVertices.push_back( vertex );
+					}
+				}
+			}
+			ranges.push_back( std::make_pair( first, mVertices.size() - first ) );
+		}
+		for( auto &label : mLabels ) {
+			label.mVisible = false;
+		}
+		mNumVertices = mVertices.size();
+		if( mVertices.empty() ) {
+			return;
+		}
+
+		// the buffer only grows, it is orphaned before each upload so the driver doesn't wait on the previous frame
+		if( mVertices.size() > mCapacity ) {
+			mCapacity = std::max<size_t>( mVertices.size(), mCapacity * 2 );
+			mVbo = ci::gl::Vbo::create( GL_ARRAY_BUFFER, mCapacity * sizeof( Vertex ), nullptr, GL_STREAM_DRAW );
+			ci::geom::BufferLayout layout;
+			layout.append( ci::geom::Attrib::POSITION, 2, sizeof( Vertex ), offsetof( Vertex, mPosition ) );
+			layout.append( ci::geom::Attrib::TEX_COORD_0, 2, sizeof( Vertex ), offsetof( Vertex, mTexCoord ) );
+			layout.append( ci::geom::Attrib::COLOR, 4, sizeof( Vertex ), offsetof( Vertex, mColor ) );
+			mBatch = ci::gl::Batch::create( ci::gl::VboMesh::create( static_cast<uint32_t>( mCapacity ), GL_TRIANGLES, { { layout, mVbo } } ), mShader );
+		}
+		mVbo->bufferData( mCapacity * sizeof( Vertex ), nullptr, GL_STREAM_DRAW );
+		mVbo->bufferSubData( 0, mVertices.size() * sizeof( Vertex ), mVertices.data() );
+
+		mShader->uniform( "uAtlas", 0 );
+		for( size_t page = 0; page < ranges.size(); ++page ) {
+			if( ranges[page].second ) {
+				ci::gl::ScopedTextureBind scopedAtlas( textures[page], 0 );
+				mBatch->draw( static_cast<GLint>( ranges[page].first ), static_cast<GLsizei>( ranges[page].second ) );
+			}
+		}
+	}
+
+	//! Returns the number of vertices of the last draw
+	size_t getNumVertices() const { return mNumVertices; }
+
+protected:
+	//! Gives access to the glyph placement in the textures of gl::TextureFont. A single atlas is baked per Font and shared by all the TextLabels
+	class Atlas : public ci::gl::TextureFont {
+	public:
+		struct Glyph {
+			size_t		mPage;
+			ci::Rectf	mRect;
+			ci::Rectf	mTexCoords;
+		};
+
+		static std::shared_ptr<Atlas> get( const ci::Font &font )
+		{
+			// the atlases are released with the last TextLabels using them, while the gl context is still alive
+			static std::map<std::pair<std::string,float>,std::weak_ptr<Atlas>> sAtlases;
+			auto &cached = sAtlases[std::make_pair( font.getName(), font.getSize() )];
+			auto atlas = cached.lock();
+			if( ! atlas ) {
+				// the default characters at sample sizes fit in a single texture
+				Format format = Format().textureWidth( 512 ).textureHeight( 512 );
+				atlas = std::shared_ptr<Atlas>( new Atlas( font, format ) );
+				cached = atlas;
+			}
+			return atlas;
+		}
+
+		//! Lays out \a text on a baseline at y = 0, same as TextureFont::drawString
+		std::vector<Glyph> layout( const std::string &text ) const
+		{
+			std::vector<Glyph> glyphs;
+			for( const auto &placement : getGlyphPlacements( text ) ) {
+				auto it = mGlyphMap.find( placement.first );
+				if( it == mGlyphMap.end() ) {
+					continue;
+				}
+				const GlyphInfo &info = it->second;
+				const auto &texture = mTextures[info.mTextureIndex];
+				Glyph glyph;
+				glyph.mPage			= info.mTextureIndex;
+				glyph.mRect			= ci::Rectf( info.mTexCoords ) - ci::vec2( info.mTexCoords.getUL() ) + placement.second + ci::vec2( std::floor( info.mOriginOffset.x + 0.5f ), std::floor( info.mOriginOffset.y ) );
+				glyph.mTexCoords	= texture->getAreaTexCoords( info.mTexCoords );
+				glyphs.push_back( glyph );
+			}
+			return glyphs;
+		}
+		const std::vector<ci::gl::TextureRef>& getTextures() const { return mTextures; }
+
+	protected:
+		Atlas( const ci::Font &font, Format &format ) : ci::gl::TextureFont( font, defaultChars(), format ) {}
+	};
+
+	struct Label {
+		Label() : mAngle( 0.0f ), mVisible( false ) {}
+
+		std::string					mText;
+		std::vector<Atlas::Glyph>	mGlyphs;
+		ci::vec2					mPosition;
+		float						mAngle;
+		ci::ColorA					mColor;
+		bool						mVisible;
+	};
+
+	struct Vertex {
+		ci::vec2		mPosition;
+		ci::vec2		mTexCoord;
+		ci::ColorA		mColor;
+	};
+
+	//! Lays out the glyphs of \a label around its anchor, centered like gl::drawStringCentered
+	void layout( Label *label ) const
+	{
+		label->mGlyphs	= mAtlas->layout( label->mText );
+		ci::vec2 offset	= ci::vec2( -mAtlas->measureString( label->mText ).x * 0.5f, mAtlas->getAscent() );
+		for( auto &glyph : label->mGlyphs ) {
+			glyph.mRect += offset;
+		}
+	}
+
+	std::shared_ptr<Atlas>	mAtlas;
+	ci::gl::GlslProgRef		mShader;
+	ci::gl::VboRef			mVbo;
+	ci::gl::BatchRef		mBatch;
+	std::vector<Label>		mLabels;
+	std::vector<Vertex>		mVertices;
+	size_t					mNumVertices, mCapacity;
+};
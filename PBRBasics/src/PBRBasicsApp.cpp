@@ -1,10 +1,17 @@
 #include "cinder/app/App.h"
 #include "cinder/app/RendererGl.h"
 #include "cinder/gl/gl.h"
+#include "cinder/gl/BufferTexture.h"
 #include "cinder/CameraUi.h"
 #include "cinder/Log.h"
+#include "cinder/Rand.h"
+#include "cinder/Timer.h"
 
 #include "CinderImGui.h"
+#include "LightClusters.h"
+#include "TextLabels.h"
+#include "HdrTarget.h"
+#include "MeshOptimizer.h"
 
 using namespace ci;
 using namespace ci::app;
@@ -17,35 +24,94 @@ public:
 	void draw() override;
 	void resize() override;
 	
+	void renderScene();
 	void renderAnnotations();
+	void createBatches();
+	void updateInstances();
+	void updateClusteredLights();
+	
+	//! per-sphere data of the instanced grid
+	struct SphereInstance {
+		mat4		mModelMatrix;
+		vec2		mMaterial; // roughness and metallic before being scaled by the ui values
+	};
+	//! animated point light of the clustered mode
+	struct ClusteredLight {
+		vec3		mCenter;
+		Color		mColor;
+		float		mOrbit, mSpeed, mPhase;
+	};
 	
 	CameraPersp		mCamera;
 	CameraUi		mCameraUi;
-	gl::BatchRef	mSphereBatch, mLightBatch;
+	gl::VboMeshRef	mSphereMesh;
+	gl::BatchRef	mSphereBatch, mInstancedSphereBatch, mLightBatch;
+	gl::VboRef		mInstanceVbo;
 	vec3			mLightPosition;
 	
-	int				mGridSize;
-	bool			mAnimateLight, mShowUi;
+	LightClusters			mLightClusters;
+	vector<ClusteredLight>	mClusteredLights;
+	vector<vec4>			mClusteredLightsBounds, mClusteredLightsData;
+	gl::VboRef				mClusteredLightsVbo, mClustersVbo, mClusterIndicesVbo;
+	gl::BufferTextureRef	mClusteredLightsTexture, mClustersTexture, mClusterIndicesTexture;
+	int						mNumClusteredLights;
+	float					mClusteredLightsRadius;
+	double					mLightAssignmentTime;
+	
+	int				mGridSize, mNumInstances, mInstancesGridSize;
+	bool			mAnimateLight, mShowUi, mInstancing, mClustered;
 	float			mRoughness, mMetallic, mSpecular;
 	Color			mBaseColor, mLightColor;
 	float			mLightRadius, mGamma, mExposure, mTime;
 	
-	Font			mFont;
+	HdrTarget		mHdrTarget;
+	bool			mHdr, mColorGrading;
+	AntiAliasingComparison mComparison;
+	
+	TextLabels		mLabels;
+	double			mAnnotationsTime;
 };
 
 void PBRBasicsApp::setup()
 {
+	// add the common texture folder
+	addAssetDirectory( fs::path( __FILE__ ).parent_path().parent_path().parent_path() / "common/textures" );
+	
 	// create a Camera and a Camera ui
-	mCamera		= CameraPersp( getWindowWidth(), getWindowHeight(), 50.0f, 1.0f, 100.0f ).calcFraming( Sphere( vec3( 0.0f ), 12.0f ) );
+	mCamera		= CameraPersp( getWindowWidth(), getWindowHeight(), 50.0f, 1.0f, 1000.0f ).calcFraming( Sphere( vec3( 0.0f ), 12.0f ) );
 	mCameraUi	= CameraUi( &mCamera, getWindow(), -1 );
 	
-	// prepare ou rendering objects and shaders
-	auto pbrShader	= gl::GlslProg::create( gl::GlslProg::Format().vertex( loadAsset( "PBR.vert" ) ).fragment( loadAsset( "PBR.frag" ) ) );
-	mSphereBatch	= gl::Batch::create( geom::Sphere().subdivisions( 32 ), pbrShader );
-	mLightBatch		= gl::Batch::create( geom::Sphere().subdivisions( 32 ), gl::getStockShader( gl::ShaderDef().color() ) );
+	// prepare ou rendering objects, the instanced version of the grid reads
+	// each sphere transform and material from an instance buffer
+	mInstanceVbo	= gl::Vbo::create( GL_ARRAY_BUFFER, 0, nullptr, GL_STATIC_DRAW );
+	geom::BufferLayout instanceLayout;
+	instanceLayout.append( geom::Attrib::CUSTOM_0, 16, sizeof( SphereInstance ), offsetof( SphereInstance, mModelMatrix ), 1 );
+	instanceLayout.append( geom::Attrib::CUSTOM_1, 2, sizeof( SphereInstance ), offsetof( SphereInstance, mMaterial ), 1 );
+	// the sphere is reordered for the vertex cache, overdraw and vertex fetch before being uploaded
+	TriMesh sphere( geom::Sphere().subdivisions( 32 ) );
+	auto report		= MeshOptimizer::optimize( &sphere );
+	CI_LOG_I( "Optimized the sphere, ACMR " << report.mBefore.mAcmr << " -> " << report.mAfter.mAcmr << ", ATVR " << report.mBefore.mAtvr << " -> " << report.mAfter.mAtvr );
+	mSphereMesh		= gl::VboMesh::create( sphere );
+	mSphereMesh->appendVbo( instanceLayout, mInstanceVbo );
+	mLightBatch		= gl::Batch::create( sphere, gl::getStockShader( gl::ShaderDef().color() ) );
+	
+	// the buffers of the clustered lights are exposed to the shader as buffer textures
+	mClusteredLightsVbo		= gl::Vbo::create( GL_TEXTURE_BUFFER, sizeof( vec4 ), nullptr, GL_STREAM_DRAW );
+	mClustersVbo			= gl::Vbo::create( GL_TEXTURE_BUFFER, sizeof( uint32_t ) * 2, nullptr, GL_STREAM_DRAW );
+	mClusterIndicesVbo		= gl::Vbo::create( GL_TEXTURE_BUFFER, sizeof( uint32_t ), nullptr, GL_STREAM_DRAW );
+	mClusteredLightsTexture	= gl::BufferTexture::create( mClusteredLightsVbo, GL_RGBA32F );
+	mClustersTexture		= gl::BufferTexture::create( mClustersVbo, GL_RG32UI );
+	mClusterIndicesTexture	= gl::BufferTexture::create( mClusterIndicesVbo, GL_R32UI );
 	
 	// set the initial parameters and setup the ui
 	mGridSize			= 4;
+	mNumInstances		= 0;
+	mInstancesGridSize	= 0;
+	mInstancing			= true;
+	mClustered			= false;
+	mNumClusteredLights	= 1024;
+	mClusteredLightsRadius	= 0.1f;
+	mLightAssignmentTime	= 0.0;
 	mRoughness			= 1.0f;
 	mMetallic			= 1.0f;
 	mSpecular			= 1.0f;
@@ -57,10 +123,27 @@ void PBRBasicsApp::setup()
 	mExposure			= 10.0f;
 	mAnimateLight		= true;
 	mShowUi				= false;
+	mAnnotationsTime	= 0.0;
+	
+	// the hdr mode renders the scene with linear colors to a multisampled float target,
+	// a single post pass then does the tone-mapping, the gamma and the color grading.
+	// the anti-aliasing is picked at startup with --aa, the temporal one and the
+	// --compare-aa harness only exist on the hdr target, see the end of the file
+	auto antiAliasing	= HdrTarget::parseAntiAliasing( getCommandLineArgs() );
+	bool comparison		= HdrTarget::parseComparison( getCommandLineArgs() );
+	mHdr				= antiAliasing == HdrTarget::TAA || comparison;
+	mColorGrading		= true;
+	mHdrTarget			= HdrTarget( toPixels( getWindowSize() ), antiAliasing, gl::GlslProg::Format().vertex( loadAsset( "Post.vert" ) ).fragment( loadAsset( "Post.frag" ) ), gl::GlslProg::Format().vertex( loadAsset( "Post.vert" ) ).fragment( loadAsset( "TemporalAA.frag" ) ) );
+	mHdrTarget.setLookupTable( LookupTable( Surface8u( loadImage( loadAsset( "colorGrading.png" ) ) ), ivec3( 32 ) ) );
+	if( comparison ) {
+		mComparison		= AntiAliasingComparison( &mHdrTarget );
+	}
+	
+	createBatches();
 	
-	// prepare ui and load font
+	// prepare ui and the annotations, their glyphs are baked once in an atlas
 	ui::initialize();
-	mFont = Font( "Arial", 12 );
+	mLabels = TextLabels( Font( "Arial", 12 ), gl::GlslProg::create( loadAsset( "Text.vert" ), loadAsset( "Text.frag" ) ) );
 	getWindow()->getSignalKeyDown().connect( [this]( KeyEvent event ) {
 		if( event.getCode() == KeyEvent::KEY_SPACE ) mShowUi = !mShowUi;
 	} );
@@ -69,6 +152,7 @@ void PBRBasicsApp::setup()
 void PBRBasicsApp::resize()
 {
 	mCamera.setAspectRatio( getWindowAspectRatio() );
+	mHdrTarget.setSize( toPixels( getWindowSize() ) );
 }
 
 void PBRBasicsApp::update()
@@ -92,29 +176,176 @@ void PBRBasicsApp::update()
 			ui::Checkbox( "Animation", &mAnimateLight );
 			ui::DragFloat( "Radius", &mLightRadius, 0.1f, 0.0f, 20.0f );
 			ui::ColorEdit3( "Color###LightColor", &mLightColor[0] );
+			if( ui::Checkbox( "Clustered", &mClustered ) ) {
+				createBatches();
+			}
+			if( mClustered ) {
+				ui::DragInt( "Lights", &mNumClusteredLights, 10.0f, 1, 10000 );
+				ui::DragFloat( "Lights Radius", &mClusteredLightsRadius, 0.005f, 0.01f, 1.0f );
+				ui::Text( "Assignment: %.2fms", mLightAssignmentTime );
+			}
 		}
 		if( ui::CollapsingHeader( "Rendering", nullptr, true, true ) ) {
 			ui::DragFloat( "Gamma", &mGamma, 0.01f, 0.0f );
 			ui::DragFloat( "Exposure", &mExposure, 0.01f, 0.0f );
+			ui::DragInt( "Grid Size", &mGridSize, 0.1f, 1, 100 );
+			ui::Checkbox( "Instancing", &mInstancing );
+			if( ! mHdrTarget.isTemporal() && ! mComparison.isRunning() && ui::Checkbox( "HDR Target", &mHdr ) ) {
+				createBatches();
+			}
+			if( mHdr ) {
+				ui::Checkbox( "Color Grading", &mColorGrading );
+				ui::Text( "Anti-Aliasing: %s, %.1fMB", HdrTarget::getName( mHdrTarget.getAntiAliasing() ), mHdrTarget.getFramebufferBytes() / ( 1024.0 * 1024.0 ) );
+			}
+			if( mHdrTarget.isTemporal() ) {
+				float feedback = mHdrTarget.getFeedback();
+				if( ui::DragFloat( "History Feedback", &feedback, 0.005f, 0.0f, 0.98f ) ) {
+					mHdrTarget.setFeedback( feedback );
+				}
+			}
+			for( const auto &result : mComparison.getResults() ) {
+				ui::Text( "%s: %.2fms, %.1fMB", HdrTarget::getName( result.mAntiAliasing ), result.mGpuTime, result.mBytes / ( 1024.0 * 1024.0 ) );
+			}
+			ui::Text( "%d spheres, %d draw calls", mNumInstances, mInstancing ? 1 : mNumInstances );
+			ui::Text( "Annotations: %.3fms", mAnnotationsTime );
+		}
+	}
+	
+	// the instance buffer only needs to be rebuilt when the grid changes
+	if( mGridSize != mInstancesGridSize ) {
+		updateInstances();
+	}
+	
+	// assign the lights to the clusters of the current view
+	if( mClustered ) {
+		updateClusteredLights();
+	}
+}
+
+void PBRBasicsApp::createBatches()
+{
+	// the same shaders are used for both paths, the instanced one, the clustered
+	// lights and the linear output of the hdr target are enabled with defines
+	auto format = gl::GlslProg::Format().vertex( loadAsset( "PBR.vert" ) ).fragment( loadAsset( "PBR.frag" ) );
+	if( mClustered ) {
+		format.define( "CLUSTERED" );
+	}
+	if( mHdr ) {
+		format.define( "HDR_TARGET" );
+	}
+	if( mHdr && mHdrTarget.isTemporal() ) {
+		format.define( "TEMPORAL" ).fragDataLocation( 0, "oColor" ).fragDataLocation( 1, "oVelocity" );
+	}
+	auto instancedFormat = format;
+	instancedFormat.define( "INSTANCED" );
+	
+	mSphereBatch			= gl::Batch::create( mSphereMesh, gl::GlslProg::create( format ) );
+	mInstancedSphereBatch	= gl::Batch::create( mSphereMesh, gl::GlslProg::create( instancedFormat ), { { geom::Attrib::CUSTOM_0, "aInstanceMatrix" }, { geom::Attrib::CUSTOM_1, "aInstanceMaterial" } } );
+}
+
+void PBRBasicsApp::updateInstances()
+{
+	vector<SphereInstance> instances;
+	instances.reserve( ( 2 * mGridSize + 1 ) * ( 2 * mGridSize + 1 ) );
+	for( int x = -mGridSize; x <= mGridSize; x++ ){
+		for( int z = -mGridSize; z <= mGridSize; z++ ){
+			SphereInstance instance;
+			instance.mModelMatrix	= glm::translate( vec3( x, 0, z ) * 2.25f );
+			instance.mMaterial		= vec2( lmap( (float) z, (float) -mGridSize, (float) mGridSize, 0.05f, 1.0f ), lmap( (float) x, (float) -mGridSize, (float) mGridSize, 1.0f, 0.0f ) );
+			instances.push_back( instance );
 		}
 	}
+	mInstanceVbo->bufferData( instances.size() * sizeof( SphereInstance ), instances.data(), GL_STATIC_DRAW );
+	mNumInstances		= (int) instances.size();
+	mInstancesGridSize	= mGridSize;
+}
+
+void PBRBasicsApp::updateClusteredLights()
+{
+	// spread new lights over the grid when their number changes
+	if( mClusteredLights.size() != (size_t) mNumClusteredLights ) {
+		Rand rand( 1234 );
+		float extent = mGridSize * 2.25f + 1.0f;
+		mClusteredLights.resize( mNumClusteredLights );
+		for( auto &light : mClusteredLights ) {
+			light.mCenter	= vec3( rand.nextFloat( -extent, extent ), rand.nextFloat( 0.25f, 2.0f ), rand.nextFloat( -extent, extent ) );
+			light.mColor	= Color( CM_HSV, rand.nextFloat(), 0.75f, 1.0f );
+			light.mOrbit	= rand.nextFloat( 0.5f, 2.0f );
+			light.mSpeed	= rand.nextFloat( -1.0f, 1.0f );
+			light.mPhase	= rand.nextFloat( 0.0f, 2.0f * M_PI );
+		}
+	}
+	
+	// the attenuation reaches zero at about 13.9 times the light radius, see getAttenuation in PBR.frag
+	float range = mClusteredLightsRadius / sqrt( 0.0052f );
+	mat4 view = mCamera.getViewMatrix();
+	mClusteredLightsBounds.resize( mClusteredLights.size() );
+	mClusteredLightsData.resize( mClusteredLights.size() * 2 );
+	for( size_t i = 0; i < mClusteredLights.size(); ++i ) {
+		const auto &light = mClusteredLights[i];
+		float angle = mTime * light.mSpeed + light.mPhase;
+		vec3 position = vec3( view * vec4( light.mCenter + vec3( cos( angle ), 0.0f, sin( angle ) ) * light.mOrbit, 1.0f ) );
+		mClusteredLightsBounds[i]		= vec4( position, range );
+		mClusteredLightsData[i * 2]		= vec4( position, mClusteredLightsRadius );
+		mClusteredLightsData[i * 2 + 1]	= vec4( light.mColor, 1.0f );
+	}
+	
+	// assign the lights to the clusters
+	Timer timer( true );
+	mLightClusters.setProjection( mCamera.getFov(), mCamera.getAspectRatio(), mCamera.getNearClip(), mCamera.getFarClip() );
+	mLightClusters.assign( &mClusteredLightsBounds[0].x, mClusteredLightsBounds.size() );
+	mLightAssignmentTime = timer.getSeconds() * 1000.0;
+	
+	// and upload the results
+	const auto &clusters	= mLightClusters.getClusters();
+	const auto &indices		= mLightClusters.getIndices();
+	mClusteredLightsVbo->bufferData( mClusteredLightsData.size() * sizeof( vec4 ), mClusteredLightsData.data(), GL_STREAM_DRAW );
+	mClustersVbo->bufferData( clusters.size() * sizeof( uint32_t ), clusters.data(), GL_STREAM_DRAW );
+	mClusterIndicesVbo->bufferData( std::max<size_t>( indices.size(), 1 ) * sizeof( uint32_t ), indices.empty() ? nullptr : indices.data(), GL_STREAM_DRAW );
 }
 
 void PBRBasicsApp::draw()
 {
-	// clear window and set matrices
-	gl::clear( Color( 0, 0, 0 ) );
+	// the comparison switches the anti-aliasing of the target between frames
+	if( mComparison.begin() ) {
+		createBatches();
+	}
+	
+	// in the hdr mode the tone-mapping runs once per pixel on the resolved target instead of once per shaded fragment
+	if( mHdr ) {
+		{
+			gl::ScopedFramebuffer scopedFbo( mHdrTarget.getFbo() );
+			gl::ScopedViewport scopedViewport( mHdrTarget.getFbo()->getSize() );
+			mHdrTarget.clear( Color( 0, 0, 0 ) );
+			mHdrTarget.beginFrame( mCamera );
+			renderScene();
+		}
+		mHdrTarget.draw( mExposure, mGamma, 10.0f, mColorGrading );
+	}
+	else {
+		gl::clear( Color( 0, 0, 0 ) );
+		renderScene();
+	}
+	mComparison.end();
+	
+	// display annotations
+	renderAnnotations();
+}
+
+void PBRBasicsApp::renderScene()
+{
+	// set matrices, the projection of the hdr target is jittered in the temporal mode
 	gl::setMatrices( mCamera );
+	if( mHdr ) {
+		gl::setProjectionMatrix( mHdrTarget.getProjectionMatrix() );
+	}
 	
 	// enable depth testing
 	gl::ScopedDepth scopedDepth( true );
 	
 	// sends the base color, the specular opacity,
 	// the light position, color and radius to the shader
-	auto shader = mSphereBatch->getGlslProg();
-	shader->uniform( "uLightPosition", mLightPosition );
-	shader->uniform( "uLightColor", mLightColor );
-	shader->uniform( "uLightRadius", mLightRadius );
+	auto shader = mInstancing ? mInstancedSphereBatch->getGlslProg() : mSphereBatch->getGlslProg();
 	shader->uniform( "uBaseColor", mBaseColor );
 	shader->uniform( "uSpecular", mSpecular );
 	
@@ -122,8 +353,38 @@ void PBRBasicsApp::draw()
 	shader->uniform( "uExposure", mExposure );
 	shader->uniform( "uGamma", mGamma );
 	
+	// and the unjittered matrices the velocity is computed with
+	if( mHdr && mHdrTarget.isTemporal() ) {
+		shader->uniform( "uViewProjection", mHdrTarget.getViewProjection() );
+		shader->uniform( "uPrevViewProjection", mHdrTarget.getPrevViewProjection() );
+	}
+	
+	// sends either the single light or the clustered lights buffers
+	gl::ScopedTextureBind scopedLights( GL_TEXTURE_BUFFER, mClusteredLightsTexture->getId(), 0 );
+	gl::ScopedTextureBind scopedClusters( GL_TEXTURE_BUFFER, mClustersTexture->getId(), 1 );
+	gl::ScopedTextureBind scopedIndices( GL_TEXTURE_BUFFER, mClusterIndicesTexture->getId(), 2 );
+	if( mClustered ) {
+		shader->uniform( "uLights", 0 );
+		shader->uniform( "uClusters", 1 );
+		shader->uniform( "uClusterIndices", 2 );
+		shader->uniform( "uClusterGrid", ivec3( mLightClusters.getNumTilesX(), mLightClusters.getNumTilesY(), mLightClusters.getNumSlices() ) );
+		shader->uniform( "uClusterDepth", vec2( mLightClusters.getDepthScale(), mLightClusters.getDepthBias() ) );
+		shader->uniform( "uViewportSize", vec2( gl::getViewport().second ) );
+	}
+	else {
+		shader->uniform( "uLightPosition", mLightPosition );
+		shader->uniform( "uLightColor", mLightColor );
+		shader->uniform( "uLightRadius", mLightRadius );
+	}
+	
 	// render a grid of sphere with different roughness/metallic values and colors
-	{
+	if( mInstancing ) {
+		// the per-sphere values are in the instance buffer and only get scaled by the material values
+		shader->uniform( "uRoughness", mRoughness );
+		shader->uniform( "uMetallic", mMetallic );
+		mInstancedSphereBatch->drawInstanced( mNumInstances );
+	}
+	else {
 		gl::ScopedMatrices scopedMatrices;
 		for( int x = -mGridSize; x <= mGridSize; x++ ){
 			for( int z = -mGridSize; z <= mGridSize; z++ ){
@@ -139,16 +400,27 @@ void PBRBasicsApp::draw()
 		}
 	}
 	
-	// render the light
-	{
+	// render the lights, the stock shader doesn't write a velocity
+	HdrTarget::ScopedColorOnly scopedColorOnly( mHdrTarget );
+	if( mClustered ) {
+		// the light positions are already in view space
+		gl::ScopedGlslProg scopedShader( gl::getStockShader( gl::ShaderDef().color() ) );
+		gl::ScopedMatrices scopedMatrices;
+		gl::setViewMatrix( mat4() );
+		gl::pointSize( 3.0f );
+		gl::VertBatch lights( GL_POINTS );
+		for( size_t i = 0; i < mClusteredLights.size(); ++i ) {
+			lights.color( mClusteredLights[i].mColor );
+			lights.vertex( vec3( mClusteredLightsData[i * 2] ) );
+		}
+		lights.draw();
+	}
+	else {
 		gl::ScopedMatrices scopedMatrices;
 		gl::color( mLightColor + Color::white() * 0.5f );
 		gl::setModelMatrix( glm::translate( mLightPosition ) * glm::scale( vec3( mLightRadius * 0.15f ) ) );
 		mLightBatch->draw();
 	}
-	
-	// display annotations
-	renderAnnotations();
 }
 
 void PBRBasicsApp::renderAnnotations()
@@ -180,31 +452,29 @@ void PBRBasicsApp::renderAnnotations()
 	vec3 metal			= glm::project( vec3( 0, 2.0f, -mGridSize * 3.0f - 2.0f ), view, proj, viewport );
 	vec3 metalEnd		= glm::project( vec3( -mGridSize * 3.0f, 1.0f, -mGridSize * 3.0f ), view, proj, viewport );
 	
-	gl::drawStringCentered( "0.0", vec2( center.x, getWindowHeight() - center.y ), ColorA( 1.0f, 1.0f, 1.0f, pitchFade ), mFont );
+	// the labels are laid out again only when their text changes and are all drawn in one call
+	Timer timer( true );
+	ColorA color( 1.0f, 1.0f, 1.0f, pitchFade );
+	mLabels.set( 0, "0.0", vec2( center.x, getWindowHeight() - center.y ), 0.0f, color );
 	
 	float angle = atan2( ( getWindowHeight() - center.y ) - ( getWindowHeight() - roughnessEnd.y ), center.x - roughnessEnd.x );
-	gl::pushModelMatrix();
-	gl::translate( vec2( roughness.x, getWindowHeight() - roughness.y ) );
-	gl::rotate( angle + ( camAngles.y < 0.0f ? M_PI : 0.0f ) );
-	gl::drawStringCentered( "Roughness", vec2( 0.0f ), ColorA( 1.0f, 1.0f, 1.0f, pitchFade ), mFont );
-	gl::popModelMatrix();
-	gl::pushModelMatrix();
-	gl::translate( vec2( roughnessEnd.x, getWindowHeight() - roughnessEnd.y ) );
-	gl::rotate( angle + ( camAngles.y < 0.0f ? M_PI : 0.0f ) );
-	gl::drawStringCentered( to_string( mRoughness ).substr( 0, 3 ), vec2( 0.0f ), ColorA( 1.0f, 1.0f, 1.0f, pitchFade ), mFont );
-	gl::popModelMatrix();
+	angle += camAngles.y < 0.0f ? M_PI : 0.0f;
+	mLabels.set( 1, "Roughness", vec2( roughness.x, getWindowHeight() - roughness.y ), angle, color );
+	mLabels.set( 2, to_string( mRoughness ).substr( 0, 3 ), vec2( roughnessEnd.x, getWindowHeight() - roughnessEnd.y ), angle, color );
 	
 	angle = atan2( ( getWindowHeight() - center.y ) - ( getWindowHeight() - metalEnd.y ), center.x - metalEnd.x );
-	gl::pushModelMatrix();
-	gl::translate( vec2( metal.x, getWindowHeight() - metal.y - 10.0f ) );
-	gl::rotate( angle + ( abs( angle ) < M_PI * 0.5f ? 0.0f : M_PI ) );
-	gl::drawStringCentered( "Metal", vec2( 0.0f ), ColorA( 1.0f, 1.0f, 1.0f, pitchFade ), mFont );
-	gl::popModelMatrix();
-	gl::pushModelMatrix();
-	gl::translate( vec2( metalEnd.x, getWindowHeight() - metalEnd.y ) );
-	gl::rotate(angle + (abs(angle) < M_PI * 0.5f ? 0.0f : M_PI));
-	gl::drawStringCentered( to_string( mMetallic ).substr( 0, 3 ), vec2( 0.0f ), ColorA( 1.0f, 1.0f, 1.0f, pitchFade ), mFont );
-	gl::popModelMatrix();
+	angle += abs( angle ) < M_PI * 0.5f ? 0.0f : M_PI;
+	mLabels.set( 3, "Metal", vec2( metal.x, getWindowHeight() - metal.y - 10.0f ), angle, color );
+	mLabels.set( 4, to_string( mMetallic ).substr( 0, 3 ), vec2( metalEnd.x, getWindowHeight() - metalEnd.y ), angle, color );
+	mLabels.draw();
+	mAnnotationsTime = timer.getSeconds() * 1000.0;
 }
 
-CINDER_APP( PBRBasicsApp, RendererGl( RendererGl::Options().msaa( 16 ) ) )
+CINDER_APP( PBRBasicsApp, RendererGl( RendererGl::Options().msaa( 16 ) ), []( App::Settings *settings ) {
+	// the window only needs the samples when the scene is rendered to it directly,
+	// the temporal anti-aliasing and the comparison always use the hdr target
+	const auto &args	= settings->getCommandLineArgs();
+	auto antiAliasing	= HdrTarget::parseAntiAliasing( args );
+	int samples			= antiAliasing == HdrTarget::TAA || HdrTarget::parseComparison( args ) ? 0 : HdrTarget::getSamples( antiAliasing );
+	settings->setDefaultRenderer( RendererGl::create( RendererGl::Options().msaa( samples ) ) );
+} )
@@ -0,0 +1,163 @@
+/*
+ Headless test and benchmark of LightClusters.h. Only needs a C++11 compiler:
+
+	g++ -std=c++11 -O2 -I../include ClusterBench.cpp -o ClusterBench -lpthread
+	cl /EHsc /O2 /I..\include ClusterBench.cpp
+
+ Usage:
+	ClusterBench [options]
+
+	--lights <n>		number of lights, 10000 by default
+	--range <r>			radius of the light spheres, 1.39 by default which is the range of the sample's 0.1 lights
+	--threads <n>		threads used by the last run, all the cores by default
+	--iterations <n>	assignments averaged by each timing, 50 by default
+	--seed <n>			seed of the light positions, 1 by default
+
+ Spreads the lights at random in the frustum of a 50 degrees, 16/9 camera between 1 and 60 units, with
+ the sample's 16x9x24 clusters and its 1000 units far clip. Every cluster is then checked against a brute
+ force sphere/box test of all the lights, with cluster bounds computed here from the projection rather
+ than taken from the class. Prints the mismatching clusters and the average time of an assignment on a
+ single thread and on the option threads. Returns 1 if any cluster doesn't match.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <string>
+#include <cstdlib>
+
+#include "LightClusters.h"
+
+using namespace std;
+using namespace std::chrono;
+
+static const int	sTilesX = 16, sTilesY = 9, sSlices = 24;
+static const float	sFovY = 50.0f, sAspectRatio = 16.0f / 9.0f, sNear = 1.0f, sFar = 1000.0f;
+
+// the view space bounding box of a cluster, from its tile and its exponential depth slice
+static void getClusterBounds( int x, int y, int z, float *boundsMin, float *boundsMax )
+{
+	float tanY		= std::tan( sFovY * 3.14159265f / 360.0f );
+	float tanX		= tanY * sAspectRatio;
+	float depth0	= sNear * std::pow( sFar / sNear, static_cast<float>( z ) / sSlices );
+	float depth1	= sNear * std::pow( sFar / sNear, static_cast<float>( z + 1 ) / sSlices );
+	float x0 = ( -1.0f + 2.0f * x / sTilesX ) * tanX, x1 = ( -1.0f + 2.0f * ( x + 1 ) / sTilesX ) * tanX;
+	float y0 = ( -1.0f + 2.0f * y / sTilesY ) * tanY, y1 = ( -1.0f + 2.0f * ( y + 1 ) / sTilesY ) * tanY;
+	boundsMin[0] = std::min( x0 * depth0, x0 * depth1 );
+	boundsMax[0] = std::max( x1 * depth0, x1 * depth1 );
+	boundsMin[1] = std::min( y0 * depth0, y0 * depth1 );
+	boundsMax[1] = std::max( y1 * depth0, y1 * depth1 );
+	boundsMin[2] = -depth1;
+	boundsMax[2] = -depth0;
+}
+
+// returns the number of clusters whose light list differs from the brute force one
+static size_t validate( const LightClusters &clusters, const vector<float> &lights, size_t *numPairs )
+{
+	const auto &offsets = clusters.getClusters();
+	const auto &indices = clusters.getIndices();
+	size_t numLights	= lights.size() / 4;
+	size_t mismatches	= 0;
+	*numPairs			= 0;
+	for( int z = 0; z < sSlices; ++z ) {
+		for( int y = 0; y < sTilesY; ++y ) {
+			for( int x = 0; x < sTilesX; ++x ) {
+				float boundsMin[3], boundsMax[3];
+				getClusterBounds( x, y, z, boundsMin, boundsMax );
+				vector<uint32_t> expected;
+				for( size_t i = 0; i < numLights; ++i ) {
+					const float *light = &lights[i * 4];
+					float distance2 = 0.0f;
+					for( int k = 0; k < 3; ++k ) {
+						float d = std::max( 0.0f, std::max( boundsMin[k] - light[k], light[k] - boundsMax[k] ) );
+						distance2 += d * d;
+					}
+					if( distance2 <= light[3] * light[3] ) {
+						expected.push_back( static_cast<uint32_t>( i ) );
+					}
+				}
+
+				size_t cluster = ( static_cast<size_t>( z ) * sTilesY + y ) * sTilesX + x;
+				vector<uint32_t> assigned( indices.begin() + offsets[cluster * 2], indices.begin() + offsets[cluster * 2] + offsets[cluster * 2 + 1] );
+				sort( assigned.begin(), assigned.end() );
+				*numPairs += expected.size();
+				if( assigned != expected ) {
+					++mismatches;
+				}
+			}
+		}
+	}
+	return mismatches;
+}
+
+static double benchmark( LightClusters *clusters, const vector<float> &lights, int iterations )
+{
+	// the first assignment grows the lists to their final size
+	clusters->assign( lights.data(), lights.size() / 4 );
+	auto start = steady_clock::now();
+	for( int i = 0; i < iterations; ++i ) {
+		clusters->assign( lights.data(), lights.size() / 4 );
+	}
+	return duration<double,milli>( steady_clock::now() - start ).count() / iterations;
+}
+
+int main( int argc, char **argv )
+{
+	size_t numLights	= 10000;
+	float range			= 1.39f;
+	size_t numThreads	= std::max( 1u, thread::hardware_concurrency() );
+	int iterations		= 50;
+	unsigned seed		= 1;
+	for( int i = 1; i < argc; ++i ) {
+		string arg = argv[i];
+		if( arg == "--lights" && i + 1 < argc ) numLights = strtoul( argv[++i], nullptr, 10 );
+		else if( arg == "--range" && i + 1 < argc ) range = static_cast<float>( atof( argv[++i] ) );
+		else if( arg == "--threads" && i + 1 < argc ) numThreads = std::max<size_t>( 1, strtoul( argv[++i], nullptr, 10 ) );
+		else if( arg == "--iterations" && i + 1 < argc ) iterations = std::max( 1, atoi( argv[++i] ) );
+		else if( arg == "--seed" && i + 1 < argc ) seed = static_cast<unsigned>( strtoul( argv[++i], nullptr, 10 ) );
+		else {
+			cerr << "Unknown option " << arg << ", see the top of ClusterBench.cpp" << endl;
+			return 1;
+		}
+	}
+
+	// view space positions and radius, the camera looks down -z
+	mt19937 rng( seed );
+	uniform_real_distribution<float> unit( -1.0f, 1.0f ), depths( sNear, 60.0f );
+	float tanY = std::tan( sFovY * 3.14159265f / 360.0f ), tanX = tanY * sAspectRatio;
+	vector<float> lights( numLights * 4 );
+	for( size_t i = 0; i < numLights; ++i ) {
+		float depth		= depths( rng );
+		lights[i * 4]		= unit( rng ) * tanX * depth;
+		lights[i * 4 + 1]	= unit( rng ) * tanY * depth;
+		lights[i * 4 + 2]	= -depth;
+		lights[i * 4 + 3]	= range;
+	}
+
+#if defined( LIGHT_CLUSTERS_SSE )
+	cout << "SSE tests" << endl;
+#else
+	cout << "scalar tests" << endl;
+#endif
+	cout << numLights << " lights of range " << range << ", " << sTilesX << "x" << sTilesY << "x" << sSlices << " clusters" << endl;
+	cout << fixed << setprecision( 3 );
+
+	size_t mismatches = 0;
+	for( size_t threads : { static_cast<size_t>( 1 ), numThreads } ) {
+		LightClusters clusters( sTilesX, sTilesY, sSlices, threads );
+		clusters.setProjection( sFovY, sAspectRatio, sNear, sFar );
+		double time = benchmark( &clusters, lights, iterations );
+
+		size_t numPairs;
+		size_t threadMismatches = validate( clusters, lights, &numPairs );
+		mismatches += threadMismatches;
+		cout << threads << ( threads > 1 ? " threads: " : " thread: " ) << time << " ms per assignment, " << clusters.getIndices().size() << " light/cluster pairs, "
+			<< numPairs << " expected, " << threadMismatches << " mismatching clusters" << endl;
+		if( numThreads == 1 ) {
+			break;
+		}
+	}
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,6 @@
+#version 150
+
+// the depth pre-pass only writes the depth, its color writes are masked
+void main()
+{
+}
@@ -0,0 +1,10 @@
+#version 150
+
+out vec4	oColor;
+
+// added for each fragment that passes the depth test, a pixel
+// shaded once is dark red and one shaded ten times or more is white
+void main()
+{
+	oColor = vec4( 0.3, 0.1, 0.1, 1.0 );
+}
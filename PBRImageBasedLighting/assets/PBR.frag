@@ -1,7 +1,16 @@
 #version 150
 
 uniform samplerCube uRadianceMap;
+#ifdef SPHERICAL_HARMONICS
+layout (std140) uniform SphericalHarmonics {
+	vec4			uSphericalHarmonics[9];
+};
+#else
 uniform samplerCube uIrradianceMap;
+#endif
+#ifdef BRDF_LUT
+uniform sampler2D	uBrdfLut;
+#endif
 
 uniform vec3		uBaseColor;
 uniform float		uRoughness;
@@ -17,9 +26,18 @@ in vec3             vPosition;
 in vec3				vEyePosition;
 in vec3				vWsNormal;
 in vec3				vWsPosition;
+#ifdef INSTANCED
+in vec2				vMaterial;
+#endif
 
 out vec4            oColor;
 
+#ifdef TEMPORAL
+in vec4				vClipPosition;
+in vec4				vPrevClipPosition;
+out vec2			oVelocity;
+#endif
+
 #define saturate(x) clamp(x, 0.0, 1.0)
 #define PI 3.1415926535897932384626433832795
 
@@ -50,6 +68,23 @@ vec3 EnvBRDFApprox( vec3 SpecularColor, float Roughness, float NoV )
 	return SpecularColor * AB.x + AB.y;
 }
 
+#ifdef SPHERICAL_HARMONICS
+// irradiance from the 9 spherical harmonics coefficients, already convolved with the cosine lobe
+// http://graphics.stanford.edu/papers/envmap/envmap.pdf
+vec3 getIrradiance( vec3 n )
+{
+	vec3 irradiance	= uSphericalHarmonics[0].rgb * 0.282095
+					+ uSphericalHarmonics[1].rgb * 0.488603 * n.y
+					+ uSphericalHarmonics[2].rgb * 0.488603 * n.z
+					+ uSphericalHarmonics[3].rgb * 0.488603 * n.x
+					+ uSphericalHarmonics[4].rgb * 1.092548 * n.x * n.y
+					+ uSphericalHarmonics[5].rgb * 1.092548 * n.y * n.z
+					+ uSphericalHarmonics[6].rgb * 0.315392 * ( 3.0 * n.z * n.z - 1.0 )
+					+ uSphericalHarmonics[7].rgb * 1.092548 * n.x * n.z
+					+ uSphericalHarmonics[8].rgb * 0.546274 * ( n.x * n.x - n.y * n.y );
+	return max( irradiance, vec3( 0.0 ) );
+}
+#endif
 
 // http://the-witness.net/news/2012/02/seamless-cube-map-filtering/
 vec3 fix_cube_lookup( vec3 v, float cube_size, float lod ) {
@@ -66,29 +101,50 @@ void main() {
 	vec3 N 				= normalize( vWsNormal );
 	vec3 V 				= normalize( vEyePosition );
 	
+	// when instanced the roughness and metallic values come from the grid and are scaled by the uniforms
+#ifdef INSTANCED
+	float roughness		= vMaterial.x * uRoughness;
+	float roughness4	= pow( roughness, 4.0 );
+	float metallic		= vMaterial.y * uMetallic;
+#else
+	float roughness		= uRoughness;
+	float roughness4	= uRoughness4;
+	float metallic		= uMetallic;
+#endif
+	
 	// deduce the diffuse and specular color from the baseColor and how metallic the material is
-	vec3 diffuseColor	= uBaseColor - uBaseColor * uMetallic;
-	vec3 specularColor	= mix( vec3( 0.08 * uSpecular ), uBaseColor, uMetallic );
+	vec3 diffuseColor	= uBaseColor - uBaseColor * metallic;
+	vec3 specularColor	= mix( vec3( 0.08 * uSpecular ), uBaseColor, metallic );
 	
 	vec3 color;
 	
 	// sample the pre-filtered cubemap at the corresponding mipmap level
 	int numMips			= 6;
-	float mip			= numMips - 1 + log2(uRoughness);
+	float mip			= numMips - 1 + log2(roughness);
 	vec3 lookup			= -reflect( V, N );
 	lookup				= fix_cube_lookup( lookup, 512, mip );
 	vec3 radiance		= pow( textureLod( uRadianceMap, lookup, mip ).rgb, vec3( 2.2f ) );
+#ifdef SPHERICAL_HARMONICS
+	vec3 irradiance		= getIrradiance( N );
+#else
 	vec3 irradiance		= pow( texture( uIrradianceMap, N ).rgb, vec3( 2.2f ) );
+#endif
 	
-	// get the approximate reflectance
+	// get the reflectance from the integrated split sum or from its approximation
 	float NoV			= saturate( dot( N, V ) );
-	vec3 reflectance	= EnvBRDFApprox( specularColor, uRoughness4, NoV );
+#ifdef BRDF_LUT
+	vec2 AB				= texture( uBrdfLut, vec2( NoV, roughness ) ).rg;
+	vec3 reflectance	= specularColor * AB.x + AB.y;
+#else
+	vec3 reflectance	= EnvBRDFApprox( specularColor, roughness4, NoV );
+#endif
 	
 	// combine the specular IBL and the BRDF
     vec3 diffuse  		= diffuseColor * irradiance;
     vec3 specular 		= radiance * reflectance;
 	color				= diffuse + specular;
 	
+#ifndef HDR_TARGET
 	// apply the tone-mapping
 	color				= Uncharted2Tonemap( color * uExposure );
 	// white balance
@@ -96,7 +152,13 @@ void main() {
 	
 	// gamma correction
 	color				= pow( color, vec3( 1.0f / uGamma ) );
+#endif
 	
 	// output the fragment color
     oColor				= vec4( color, 1.0 );
+	
+#ifdef TEMPORAL
+	// motion since the previous frame in texture coordinates
+	oVelocity			= ( vClipPosition.xy / vClipPosition.w - vPrevClipPosition.xy / vPrevClipPosition.w ) * 0.5;
+#endif
 }
\ No newline at end of file
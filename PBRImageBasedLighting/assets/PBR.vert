@@ -10,18 +10,50 @@ uniform mat4	ciViewMatrixInverse;
 in vec4         ciPosition;
 in vec3         ciNormal;
 
+#ifdef INSTANCED
+uniform mat4	uRotationMatrix;
+in mat4			aInstanceMatrix;
+in vec2			aInstanceMaterial;
+out vec2		vMaterial;
+#endif
+
 out vec3		vNormal;
 out vec3		vPosition;
 out vec3		vWsNormal;
 out vec3		vEyePosition;
 out vec3		vWsPosition;
 
+// the depth pre-pass has the same vertex shader, the positions
+// have to match exactly for the shading pass depth test to pass
+invariant gl_Position;
+
+#ifdef TEMPORAL
+uniform mat4	uViewProjection;		// the view projection of this frame and the previous one, without the jitter
+uniform mat4	uPrevViewProjection;
+#ifdef INSTANCED
+uniform mat4	uPrevRotationMatrix;
+#else
+uniform mat4	uPrevModelMatrix;
+#endif
+out vec4		vClipPosition;
+out vec4		vPrevClipPosition;
+#endif
+
 
 void main(){
-    vec4 worldSpacePosition	= ciModelMatrix * ciPosition;
+#ifdef INSTANCED
+	// rotations and translations only, the upper 3x3 can be used as the normal matrix
+	mat4 modelMatrix		= aInstanceMatrix * uRotationMatrix;
+	mat3 normalMatrix		= mat3( ciViewMatrix * modelMatrix );
+	vMaterial				= aInstanceMaterial;
+#else
+	mat4 modelMatrix		= ciModelMatrix;
+	mat3 normalMatrix		= ciNormalMatrix;
+#endif
+    vec4 worldSpacePosition	= modelMatrix * ciPosition;
     vec4 viewSpacePosition	= ciViewMatrix * worldSpacePosition;
 	
-    vNormal					= ciNormalMatrix * ciNormal;
+    vNormal					= normalMatrix * ciNormal;
     vPosition				= viewSpacePosition.xyz;
 	vWsPosition				= worldSpacePosition.xyz;
 	
@@ -30,4 +62,15 @@ void main(){
 	vWsNormal				= vec3( ciViewMatrixInverse * vec4( vNormal, 0.0 ) );
 	
     gl_Position				= ciProjectionMatrix * viewSpacePosition;
+	
+#ifdef TEMPORAL
+	// the models rotate, their previous position uses the rotation of the previous frame
+#ifdef INSTANCED
+	mat4 prevModelMatrix	= aInstanceMatrix * uPrevRotationMatrix;
+#else
+	mat4 prevModelMatrix	= uPrevModelMatrix;
+#endif
+	vClipPosition			= uViewProjection * worldSpacePosition;
+	vPrevClipPosition		= uPrevViewProjection * prevModelMatrix * ciPosition;
+#endif
 }
\ No newline at end of file
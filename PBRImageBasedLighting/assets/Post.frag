@@ -0,0 +1,49 @@
+#version 150
+
+uniform sampler2D	uHdr;
+uniform float		uExposure;
+uniform float		uGamma;
+uniform float		uWhiteLevel;
+
+#ifdef COLOR_GRADING
+uniform sampler3D	uLookupTable;
+uniform float		uLookupTableSize;
+#endif
+
+in vec2				vTexCoord;
+out vec4			oColor;
+
+// Filmic tonemapping from
+// http://filmicgames.com/archives/75
+
+const float A = 0.15;
+const float B = 0.50;
+const float C = 0.10;
+const float D = 0.20;
+const float E = 0.02;
+const float F = 0.30;
+
+vec3 Uncharted2Tonemap( vec3 x )
+{
+	return ((x*(A*x+C*B)+D*E)/(x*(A*x+B)+D*F))-E/F;
+}
+
+void main()
+{
+	vec3 color	= texture( uHdr, vTexCoord ).rgb;
+	
+	// apply the tone-mapping and the white balance
+	color		= Uncharted2Tonemap( color * uExposure );
+	color		= color * ( 1.0f / Uncharted2Tonemap( vec3( uWhiteLevel ) ) );
+	
+	// gamma correction
+	color		= pow( color, vec3( 1.0f / uGamma ) );
+	
+#ifdef COLOR_GRADING
+	// the lookup table is sampled at the center of its edge texels
+	float scale	= ( uLookupTableSize - 1.0f ) / uLookupTableSize;
+	color		= texture( uLookupTable, clamp( color, 0.0f, 1.0f ) * scale + 0.5f / uLookupTableSize ).rgb;
+#endif
+	
+	oColor		= vec4( color, 1.0f );
+}
@@ -8,6 +8,12 @@ in vec3		vDirection;
 
 out vec4 	oColor;
 
+#ifdef TEMPORAL
+in vec4		vClipPosition;
+in vec4		vPrevClipPosition;
+out vec2	oVelocity;
+#endif
+
 
 // Filmic tonemapping from
 // http://filmicgames.com/archives/75
@@ -28,6 +34,7 @@ void main( void )
 {
 	vec3 color 	= pow( texture( uCubeMapTex, vDirection ).rgb, vec3( 2.2f ) );
 	
+#ifndef HDR_TARGET
 	// apply the tone-mapping
 	color 		= Uncharted2Tonemap( color * uExposure );
 	// white balance
@@ -35,5 +42,10 @@ void main( void )
 	
 	// gamma correction
 	color		= pow( color, vec3( 1.0f / uGamma ) );
+#endif
 	oColor 		= vec4( color, 1.0 );
+	
+#ifdef TEMPORAL
+	oVelocity	= ( vClipPosition.xy / vClipPosition.w - vPrevClipPosition.xy / vPrevClipPosition.w ) * 0.5;
+#endif
 }
\ No newline at end of file
@@ -1,13 +1,31 @@
 #version 150
 
-uniform mat4	ciModelViewProjection;
+uniform mat4	ciProjectionMatrixInverse;
+uniform mat4	ciViewMatrixInverse;
 
 in vec4			ciPosition;
 
 out vec3		vDirection;
 
+#ifdef TEMPORAL
+uniform mat4	uViewProjection;
+uniform mat4	uPrevViewProjection;
+out vec4		vClipPosition;
+out vec4		vPrevClipPosition;
+#endif
+
 void main( void )
 {
-	vDirection 	= vec3( ciPosition );
-	gl_Position = ciModelViewProjection * ciPosition;
+	// the vertices of the fullscreen triangle are already in clip space, at the far plane.
+	// the view direction of each one is the far plane point brought back to world space,
+	// without the division by w which only changes its length
+	vec4 farPoint	= ciProjectionMatrixInverse * vec4( ciPosition.xy, 1.0, 1.0 );
+	vDirection 		= mat3( ciViewMatrixInverse ) * farPoint.xyz;
+	gl_Position		= vec4( ciPosition.xy, 1.0, 1.0 );
+	
+#ifdef TEMPORAL
+	// the sky is infinitely far, only the rotation of the camera moves it
+	vClipPosition		= uViewProjection * vec4( vDirection, 0.0 );
+	vPrevClipPosition	= uPrevViewProjection * vec4( vDirection, 0.0 );
+#endif
 }
@@ -0,0 +1,727 @@
+/*
+
+ BC6H
+
+ Copyright (c) 2015, Simon Geilfus
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <limits>
+
+#include "CubeMapPrefilter.h"
+
+//! BC6H_UF16 cubemap, the blocks of each face and mip. Faces are in the +X, -X, +Y, -Y, +Z, -Z order
+class BC6HCubeMap {
+public:
+	BC6HCubeMap() : mSize( 0 ) {}
+	BC6HCubeMap( int size, int numMips )
+	: mSize( size ), mFaces( 6 * numMips )
+	{
+		for( int mip = 0; mip < numMips; ++mip ) {
+			for( int face = 0; face < 6; ++face ) {
+				mFaces[mip * 6 + face].resize( getNumBlocks( mip ) * getNumBlocks( mip ) * 16 );
+			}
+		}
+	}
+
+	int getSize( int mip = 0 ) const { return std::max( 1, mSize >> mip ); }
+	//! Returns the number of blocks on each side of a face
+	int getNumBlocks( int mip = 0 ) const { return ( getSize( mip ) + 3 ) / 4; }
+	int getNumMips() const { return static_cast<int>( mFaces.size() / 6 ); }
+	uint8_t* getFace( int face, int mip = 0 ) { return mFaces[mip * 6 + face].data(); }
+	const uint8_t* getFace( int face, int mip = 0 ) const { return mFaces[mip * 6 + face].data(); }
+
+protected:
+	int									mSize;
+	std::vector<std::vector<uint8_t>>	mFaces;
+};
+
+//! BC6H encoder and decoder for the unsigned float variant, 1 byte per texel instead of 6 for RGB16F.
+//! Endpoints are fitted in the half float bit space, which is close to a logarithmic space, like the hardware interpolates.
+//! The encoder tries the one region modes 11 to 14, then the two regions modes 1 to 10 over the partitions.
+class BC6H {
+public:
+	enum Quality {
+		//! one region modes only
+		QUALITY_FAST,
+		//! one region modes with a least squares refinement of the endpoints, and the two regions modes for the 4 most promising partitions
+		QUALITY_NORMAL,
+		//! every mode and partition, refined twice
+		QUALITY_HIGH
+	};
+
+	struct Options {
+		Options() : mQuality( QUALITY_NORMAL ), mNumThreads( std::max( 1u, std::thread::hardware_concurrency() ) ) {}
+
+		Options& quality( Quality quality ) { mQuality = quality; return *this; }
+		Options& threads( size_t numThreads ) { mNumThreads = std::max<size_t>( 1, numThreads ); return *this; }
+		//! Called with progress messages and per face timings
+		Options& log( const std::function<void(const std::string&)> &log ) { mLog = log; return *this; }
+
+		Quality		mQuality;
+		size_t		mNumThreads;
+		std::function<void(const std::string&)> mLog;
+	};
+
+	//! Compresses every face and mip of \a cubeMap. The values are stored as they are, like CubeMapPrefilter::writeDds without the gamma
+	static BC6HCubeMap encode( const CubeMapData &cubeMap, const Options &options = Options() )
+	{
+		static const char* faceNames[6] = { "+X", "-X", "+Y", "-Y", "+Z", "-Z" };
+		BC6HCubeMap compressed( cubeMap.getSize(), cubeMap.getNumMips() );
+		for( int face = 0; face < 6; ++face ) {
+			auto start = std::chrono::steady_clock::now();
+
+			// the rows of blocks of each mip are spread over the threads
+			std::vector<std::pair<int,int>> rows;
+			for( int mip = 0; mip < cubeMap.getNumMips(); ++mip ) {
+				for( int y = 0; y < compressed.getNumBlocks( mip ); ++y ) {
+					rows.push_back( std::make_pair( mip, y ) );
+				}
+			}
+			std::atomic<size_t> nextRow( 0 );
+			auto worker = [&](){
+				size_t row;
+				while( ( row = nextRow++ ) < rows.size() ) {
+					int mip = rows[row].first, by = rows[row].second, size = cubeMap.getSize( mip );
+					const float *data = cubeMap.getFace( face, mip );
+					for( int bx = 0; bx < compressed.getNumBlocks( mip ); ++bx ) {
+						// blocks of the smallest mips repeat their texels
+						uint16_t halfs[48];
+						for( int i = 0; i < 16; ++i ) {
+							int x = std::min( bx * 4 + i % 4, size - 1 ), y = std::min( by * 4 + i / 4, size - 1 );
+							for( int c = 0; c < 3; ++c ) {
+								halfs[i * 3 + c] = CubeMapPrefilter::floatToHalf( data[( y * size + x ) * 3 + c] );
+							}
+						}
+						encodeBlock( halfs, options.mQuality, compressed.getFace( face, mip ) + ( by * compressed.getNumBlocks( mip ) + bx ) * 16 );
+					}
+				}
+			};
+			std::vector<std::thread> threads;
+			for( size_t i = 1; i < options.mNumThreads; ++i ) {
+				threads.push_back( std::thread( worker ) );
+			}
+			worker();
+			for( auto &thread : threads ) thread.join();
+
+			if( options.mLog ) {
+				double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+				std::ostringstream message;
+				message << "BC6H face " << faceNames[face] << " (" << face + 1 << "/6): " << static_cast<int>( seconds * 1000.0 ) << "ms";
+				options.mLog( message.str() );
+			}
+		}
+		return compressed;
+	}
+
+	//! Decompresses every face and mip of \a compressed
+	static CubeMapData decode( const BC6HCubeMap &compressed )
+	{
+		CubeMapData cubeMap( compressed.getSize(), compressed.getNumMips() );
+		for( int mip = 0; mip < compressed.getNumMips(); ++mip ) {
+			for( int face = 0; face < 6; ++face ) {
+				decodeFace( compressed.getFace( face, mip ), compressed.getSize( mip ), cubeMap.getFace( face, mip ) );
+			}
+		}
+		return cubeMap;
+	}
+	//! Decompresses the blocks of a \a size x \a size face to RGB floats
+	static void decodeFace( const uint8_t *blocks, int size, float *rgb )
+	{
+		int numBlocks = ( size + 3 ) / 4;
+		for( int by = 0; by < numBlocks; ++by ) {
+			for( int bx = 0; bx < numBlocks; ++bx ) {
+				uint16_t halfs[48];
+				decodeBlock( blocks + ( by * numBlocks + bx ) * 16, halfs );
+				for( int i = 0; i < 16; ++i ) {
+					int x = bx * 4 + i % 4, y = by * 4 + i / 4;
+					if( x < size && y < size ) {
+						for( int c = 0; c < 3; ++c ) rgb[( y * size + x ) * 3 + c] = CubeMapPrefilter::halfToFloat( halfs[i * 3 + c] );
+					}
+				}
+			}
+		}
+	}
+
+	//! Writes a DX10 BC6H_UF16 cubemap dds
+	static void writeDds( const BC6HCubeMap &compressed, const std::string &path )
+	{
+		std::ofstream file( path.c_str(), std::ios::binary );
+		if( ! file ) {
+			throw CubeMapPrefilterExc( "Can't write " + path );
+		}
+		uint32_t header[32] = {};
+		header[0]	= 0x20534444; // "DDS "
+		header[1]	= 124;
+		header[2]	= 0x1 | 0x2 | 0x4 | 0x1000 | 0x80000 | ( compressed.getNumMips() > 1 ? 0x20000 : 0 );
+		header[3]	= compressed.getSize();
+		header[4]	= compressed.getSize();
+		header[5]	= compressed.getNumBlocks() * compressed.getNumBlocks() * 16;
+		header[7]	= compressed.getNumMips();
+		header[19]	= 32;
+		header[20]	= 0x4; // fourcc
+		header[21]	= 0x30315844; // "DX10"
+		header[27]	= 0x1008 | ( compressed.getNumMips() > 1 ? 0x400000 : 0 );
+		header[28]	= 0xfe00; // all cube faces
+		uint32_t dx10[5] = { 95, 3, 4, 1, 0 }; // BC6H_UF16, 2d texture, cubemap, one element
+		file.write( reinterpret_cast<const char*>( header ), sizeof( header ) );
+		file.write( reinterpret_cast<const char*>( dx10 ), sizeof( dx10 ) );
+		for( int face = 0; face < 6; ++face ) {
+			for( int mip = 0; mip < compressed.getNumMips(); ++mip ) {
+				file.write( reinterpret_cast<const char*>( compressed.getFace( face, mip ) ), compressed.getNumBlocks( mip ) * compressed.getNumBlocks( mip ) * 16 );
+			}
+		}
+	}
+
+	//! Compresses 16 RGB half floats, negative values are clamped to 0
+	static void encodeBlock( const uint16_t *halfs, Quality quality, uint8_t *block )
+	{
+		Pixels pixels;
+		for( int i = 0; i < 16; ++i ) {
+			for( int c = 0; c < 3; ++c ) {
+				uint16_t value = halfs[i * 3 + c];
+				pixels.mValues[c][i] = ( value & 0x8000 ) ? 0.0f : static_cast<float>( std::min<uint16_t>( value, 0x7bff ) );
+			}
+		}
+
+		int refinements = quality == QUALITY_FAST ? 0 : quality == QUALITY_NORMAL ? 1 : 2;
+		Encoding best, candidate;
+		Fit fits[32];
+		fitPartition( pixels, 1, 0, &fits[0] );
+		for( int mode = 10; mode < 14; ++mode ) {
+			if( encodeMode( pixels, sModes[mode], 0, fits[0], refinements, &candidate ) && candidate.mError < best.mError ) {
+				best = candidate;
+			}
+		}
+
+		if( quality != QUALITY_FAST && best.mError > 0.0f ) {
+			// rank the partitions with unquantized endpoints, the most promising ones get encoded until they can't beat the best error
+			std::pair<float,int> partitions[32];
+			for( int partition = 0; partition < 32; ++partition ) {
+				fitPartition( pixels, 2, partition, &fits[partition] );
+				partitions[partition] = std::make_pair( estimatePartition( pixels, fits[partition], partition ), partition );
+			}
+			std::sort( partitions, partitions + 32 );
+			int numPartitions = quality == QUALITY_NORMAL ? 4 : 32;
+			for( int i = 0; i < numPartitions && partitions[i].first < best.mError; ++i ) {
+				// the modes are sorted by decreasing precision, the normal quality stops at the most precise ones the deltas fit in
+				static const int modes[10] = { 2, 3, 4, 0, 5, 6, 7, 8, 1, 9 };
+				int partition = partitions[i].second, precision = 0;
+				for( int j = 0; j < 10; ++j ) {
+					const Mode &mode = sModes[modes[j]];
+					if( quality == QUALITY_NORMAL && mode.mPrecision < precision ) {
+						break;
+					}
+					if( encodeMode( pixels, mode, partition, fits[partition], refinements, &candidate ) ) {
+						precision = mode.mPrecision;
+						if( candidate.mError < best.mError ) best = candidate;
+					}
+				}
+			}
+		}
+		pack( best, block );
+	}
+
+	//! Decompresses a block to 16 RGB half floats. Reserved modes decode to black
+	static void decodeBlock( const uint8_t *block, uint16_t *halfs )
+	{
+		uint64_t bits[2];
+		std::memcpy( bits, block, 16 );
+		int modeBits = static_cast<int>( bits[0] & 0x3 );
+		if( modeBits > 1 ) {
+			modeBits = static_cast<int>( bits[0] & 0x1f );
+		}
+		const Mode *mode = nullptr;
+		for( int i = 0; i < 14; ++i ) {
+			if( sModes[i].mModeBits == modeBits ) mode = &sModes[i];
+		}
+		if( ! mode ) {
+			std::fill( halfs, halfs + 48, uint16_t( 0 ) );
+			return;
+		}
+
+		// gather the endpoints and the partition from the mode layout
+		int endpoints[4][3] = {}, partition = 0, position = mode->mModeBits < 2 ? 2 : 5;
+		for( const Run *run = mode->mLayout; run->mField != END; ++run ) {
+			for( int i = 0; i <= std::abs( run->mLast - run->mFirst ); ++i, ++position ) {
+				int bit = run->mLast >= run->mFirst ? run->mFirst + i : run->mFirst - i;
+				int value = static_cast<int>( getBits( bits, position, 1 ) );
+				if( run->mField == D ) partition |= value << bit;
+				else endpoints[run->mField - W][run->mChannel] |= value << bit;
+			}
+		}
+		int numEndpoints = mode->mNumRegions * 2;
+		if( mode->mTransformed ) {
+			for( int e = 1; e < numEndpoints; ++e ) {
+				for( int c = 0; c < 3; ++c ) {
+					endpoints[e][c] = ( endpoints[0][c] + signExtend( endpoints[e][c], mode->mDeltaBits[c] ) ) & ( ( 1 << mode->mPrecision ) - 1 );
+				}
+			}
+		}
+		int unquantized[4][3];
+		for( int e = 0; e < numEndpoints; ++e ) {
+			for( int c = 0; c < 3; ++c ) unquantized[e][c] = unquantize( endpoints[e][c], mode->mPrecision );
+		}
+
+		// read the indices and interpolate
+		int indexBits = mode->mNumRegions == 1 ? 4 : 3;
+		const int *weights = indexBits == 4 ? sWeights4 : sWeights3;
+		position = mode->mNumRegions == 1 ? 65 : 82;
+		for( int i = 0; i < 16; ++i ) {
+			int region	= mode->mNumRegions == 1 ? 0 : ( sPartitions[partition] >> i ) & 1;
+			bool anchor	= i == 0 || ( region == 1 && i == sAnchors[partition] );
+			int count	= anchor ? indexBits - 1 : indexBits;
+			int index	= static_cast<int>( getBits( bits, position, count ) );
+			position	+= count;
+			for( int c = 0; c < 3; ++c ) {
+				int value = ( unquantized[region * 2][c] * ( 64 - weights[index] ) + unquantized[region * 2 + 1][c] * weights[index] + 32 ) >> 6;
+				halfs[i * 3 + c] = static_cast<uint16_t>( ( value * 31 ) >> 6 );
+			}
+		}
+	}
+
+protected:
+	enum { END, W, X, Y, Z, D };
+	enum { R, G, B };
+	//! Bits mFirst to mLast of an endpoint channel or of the partition, a reversed range is stored from its highest bit
+	struct Run {
+		int mField, mChannel, mFirst, mLast;
+	};
+	//! Mode bits and layout of the fields following them. W and X are the endpoints of the first region, Y and Z of the second
+	struct Mode {
+		int			mId, mModeBits, mNumRegions;
+		bool		mTransformed;
+		int			mPrecision, mDeltaBits[3];
+		Run			mLayout[28];
+	};
+	//! The block texels in the half float bit space, one array per channel
+	struct Pixels {
+		float mValues[3][16];
+	};
+	//! Unquantized endpoints of the regions
+	struct Fit {
+		float mStarts[2][3], mEnds[2][3];
+	};
+	struct Encoding {
+		Encoding() : mMode( nullptr ), mPartition( 0 ), mError( std::numeric_limits<float>::max() ) {}
+
+		const Mode	*mMode;
+		int			mPartition, mEndpoints[4][3], mIndices[16];
+		float		mError;
+	};
+
+	static const Mode	sModes[14];
+	static const int	sWeights3[8], sWeights4[16];
+	static const uint16_t sPartitions[32];
+	static const int	sAnchors[32];
+
+	static uint64_t getBits( const uint64_t *bits, int position, int count )
+	{
+		uint64_t value = 0;
+		for( int i = 0; i < count; ++i, ++position ) {
+			value |= ( ( bits[position >> 6] >> ( position & 63 ) ) & 1 ) << i;
+		}
+		return value;
+	}
+	static void setBits( uint64_t *bits, int position, int count, uint64_t value )
+	{
+		for( int i = 0; i < count; ++i, ++position ) {
+			bits[position >> 6] |= ( ( value >> i ) & 1 ) << ( position & 63 );
+		}
+	}
+	static int signExtend( int value, int numBits )
+	{
+		return ( value & ( 1 << ( numBits - 1 ) ) ) ? value - ( 1 << numBits ) : value;
+	}
+	//! Expands an endpoint of \a precision bits to the 16 bits the hardware interpolates
+	static int unquantize( int value, int precision )
+	{
+		if( precision >= 15 ) return value;
+		if( value == 0 ) return 0;
+		if( value == ( 1 << precision ) - 1 ) return 0xffff;
+		return ( ( value << 16 ) + 0x8000 ) >> precision;
+	}
+	//! Returns the endpoint of \a precision bits closest to a value in the half float bit space
+	static int quantize( float value, int precision )
+	{
+		int maxValue	= ( 1 << precision ) - 1;
+		float target	= value * 64.0f / 31.0f;
+		int guess		= std::max( 0, std::min( maxValue, static_cast<int>( target * ( 1 << precision ) / 65536.0f ) ) );
+		int best		= guess;
+		float bestError	= std::numeric_limits<float>::max();
+		for( int candidate = std::max( 0, guess - 1 ); candidate <= std::min( maxValue, guess + 1 ); ++candidate ) {
+			float error = std::abs( unquantize( candidate, precision ) - target );
+			if( error < bestError ) {
+				bestError	= error;
+				best		= candidate;
+			}
+		}
+		return best;
+	}
+
+	//! Fits the endpoints of a region along its principal axis
+	static void fitEndpoints( const Pixels &pixels, uint16_t mask, float *start, float *end )
+	{
+		float mean[3] = {}, count = 0.0f;
+		for( int i = 0; i < 16; ++i ) {
+			if( ! ( ( mask >> i ) & 1 ) ) continue;
+			for( int c = 0; c < 3; ++c ) mean[c] += pixels.mValues[c][i];
+			count += 1.0f;
+		}
+		for( int c = 0; c < 3; ++c ) mean[c] /= count;
+
+		// a few power iterations on the covariance matrix give the principal axis
+		float covariance[6] = {};
+		for( int i = 0; i < 16; ++i ) {
+			if( ! ( ( mask >> i ) & 1 ) ) continue;
+			float r = pixels.mValues[0][i] - mean[0], g = pixels.mValues[1][i] - mean[1], b = pixels.mValues[2][i] - mean[2];
+			covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+			covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+		}
+		float axis[3] = { 1.0f, 1.0f, 1.0f };
+		for( int iteration = 0; iteration < 8; ++iteration ) {
+			float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+			float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+			float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+			float length = std::sqrt( x * x + y * y + z * z );
+			if( length < 1e-6f ) break;
+			axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+		}
+
+		float minProjection = std::numeric_limits<float>::max(), maxProjection = -std::numeric_limits<float>::max();
+		for( int i = 0; i < 16; ++i ) {
+			if( ! ( ( mask >> i ) & 1 ) ) continue;
+			float projection = ( pixels.mValues[0][i] - mean[0] ) * axis[0] + ( pixels.mValues[1][i] - mean[1] ) * axis[1] + ( pixels.mValues[2][i] - mean[2] ) * axis[2];
+			minProjection = std::min( minProjection, projection );
+			maxProjection = std::max( maxProjection, projection );
+		}
+		for( int c = 0; c < 3; ++c ) {
+			start[c]	= std::max( 0.0f, std::min( 31743.0f, mean[c] + axis[c] * minProjection ) );
+			end[c]		= std::max( 0.0f, std::min( 31743.0f, mean[c] + axis[c] * maxProjection ) );
+		}
+	}
+
+	//! Least squares endpoints for the current indices of a region
+	static void refineEndpoints( const Pixels &pixels, uint16_t mask, const int *indices, const int *weights, float *start, float *end )
+	{
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = {}, bx[3] = {};
+		for( int i = 0; i < 16; ++i ) {
+			if( ! ( ( mask >> i ) & 1 ) ) continue;
+			float b = weights[indices[i]] / 64.0f, a = 1.0f - b;
+			aa += a * a; ab += a * b; bb += b * b;
+			for( int c = 0; c < 3; ++c ) {
+				ax[c] += a * pixels.mValues[c][i];
+				bx[c] += b * pixels.mValues[c][i];
+			}
+		}
+		float determinant = aa * bb - ab * ab;
+		if( std::abs( determinant ) < 1e-6f ) return;
+		for( int c = 0; c < 3; ++c ) {
+			start[c]	= std::max( 0.0f, std::min( 31743.0f, ( ax[c] * bb - bx[c] * ab ) / determinant ) );
+			end[c]		= std::max( 0.0f, std::min( 31743.0f, ( bx[c] * aa - ax[c] * ab ) / determinant ) );
+		}
+	}
+
+	//! Fits the endpoints of the regions of a partition along their principal axes
+	static void fitPartition( const Pixels &pixels, int numRegions, int partition, Fit *fit )
+	{
+		for( int region = 0; region < numRegions; ++region ) {
+			fitEndpoints( pixels, getRegionMask( numRegions, partition, region ), fit->mStarts[region], fit->mEnds[region] );
+		}
+	}
+	//! Cheap error of a partition, the fitted endpoints are not quantized
+	static float estimatePartition( const Pixels &pixels, const Fit &fit, int partition )
+	{
+		float palettes[2][3][16];
+		for( int region = 0; region < 2; ++region ) {
+			for( int c = 0; c < 3; ++c ) {
+				for( int k = 0; k < 8; ++k ) palettes[region][c][k] = fit.mStarts[region][c] + ( fit.mEnds[region][c] - fit.mStarts[region][c] ) * sWeights3[k] / 64.0f;
+			}
+		}
+		int indices[16];
+		return assignIndices( pixels, sPartitions[partition], palettes, 8, indices );
+	}
+	static uint16_t getRegionMask( int numRegions, int partition, int region )
+	{
+		return numRegions == 1 ? 0xffff : region ? sPartitions[partition] : static_cast<uint16_t>( ~sPartitions[partition] );
+	}
+
+	//! Picks the closest palette entry of each pixel, the palettes of both regions are evaluated and selected by the partition mask. Returns the total error
+	static float assignIndices( const Pixels &pixels, uint16_t partitionMask, const float palettes[2][3][16], int numEntries, int *indices )
+	{
+#if defined( CUBEMAP_PREFILTER_SSE )
+		__m128 totalError = _mm_setzero_ps();
+		for( int i = 0; i < 16; i += 4 ) {
+			__m128 r = _mm_loadu_ps( &pixels.mValues[0][i] ), g = _mm_loadu_ps( &pixels.mValues[1][i] ), b = _mm_loadu_ps( &pixels.mValues[2][i] );
+			__m128i regionBits = _mm_and_si128( _mm_set1_epi32( partitionMask >> i ), _mm_set_epi32( 8, 4, 2, 1 ) );
+			__m128 region = _mm_castsi128_ps( _mm_cmpeq_epi32( regionBits, _mm_set_epi32( 8, 4, 2, 1 ) ) );
+			__m128 bestError = _mm_set1_ps( std::numeric_limits<float>::max() );
+			__m128i bestIndex = _mm_setzero_si128();
+			for( int k = 0; k < numEntries; ++k ) {
+				__m128 pr = _mm_or_ps( _mm_and_ps( region, _mm_set1_ps( palettes[1][0][k] ) ), _mm_andnot_ps( region, _mm_set1_ps( palettes[0][0][k] ) ) );
+				__m128 pg = _mm_or_ps( _mm_and_ps( region, _mm_set1_ps( palettes[1][1][k] ) ), _mm_andnot_ps( region, _mm_set1_ps( palettes[0][1][k] ) ) );
+				__m128 pb = _mm_or_ps( _mm_and_ps( region, _mm_set1_ps( palettes[1][2][k] ) ), _mm_andnot_ps( region, _mm_set1_ps( palettes[0][2][k] ) ) );
+				__m128 dr = _mm_sub_ps( r, pr ), dg = _mm_sub_ps( g, pg ), db = _mm_sub_ps( b, pb );
+				__m128 error = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dr, dr ), _mm_mul_ps( dg, dg ) ), _mm_mul_ps( db, db ) );
+				__m128 closer = _mm_cmplt_ps( error, bestError );
+				bestError = _mm_min_ps( error, bestError );
+				bestIndex = _mm_or_si128( _mm_and_si128( _mm_castps_si128( closer ), _mm_set1_epi32( k ) ), _mm_andnot_si128( _mm_castps_si128( closer ), bestIndex ) );
+			}
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( indices + i ), bestIndex );
+			totalError = _mm_add_ps( totalError, bestError );
+		}
+		float errors[4];
+		_mm_storeu_ps( errors, totalError );
+		return errors[0] + errors[1] + errors[2] + errors[3];
+#else
+		float totalError = 0.0f;
+		for( int i = 0; i < 16; ++i ) {
+			int region = ( partitionMask >> i ) & 1;
+			float bestError = std::numeric_limits<float>::max();
+			for( int k = 0; k < numEntries; ++k ) {
+				float dr = pixels.mValues[0][i] - palettes[region][0][k], dg = pixels.mValues[1][i] - palettes[region][1][k], db = pixels.mValues[2][i] - palettes[region][2][k];
+				float error = dr * dr + dg * dg + db * db;
+				if( error < bestError ) {
+					bestError	= error;
+					indices[i]	= k;
+				}
+			}
+			totalError += bestError;
+		}
+		return totalError;
+#endif
+	}
+
+	//! Builds the palettes the hardware decodes from quantized endpoints, in the half float bit space
+	static void buildPalettes( const Mode &mode, const int endpoints[4][3], float palettes[2][3][16] )
+	{
+		int numEntries = mode.mNumRegions == 1 ? 16 : 8;
+		const int *weights = mode.mNumRegions == 1 ? sWeights4 : sWeights3;
+		for( int region = 0; region < mode.mNumRegions; ++region ) {
+			for( int c = 0; c < 3; ++c ) {
+				int start = unquantize( endpoints[region * 2][c], mode.mPrecision ), end = unquantize( endpoints[region * 2 + 1][c], mode.mPrecision );
+				for( int k = 0; k < numEntries; ++k ) {
+					palettes[region][c][k] = static_cast<float>( ( ( ( start * ( 64 - weights[k] ) + end * weights[k] + 32 ) >> 6 ) * 31 ) >> 6 );
+				}
+			}
+		}
+		if( mode.mNumRegions == 1 ) {
+			std::memcpy( palettes[1], palettes[0], sizeof( palettes[0] ) );
+		}
+	}
+
+	//! Returns whether the deltas of a transformed mode fit in their number of bits
+	static bool fitsDeltas( const Mode &mode, const int endpoints[4][3] )
+	{
+		if( ! mode.mTransformed ) return true;
+		for( int e = 1; e < mode.mNumRegions * 2; ++e ) {
+			for( int c = 0; c < 3; ++c ) {
+				int range = 1 << ( mode.mDeltaBits[c] - 1 ), delta = endpoints[e][c] - endpoints[0][c];
+				if( delta < -range || delta >= range ) return false;
+			}
+		}
+		return true;
+	}
+	//! Makes the endpoints representable by a transformed mode, the deltas to the first endpoint are clamped to their number of bits
+	static void clampDeltas( const Mode &mode, int endpoints[4][3] )
+	{
+		if( ! mode.mTransformed ) return;
+		for( int e = 1; e < mode.mNumRegions * 2; ++e ) {
+			for( int c = 0; c < 3; ++c ) {
+				int range = 1 << ( mode.mDeltaBits[c] - 1 );
+				int delta = std::max( -range, std::min( range - 1, endpoints[e][c] - endpoints[0][c] ) );
+				endpoints[e][c] = std::max( 0, std::min( ( 1 << mode.mPrecision ) - 1, endpoints[0][c] + delta ) );
+			}
+		}
+	}
+
+	//! Encodes the pixels with a mode and a partition. Returns false when the endpoints can't be represented
+	static bool encodeMode( const Pixels &pixels, const Mode &mode, int partition, Fit fit, int refinements, Encoding *encoding )
+	{
+		uint16_t partitionMask	= mode.mNumRegions == 1 ? 0 : sPartitions[partition];
+		int numEntries			= mode.mNumRegions == 1 ? 16 : 8;
+		const int *weights		= mode.mNumRegions == 1 ? sWeights4 : sWeights3;
+		float palettes[2][3][16];
+
+		Encoding best, candidate;
+		candidate.mMode			= &mode;
+		candidate.mPartition	= partition;
+		for( int pass = 0; pass <= refinements; ++pass ) {
+			for( int region = 0; region < mode.mNumRegions; ++region ) {
+				for( int c = 0; c < 3; ++c ) {
+					candidate.mEndpoints[region * 2][c]		= quantize( fit.mStarts[region][c], mode.mPrecision );
+					candidate.mEndpoints[region * 2 + 1][c]	= quantize( fit.mEnds[region][c], mode.mPrecision );
+				}
+			}
+
+			// two regions modes have few bits for the deltas, the partition is better left to the other modes when they overflow
+			if( pass == 0 && mode.mNumRegions == 2 && ! fitsDeltas( mode, candidate.mEndpoints ) ) {
+				return false;
+			}
+
+			// the most significant bit of the anchor indices is implicit, swapping the endpoints of a region mirrors its indices.
+			// with transformed modes the swap changes the deltas, a couple of tries are enough to find a valid combination
+			bool valid = false;
+			for( int attempt = 0; attempt < 3 && ! valid; ++attempt ) {
+				clampDeltas( mode, candidate.mEndpoints );
+				buildPalettes( mode, candidate.mEndpoints, palettes );
+				candidate.mError = assignIndices( pixels, partitionMask, palettes, numEntries, candidate.mIndices );
+				for( int region = 0; region < mode.mNumRegions; ++region ) {
+					int anchor = region == 0 ? 0 : sAnchors[partition];
+					if( candidate.mIndices[anchor] >= numEntries / 2 ) {
+						std::swap( candidate.mEndpoints[region * 2], candidate.mEndpoints[region * 2 + 1] );
+						uint16_t mask = getRegionMask( mode.mNumRegions, partition, region );
+						for( int i = 0; i < 16; ++i ) {
+							if( ( mask >> i ) & 1 ) candidate.mIndices[i] = numEntries - 1 - candidate.mIndices[i];
+						}
+					}
+				}
+				valid = fitsDeltas( mode, candidate.mEndpoints );
+			}
+			if( valid && candidate.mError < best.mError ) {
+				best = candidate;
+			}
+			if( pass < refinements && valid ) {
+				for( int region = 0; region < mode.mNumRegions; ++region ) {
+					refineEndpoints( pixels, getRegionMask( mode.mNumRegions, partition, region ), candidate.mIndices, weights, fit.mStarts[region], fit.mEnds[region] );
+				}
+			}
+		}
+		if( ! best.mMode ) {
+			return false;
+		}
+		*encoding = best;
+		return true;
+	}
+
+	//! Writes the mode, endpoints, partition and indices of an encoding
+	static void pack( const Encoding &encoding, uint8_t *block )
+	{
+		const Mode &mode = *encoding.mMode;
+		uint64_t bits[2] = { 0, 0 };
+		int position = mode.mModeBits < 2 ? 2 : 5;
+		setBits( bits, 0, position, mode.mModeBits );
+
+		// transformed modes store the other endpoints as deltas to the first one
+		int values[4][3];
+		for( int e = 0; e < mode.mNumRegions * 2; ++e ) {
+			for( int c = 0; c < 3; ++c ) {
+				values[e][c] = e > 0 && mode.mTransformed ? ( encoding.mEndpoints[e][c] - encoding.mEndpoints[0][c] ) & ( ( 1 << mode.mDeltaBits[c] ) - 1 ) : encoding.mEndpoints[e][c];
+			}
+		}
+		for( const Run *run = mode.mLayout; run->mField != END; ++run ) {
+			for( int i = 0; i <= std::abs( run->mLast - run->mFirst ); ++i, ++position ) {
+				int bit = run->mLast >= run->mFirst ? run->mFirst + i : run->mFirst - i;
+				int value = run->mField == D ? encoding.mPartition : values[run->mField - W][run->mChannel];
+				setBits( bits, position, 1, ( value >> bit ) & 1 );
+			}
+		}
+
+		int indexBits = mode.mNumRegions == 1 ? 4 : 3;
+		position = mode.mNumRegions == 1 ? 65 : 82;
+		for( int i = 0; i < 16; ++i ) {
+			int region	= mode.mNumRegions == 1 ? 0 : ( sPartitions[encoding.mPartition] >> i ) & 1;
+			bool anchor	= i == 0 || ( region == 1 && i == sAnchors[encoding.mPartition] );
+			int count	= anchor ? indexBits - 1 : indexBits;
+			setBits( bits, position, count, encoding.mIndices[i] );
+			position	+= count;
+		}
+		std::memcpy( block, bits, 16 );
+	}
+};
+
+const BC6H::Mode BC6H::sModes[14] = {
+	// mode 1, 2 regions, 10 bits endpoints and 5 bits deltas
+	{ 1, 0x00, 2, true, 10, { 5, 5, 5 }, {
+		{ Y, G, 4, 4 }, { Y, B, 4, 4 }, { Z, B, 4, 4 }, { W, R, 0, 9 }, { W, G, 0, 9 }, { W, B, 0, 9 }, { X, R, 0, 4 }, { Z, G, 4, 4 },
+		{ Y, G, 0, 3 }, { X, G, 0, 4 }, { Z, B, 0, 0 }, { Z, G, 0, 3 }, { X, B, 0, 4 }, { Z, B, 1, 1 }, { Y, B, 0, 3 }, { Y, R, 0, 4 },
+		{ Z, B, 2, 2 }, { Z, R, 0, 4 }, { Z, B, 3, 3 }, { D, 0, 0, 4 } } },
+	// mode 2, 2 regions, 7 bits endpoints and 6 bits deltas
+	{ 2, 0x01, 2, true, 7, { 6, 6, 6 }, {
+		{ Y, G, 5, 5 }, { Z, G, 4, 5 }, { W, R, 0, 6 }, { Z, B, 0, 1 }, { Y, B, 4, 4 }, { W, G, 0, 6 }, { Y, B, 5, 5 }, { Z, B, 2, 2 },
+		{ Y, G, 4, 4 }, { W, B, 0, 6 }, { Z, B, 3, 3 }, { Z, B, 5, 4 }, { X, R, 0, 5 }, { Y, G, 0, 3 }, { X, G, 0, 5 }, { Z, G, 0, 3 },
+		{ X, B, 0, 5 }, { Y, B, 0, 3 }, { Y, R, 0, 5 }, { Z, R, 0, 5 }, { D, 0, 0, 4 } } },
+	// mode 3, 2 regions, 11 bits endpoints and 5, 4, 4 bits deltas
+	{ 3, 0x02, 2, true, 11, { 5, 4, 4 }, {
+		{ W, R, 0, 9 }, { W, G, 0, 9 }, { W, B, 0, 9 }, { X, R, 0, 4 }, { W, R, 10, 10 }, { Y, G, 0, 3 }, { X, G, 0, 3 }, { W, G, 10, 10 },
+		{ Z, B, 0, 0 }, { Z, G, 0, 3 }, { X, B, 0, 3 }, { W, B, 10, 10 }, { Z, B, 1, 1 }, { Y, B, 0, 3 }, { Y, R, 0, 4 }, { Z, B, 2, 2 },
+		{ Z, R, 0, 4 }, { Z, B, 3, 3 }, { D, 0, 0, 4 } } },
+	// mode 4, 2 regions, 11 bits endpoints and 4, 5, 4 bits deltas
+	{ 4, 0x06, 2, true, 11, { 4, 5, 4 }, {
+		{ W, R, 0, 9 }, { W, G, 0, 9 }, { W, B, 0, 9 }, { X, R, 0, 3 }, { W, R, 10, 10 }, { Z, G, 4, 4 }, { Y, G, 0, 3 }, { X, G, 0, 4 },
+		{ W, G, 10, 10 }, { Z, G, 0, 3 }, { X, B, 0, 3 }, { W, B, 10, 10 }, { Z, B, 1, 1 }, { Y, B, 0, 3 }, { Y, R, 0, 3 }, { Z, B, 0, 0 },
+		{ Z, B, 2, 2 }, { Z, R, 0, 3 }, { Y, G, 4, 4 }, { Z, B, 3, 3 }, { D, 0, 0, 4 } } },
+	// mode 5, 2 regions, 11 bits endpoints and 4, 4, 5 bits deltas
+	{ 5, 0x0a, 2, true, 11, { 4, 4, 5 }, {
+		{ W, R, 0, 9 }, { W, G, 0, 9 }, { W, B, 0, 9 }, { X, R, 0, 3 }, { W, R, 10, 10 }, { Y, B, 4, 4 }, { Y, G, 0, 3 }, { X, G, 0, 3 },
+		{ W, G, 10, 10 }, { Z, B, 0, 0 }, { Z, G, 0, 3 }, { X, B, 0, 4 }, { W, B, 10, 10 }, { Y, B, 0, 3 }, { Y, R, 0, 3 }, { Z, B, 1, 2 },
+		{ Z, R, 0, 3 }, { Z, B, 4, 4 }, { Z, B, 3, 3 }, { D, 0, 0, 4 } } },
+	// mode 6, 2 regions, 9 bits endpoints and 5 bits deltas
+	{ 6, 0x0e, 2, true, 9, { 5, 5, 5 }, {
+		{ W, R, 0, 8 }, { Y, B, 4, 4 }, { W, G, 0, 8 }, { Y, G, 4, 4 }, { W, B, 0, 8 }, { Z, B, 4, 4 }, { X, R, 0, 4 }, { Z, G, 4, 4 },
+		{ Y, G, 0, 3 }, { X, G, 0, 4 }, { Z, B, 0, 0 }, { Z, G, 0, 3 }, { X, B, 0, 4 }, { Z, B, 1, 1 }, { Y, B, 0, 3 }, { Y, R, 0, 4 },
+		{ Z, B, 2, 2 }, { Z, R, 0, 4 }, { Z, B, 3, 3 }, { D, 0, 0, 4 } } },
+	// mode 7, 2 regions, 8 bits endpoints and 6, 5, 5 bits deltas
+	{ 7, 0x12, 2, true, 8, { 6, 5, 5 }, {
+		{ W, R, 0, 7 }, { Z, G, 4, 4 }, { Y, B, 4, 4 }, { W, G, 0, 7 }, { Z, B, 2, 2 }, { Y, G, 4, 4 }, { W, B, 0, 7 }, { Z, B, 3, 4 },
+		{ X, R, 0, 5 }, { Y, G, 0, 3 }, { X, G, 0, 4 }, { Z, B, 0, 0 }, { Z, G, 0, 3 }, { X, B, 0, 4 }, { Z, B, 1, 1 }, { Y, B, 0, 3 },
+		{ Y, R, 0, 5 }, { Z, R, 0, 5 }, { D, 0, 0, 4 } } },
+	// mode 8, 2 regions, 8 bits endpoints and 5, 6, 5 bits deltas
+	{ 8, 0x16, 2, true, 8, { 5, 6, 5 }, {
+		{ W, R, 0, 7 }, { Z, B, 0, 0 }, { Y, B, 4, 4 }, { W, G, 0, 7 }, { Y, G, 5, 4 }, { W, B, 0, 7 }, { Z, G, 5, 5 }, { Z, B, 4, 4 },
+		{ X, R, 0, 4 }, { Z, G, 4, 4 }, { Y, G, 0, 3 }, { X, G, 0, 5 }, { Z, G, 0, 3 }, { X, B, 0, 4 }, { Z, B, 1, 1 }, { Y, B, 0, 3 },
+		{ Y, R, 0, 4 }, { Z, B, 2, 2 }, { Z, R, 0, 4 }, { Z, B, 3, 3 }, { D, 0, 0, 4 } } },
+	// mode 9, 2 regions, 8 bits endpoints and 5, 5, 6 bits deltas
+	{ 9, 0x1a, 2, true, 8, { 5, 5, 6 }, {
+		{ W, R, 0, 7 }, { Z, B, 1, 1 }, { Y, B, 4, 4 }, { W, G, 0, 7 }, { Y, B, 5, 5 }, { Y, G, 4, 4 }, { W, B, 0, 7 }, { Z, B, 5, 4 },
+		{ X, R, 0, 4 }, { Z, G, 4, 4 }, { Y, G, 0, 3 }, { X, G, 0, 4 }, { Z, B, 0, 0 }, { Z, G, 0, 3 }, { X, B, 0, 5 }, { Y, B, 0, 3 },
+		{ Y, R, 0, 4 }, { Z, B, 2, 2 }, { Z, R, 0, 4 }, { Z, B, 3, 3 }, { D, 0, 0, 4 } } },
+	// mode 10, 2 regions, 6 bits endpoints without deltas
+	{ 10, 0x1e, 2, false, 6, { 6, 6, 6 }, {
+		{ W, R, 0, 5 }, { Z, G, 4, 4 }, { Z, B, 0, 1 }, { Y, B, 4, 4 }, { W, G, 0, 5 }, { Y, G, 5, 5 }, { Y, B, 5, 5 }, { Z, B, 2, 2 },
+		{ Y, G, 4, 4 }, { W, B, 0, 5 }, { Z, G, 5, 5 }, { Z, B, 3, 3 }, { Z, B, 5, 4 }, { X, R, 0, 5 }, { Y, G, 0, 3 }, { X, G, 0, 5 },
+		{ Z, G, 0, 3 }, { X, B, 0, 5 }, { Y, B, 0, 3 }, { Y, R, 0, 5 }, { Z, R, 0, 5 }, { D, 0, 0, 4 } } },
+	// mode 11, 1 region, 10 bits endpoints without deltas
+	{ 11, 0x03, 1, false, 10, { 10, 10, 10 }, {
+		{ W, R, 0, 9 }, { W, G, 0, 9 }, { W, B, 0, 9 }, { X, R, 0, 9 }, { X, G, 0, 9 }, { X, B, 0, 9 } } },
+	// mode 12, 1 region, 11 bits endpoints and 9 bits deltas
+	{ 12, 0x07, 1, true, 11, { 9, 9, 9 }, {
+		{ W, R, 0, 9 }, { W, G, 0, 9 }, { W, B, 0, 9 }, { X, R, 0, 8 }, { W, R, 10, 10 }, { X, G, 0, 8 }, { W, G, 10, 10 }, { X, B, 0, 8 }, { W, B, 10, 10 } } },
+	// mode 13, 1 region, 12 bits endpoints and 8 bits deltas
+	{ 13, 0x0b, 1, true, 12, { 8, 8, 8 }, {
+		{ W, R, 0, 9 }, { W, G, 0, 9 }, { W, B, 0, 9 }, { X, R, 0, 7 }, { W, R, 11, 10 }, { X, G, 0, 7 }, { W, G, 11, 10 }, { X, B, 0, 7 }, { W, B, 11, 10 } } },
+	// mode 14, 1 region, 16 bits endpoints and 4 bits deltas
+	{ 14, 0x0f, 1, true, 16, { 4, 4, 4 }, {
+		{ W, R, 0, 9 }, { W, G, 0, 9 }, { W, B, 0, 9 }, { X, R, 0, 3 }, { W, R, 15, 10 }, { X, G, 0, 3 }, { W, G, 15, 10 }, { X, B, 0, 3 }, { W, B, 15, 10 } } }
+};
+
+const int BC6H::sWeights3[8]	= { 0, 9, 18, 27, 37, 46, 55, 64 };
+const int BC6H::sWeights4[16]	= { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+//! Second region of the 32 partitions, bit i is set when texel i belongs to it
+const uint16_t BC6H::sPartitions[32] = {
+	0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80, 0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+	0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce, 0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c
+};
+//! Anchor texel of the second region of each partition
+const int BC6H::sAnchors[32] = {
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2
+};
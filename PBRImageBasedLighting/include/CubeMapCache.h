@@ -0,0 +1,537 @@
+/*
+
+ CubeMapCache
+
+ Copyright (c) 2015, Simon Geilfus
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#if defined( _WIN32 )
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#include "cinder/gl/Texture.h"
+#include "cinder/gl/Pbo.h"
+#include "cinder/gl/scoped.h"
+#include "cinder/Filesystem.h"
+#include "cinder/Log.h"
+
+#include "SphericalHarmonics.h"
+#include "BC6H.h"
+
+//! Read-only memory mapping of a file. Nothing is read until the pages are touched
+class MappedFile {
+public:
+	MappedFile( const std::string &path )
+	: mData( nullptr ), mSize( 0 )
+	{
+#if defined( _WIN32 )
+		mMapping	= nullptr;
+		mFile		= CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+		LARGE_INTEGER size;
+		if( mFile != INVALID_HANDLE_VALUE && GetFileSizeEx( mFile, &size ) && size.QuadPart > 0 ) {
+			mSize		= static_cast<size_t>( size.QuadPart );
+			mMapping	= CreateFileMappingA( mFile, nullptr, PAGE_READONLY, 0, 0, nullptr );
+			if( mMapping ) {
+				mData = reinterpret_cast<const char*>( MapViewOfFile( mMapping, FILE_MAP_READ, 0, 0, 0 ) );
+			}
+		}
+#else
+		int file = open( path.c_str(), O_RDONLY );
+		struct stat status;
+		if( file >= 0 && fstat( file, &status ) == 0 && status.st_size > 0 ) {
+			mSize		= static_cast<size_t>( status.st_size );
+			void *data	= mmap( nullptr, mSize, PROT_READ, MAP_PRIVATE, file, 0 );
+			mData		= data != MAP_FAILED ? reinterpret_cast<const char*>( data ) : nullptr;
+		}
+		if( file >= 0 ) {
+			close( file );
+		}
+#endif
+		if( ! mData ) {
+			release();
+			throw CubeMapPrefilterExc( "Can't map " + path );
+		}
+	}
+	~MappedFile()
+	{
+		release();
+	}
+
+	const char*	getData() const { return mData; }
+	size_t		getSize() const { return mSize; }
+
+	//! Lets the os start reading the file in the background, the first accesses are less likely to wait for the disk
+	void prefetch() const
+	{
+#if ! defined( _WIN32 )
+		madvise( const_cast<char*>( mData ), mSize, MADV_WILLNEED );
+#endif
+	}
+
+protected:
+	void release()
+	{
+#if defined( _WIN32 )
+		if( mData ) UnmapViewOfFile( mData );
+		if( mMapping ) CloseHandle( mMapping );
+		if( mFile != INVALID_HANDLE_VALUE ) CloseHandle( mFile );
+#else
+		if( mData ) munmap( const_cast<char*>( mData ), mSize );
+#endif
+		mData = nullptr;
+	}
+
+	MappedFile( const MappedFile& );
+	MappedFile& operator=( const MappedFile& );
+
+	const char	*mData;
+	size_t		mSize;
+#if defined( _WIN32 )
+	HANDLE		mFile, mMapping;
+#endif
+};
+
+//! Loads floating point or BC6H dds cubemaps without blocking the gl thread and keeps the most recently used ones resident.
+//! Files are memory mapped and streamed to the gpu through a pbo straight from the mapping, a few faces per frame
+//! and smallest mips first, so a blurry version of the cubemap is available from the first update. A worker thread
+//! projects them on the spherical harmonics. The least recently used cubemaps are released once the resident ones
+//! go over the vram budget.
+class CubeMapCache {
+public:
+	struct Options {
+		Options() : mBudget( 128 * 1024 * 1024 ), mUploadBytesPerFrame( 2 * 1024 * 1024 ), mInternalFormat( GL_RGB16F ) {}
+
+		//! Maximum size in bytes of the resident cubemaps
+		Options& budget( size_t bytes ) { mBudget = bytes; return *this; }
+		//! Maximum number of bytes copied to the gpu each frame
+		Options& uploadBytesPerFrame( size_t bytes ) { mUploadBytesPerFrame = bytes; return *this; }
+		Options& internalFormat( GLint internalFormat ) { mInternalFormat = internalFormat; return *this; }
+
+		size_t	mBudget, mUploadBytesPerFrame;
+		GLint	mInternalFormat;
+	};
+
+	CubeMapCache( const Options &options = Options() )
+	: mOptions( options ), mResidentBytes( 0 ), mRunning( true )
+	{
+		mThread = std::thread( &CubeMapCache::projectRequests, this );
+	}
+	~CubeMapCache()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mRunning = false;
+		}
+		mCondition.notify_one();
+		mThread.join();
+	}
+
+	//! Starts loading \a path unless it is already resident or loading. Only maps the file and reads its header, the texels are uploaded by the next updates. Call from the gl thread
+	void request( const ci::fs::path &path )
+	{
+		std::string key = path.string();
+		auto it = mEntries.find( key );
+		if( it != mEntries.end() ) {
+			touch( it->second );
+			return;
+		}
+
+		auto parsed = std::make_shared<Parsed>();
+		parsed->mKey = key;
+		try {
+			parse( parsed.get() );
+		}
+		catch( const std::exception &exc ) {
+			CI_LOG_E( exc.what() );
+			return;
+		}
+
+		Entry &entry = mEntries[key];
+		mLru.push_front( key );
+		entry.mLruIt = mLru.begin();
+		allocate( &entry, parsed );
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mRequests.push_back( parsed );
+		}
+		mCondition.notify_one();
+	}
+	//! Returns the cubemap as soon as its smallest mip is uploaded, the sharper mips keep streaming in after that. Returns nullptr if \a path hasn't been requested or isn't ready yet
+	ci::gl::TextureCubeMapRef get( const ci::fs::path &path )
+	{
+		auto it = mEntries.find( path.string() );
+		if( it == mEntries.end() || it->second.mBaseLevel < 0 ) {
+			return nullptr;
+		}
+		touch( it->second );
+		return it->second.mTexture;
+	}
+	//! Returns whether all the mips of \a path are uploaded
+	bool isComplete( const ci::fs::path &path ) const
+	{
+		auto it = mEntries.find( path.string() );
+		return it != mEntries.end() && it->second.mBaseLevel == 0;
+	}
+	//! Returns false until the worker has projected \a path on the spherical harmonics, usually a few milliseconds after the request. The coefficients are convolved by the cosine lobe like SphericalHarmonics::getIrradiance
+	bool getSphericalHarmonics( const ci::fs::path &path, SphericalHarmonics *sphericalHarmonics ) const
+	{
+		auto it = mEntries.find( path.string() );
+		if( it == mEntries.end() || ! it->second.mSphericalHarmonicsReady ) {
+			return false;
+		}
+		*sphericalHarmonics = it->second.mSphericalHarmonics;
+		return true;
+	}
+
+	//! Picks up the spherical harmonics, streams up to Options::mUploadBytesPerFrame to the gpu and evicts the least recently used cubemaps. Call once per frame from the gl thread
+	void update()
+	{
+		// collect the work done by the worker thread, the files evicted meanwhile are skipped
+		std::deque<std::pair<std::string,SphericalHarmonics>> projected;
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			projected.swap( mProjected );
+		}
+		for( const auto &result : projected ) {
+			auto it = mEntries.find( result.first );
+			if( it != mEntries.end() ) {
+				it->second.mSphericalHarmonics		= result.second;
+				it->second.mSphericalHarmonicsReady	= true;
+			}
+		}
+
+		// upload the entries in the order they were last used
+		size_t uploaded = 0;
+		for( auto key = mLru.begin(); key != mLru.end() && uploaded < mOptions.mUploadBytesPerFrame; ++key ) {
+			Entry &entry = mEntries[*key];
+			if( entry.mParsed ) {
+				uploaded += upload( &entry, mOptions.mUploadBytesPerFrame - uploaded );
+			}
+		}
+
+		// release the least recently used cubemaps, the most recent one is always kept
+		while( mResidentBytes > mOptions.mBudget && mLru.size() > 1 ) {
+			auto it = mEntries.find( mLru.back() );
+			mResidentBytes -= it->second.mBytes;
+			mEntries.erase( it );
+			mLru.pop_back();
+		}
+	}
+
+	//! Returns the number of bytes used by the resident cubemaps
+	size_t getResidentBytes() const { return mResidentBytes; }
+	//! Returns the number of cubemaps in the cache, including the ones still loading
+	size_t getNumEntries() const { return mEntries.size(); }
+
+protected:
+	//! A mapped dds file and its layout
+	struct Parsed {
+		std::string					mKey;
+		std::unique_ptr<MappedFile>	mFile;
+		int							mSize, mNumMips;
+		size_t						mTexelSize, mDataOffset, mFaceBytes;
+		GLenum						mFormat, mType, mCompressedFormat;
+
+		int getSize( int mip ) const { return std::max( 1, mSize >> mip ); }
+		//! Returns the number of rows of a mip, compressed files have rows of 4x4 blocks
+		int getNumRows( int mip ) const { return mCompressedFormat ? ( getSize( mip ) + 3 ) / 4 : getSize( mip ); }
+		size_t getRowBytes( int mip ) const { return mCompressedFormat ? getNumRows( mip ) * 16 : getSize( mip ) * mTexelSize; }
+		size_t getMipBytes( int mip ) const { return getNumRows( mip ) * getRowBytes( mip ); }
+		//! Returns the offset of a mip in the file, dds files store the mips of each face one after the other
+		size_t getOffset( int face, int mip ) const
+		{
+			size_t offset = mDataOffset + face * mFaceBytes;
+			for( int parent = 0; parent < mip; ++parent ) {
+				offset += getMipBytes( parent );
+			}
+			return offset;
+		}
+	};
+	//! A face, or a band of rows of a face when it doesn't fit in the per frame upload. Rows of blocks for compressed files
+	struct Chunk {
+		int		mFace, mMip, mY, mNumRows;
+		size_t	mOffset;
+	};
+	struct Entry {
+		Entry() : mBytes( 0 ), mNextChunk( 0 ), mBaseLevel( -1 ), mSphericalHarmonicsReady( false ) {}
+
+		ci::gl::TextureCubeMapRef	mTexture;
+		std::shared_ptr<Parsed>		mParsed;
+		std::vector<Chunk>			mChunks;
+		size_t						mBytes, mNextChunk;
+		int							mBaseLevel;
+		bool						mSphericalHarmonicsReady;
+		SphericalHarmonics			mSphericalHarmonics;
+		std::list<std::string>::iterator mLruIt;
+	};
+
+	void touch( Entry &entry )
+	{
+		mLru.splice( mLru.begin(), mLru, entry.mLruIt );
+	}
+
+	//! Creates the texture storage and the list of uploads, smallest mips first
+	void allocate( Entry *entry, const std::shared_ptr<Parsed> &parsed )
+	{
+		using namespace ci;
+		// compressed files keep their format on the gpu
+		GLint internalFormat = parsed->mCompressedFormat ? parsed->mCompressedFormat : mOptions.mInternalFormat;
+		entry->mTexture = gl::TextureCubeMap::create( parsed->mSize, parsed->mSize, gl::TextureCubeMap::Format().internalFormat( internalFormat ).minFilter( GL_LINEAR_MIPMAP_LINEAR ).magFilter( GL_LINEAR ) );
+		gl::ScopedTextureBind scopedTexBind( entry->mTexture );
+		for( int mip = 0; mip < parsed->mNumMips; ++mip ) {
+			int size = parsed->getSize( mip );
+			for( int face = 0; face < 6; ++face ) {
+				if( parsed->mCompressedFormat ) {
+					glCompressedTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, internalFormat, size, size, 0, static_cast<GLsizei>( parsed->getMipBytes( mip ) ), nullptr );
+				}
+				else {
+					glTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, internalFormat, size, size, 0, parsed->mFormat, parsed->mType, nullptr );
+				}
+			}
+			// most drivers pad 3 channels textures to 4
+			entry->mBytes += 6 * ( parsed->mCompressedFormat ? parsed->getMipBytes( mip ) : size * size * std::max<size_t>( parsed->mTexelSize, 8 ) );
+		}
+		glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, parsed->mNumMips );
+		glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, parsed->mNumMips - 1 );
+		mResidentBytes += entry->mBytes;
+
+		for( int mip = parsed->mNumMips - 1; mip >= 0; --mip ) {
+			int numRows		= parsed->getNumRows( mip );
+			size_t rowBytes	= parsed->getRowBytes( mip );
+			int bandRows	= static_cast<int>( std::max<size_t>( 1, mOptions.mUploadBytesPerFrame / rowBytes ) );
+			for( int face = 0; face < 6; ++face ) {
+				size_t offset = parsed->getOffset( face, mip );
+				for( int y = 0; y < numRows; y += bandRows ) {
+					Chunk chunk = { face, mip, y, std::min( bandRows, numRows - y ), offset + y * rowBytes };
+					entry->mChunks.push_back( chunk );
+				}
+			}
+		}
+
+		entry->mParsed = parsed;
+	}
+
+	//! Copies the next chunks of \a entry to the pbo and from there to the texture. Returns the number of bytes uploaded
+	size_t upload( Entry *entry, size_t budget )
+	{
+		using namespace ci;
+		const Parsed &parsed = *entry->mParsed;
+
+		// gather the chunks of this frame, there's always at least one
+		size_t first = entry->mNextChunk, last = first, bytes = 0;
+		while( last < entry->mChunks.size() ) {
+			const Chunk &chunk	= entry->mChunks[last];
+			size_t chunkBytes	= chunk.mNumRows * parsed.getRowBytes( chunk.mMip );
+			if( last > first && bytes + chunkBytes > budget ) {
+				break;
+			}
+			bytes += chunkBytes;
+			++last;
+		}
+
+		if( ! mPbo || static_cast<size_t>( mPbo->getSize() ) < bytes ) {
+			mPbo = gl::Pbo::create( GL_PIXEL_UNPACK_BUFFER, std::max( bytes, mOptions.mUploadBytesPerFrame ), nullptr, GL_STREAM_DRAW );
+		}
+		gl::ScopedBuffer scopedPbo( mPbo );
+		gl::ScopedTextureBind scopedTexBind( entry->mTexture );
+
+		// orphan the previous content of the pbo so the copy doesn't wait for last frame's transfer.
+		// this is the only copy of the texels, straight from the file mapping
+		char *mapped = reinterpret_cast<char*>( mPbo->mapBufferRange( 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT ) );
+		size_t offset = 0;
+		for( size_t i = first; i < last; ++i ) {
+			const Chunk &chunk	= entry->mChunks[i];
+			size_t chunkBytes	= chunk.mNumRows * parsed.getRowBytes( chunk.mMip );
+			std::memcpy( mapped + offset, parsed.mFile->getData() + chunk.mOffset, chunkBytes );
+			offset += chunkBytes;
+		}
+		mPbo->unmap();
+
+		glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+		offset = 0;
+		for( size_t i = first; i < last; ++i ) {
+			const Chunk &chunk	= entry->mChunks[i];
+			int size			= parsed.getSize( chunk.mMip );
+			size_t chunkBytes	= chunk.mNumRows * parsed.getRowBytes( chunk.mMip );
+			if( parsed.mCompressedFormat ) {
+				// the last band of blocks can be taller than the mip
+				int y = chunk.mY * 4, height = std::min( chunk.mNumRows * 4, size - y );
+				glCompressedTexSubImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_X + chunk.mFace, chunk.mMip, 0, y, size, height, parsed.mCompressedFormat, static_cast<GLsizei>( chunkBytes ), reinterpret_cast<const GLvoid*>( offset ) );
+			}
+			else {
+				glTexSubImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_X + chunk.mFace, chunk.mMip, 0, chunk.mY, size, chunk.mNumRows, parsed.mFormat, parsed.mType, reinterpret_cast<const GLvoid*>( offset ) );
+			}
+			offset += chunkBytes;
+
+			// a mip is complete once its last chunk is in, the texture can then be sampled down to that mip
+			if( i + 1 == entry->mChunks.size() || entry->mChunks[i + 1].mMip != chunk.mMip ) {
+				entry->mBaseLevel = chunk.mMip;
+				glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, chunk.mMip );
+			}
+		}
+		glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+
+		// the file is unmapped once everything is on the gpu
+		entry->mNextChunk = last;
+		if( entry->mNextChunk == entry->mChunks.size() ) {
+			entry->mParsed.reset();
+			entry->mChunks.clear();
+		}
+		return bytes;
+	}
+
+	//! Worker thread, projects the requested files on the spherical harmonics
+	void projectRequests()
+	{
+		while( true ) {
+			std::shared_ptr<Parsed> request;
+			{
+				std::unique_lock<std::mutex> lock( mMutex );
+				mCondition.wait( lock, [this]() { return ! mRunning || ! mRequests.empty(); } );
+				if( ! mRunning ) {
+					return;
+				}
+				request = mRequests.front();
+				mRequests.pop_front();
+			}
+
+			SphericalHarmonics sphericalHarmonics = project( *request );
+			std::lock_guard<std::mutex> lock( mMutex );
+			mProjected.push_back( std::make_pair( request->mKey, sphericalHarmonics ) );
+		}
+	}
+
+	//! Maps a file and reads its header
+	static void parse( Parsed *parsed )
+	{
+		parsed->mFile.reset( new MappedFile( parsed->mKey ) );
+		const char *data = parsed->mFile->getData();
+
+		uint32_t header[32];
+		if( parsed->mFile->getSize() < sizeof( header ) + 20 ) {
+			throw CubeMapPrefilterExc( "Not a dds file: " + parsed->mKey );
+		}
+		std::memcpy( header, data, sizeof( header ) );
+		if( header[0] != 0x20534444 ) {
+			throw CubeMapPrefilterExc( "Not a dds file: " + parsed->mKey );
+		}
+		if( ! ( header[28] & 0x200 ) ) {
+			throw CubeMapPrefilterExc( "Not a cubemap: " + parsed->mKey );
+		}
+		// the mip sizes are shifts of the size, a corrupt size or mip count can't be used to compute the file layout
+		int maxMips = 1;
+		while( maxMips < 32 && ( header[3] >> maxMips ) ) {
+			++maxMips;
+		}
+		if( header[3] == 0 || header[3] > 65536 || header[7] > static_cast<uint32_t>( maxMips ) ) {
+			throw CubeMapPrefilterExc( "Invalid size or mip count: " + parsed->mKey );
+		}
+		parsed->mSize		= header[3];
+		parsed->mNumMips	= std::max<uint32_t>( 1, header[7] );
+		parsed->mDataOffset	= sizeof( header );
+
+		uint32_t format = header[21];
+		if( format == 0x30315844 ) {
+			uint32_t dx10[5];
+			std::memcpy( dx10, data + parsed->mDataOffset, sizeof( dx10 ) );
+			parsed->mDataOffset += sizeof( dx10 );
+			format = dx10[0] == 10 ? 113 : dx10[0] == 2 ? 116 : dx10[0] == 6 ? 6 : dx10[0] == 95 ? 95 : 0;
+		}
+		parsed->mCompressedFormat = 0;
+		switch( format ) {
+			case 113: parsed->mFormat = GL_RGBA; parsed->mType = GL_HALF_FLOAT; parsed->mTexelSize = 8; break;
+			case 116: parsed->mFormat = GL_RGBA; parsed->mType = GL_FLOAT; parsed->mTexelSize = 16; break;
+			case 6: parsed->mFormat = GL_RGB; parsed->mType = GL_FLOAT; parsed->mTexelSize = 12; break;
+			case 95: parsed->mFormat = GL_RGB; parsed->mType = GL_HALF_FLOAT; parsed->mTexelSize = 1; parsed->mCompressedFormat = GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT; break;
+			default: throw CubeMapPrefilterExc( "Unsupported dds format: " + parsed->mKey );
+		}
+
+		parsed->mFaceBytes = 0;
+		for( int mip = 0; mip < parsed->mNumMips; ++mip ) {
+			parsed->mFaceBytes += parsed->getMipBytes( mip );
+		}
+		if( parsed->mFile->getSize() < parsed->mDataOffset + 6 * parsed->mFaceBytes ) {
+			throw CubeMapPrefilterExc( "Truncated dds file: " + parsed->mKey );
+		}
+		parsed->mFile->prefetch();
+	}
+
+	//! Projects the first mip of 64x64 or less, decoded to linear values like PBR.frag does
+	static SphericalHarmonics project( const Parsed &parsed )
+	{
+		int mip = 0;
+		while( mip < parsed.mNumMips - 1 && ( parsed.mSize >> mip ) > 64 ) {
+			++mip;
+		}
+		int size = parsed.getSize( mip );
+		CubeMapData cubeMap( size, 1 );
+		for( int face = 0; face < 6; ++face ) {
+			const char *texels = parsed.mFile->getData() + parsed.getOffset( face, mip );
+			float *data = cubeMap.getFace( face );
+			if( parsed.mCompressedFormat ) {
+				BC6H::decodeFace( reinterpret_cast<const uint8_t*>( texels ), size, data );
+			}
+			else {
+				for( int i = 0; i < size * size; ++i ) {
+					for( int c = 0; c < 3; ++c ) {
+						if( parsed.mType == GL_HALF_FLOAT ) {
+							uint16_t half;
+							std::memcpy( &half, texels + i * parsed.mTexelSize + c * 2, 2 );
+							data[i * 3 + c] = CubeMapPrefilter::halfToFloat( half );
+						}
+						else {
+							std::memcpy( &data[i * 3 + c], texels + i * parsed.mTexelSize + c * 4, 4 );
+						}
+					}
+				}
+			}
+			for( int i = 0; i < size * size * 3; ++i ) {
+				data[i] = std::pow( std::max( data[i], 0.0f ), 2.2f );
+			}
+		}
+		return SphericalHarmonics::project( cubeMap, 0, 1 ).getIrradiance();
+	}
+
+	Options											mOptions;
+	std::unordered_map<std::string,Entry>			mEntries;
+	std::list<std::string>							mLru;
+	size_t											mResidentBytes;
+	ci::gl::PboRef									mPbo;
+
+	std::thread										mThread;
+	std::mutex										mMutex;
+	std::condition_variable							mCondition;
+	std::deque<std::shared_ptr<Parsed>>				mRequests;
+	std::deque<std::pair<std::string,SphericalHarmonics>>	mProjected;
+	bool											mRunning;
+};
@@ -0,0 +1,639 @@
+/*
+
+ CubeMapPrefilter
+
+ Copyright (c) 2015, Simon Geilfus
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+	#define CUBEMAP_PREFILTER_SSE
+	#include <emmintrin.h>
+#endif
+
+//! Exception for when an environment can't be read or written
+class CubeMapPrefilterExc : public std::runtime_error {
+public:
+	CubeMapPrefilterExc( const std::string &description ) : std::runtime_error( description ) {}
+};
+
+//! A floating point RGB cubemap and its mip chain. Faces are in the +X, -X, +Y, -Y, +Z, -Z order and follow the OpenGL conventions
+class CubeMapData {
+public:
+	CubeMapData() : mSize( 0 ) {}
+	CubeMapData( int size, int numMips )
+	: mSize( size )
+	{
+		mFaces.resize( 6 * numMips );
+		for( int mip = 0; mip < numMips; ++mip ) {
+			for( int face = 0; face < 6; ++face ) {
+				mFaces[mip * 6 + face].resize( getSize( mip ) * getSize( mip ) * 3, 0.0f );
+			}
+		}
+	}
+
+	int getSize( int mip = 0 ) const { return std::max( 1, mSize >> mip ); }
+	int getNumMips() const { return static_cast<int>( mFaces.size() / 6 ); }
+	float* getFace( int face, int mip = 0 ) { return mFaces[mip * 6 + face].data(); }
+	const float* getFace( int face, int mip = 0 ) const { return mFaces[mip * 6 + face].data(); }
+
+	//! Returns the direction of the center of a texel
+	static void getDirection( int face, int x, int y, int size, float *dir )
+	{
+		float s = ( x + 0.5f ) / size * 2.0f - 1.0f;
+		float t = ( y + 0.5f ) / size * 2.0f - 1.0f;
+		switch( face ) {
+			case 0: dir[0] = 1.0f; dir[1] = -t; dir[2] = -s; break;
+			case 1: dir[0] = -1.0f; dir[1] = -t; dir[2] = s; break;
+			case 2: dir[0] = s; dir[1] = 1.0f; dir[2] = t; break;
+			case 3: dir[0] = s; dir[1] = -1.0f; dir[2] = -t; break;
+			case 4: dir[0] = s; dir[1] = -t; dir[2] = 1.0f; break;
+			default: dir[0] = -s; dir[1] = -t; dir[2] = -1.0f; break;
+		}
+		float invLength = 1.0f / std::sqrt( dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2] );
+		dir[0] *= invLength; dir[1] *= invLength; dir[2] *= invLength;
+	}
+	//! Returns the face and the [0,1] texture coordinates of a direction
+	static int getFaceCoords( float x, float y, float z, float *s, float *t )
+	{
+		float ax = std::abs( x ), ay = std::abs( y ), az = std::abs( z );
+		float sc, tc, ma; int face;
+		if( ax >= ay && ax >= az ) { ma = ax; face = x < 0.0f ? 1 : 0; sc = x < 0.0f ? z : -z; tc = -y; }
+		else if( ay >= az ) { ma = ay; face = y < 0.0f ? 3 : 2; sc = x; tc = y < 0.0f ? -z : z; }
+		else { ma = az; face = z < 0.0f ? 5 : 4; sc = z < 0.0f ? -x : x; tc = -y; }
+		*s = 0.5f * ( sc / ma + 1.0f );
+		*t = 0.5f * ( tc / ma + 1.0f );
+		return face;
+	}
+	//! Bilinear lookup of a face at a given mip level
+	void sample( int face, float s, float t, int mip, float *rgb ) const
+	{
+		const int size		= getSize( mip );
+		const float *data	= getFace( face, mip );
+		float x = s * size - 0.5f, y = t * size - 0.5f;
+		int x0 = static_cast<int>( std::floor( x ) ), y0 = static_cast<int>( std::floor( y ) );
+		float fx = x - x0, fy = y - y0;
+		int x1 = std::min( x0 + 1, size - 1 ), y1 = std::min( y0 + 1, size - 1 );
+		x0 = std::max( x0, 0 ); y0 = std::max( y0, 0 );
+		const float *p00 = data + ( y0 * size + x0 ) * 3, *p10 = data + ( y0 * size + x1 ) * 3;
+		const float *p01 = data + ( y1 * size + x0 ) * 3, *p11 = data + ( y1 * size + x1 ) * 3;
+		for( int c = 0; c < 3; ++c ) {
+			float top		= p00[c] + ( p10[c] - p00[c] ) * fx;
+			float bottom	= p01[c] + ( p11[c] - p01[c] ) * fx;
+			rgb[c]			= top + ( bottom - top ) * fy;
+		}
+	}
+
+	//! Rebuilds the mip chain down to 1x1 with a box filter
+	void generateMips()
+	{
+		int numMips = 1;
+		while( ( mSize >> numMips ) > 0 ) ++numMips;
+		mFaces.resize( 6 * numMips );
+		for( int mip = 1; mip < numMips; ++mip ) {
+			int size = getSize( mip ), parentSize = getSize( mip - 1 );
+			for( int face = 0; face < 6; ++face ) {
+				mFaces[mip * 6 + face].resize( size * size * 3 );
+				const float *parent = getFace( face, mip - 1 );
+				float *data = getFace( face, mip );
+				for( int y = 0; y < size; ++y ) {
+					for( int x = 0; x < size; ++x ) {
+						const float *p = parent + ( y * 2 * parentSize + x * 2 ) * 3;
+						for( int c = 0; c < 3; ++c ) {
+							data[( y * size + x ) * 3 + c] = 0.25f * ( p[c] + p[c + 3] + p[parentSize * 3 + c] + p[parentSize * 3 + c + 3] );
+						}
+					}
+				}
+			}
+		}
+	}
+
+	//! Resamples a latitude/longitude image to a cubemap of \a size
+	static CubeMapData fromEquirect( const std::vector<float> &rgb, int width, int height, int size )
+	{
+		CubeMapData cubeMap( size, 1 );
+		for( int face = 0; face < 6; ++face ) {
+			float *data = cubeMap.getFace( face );
+			for( int y = 0; y < size; ++y ) {
+				for( int x = 0; x < size; ++x ) {
+					float dir[3];
+					getDirection( face, x, y, size, dir );
+					float u = 0.5f + std::atan2( dir[0], -dir[2] ) / ( 2.0f * 3.14159265f );
+					float v = std::acos( std::max( -1.0f, std::min( 1.0f, dir[1] ) ) ) / 3.14159265f;
+					// bilinear lookup, wrapping horizontally
+					float px = u * width - 0.5f, py = std::max( 0.0f, std::min( v * height - 0.5f, height - 1.0f ) );
+					int x0 = static_cast<int>( std::floor( px ) ), y0 = static_cast<int>( py );
+					float fx = px - x0, fy = py - y0;
+					int x1 = ( x0 + 1 + width ) % width, y1 = std::min( y0 + 1, height - 1 );
+					x0 = ( x0 + width ) % width;
+					for( int c = 0; c < 3; ++c ) {
+						float top		= rgb[( y0 * width + x0 ) * 3 + c] * ( 1.0f - fx ) + rgb[( y0 * width + x1 ) * 3 + c] * fx;
+						float bottom	= rgb[( y1 * width + x0 ) * 3 + c] * ( 1.0f - fx ) + rgb[( y1 * width + x1 ) * 3 + c] * fx;
+						data[( y * size + x ) * 3 + c] = top * ( 1.0f - fy ) + bottom * fy;
+					}
+				}
+			}
+		}
+		return cubeMap;
+	}
+
+protected:
+	int								mSize;
+	std::vector<std::vector<float>>	mFaces;
+};
+
+//! Bakes the radiance and irradiance cubemaps used by the image based lighting shaders. Runs on the cpu, doesn't need a gpu or a window.
+class CubeMapPrefilter {
+public:
+	struct Options {
+		Options() : mRadianceSize( 256 ), mRadianceMips( 7 ), mIrradianceSize( 128 ), mRadianceSamples( 64 ), mIrradianceSamples( 256 ), mNumThreads( std::max( 1u, std::thread::hardware_concurrency() ) ) {}
+
+		//! Size and number of mips of the radiance cubemap. The roughness of each mip matches the lookup of PBR.frag
+		Options& radiance( int size, int numMips ) { mRadianceSize = size; mRadianceMips = numMips; return *this; }
+		//! Size of the irradiance cubemap
+		Options& irradiance( int size ) { mIrradianceSize = size; return *this; }
+		//! Number of importance samples per texel
+		Options& samples( int radiance, int irradiance ) { mRadianceSamples = radiance; mIrradianceSamples = irradiance; return *this; }
+		Options& threads( size_t numThreads ) { mNumThreads = std::max<size_t>( 1, numThreads ); return *this; }
+		//! Called with progress messages and per face timings
+		Options& log( const std::function<void(const std::string&)> &log ) { mLog = log; return *this; }
+
+		int		mRadianceSize, mRadianceMips, mIrradianceSize, mRadianceSamples, mIrradianceSamples;
+		size_t	mNumThreads;
+		std::function<void(const std::string&)> mLog;
+	};
+
+	//! Returns the roughness a mip of the radiance cubemap is filtered for. PBR.frag samples mip = numMips - 1 + log2( roughness ) with numMips = 6
+	static float getMipRoughness( int mip ) { return mip == 0 ? 0.0f : std::min( 1.0f, std::pow( 2.0f, static_cast<float>( mip - 5 ) ) ); }
+
+	//! Filters the radiance mip chain with GGX importance sampling, \a source needs its mips
+	static CubeMapData prefilterRadiance( const CubeMapData &source, const Options &options = Options() )
+	{
+		CubeMapData radiance( options.mRadianceSize, options.mRadianceMips );
+		std::vector<SampleSet> sampleSets( options.mRadianceMips );
+		for( int mip = 1; mip < options.mRadianceMips; ++mip ) {
+			sampleSets[mip] = getGgxSamples( getMipRoughness( mip ), options.mRadianceSamples, source );
+		}
+		process( "Radiance", source, &radiance, sampleSets, options );
+		return radiance;
+	}
+	//! Integrates the cosine weighted irradiance, \a source needs its mips. The result is divided by pi so it can be multiplied by the albedo directly
+	static CubeMapData prefilterIrradiance( const CubeMapData &source, const Options &options = Options() )
+	{
+		CubeMapData irradiance( options.mIrradianceSize, 1 );
+		std::vector<SampleSet> sampleSets( 1, getCosineSamples( options.mIrradianceSamples, source ) );
+		process( "Irradiance", source, &irradiance, sampleSets, options );
+		return irradiance;
+	}
+
+	//! Loads a Radiance .hdr latitude/longitude image or a floating point .dds cubemap, values are divided by \a gamma to get linear values
+	static CubeMapData load( const std::string &path, int equirectCubeSize = 512, float gamma = 1.0f )
+	{
+		CubeMapData cubeMap;
+		std::string extension = path.substr( path.find_last_of( '.' ) + 1 );
+		std::transform( extension.begin(), extension.end(), extension.begin(), ::tolower );
+		if( extension == "hdr" ) {
+			int width, height;
+			std::vector<float> rgb = loadHdr( path, &width, &height );
+			cubeMap = CubeMapData::fromEquirect( rgb, width, height, equirectCubeSize );
+		}
+		else if( extension == "dds" ) {
+			cubeMap = loadDds( path );
+		}
+		else {
+			throw CubeMapPrefilterExc( "Unsupported environment format: " + path );
+		}
+		if( gamma != 1.0f ) {
+			applyGamma( &cubeMap, gamma );
+		}
+		cubeMap.generateMips();
+		return cubeMap;
+	}
+	//! Writes a RGBA16F cubemap dds, the same format as the files in common/textures. Values are raised to 1 / \a gamma, PBR.frag linearizes them with a 2.2 power
+	static void writeDds( const CubeMapData &cubeMap, const std::string &path, float gamma = 2.2f )
+	{
+		std::ofstream file( path.c_str(), std::ios::binary );
+		if( ! file ) {
+			throw CubeMapPrefilterExc( "Can't write " + path );
+		}
+		uint32_t header[32] = {};
+		header[0]	= 0x20534444; // "DDS "
+		header[1]	= 124;
+		header[2]	= 0x1 | 0x2 | 0x4 | 0x8 | 0x1000 | ( cubeMap.getNumMips() > 1 ? 0x20000 : 0 );
+		header[3]	= cubeMap.getSize();
+		header[4]	= cubeMap.getSize();
+		header[5]	= cubeMap.getSize() * 8;
+		header[7]	= cubeMap.getNumMips();
+		header[19]	= 32;
+		header[20]	= 0x4; // fourcc
+		header[21]	= 0x30315844; // "DX10"
+		header[27]	= 0x1008 | ( cubeMap.getNumMips() > 1 ? 0x400000 : 0 );
+		header[28]	= 0xfe00; // all cube faces
+		uint32_t dx10[5] = { 10, 3, 4, 1, 0 }; // R16G16B16A16_FLOAT, 2d texture, cubemap, one element
+		file.write( reinterpret_cast<const char*>( header ), sizeof( header ) );
+		file.write( reinterpret_cast<const char*>( dx10 ), sizeof( dx10 ) );
+
+		std::vector<uint16_t> halfs;
+		for( int face = 0; face < 6; ++face ) {
+			for( int mip = 0; mip < cubeMap.getNumMips(); ++mip ) {
+				int numTexels		= cubeMap.getSize( mip ) * cubeMap.getSize( mip );
+				const float *data	= cubeMap.getFace( face, mip );
+				halfs.resize( numTexels * 4 );
+				for( int i = 0; i < numTexels; ++i ) {
+					for( int c = 0; c < 3; ++c ) {
+						halfs[i * 4 + c] = floatToHalf( std::pow( std::max( data[i * 3 + c], 0.0f ), 1.0f / gamma ) );
+					}
+					halfs[i * 4 + 3] = floatToHalf( 1.0f );
+				}
+				file.write( reinterpret_cast<const char*>( halfs.data() ), halfs.size() * sizeof( uint16_t ) );
+			}
+		}
+	}
+
+	//! Reads the mip 0 of a RGBA16F / RGBA32F / RGB32F cubemap dds, or all its mips when \a allMips is true
+	static CubeMapData loadDds( const std::string &path, bool allMips = false )
+	{
+		std::ifstream file( path.c_str(), std::ios::binary );
+		uint32_t header[32];
+		if( ! file.read( reinterpret_cast<char*>( header ), sizeof( header ) ) || header[0] != 0x20534444 ) {
+			throw CubeMapPrefilterExc( "Not a dds file: " + path );
+		}
+		if( ! ( header[28] & 0x200 ) ) {
+			throw CubeMapPrefilterExc( "Not a cubemap: " + path );
+		}
+		int size		= header[3];
+		int numMips		= std::max<uint32_t>( 1, header[7] );
+		int channels	= 4;
+		bool halfFloat	= true;
+		if( header[21] == 0x30315844 ) {
+			uint32_t dx10[5];
+			file.read( reinterpret_cast<char*>( dx10 ), sizeof( dx10 ) );
+			if( dx10[0] == 10 ) { channels = 4; halfFloat = true; }
+			else if( dx10[0] == 2 ) { channels = 4; halfFloat = false; }
+			else if( dx10[0] == 6 ) { channels = 3; halfFloat = false; }
+			else throw CubeMapPrefilterExc( "Unsupported dds format: " + path );
+		}
+		else if( header[21] == 113 ) { channels = 4; halfFloat = true; }
+		else if( header[21] == 116 ) { channels = 4; halfFloat = false; }
+		else {
+			throw CubeMapPrefilterExc( "Unsupported dds format: " + path );
+		}
+
+		CubeMapData cubeMap( size, allMips ? numMips : 1 );
+		size_t texelSize = channels * ( halfFloat ? 2 : 4 );
+		std::vector<char> buffer;
+		for( int face = 0; face < 6; ++face ) {
+			for( int mip = 0; mip < numMips; ++mip ) {
+				int mipSize = std::max( 1, size >> mip );
+				buffer.resize( mipSize * mipSize * texelSize );
+				if( ! file.read( buffer.data(), buffer.size() ) ) {
+					throw CubeMapPrefilterExc( "Truncated dds file: " + path );
+				}
+				if( mip >= cubeMap.getNumMips() ) continue;
+				float *data = cubeMap.getFace( face, mip );
+				for( int i = 0; i < mipSize * mipSize; ++i ) {
+					for( int c = 0; c < 3; ++c ) {
+						if( halfFloat ) {
+							uint16_t value;
+							std::memcpy( &value, buffer.data() + i * texelSize + c * 2, 2 );
+							data[i * 3 + c] = halfToFloat( value );
+						}
+						else {
+							std::memcpy( &data[i * 3 + c], buffer.data() + i * texelSize + c * 4, 4 );
+						}
+					}
+				}
+			}
+		}
+		return cubeMap;
+	}
+
+	//! Reads a Radiance .hdr image as linear RGB floats
+	static std::vector<float> loadHdr( const std::string &path, int *width, int *height )
+	{
+		std::ifstream file( path.c_str(), std::ios::binary );
+		std::string line;
+		if( ! std::getline( file, line ) || line.compare( 0, 2, "#?" ) != 0 ) {
+			throw CubeMapPrefilterExc( "Not a Radiance hdr file: " + path );
+		}
+		while( std::getline( file, line ) && ! line.empty() ) {
+			if( line.compare( 0, 7, "FORMAT=" ) == 0 && line != "FORMAT=32-bit_rle_rgbe" ) {
+				throw CubeMapPrefilterExc( "Unsupported hdr format: " + path );
+			}
+		}
+		std::string ySign, xSign;
+		std::getline( file, line );
+		std::istringstream resolution( line );
+		resolution >> ySign >> *height >> xSign >> *width;
+		if( ySign != "-Y" || xSign != "+X" || *width <= 0 || *height <= 0 ) {
+			throw CubeMapPrefilterExc( "Unsupported hdr orientation: " + path );
+		}
+
+		std::vector<float> rgb( *width * *height * 3 );
+		std::vector<uint8_t> scanline( *width * 4 );
+		for( int y = 0; y < *height; ++y ) {
+			uint8_t rgbe[4];
+			if( ! file.read( reinterpret_cast<char*>( rgbe ), 4 ) ) {
+				throw CubeMapPrefilterExc( "Truncated hdr file: " + path );
+			}
+			// new run length encoding, each channel is stored separately
+			if( rgbe[0] == 2 && rgbe[1] == 2 && ( ( rgbe[2] << 8 ) | rgbe[3] ) == *width && *width >= 8 && *width < 32768 ) {
+				for( int c = 0; c < 4; ++c ) {
+					for( int x = 0; x < *width; ) {
+						int count = file.get();
+						if( count > 128 ) {
+							count -= 128;
+							int value = file.get();
+							for( int i = 0; i < count && x < *width; ++i ) scanline[( x++ ) * 4 + c] = static_cast<uint8_t>( value );
+						}
+						else if( count > 0 ) {
+							for( int i = 0; i < count && x < *width; ++i ) scanline[( x++ ) * 4 + c] = static_cast<uint8_t>( file.get() );
+						}
+						else {
+							throw CubeMapPrefilterExc( "Corrupted hdr file: " + path );
+						}
+					}
+				}
+			}
+			// flat scanline
+			else {
+				std::memcpy( scanline.data(), rgbe, 4 );
+				file.read( reinterpret_cast<char*>( scanline.data() + 4 ), ( *width - 1 ) * 4 );
+			}
+			if( ! file ) {
+				throw CubeMapPrefilterExc( "Truncated hdr file: " + path );
+			}
+			for( int x = 0; x < *width; ++x ) {
+				const uint8_t *p = &scanline[x * 4];
+				float scale = p[3] ? std::ldexp( 1.0f, p[3] - 136 ) : 0.0f;
+				for( int c = 0; c < 3; ++c ) rgb[( y * *width + x ) * 3 + c] = p[c] * scale;
+			}
+		}
+		return rgb;
+	}
+
+	//! Raises the first mip of a cubemap to \a gamma
+	static void applyGamma( CubeMapData *cubeMap, float gamma )
+	{
+		for( int face = 0; face < 6; ++face ) {
+			float *data = cubeMap->getFace( face );
+			for( int i = 0; i < cubeMap->getSize() * cubeMap->getSize() * 3; ++i ) {
+				data[i] = std::pow( std::max( data[i], 0.0f ), gamma );
+			}
+		}
+	}
+
+	static float halfToFloat( uint16_t value )
+	{
+		uint32_t sign = ( value & 0x8000 ) << 16, exponent = ( value >> 10 ) & 0x1f, mantissa = value & 0x3ff, bits;
+		if( exponent == 0 ) {
+			if( mantissa == 0 ) bits = sign;
+			else {
+				// denormal, normalize it
+				exponent = 127 - 15 + 1;
+				while( ! ( mantissa & 0x400 ) ) { mantissa <<= 1; --exponent; }
+				bits = sign | ( exponent << 23 ) | ( ( mantissa & 0x3ff ) << 13 );
+			}
+		}
+		else if( exponent == 31 ) bits = sign | 0x7f800000 | ( mantissa << 13 );
+		else bits = sign | ( ( exponent + 127 - 15 ) << 23 ) | ( mantissa << 13 );
+		float result;
+		std::memcpy( &result, &bits, 4 );
+		return result;
+	}
+	static uint16_t floatToHalf( float value )
+	{
+		uint32_t bits;
+		std::memcpy( &bits, &value, 4 );
+		uint16_t sign = ( bits >> 16 ) & 0x8000;
+		int exponent = static_cast<int>( ( bits >> 23 ) & 0xff ) - 127 + 15;
+		uint32_t mantissa = bits & 0x7fffff;
+		if( exponent >= 31 ) return sign | 0x7c00; // overflow to infinity
+		if( exponent <= 0 ) {
+			if( exponent < -10 ) return sign;
+			mantissa = ( mantissa | 0x800000 ) >> ( 1 - exponent );
+			return sign | static_cast<uint16_t>( ( mantissa + 0x1000 ) >> 13 );
+		}
+		// round to nearest, the carry can correctly overflow into the exponent
+		return sign | static_cast<uint16_t>( ( ( exponent << 10 ) | ( mantissa >> 13 ) ) + ( ( mantissa >> 12 ) & 1 ) );
+	}
+
+protected:
+	//! Importance samples in tangent space (N = +Z) with their weights and source mip level, stored as structure of arrays padded to a multiple of 4
+	struct SampleSet {
+		std::vector<float>	mX, mY, mZ, mWeight, mLod;
+
+		void add( float x, float y, float z, float weight, float lod )
+		{
+			mX.push_back( x ); mY.push_back( y ); mZ.push_back( z ); mWeight.push_back( weight ); mLod.push_back( lod );
+		}
+		void pad()
+		{
+			while( mX.size() % 4 ) add( 0.0f, 0.0f, 1.0f, 0.0f, 0.0f );
+		}
+		size_t size() const { return mX.size(); }
+	};
+
+	static void hammersley( uint32_t i, uint32_t count, float *u, float *v )
+	{
+		uint32_t bits = i;
+		bits = ( bits << 16 ) | ( bits >> 16 );
+		bits = ( ( bits & 0x55555555 ) << 1 ) | ( ( bits & 0xAAAAAAAA ) >> 1 );
+		bits = ( ( bits & 0x33333333 ) << 2 ) | ( ( bits & 0xCCCCCCCC ) >> 2 );
+		bits = ( ( bits & 0x0F0F0F0F ) << 4 ) | ( ( bits & 0xF0F0F0F0 ) >> 4 );
+		bits = ( ( bits & 0x00FF00FF ) << 8 ) | ( ( bits & 0xFF00FF00 ) >> 8 );
+		*u = static_cast<float>( i ) / count;
+		*v = bits * 2.3283064365386963e-10f;
+	}
+	//! Returns the source mip to sample for a given pdf, "GPU-Based Importance Sampling" (Colbert and Krivanek)
+	static float getSampleLod( float pdf, int numSamples, const CubeMapData &source )
+	{
+		float texelSolidAngle	= 4.0f * 3.14159265f / ( 6.0f * source.getSize() * source.getSize() );
+		float sampleSolidAngle	= 1.0f / ( numSamples * pdf + 1e-6f );
+		return std::max( 0.0f, std::min( 0.5f * std::log2( sampleSolidAngle / texelSolidAngle ) + 1.0f, source.getNumMips() - 1.0f ) );
+	}
+	//! GGX samples with N = V = R, weighted by NoL as in Karis' "Real Shading in Unreal Engine 4"
+	static SampleSet getGgxSamples( float roughness, int numSamples, const CubeMapData &source )
+	{
+		SampleSet samples;
+		float a = roughness * roughness, a2 = a * a;
+		for( int i = 0; i < numSamples; ++i ) {
+			float u, v;
+			hammersley( i, numSamples, &u, &v );
+			float phi		= 2.0f * 3.14159265f * u;
+			float cosTheta	= std::sqrt( ( 1.0f - v ) / ( 1.0f + ( a2 - 1.0f ) * v ) );
+			float sinTheta	= std::sqrt( 1.0f - cosTheta * cosTheta );
+			float hx = sinTheta * std::cos( phi ), hy = sinTheta * std::sin( phi ), hz = cosTheta;
+			// reflect the view vector around the half vector
+			float lx = 2.0f * hz * hx, ly = 2.0f * hz * hy, lz = 2.0f * hz * hz - 1.0f;
+			if( lz <= 0.0f ) continue;
+			// with N = V the pdf of L is D * NoH / ( 4 * VoH ) = D / 4
+			float d		= ( cosTheta * a2 - cosTheta ) * cosTheta + 1.0f;
+			float pdf	= a2 / ( 3.14159265f * d * d ) * 0.25f;
+			samples.add( lx, ly, lz, lz, getSampleLod( pdf, numSamples, source ) );
+		}
+		samples.pad();
+		return samples;
+	}
+	//! Cosine distributed samples, the pdf cancels the cosine term so they all have the same weight
+	static SampleSet getCosineSamples( int numSamples, const CubeMapData &source )
+	{
+		SampleSet samples;
+		for( int i = 0; i < numSamples; ++i ) {
+			float u, v;
+			hammersley( i, numSamples, &u, &v );
+			float phi		= 2.0f * 3.14159265f * u;
+			float cosTheta	= std::sqrt( 1.0f - v );
+			float sinTheta	= std::sqrt( v );
+			samples.add( sinTheta * std::cos( phi ), sinTheta * std::sin( phi ), cosTheta, 1.0f, getSampleLod( cosTheta / 3.14159265f, numSamples, source ) );
+		}
+		samples.pad();
+		return samples;
+	}
+
+	//! Filters one texel of direction \a n with a sample set
+	static void filterTexel( const CubeMapData &source, const SampleSet &samples, const float *n, float *rgb )
+	{
+		// tangent basis around the normal
+		float up[3] = { 0.0f, 0.0f, 1.0f };
+		if( std::abs( n[2] ) > 0.999f ) { up[0] = 1.0f; up[2] = 0.0f; }
+		float t[3] = { up[1] * n[2] - up[2] * n[1], up[2] * n[0] - up[0] * n[2], up[0] * n[1] - up[1] * n[0] };
+		float invLength = 1.0f / std::sqrt( t[0] * t[0] + t[1] * t[1] + t[2] * t[2] );
+		t[0] *= invLength; t[1] *= invLength; t[2] *= invLength;
+		float b[3] = { n[1] * t[2] - n[2] * t[1], n[2] * t[0] - n[0] * t[2], n[0] * t[1] - n[1] * t[0] };
+
+		float sum[3] = { 0.0f, 0.0f, 0.0f }, weights = 0.0f;
+		float s[4], tc[4];
+		int faces[4];
+		for( size_t i = 0; i < samples.size(); i += 4 ) {
+#ifdef CUBEMAP_PREFILTER_SSE
+			// rotate 4 samples to world space and find their face and texture coordinates at once
+			__m128 sx = _mm_loadu_ps( &samples.mX[i] ), sy = _mm_loadu_ps( &samples.mY[i] ), sz = _mm_loadu_ps( &samples.mZ[i] );
+			__m128 x = _mm_add_ps( _mm_add_ps( _mm_mul_ps( sx, _mm_set1_ps( t[0] ) ), _mm_mul_ps( sy, _mm_set1_ps( b[0] ) ) ), _mm_mul_ps( sz, _mm_set1_ps( n[0] ) ) );
+			__m128 y = _mm_add_ps( _mm_add_ps( _mm_mul_ps( sx, _mm_set1_ps( t[1] ) ), _mm_mul_ps( sy, _mm_set1_ps( b[1] ) ) ), _mm_mul_ps( sz, _mm_set1_ps( n[1] ) ) );
+			__m128 z = _mm_add_ps( _mm_add_ps( _mm_mul_ps( sx, _mm_set1_ps( t[2] ) ), _mm_mul_ps( sy, _mm_set1_ps( b[2] ) ) ), _mm_mul_ps( sz, _mm_set1_ps( n[2] ) ) );
+			const __m128 signMask = _mm_set1_ps( -0.0f ), zero = _mm_setzero_ps();
+			__m128 ax = _mm_andnot_ps( signMask, x ), ay = _mm_andnot_ps( signMask, y ), az = _mm_andnot_ps( signMask, z );
+			__m128 isX = _mm_and_ps( _mm_cmpge_ps( ax, ay ), _mm_cmpge_ps( ax, az ) );
+			__m128 isY = _mm_andnot_ps( isX, _mm_cmpge_ps( ay, az ) );
+			__m128 isZ = _mm_andnot_ps( _mm_or_ps( isX, isY ), _mm_castsi128_ps( _mm_set1_epi32( -1 ) ) );
+			__m128 negX = _mm_cmplt_ps( x, zero ), negY = _mm_cmplt_ps( y, zero ), negZ = _mm_cmplt_ps( z, zero );
+			// +X: -z, -y  -X: z, -y  +Y: x, z  -Y: x, -z  +Z: x, -y  -Z: -x, -y
+			__m128 ma = _mm_or_ps( _mm_and_ps( isX, ax ), _mm_or_ps( _mm_and_ps( isY, ay ), _mm_and_ps( isZ, az ) ) );
+			__m128 scX = _mm_xor_ps( z, _mm_andnot_ps( negX, signMask ) );
+			__m128 scZ = _mm_xor_ps( x, _mm_and_ps( negZ, signMask ) );
+			__m128 sc = _mm_or_ps( _mm_and_ps( isX, scX ), _mm_or_ps( _mm_and_ps( isY, x ), _mm_and_ps( isZ, scZ ) ) );
+			__m128 tcY = _mm_xor_ps( z, _mm_and_ps( negY, signMask ) );
+			__m128 tcc = _mm_or_ps( _mm_and_ps( isY, tcY ), _mm_andnot_ps( isY, _mm_xor_ps( y, signMask ) ) );
+			__m128 invMa = _mm_div_ps( _mm_set1_ps( 0.5f ), ma );
+			_mm_storeu_ps( s, _mm_add_ps( _mm_mul_ps( sc, invMa ), _mm_set1_ps( 0.5f ) ) );
+			_mm_storeu_ps( tc, _mm_add_ps( _mm_mul_ps( tcc, invMa ), _mm_set1_ps( 0.5f ) ) );
+			__m128i face = _mm_or_si128( _mm_and_si128( _mm_castps_si128( isY ), _mm_set1_epi32( 2 ) ), _mm_and_si128( _mm_castps_si128( isZ ), _mm_set1_epi32( 4 ) ) );
+			__m128 negative = _mm_or_ps( _mm_and_ps( isX, negX ), _mm_or_ps( _mm_and_ps( isY, negY ), _mm_and_ps( isZ, negZ ) ) );
+			face = _mm_add_epi32( face, _mm_and_si128( _mm_castps_si128( negative ), _mm_set1_epi32( 1 ) ) );
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( faces ), face );
+#else
+			for( int j = 0; j < 4; ++j ) {
+				float x = samples.mX[i + j] * t[0] + samples.mY[i + j] * b[0] + samples.mZ[i + j] * n[0];
+				float y = samples.mX[i + j] * t[1] + samples.mY[i + j] * b[1] + samples.mZ[i + j] * n[1];
+				float z = samples.mX[i + j] * t[2] + samples.mY[i + j] * b[2] + samples.mZ[i + j] * n[2];
+				faces[j] = CubeMapData::getFaceCoords( x, y, z, &s[j], &tc[j] );
+			}
+#endif
+			for( int j = 0; j < 4; ++j ) {
+				float weight = samples.mWeight[i + j];
+				if( weight <= 0.0f ) continue;
+				float color[3];
+				source.sample( faces[j], s[j], tc[j], static_cast<int>( samples.mLod[i + j] + 0.5f ), color );
+				sum[0] += color[0] * weight; sum[1] += color[1] * weight; sum[2] += color[2] * weight;
+				weights += weight;
+			}
+		}
+		float invWeights = weights > 0.0f ? 1.0f / weights : 0.0f;
+		rgb[0] = sum[0] * invWeights; rgb[1] = sum[1] * invWeights; rgb[2] = sum[2] * invWeights;
+	}
+
+	//! Filters each face of \a target, the rows of a face are spread over the threads
+	static void process( const std::string &name, const CubeMapData &source, CubeMapData *target, const std::vector<SampleSet> &sampleSets, const Options &options )
+	{
+		static const char* faceNames[6] = { "+X", "-X", "+Y", "-Y", "+Z", "-Z" };
+		for( int face = 0; face < 6; ++face ) {
+			auto start = std::chrono::steady_clock::now();
+
+			// the first mip of the radiance is the source resampled
+			std::vector<std::pair<int,int>> rows;
+			for( int mip = 0; mip < target->getNumMips(); ++mip ) {
+				for( int y = 0; y < target->getSize( mip ); ++y ) {
+					rows.push_back( std::make_pair( mip, y ) );
+				}
+			}
+
+			std::atomic<size_t> nextRow( 0 );
+			auto worker = [&](){
+				size_t row;
+				while( ( row = nextRow++ ) < rows.size() ) {
+					int mip = rows[row].first, y = rows[row].second, size = target->getSize( mip );
+					float *data = target->getFace( face, mip ) + y * size * 3;
+					for( int x = 0; x < size; ++x ) {
+						float dir[3];
+						CubeMapData::getDirection( face, x, y, size, dir );
+						if( sampleSets[mip].size() ) {
+							filterTexel( source, sampleSets[mip], dir, data + x * 3 );
+						}
+						else {
+							float s, t;
+							int sourceFace = CubeMapData::getFaceCoords( dir[0], dir[1], dir[2], &s, &t );
+							int sourceMip = 0;
+							while( sourceMip < source.getNumMips() - 1 && source.getSize( sourceMip ) > size ) ++sourceMip;
+							source.sample( sourceFace, s, t, sourceMip, data + x * 3 );
+						}
+					}
+				}
+			};
+			std::vector<std::thread> threads;
+			for( size_t i = 1; i < options.mNumThreads; ++i ) {
+				threads.push_back( std::thread( worker ) );
+			}
+			worker();
+			for( auto &thread : threads ) thread.join();
+
+			if( options.mLog ) {
+				double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+				std::ostringstream message;
+				message << name << " face " << faceNames[face] << " (" << face + 1 << "/6): " << static_cast<int>( seconds * 1000.0 ) << "ms";
+				options.mLog( message.str() );
+			}
+		}
+	}
+};
@@ -0,0 +1,379 @@
+/*
+
+ HdrTarget
+
+ Copyright (c) 2015, Simon Geilfus
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Fbo.h"
+#include "cinder/gl/Query.h"
+#include "cinder/gl/Texture.h"
+#include "cinder/Camera.h"
+#include "cinder/Log.h"
+
+#include "LookupTable.h"
+
+//! RGBA16F framebuffer the scene is rendered to with linear colors. The samples are resolved and a single fullscreen pass applies the
+//! exposure, the filmic tonemapping, the gamma and an optional 3d color grading lookup table, once per pixel instead of once per shaded
+//! fragment. The scene shaders skip their own tonemapping when compiled with HDR_TARGET.
+//!
+//! The target is either multisampled or temporally anti-aliased. In the temporal mode it has a single sample per pixel: the projection
+//! is offset by a different sub-pixel jitter every frame, the scene shaders compiled with TEMPORAL write their screen space motion to
+//! a second RG16F attachment and a resolve pass blends each pixel with the history of the previous frames reprojected by that motion,
+//! clamped to the colors of its neighbourhood so disoccluded or changing pixels don't ghost.
+class HdrTarget {
+public:
+	enum AntiAliasing { MSAA_4, MSAA_8, MSAA_16, TAA, NUM_ANTI_ALIASING };
+
+	HdrTarget() : mAntiAliasing( MSAA_16 ), mSamples( 0 ), mFrame( 0 ), mHistoryValid( false ), mFeedback( 0.9f ) {}
+	//! Creates a target of \a size with the \a antiAliasing mode. \a postFormat holds the post pass shaders, see assets/Post.vert and
+	//! assets/Post.frag, and \a temporalFormat the shaders of the temporal resolve, see assets/TemporalAA.frag
+	HdrTarget( const ci::ivec2 &size, AntiAliasing antiAliasing, const ci::gl::GlslProg::Format &postFormat, const ci::gl::GlslProg::Format &temporalFormat )
+	: mAntiAliasing( antiAliasing ), mSamples( 0 ), mFrame( 0 ), mHistoryValid( false ), mFeedback( 0.9f )
+	{
+		auto gradingFormat = postFormat;
+		gradingFormat.define( "COLOR_GRADING" );
+		mPostProg		= ci::gl::GlslProg::create( postFormat );
+		mGradingProg	= ci::gl::GlslProg::create( gradingFormat );
+		mTemporalProg	= ci::gl::GlslProg::create( temporalFormat );
+		setSize( size );
+	}
+
+	//! Parses the --aa startup option, one of msaa4, msaa8, msaa16 or taa, and returns \a defaultAntiAliasing when it isn't there
+	static AntiAliasing parseAntiAliasing( const std::vector<std::string> &args, AntiAliasing defaultAntiAliasing = MSAA_16 )
+	{
+		static const char *options[NUM_ANTI_ALIASING] = { "msaa4", "msaa8", "msaa16", "taa" };
+		for( size_t i = 0; i + 1 < args.size(); ++i ) {
+			if( args[i] != "--aa" ) {
+				continue;
+			}
+			for( int mode = 0; mode < NUM_ANTI_ALIASING; ++mode ) {
+				if( args[i + 1] == options[mode] ) {
+					return static_cast<AntiAliasing>( mode );
+				}
+			}
+			CI_LOG_W( "Unknown anti-aliasing " << args[i + 1] << ", expected msaa4, msaa8, msaa16 or taa" );
+		}
+		return defaultAntiAliasing;
+	}
+	//! Returns whether the --compare-aa startup option is there, see AntiAliasingComparison
+	static bool parseComparison( const std::vector<std::string> &args )
+	{
+		return std::find( args.begin(), args.end(), "--compare-aa" ) != args.end();
+	}
+	//! Returns the number of samples per pixel of \a antiAliasing, before clamping to what the driver supports
+	static int getSamples( AntiAliasing antiAliasing )
+	{
+		static const int samples[NUM_ANTI_ALIASING] = { 4, 8, 16, 0 };
+		return samples[antiAliasing];
+	}
+	static const char* getName( AntiAliasing antiAliasing )
+	{
+		static const char *names[NUM_ANTI_ALIASING] = { "MSAA 4x", "MSAA 8x", "MSAA 16x", "TAA" };
+		return names[antiAliasing];
+	}
+
+	//! Switches the anti-aliasing mode and recreates the framebuffers. The scene shaders need the TEMPORAL define in the temporal mode only
+	void setAntiAliasing( AntiAliasing antiAliasing )
+	{
+		if( antiAliasing == mAntiAliasing ) {
+			return;
+		}
+		mAntiAliasing = antiAliasing;
+		if( mFbo ) {
+			ci::ivec2 size = mFbo->getSize();
+			mFbo.reset();
+			setSize( size );
+		}
+	}
+	AntiAliasing	getAntiAliasing() const { return mAntiAliasing; }
+	bool			isTemporal() const { return mAntiAliasing == TAA; }
+	//! Returns the actual number of samples per pixel of the target
+	int				getSamples() const { return mSamples; }
+
+	//! Recreates the framebuffers when the window size changes
+	void setSize( const ci::ivec2 &size )
+	{
+		if( mFbo && mFbo->getSize() == size ) {
+			return;
+		}
+		auto colorFormat = ci::gl::Texture2d::Format().internalFormat( GL_RGBA16F ).minFilter( GL_NEAREST ).magFilter( GL_NEAREST );
+		if( isTemporal() ) {
+			// the velocity is the second attachment, the history is sampled between texels when reprojected
+			auto velocityFormat	= ci::gl::Texture2d::Format().internalFormat( GL_RG16F ).minFilter( GL_NEAREST ).magFilter( GL_NEAREST );
+			auto historyFormat	= ci::gl::Texture2d::Format().internalFormat( GL_RGBA16F ).minFilter( GL_LINEAR ).magFilter( GL_LINEAR ).wrap( GL_CLAMP_TO_EDGE );
+			mSamples	= 0;
+			mFbo		= ci::gl::Fbo::create( size.x, size.y, ci::gl::Fbo::Format()
+							.attachment( GL_COLOR_ATTACHMENT0, ci::gl::Texture2d::create( size.x, size.y, colorFormat ) )
+							.attachment( GL_COLOR_ATTACHMENT1, ci::gl::Texture2d::create( size.x, size.y, velocityFormat ) ) );
+			for( auto &history : mHistory ) {
+				// cleared so the first frame doesn't blend with undefined values, even with a zero weight
+				history = ci::gl::Fbo::create( size.x, size.y, ci::gl::Fbo::Format().colorTexture( historyFormat ).disableDepth() );
+				ci::gl::ScopedFramebuffer scopedFbo( history );
+				ci::gl::clear( ci::ColorA::zero() );
+			}
+		}
+		else {
+			mSamples	= std::min<int>( getSamples( mAntiAliasing ), ci::gl::Fbo::getMaxSamples() );
+			mFbo		= ci::gl::Fbo::create( size.x, size.y, ci::gl::Fbo::Format().samples( mSamples ).colorTexture( colorFormat ) );
+			mHistory[0].reset();
+			mHistory[1].reset();
+		}
+		mHistoryValid = false;
+	}
+	//! Sets the lookup table applied after the gamma correction
+	void setLookupTable( const LookupTable &lut )
+	{
+		auto format		= ci::gl::Texture3d::Format().internalFormat( GL_RGB16F ).dataType( GL_FLOAT ).minFilter( GL_LINEAR ).magFilter( GL_LINEAR ).wrap( GL_CLAMP_TO_EDGE );
+		mLookupTable	= ci::gl::Texture3d::create( lut.getData(), GL_RGB, lut.getSize(), lut.getSize(), lut.getSize(), format );
+	}
+	//! Sets how much of the history is kept each frame in the temporal mode, higher values are smoother but slower to react
+	void setFeedback( float feedback ) { mFeedback = feedback; }
+	float getFeedback() const { return mFeedback; }
+
+	//! Returns the framebuffer the scene is rendered to
+	const ci::gl::FboRef&		getFbo() const { return mFbo; }
+	//! Returns the color grading lookup table
+	const ci::gl::Texture3dRef&	getLookupTable() const { return mLookupTable; }
+
+	//! Returns an estimate of the memory used by the target: the color and depth samples, the resolved color, the velocity and the history
+	size_t getFramebufferBytes() const
+	{
+		if( ! mFbo ) {
+			return 0;
+		}
+		size_t pixels	= static_cast<size_t>( mFbo->getWidth() ) * mFbo->getHeight();
+		size_t bytes	= pixels * std::max( 1, mSamples ) * ( 8 + 4 );
+		if( mSamples > 0 ) {
+			bytes += pixels * 8;
+		}
+		if( isTemporal() ) {
+			bytes += pixels * ( 4 + 2 * 8 );
+		}
+		return bytes;
+	}
+
+	//! Starts a frame seen from \a camera, in the temporal mode it picks the jitter of the frame and keeps the matrices of the previous one
+	void beginFrame( const ci::Camera &camera )
+	{
+		ci::mat4 viewProjection = camera.getProjectionMatrix() * camera.getViewMatrix();
+		mPrevViewProjection	= mHistoryValid ? mViewProjection : viewProjection;
+		mViewProjection		= viewProjection;
+		mProjection			= camera.getProjectionMatrix();
+		if( isTemporal() ) {
+			// the 8 first points of the Halton (2,3) sequence cover the pixel evenly and don't repeat visibly
+			int index	= static_cast<int>( mFrame % 8 ) + 1;
+			mJitter		= ci::vec2( halton( index, 2 ), halton( index, 3 ) ) - ci::vec2( 0.5f );
+			mProjection	= glm::translate( ci::vec3( mJitter * 2.0f / ci::vec2( mFbo->getSize() ), 0.0f ) ) * mProjection;
+		}
+		else {
+			mJitter		= ci::vec2( 0.0f );
+		}
+	}
+	//! Returns the projection of the frame, jittered in the temporal mode
+	const ci::mat4& getProjectionMatrix() const { return mProjection; }
+	//! Returns the view projection of the frame without the jitter, the velocity is computed without it so a static scene has none
+	const ci::mat4& getViewProjection() const { return mViewProjection; }
+	//! Returns the view projection of the previous frame without the jitter
+	const ci::mat4& getPrevViewProjection() const { return mPrevViewProjection; }
+	//! Returns the jitter of the frame in pixels
+	const ci::vec2& getJitter() const { return mJitter; }
+
+	//! Clears the color and the depth of the bound target, and its velocity to zero in the temporal mode
+	void clear( const ci::ColorA &color ) const
+	{
+		ci::gl::clear( color );
+		if( isTemporal() ) {
+			const GLfloat zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			glClearBufferfv( GL_COLOR, 1, zero );
+		}
+	}
+
+	//! Limits the drawing to the color attachment in the temporal mode, for the objects whose shaders don't write a velocity
+	class ScopedColorOnly {
+	public:
+		ScopedColorOnly( const HdrTarget &target ) : mEnabled( target.isTemporal() )
+		{
+			if( mEnabled ) {
+				glDrawBuffer( GL_COLOR_ATTACHMENT0 );
+			}
+		}
+		~ScopedColorOnly()
+		{
+			if( mEnabled ) {
+				const GLenum buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+				glDrawBuffers( 2, buffers );
+			}
+		}
+	protected:
+		bool mEnabled;
+	};
+
+	//! Resolves the framebuffer and draws it tonemapped to the current framebuffer, \a whiteLevel being the input level that maps to white.
+	//! In the temporal mode the frame is first blended with the history
+	void draw( float exposure, float gamma, float whiteLevel, bool colorGrading = true )
+	{
+		ci::gl::ScopedDepth scopedDepth( false );
+		ci::gl::ScopedBlend scopedBlend( false );
+		ci::gl::ScopedMatrices scopedMatrices;
+		ci::gl::setMatricesWindow( mFbo->getSize() );
+		const ci::Rectf rect( ci::vec2( 0.0f ), ci::vec2( mFbo->getSize() ) );
+
+		// getColorTexture resolves the samples first
+		ci::gl::Texture2dRef hdr = mFbo->getColorTexture();
+		if( isTemporal() ) {
+			const auto &target	= mHistory[mFrame % 2];
+			const auto &history	= mHistory[( mFrame + 1 ) % 2];
+			ci::gl::ScopedFramebuffer scopedFbo( target );
+			ci::gl::ScopedViewport scopedViewport( target->getSize() );
+			ci::gl::ScopedTextureBind scopedColor( hdr, 0 );
+			ci::gl::ScopedTextureBind scopedHistory( history->getColorTexture(), 1 );
+			ci::gl::ScopedTextureBind scopedVelocity( mFbo->getTexture2d( GL_COLOR_ATTACHMENT1 ), 2 );
+			ci::gl::ScopedGlslProg scopedProg( mTemporalProg );
+			mTemporalProg->uniform( "uColor", 0 );
+			mTemporalProg->uniform( "uHistory", 1 );
+			mTemporalProg->uniform( "uVelocity", 2 );
+			mTemporalProg->uniform( "uTexelSize", ci::vec2( 1.0f ) / ci::vec2( mFbo->getSize() ) );
+			mTemporalProg->uniform( "uFeedback", mHistoryValid ? mFeedback : 0.0f );
+			ci::gl::drawSolidRect( rect, ci::vec2( 0.0f, 1.0f ), ci::vec2( 1.0f, 0.0f ) );
+			hdr				= target->getColorTexture();
+			mHistoryValid	= true;
+		}
+		++mFrame;
+
+		bool grading	= colorGrading && mLookupTable;
+		auto prog		= grading ? mGradingProg : mPostProg;
+		ci::gl::ScopedTextureBind scopedHdr( hdr, 0 );
+		ci::gl::ScopedTextureBind scopedLut( GL_TEXTURE_3D, grading ? mLookupTable->getId() : 0, 1 );
+		ci::gl::ScopedGlslProg scopedProg( prog );
+		prog->uniform( "uHdr", 0 );
+		prog->uniform( "uExposure", exposure );
+		prog->uniform( "uGamma", gamma );
+		prog->uniform( "uWhiteLevel", whiteLevel );
+		if( grading ) {
+			prog->uniform( "uLookupTable", 1 );
+			prog->uniform( "uLookupTableSize", static_cast<float>( mLookupTable->getWidth() ) );
+		}
+		ci::gl::drawSolidRect( rect, ci::vec2( 0.0f, 1.0f ), ci::vec2( 1.0f, 0.0f ) );
+	}
+
+protected:
+	static float halton( int index, int base )
+	{
+		float f = 1.0f, result = 0.0f;
+		while( index > 0 ) {
+			f		/= base;
+			result	+= f * ( index % base );
+			index	/= base;
+		}
+		return result;
+	}
+
+	AntiAliasing			mAntiAliasing;
+	int						mSamples;
+	ci::gl::FboRef			mFbo, mHistory[2];
+	ci::gl::GlslProgRef		mPostProg, mGradingProg, mTemporalProg;
+	ci::gl::Texture3dRef	mLookupTable;
+
+	uint32_t				mFrame;
+	bool					mHistoryValid;
+	float					mFeedback;
+	ci::vec2				mJitter;
+	ci::mat4				mProjection, mViewProjection, mPrevViewProjection;
+};
+
+//! Renders the scene with each anti-aliasing mode of an HdrTarget in turn and reports the average gpu time of the frame and the memory
+//! of the target for each of them. Meant to be started with --compare-aa, in which case the window isn't multisampled so the modes only
+//! differ by the target.
+class AntiAliasingComparison {
+public:
+	struct Result {
+		HdrTarget::AntiAliasing	mAntiAliasing;
+		double					mGpuTime;
+		size_t					mBytes;
+	};
+
+	AntiAliasingComparison() : mTarget( nullptr ), mInitial( HdrTarget::MSAA_16 ), mMode( HdrTarget::NUM_ANTI_ALIASING ), mFrame( 0 ), mWarmupFrames( 0 ), mFrames( 0 ), mGpuTime( 0.0 ) {}
+	//! Measures \a frames frames of each mode of \a target after \a warmupFrames frames, then goes back to the mode \a target had
+	AntiAliasingComparison( HdrTarget *target, int warmupFrames = 60, int frames = 240 )
+	: mTarget( target ), mInitial( target->getAntiAliasing() ), mMode( 0 ), mFrame( 0 ), mWarmupFrames( warmupFrames ), mFrames( frames ), mGpuTime( 0.0 ),
+	mTimer( ci::gl::QueryTimeSwapped::create() )
+	{
+	}
+
+	bool isRunning() const { return mTarget && mMode < HdrTarget::NUM_ANTI_ALIASING; }
+
+	//! Call before rendering the frame. Returns true when the mode of the target changed and the scene shaders need to be recreated
+	bool begin()
+	{
+		if( ! mTarget ) {
+			return false;
+		}
+		auto antiAliasing	= isRunning() ? static_cast<HdrTarget::AntiAliasing>( mMode ) : mInitial;
+		bool changed		= antiAliasing != mTarget->getAntiAliasing();
+		mTarget->setAntiAliasing( antiAliasing );
+		if( isRunning() ) {
+			mTimer->begin();
+		}
+		return changed;
+	}
+	//! Call once the frame has been drawn, post pass included
+	void end()
+	{
+		if( ! isRunning() ) {
+			return;
+		}
+		mTimer->end();
+
+		// the swapped queries return the time of the previous frame, the warm up frames cover the switch between two modes
+		if( mFrame >= mWarmupFrames ) {
+			mGpuTime += mTimer->getElapsedMilliseconds();
+		}
+		if( ++mFrame == mWarmupFrames + mFrames ) {
+			Result result;
+			result.mAntiAliasing	= static_cast<HdrTarget::AntiAliasing>( mMode );
+			result.mGpuTime			= mGpuTime / mFrames;
+			result.mBytes			= mTarget->getFramebufferBytes();
+			mResults.push_back( result );
+			CI_LOG_I( HdrTarget::getName( result.mAntiAliasing ) << ": " << result.mGpuTime << "ms, " << result.mBytes / ( 1024.0 * 1024.0 ) << "MB" );
+
+			++mMode;
+			mFrame		= 0;
+			mGpuTime	= 0.0;
+		}
+	}
+
+	//! Returns the results of the modes measured so far
+	const std::vector<Result>& getResults() const { return mResults; }
+
+protected:
+	HdrTarget					*mTarget;
+	HdrTarget::AntiAliasing		mInitial;
+	int							mMode, mFrame, mWarmupFrames, mFrames;
+	double						mGpuTime;
+	ci::gl::QueryTimeSwappedRef	mTimer;
+	std::vector<Result>			mResults;
+};
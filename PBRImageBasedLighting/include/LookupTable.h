@@ -0,0 +1,508 @@
+/*
+
+ LookupTable
+
+ Copyright (c) 2015, Simon Geilfus
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "cinder/DataSource.h"
+#include "cinder/DataTarget.h"
+#include "cinder/Surface.h"
+#include "cinder/Exception.h"
+
+//! Exception for when a lookup table file can't be parsed
+class LookupTableExc : public ci::Exception {
+public:
+	LookupTableExc( const std::string &description ) : ci::Exception( description ) {}
+};
+
+//! Cpu side 3d color lookup table. Supports the .cube (Adobe/Resolve) and .3dl (Autodesk/Nuke) formats. The texels are stored as rgb float triplets with red changing fastest, then green, then blue, which is the layout expected by gl::Texture3d.
+class LookupTable {
+public:
+	//! Constructs an empty lookup table
+	LookupTable() : mSize( 0 ), mDomainMin( 0.0f ), mDomainMax( 1.0f ) {}
+	//! Constructs an identity lookup table of size³
+	explicit LookupTable( int size );
+	//! Constructs a lookup table from an horizontal strip of size.z slices of size.x * size.y pixels
+	LookupTable( const ci::Surface8u &strip, const ci::ivec3 &size );
+
+	//! Returns whether the extension of \a path is a lookup table format that can be parsed
+	static bool isSupported( const ci::fs::path &path );
+	//! Loads a .cube or a .3dl file depending on the extension of the source
+	static LookupTable load( const ci::DataSourceRef &source );
+	//! Parses a .cube file
+	static LookupTable loadCube( const ci::DataSourceRef &source );
+	//! Parses a .3dl file
+	static LookupTable load3dl( const ci::DataSourceRef &source );
+
+	//! Writes a .cube or a .3dl file depending on the extension of the target
+	void write( const ci::DataTargetRef &target ) const;
+	//! Writes a .cube file
+	void writeCube( const ci::DataTargetRef &target, const std::string &title = "" ) const;
+	//! Writes a .3dl file with the specified output bit depth
+	void write3dl( const ci::DataTargetRef &target, int outputBitDepth = 12 ) const;
+
+	//! Returns the number of texels on each side of the lookup table
+	int				getSize() const { return mSize; }
+	//! Returns the rgb triplets of the lookup table
+	const float*	getData() const { return mData.data(); }
+	//! Returns the rgb triplets of the lookup table
+	float*			getData() { return mData.data(); }
+	//! Returns the minimum input value of the table as specified by DOMAIN_MIN
+	float			getDomainMin() const { return mDomainMin; }
+	//! Returns the maximum input value of the table as specified by DOMAIN_MAX
+	float			getDomainMax() const { return mDomainMax; }
+
+protected:
+	// a [begin,end) range of characters in the source buffer
+	struct Range { const char *mBegin, *mEnd; };
+
+	void allocate( int size ) { mSize = size; mData.resize( static_cast<size_t>( size ) * size * size * 3 ); }
+
+	//! Parses the body of a table in parallel, \a blueMajor is used for .3dl files where blue changes fastest
+	void parseBody( const Range &body, bool blueMajor, float scale );
+
+	// locale independent parsing and formatting helpers
+	static bool			isNumberStart( char c ) { return ( c >= '0' && c <= '9' ) || c == '-' || c == '+' || c == '.'; }
+	static const char*	skipSpaces( const char *it, const char *end ) { while( it < end && ( *it == ' ' || *it == '\t' || *it == '\r' ) ) ++it; return it; }
+	static const char*	nextLine( const char *it, const char *end ) { const void *nl = memchr( it, '\n', end - it ); return nl ? static_cast<const char*>( nl ) + 1 : end; }
+	static const char*	parseFloat( const char *it, const char *end, float *result );
+	static void			appendFloat( std::string *str, float value );
+	static void			appendInt( std::string *str, int value );
+	static void			writeString( const ci::DataTargetRef &target, const std::string &str );
+
+	int					mSize;
+	float				mDomainMin, mDomainMax;
+	std::vector<float>	mData;
+};
+
+inline LookupTable::LookupTable( int size )
+: mDomainMin( 0.0f ), mDomainMax( 1.0f )
+{
+	allocate( size );
+	float *data = mData.data();
+	float norm = 1.0f / static_cast<float>( std::max( size - 1, 1 ) );
+	for( int b = 0; b < size; ++b ) {
+		for( int g = 0; g < size; ++g ) {
+			for( int r = 0; r < size; ++r ) {
+				*data++ = r * norm;
+				*data++ = g * norm;
+				*data++ = b * norm;
+			}
+		}
+	}
+}
+
+inline LookupTable::LookupTable( const ci::Surface8u &strip, const ci::ivec3 &size )
+: mDomainMin( 0.0f ), mDomainMax( 1.0f )
+{
+	// the strip layout is the one used by ColorGradingApp::createLut, red on x, green on y and blue on the slice index
+	allocate( size.z );
+	float *data = mData.data();
+	const int stride = static_cast<int>( strip.getRowBytes() );
+	const int inc = strip.getPixelInc();
+	const uint8_t r = strip.getChannelOrder().getRedOffset(), g = strip.getChannelOrder().getGreenOffset(), b = strip.getChannelOrder().getBlueOffset();
+	for( int i = 0; i < size.z; ++i ) {
+		for( int y = 0; y < size.y; ++y ) {
+			const uint8_t *line = strip.getData() + y * stride + i * size.x * inc;
+			for( int x = 0; x < size.x; ++x, line += inc ) {
+				*data++ = line[r] / 255.0f;
+				*data++ = line[g] / 255.0f;
+				*data++ = line[b] / 255.0f;
+			}
+		}
+	}
+}
+
+inline bool LookupTable::isSupported( const ci::fs::path &path )
+{
+	std::string ext = path.extension().string();
+	std::transform( ext.begin(), ext.end(), ext.begin(), ::tolower );
+	return ext == ".cube" || ext == ".3dl";
+}
+
+inline LookupTable LookupTable::load( const ci::DataSourceRef &source )
+{
+	std::string ext = source->getFilePathHint().extension().string();
+	std::transform( ext.begin(), ext.end(), ext.begin(), ::tolower );
+	if( ext == ".3dl" ) return load3dl( source );
+	return loadCube( source );
+}
+
+inline LookupTable LookupTable::loadCube( const ci::DataSourceRef &source )
+{
+	LookupTable lut;
+
+	// parse the header in place until we reach the first line of numbers
+	auto buffer = source->getBuffer();
+	const char *it	= static_cast<const char*>( buffer->getData() );
+	const char *end	= it + buffer->getSize();
+	while( it < end ) {
+		const char *line = skipSpaces( it, end );
+		if( line < end && isNumberStart( *line ) ) {
+			break;
+		}
+		const char *next = nextLine( line, end );
+		std::string keyword( line, std::find_if( line, next, []( char c ) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; } ) );
+		const char *args = skipSpaces( line + keyword.size(), next );
+		if( keyword == "LUT_3D_SIZE" ) {
+			float size;
+			parseFloat( args, next, &size );
+			// the format limits the tables to 256 texels per side, check before allocating so a corrupt header is a LookupTableExc
+			if( ! ( size >= 2.0f && size <= 256.0f ) ) {
+				throw LookupTableExc( "Invalid LUT_3D_SIZE in " + source->getFilePathHint().string() );
+			}
+			lut.allocate( static_cast<int>( size ) );
+		}
+		else if( keyword == "DOMAIN_MIN" ) {
+			parseFloat( args, next, &lut.mDomainMin );
+		}
+		else if( keyword == "DOMAIN_MAX" ) {
+			parseFloat( args, next, &lut.mDomainMax );
+		}
+		else if( keyword == "LUT_3D_INPUT_RANGE" ) {
+			parseFloat( skipSpaces( parseFloat( args, next, &lut.mDomainMin ), next ), next, &lut.mDomainMax );
+		}
+		else if( keyword == "LUT_1D_SIZE" ) {
+			throw LookupTableExc( "1d lookup tables are not supported" );
+		}
+		it = next;
+	}
+
+	if( lut.mSize < 2 ) {
+		throw LookupTableExc( "Missing or invalid LUT_3D_SIZE in " + source->getFilePathHint().string() );
+	}
+
+	lut.parseBody( { it, end }, false, 1.0f );
+	return lut;
+}
+
+inline LookupTable LookupTable::load3dl( const ci::DataSourceRef &source )
+{
+	LookupTable lut;
+
+	auto buffer = source->getBuffer();
+	const char *it	= static_cast<const char*>( buffer->getData() );
+	const char *end	= it + buffer->getSize();
+
+	// skip the comments and keywords until we reach the shaper line
+	int outputBitDepth = 0;
+	while( it < end ) {
+		const char *line = skipSpaces( it, end );
+		if( line < end && isNumberStart( *line ) ) {
+			break;
+		}
+		const char *next = nextLine( line, end );
+		// "Mesh inputDepth outputDepth" is written by Lustre and Flame
+		if( next - line > 4 && strncmp( line, "Mesh", 4 ) == 0 ) {
+			float input, output;
+			parseFloat( skipSpaces( parseFloat( skipSpaces( line + 4, next ), next, &input ), next ), next, &output );
+			outputBitDepth = static_cast<int>( output );
+		}
+		it = next;
+	}
+
+	// the shaper line gives the size of the table and the input range
+	const char *shaperEnd = nextLine( it, end );
+	int shaperCount = 0;
+	for( const char *s = skipSpaces( it, shaperEnd ); s < shaperEnd && isNumberStart( *s ); s = skipSpaces( s, shaperEnd ) ) {
+		float value;
+		s = parseFloat( s, shaperEnd, &value );
+		++shaperCount;
+	}
+	// some files don't have a shaper line, in that case the size is deduced from the number of lines
+	const char *body = it;
+	if( shaperCount > 3 ) {
+		// same limit as LUT_3D_SIZE, a corrupt shaper line would otherwise allocate its count cubed
+		if( shaperCount > 256 ) {
+			throw LookupTableExc( "Invalid shaper in " + source->getFilePathHint().string() );
+		}
+		lut.allocate( shaperCount );
+		body = shaperEnd;
+	}
+	else {
+		size_t lines = 0;
+		for( const char *l = it; l < end; l = nextLine( l, end ) ) {
+			const char *s = skipSpaces( l, end );
+			if( s < end && isNumberStart( *s ) ) ++lines;
+		}
+		int size = static_cast<int>( std::round( std::cbrt( static_cast<double>( lines ) ) ) );
+		lut.allocate( size );
+	}
+
+	if( lut.mSize < 2 ) {
+		throw LookupTableExc( "Invalid shaper in " + source->getFilePathHint().string() );
+	}
+
+	// when the output depth isn't specified, find the smallest common integer range that fits the values
+	float maxOutput = 0.0f;
+	if( outputBitDepth == 0 ) {
+		for( const char *s = body; s < end; ) {
+			s = skipSpaces( s, end );
+			if( s < end && isNumberStart( *s ) ) {
+				float value;
+				s = parseFloat( s, end, &value );
+				maxOutput = std::max( maxOutput, value );
+			}
+			else {
+				s = nextLine( s, end );
+			}
+		}
+		outputBitDepth = maxOutput <= 1023.0f ? 10 : ( maxOutput <= 4095.0f ? 12 : 16 );
+	}
+
+	lut.parseBody( { body, end }, true, 1.0f / static_cast<float>( ( 1 << outputBitDepth ) - 1 ) );
+	return lut;
+}
+
+inline void LookupTable::parseBody( const Range &body, bool blueMajor, float scale )
+{
+	const size_t numTexels = static_cast<size_t>( mSize ) * mSize * mSize;
+
+	// split the body in chunks aligned on line boundaries, small tables are parsed on the calling thread
+	size_t numChunks = numTexels < 32768 ? 1 : std::max( 1u, std::thread::hardware_concurrency() );
+	std::vector<Range> chunks;
+	const char *chunkBegin = body.mBegin;
+	for( size_t i = 0; i < numChunks && chunkBegin < body.mEnd; ++i ) {
+		const char *chunkEnd = ( i == numChunks - 1 ) ? body.mEnd : nextLine( std::min( body.mBegin + ( body.mEnd - body.mBegin ) * ( i + 1 ) / numChunks, body.mEnd ), body.mEnd );
+		chunkEnd = std::max( chunkEnd, chunkBegin );
+		chunks.push_back( { chunkBegin, chunkEnd } );
+		chunkBegin = chunkEnd;
+	}
+
+	// counts the texels in each chunk so every thread knows where to write without synchronization
+	auto countTexels = []( const Range &chunk ) {
+		size_t count = 0;
+		for( const char *l = chunk.mBegin; l < chunk.mEnd; l = nextLine( l, chunk.mEnd ) ) {
+			const char *s = skipSpaces( l, chunk.mEnd );
+			if( s < chunk.mEnd && isNumberStart( *s ) ) ++count;
+		}
+		return count;
+	};
+
+	std::vector<size_t> offsets( chunks.size() + 1, 0 );
+	if( chunks.size() == 1 ) {
+		offsets[1] = countTexels( chunks[0] );
+	}
+	else {
+		std::vector<std::thread> threads;
+		for( size_t i = 0; i < chunks.size(); ++i ) {
+			threads.emplace_back( [&, i]() { offsets[i + 1] = countTexels( chunks[i] ); } );
+		}
+		for( auto &thread : threads ) thread.join();
+	}
+	for( size_t i = 1; i < offsets.size(); ++i ) {
+		offsets[i] += offsets[i - 1];
+	}
+	if( offsets.back() != numTexels ) {
+		throw LookupTableExc( "Expected " + std::to_string( numTexels ) + " entries but found " + std::to_string( offsets.back() ) );
+	}
+
+	// convert each chunk into its final location
+	const int size = mSize;
+	float *data = mData.data();
+	auto parseChunk = [=]( const Range &chunk, size_t index ) {
+		for( const char *l = chunk.mBegin; l < chunk.mEnd; ) {
+			const char *next = nextLine( l, chunk.mEnd );
+			const char *s = skipSpaces( l, next );
+			if( s < next && isNumberStart( *s ) ) {
+				size_t dst = index;
+				if( blueMajor ) {
+					size_t r = index / ( size * size ), g = ( index / size ) % size, b = index % size;
+					dst = ( b * size + g ) * size + r;
+				}
+				float *texel = data + dst * 3;
+				s = skipSpaces( parseFloat( s, next, &texel[0] ), next );
+				s = skipSpaces( parseFloat( s, next, &texel[1] ), next );
+				parseFloat( s, next, &texel[2] );
+				texel[0] *= scale;
+				texel[1] *= scale;
+				texel[2] *= scale;
+				++index;
+			}
+			l = next;
+		}
+	};
+
+	if( chunks.size() == 1 ) {
+		parseChunk( chunks[0], 0 );
+	}
+	else {
+		std::vector<std::thread> threads;
+		for( size_t i = 0; i < chunks.size(); ++i ) {
+			threads.emplace_back( parseChunk, chunks[i], offsets[i] );
+		}
+		for( auto &thread : threads ) thread.join();
+	}
+}
+
+inline const char* LookupTable::parseFloat( const char *it, const char *end, float *result )
+{
+	// strtod depends on the current locale (decimal comma) and is fairly slow, this
+	// accumulates the digits in an integer and scales it once by a power of ten
+	static const double sPowers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	bool negative = false;
+	if( it < end && ( *it == '-' || *it == '+' ) ) {
+		negative = *it++ == '-';
+	}
+
+	uint64_t mantissa = 0;
+	int exponent = 0, digits = 0;
+	for( ; it < end && *it >= '0' && *it <= '9'; ++it ) {
+		if( digits < 19 ) { mantissa = mantissa * 10 + ( *it - '0' ); if( mantissa ) ++digits; }
+		else ++exponent;
+	}
+	if( it < end && *it == '.' ) {
+		for( ++it; it < end && *it >= '0' && *it <= '9'; ++it ) {
+			if( digits < 19 ) { mantissa = mantissa * 10 + ( *it - '0' ); --exponent; if( mantissa ) ++digits; }
+		}
+	}
+	if( it < end && ( *it == 'e' || *it == 'E' ) ) {
+		const char *e = it + 1;
+		bool negativeExp = false;
+		if( e < end && ( *e == '-' || *e == '+' ) ) {
+			negativeExp = *e++ == '-';
+		}
+		if( e < end && *e >= '0' && *e <= '9' ) {
+			int exp = 0;
+			for( ; e < end && *e >= '0' && *e <= '9'; ++e ) {
+				exp = std::min( exp * 10 + ( *e - '0' ), 1000 );
+			}
+			exponent += negativeExp ? -exp : exp;
+			it = e;
+		}
+	}
+
+	double value = static_cast<double>( mantissa );
+	while( exponent > 22 ) { value *= 1e22; exponent -= 22; }
+	while( exponent < -22 ) { value /= 1e22; exponent += 22; }
+	value = exponent >= 0 ? value * sPowers[exponent] : value / sPowers[-exponent];
+
+	*result = static_cast<float>( negative ? -value : value );
+	return it;
+}
+
+inline void LookupTable::appendInt( std::string *str, int value )
+{
+	char buffer[16];
+	char *it = buffer + sizeof( buffer );
+	unsigned int v = static_cast<unsigned int>( value < 0 ? -value : value );
+	do { *--it = static_cast<char>( '0' + v % 10 ); v /= 10; } while( v );
+	if( value < 0 ) *--it = '-';
+	str->append( it, buffer + sizeof( buffer ) );
+}
+
+inline void LookupTable::appendFloat( std::string *str, float value )
+{
+	// fixed notation with 6 decimals, which is what most grading tools write
+	int64_t fixed = static_cast<int64_t>( std::llround( static_cast<double>( value ) * 1e6 ) );
+	if( fixed < 0 ) {
+		str->push_back( '-' );
+		fixed = -fixed;
+	}
+	char buffer[32];
+	char *it = buffer + sizeof( buffer );
+	for( int i = 0; i < 6; ++i ) { *--it = static_cast<char>( '0' + fixed % 10 ); fixed /= 10; }
+	*--it = '.';
+	do { *--it = static_cast<char>( '0' + fixed % 10 ); fixed /= 10; } while( fixed );
+	str->append( it, buffer + sizeof( buffer ) );
+}
+
+inline void LookupTable::writeString( const ci::DataTargetRef &target, const std::string &str )
+{
+	target->getStream()->writeData( str.data(), str.size() );
+}
+
+inline void LookupTable::write( const ci::DataTargetRef &target ) const
+{
+	std::string ext = target->getFilePathHint().extension().string();
+	std::transform( ext.begin(), ext.end(), ext.begin(), ::tolower );
+	if( ext == ".3dl" ) write3dl( target );
+	else writeCube( target, target->getFilePathHint().stem().string() );
+}
+
+inline void LookupTable::writeCube( const ci::DataTargetRef &target, const std::string &title ) const
+{
+	std::string str;
+	str.reserve( 64 + mData.size() * 10 );
+
+	if( ! title.empty() ) {
+		str += "TITLE \"" + title + "\"\n";
+	}
+	str += "LUT_3D_SIZE ";
+	appendInt( &str, mSize );
+	if( mDomainMin != 0.0f || mDomainMax != 1.0f ) {
+		for( int i = 0; i < 2; ++i ) {
+			float v = i ? mDomainMax : mDomainMin;
+			str += i ? "\nDOMAIN_MAX " : "\nDOMAIN_MIN ";
+			appendFloat( &str, v ); str += ' ';
+			appendFloat( &str, v ); str += ' ';
+			appendFloat( &str, v );
+		}
+	}
+	str += "\n\n";
+
+	// red changes fastest, same as our own layout
+	for( size_t i = 0; i < mData.size(); i += 3 ) {
+		appendFloat( &str, mData[i] ); str += ' ';
+		appendFloat( &str, mData[i+1] ); str += ' ';
+		appendFloat( &str, mData[i+2] ); str += '\n';
+	}
+
+	writeString( target, str );
+}
+
+inline void LookupTable::write3dl( const ci::DataTargetRef &target, int outputBitDepth ) const
+{
+	std::string str;
+	str.reserve( 64 + mData.size() * 6 );
+
+	// the shaper line maps the table entries to a 10 bits input range
+	for( int i = 0; i < mSize; ++i ) {
+		appendInt( &str, static_cast<int>( std::round( i * 1023.0f / ( mSize - 1 ) ) ) );
+		str += i < mSize - 1 ? ' ' : '\n';
+	}
+
+	// blue changes fastest in .3dl files
+	const float maxOutput = static_cast<float>( ( 1 << outputBitDepth ) - 1 );
+	for( int r = 0; r < mSize; ++r ) {
+		for( int g = 0; g < mSize; ++g ) {
+			for( int b = 0; b < mSize; ++b ) {
+				const float *texel = &mData[( ( static_cast<size_t>( b ) * mSize + g ) * mSize + r ) * 3];
+				for( int c = 0; c < 3; ++c ) {
+					appendInt( &str, static_cast<int>( std::round( std::min( std::max( texel[c], 0.0f ), 1.0f ) * maxOutput ) ) );
+					str += c < 2 ? ' ' : '\n';
+				}
+			}
+		}
+	}
+
+	writeString( target, str );
+}
@@ -0,0 +1,141 @@
+/*
+
+ SphericalHarmonics
+
+ Copyright (c) 2015, Simon Geilfus
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+
+#include "CubeMapPrefilter.h"
+
+//! Nine RGB coefficients of the order 2 spherical harmonics projection of an environment. Enough to reconstruct its irradiance within a few percents ( Ramamoorthi and Hanrahan, "An Efficient Representation for Irradiance Environment Maps" )
+class SphericalHarmonics {
+public:
+	SphericalHarmonics() { std::fill( mCoefficients, mCoefficients + 27, 0.0f ); }
+
+	//! Projects a mip of \a cubeMap, each texel weighted by its solid angle. The faces are split in bands of rows accumulated by \a numThreads threads
+	static SphericalHarmonics project( const CubeMapData &cubeMap, int mip = 0, size_t numThreads = std::max( 1u, std::thread::hardware_concurrency() ) )
+	{
+		const int size		= cubeMap.getSize( mip );
+		const int numRows	= 6 * size;
+		numThreads			= std::max<size_t>( 1, std::min<size_t>( numThreads, numRows ) );
+
+		// each thread accumulates its own partial sums, they are added once all the threads are done
+		std::vector<SphericalHarmonics> partials( numThreads );
+		auto worker = [&]( size_t index ) {
+			float *sums = partials[index].mCoefficients;
+			for( int row = static_cast<int>( index * numRows / numThreads ); row < static_cast<int>( ( index + 1 ) * numRows / numThreads ); ++row ) {
+				int face = row / size, y = row % size;
+				const float *data = cubeMap.getFace( face, mip ) + y * size * 3;
+				for( int x = 0; x < size; ++x ) {
+					float dir[3], basis[9];
+					CubeMapData::getDirection( face, x, y, size, dir );
+					evaluateBasis( dir, basis );
+					float weight = getSolidAngle( x, y, size );
+					for( int i = 0; i < 9; ++i ) {
+						for( int c = 0; c < 3; ++c ) {
+							sums[i * 3 + c] += data[x * 3 + c] * basis[i] * weight;
+						}
+					}
+				}
+			}
+		};
+		std::vector<std::thread> threads;
+		for( size_t i = 1; i < numThreads; ++i ) {
+			threads.push_back( std::thread( worker, i ) );
+		}
+		worker( 0 );
+		for( auto &thread : threads ) thread.join();
+
+		SphericalHarmonics sh;
+		for( const auto &partial : partials ) {
+			for( int i = 0; i < 27; ++i ) sh.mCoefficients[i] += partial.mCoefficients[i];
+		}
+		return sh;
+	}
+
+	//! Returns the coefficients convolved with the clamped cosine lobe and divided by pi. Evaluating them gives the same values as the *Irradiance.dds cubemaps
+	SphericalHarmonics getIrradiance() const
+	{
+		static const float bands[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+		SphericalHarmonics irradiance;
+		for( int i = 0; i < 27; ++i ) irradiance.mCoefficients[i] = mCoefficients[i] * bands[i / 3];
+		return irradiance;
+	}
+
+	//! Reconstructs the function in the normalized direction \a dir
+	void evaluate( const float *dir, float *rgb ) const
+	{
+		float basis[9];
+		evaluateBasis( dir, basis );
+		rgb[0] = rgb[1] = rgb[2] = 0.0f;
+		for( int i = 0; i < 9; ++i ) {
+			for( int c = 0; c < 3; ++c ) rgb[c] += mCoefficients[i * 3 + c] * basis[i];
+		}
+	}
+
+	//! Writes the coefficients as 9 vec4, the std140 layout of the "SphericalHarmonics" uniform block of PBR.frag
+	void getStd140( float *vec4s ) const
+	{
+		for( int i = 0; i < 9; ++i ) {
+			for( int c = 0; c < 3; ++c ) vec4s[i * 4 + c] = mCoefficients[i * 3 + c];
+			vec4s[i * 4 + 3] = 0.0f;
+		}
+	}
+
+	const float* getCoefficient( int index ) const { return mCoefficients + index * 3; }
+
+	//! The 9 real spherical harmonics basis functions, in the order used by the shaders
+	static void evaluateBasis( const float *dir, float *basis )
+	{
+		const float x = dir[0], y = dir[1], z = dir[2];
+		basis[0] = 0.282095f;
+		basis[1] = 0.488603f * y;
+		basis[2] = 0.488603f * z;
+		basis[3] = 0.488603f * x;
+		basis[4] = 1.092548f * x * y;
+		basis[5] = 1.092548f * y * z;
+		basis[6] = 0.315392f * ( 3.0f * z * z - 1.0f );
+		basis[7] = 1.092548f * x * z;
+		basis[8] = 0.546274f * ( x * x - y * y );
+	}
+
+	//! Returns the solid angle covered by a texel of a cubemap face
+	static float getSolidAngle( int x, int y, int size )
+	{
+		float invSize	= 1.0f / size;
+		float x0		= ( 2.0f * x ) * invSize - 1.0f, x1 = x0 + 2.0f * invSize;
+		float y0		= ( 2.0f * y ) * invSize - 1.0f, y1 = y0 + 2.0f * invSize;
+		return getAreaElement( x0, y0 ) - getAreaElement( x0, y1 ) - getAreaElement( x1, y0 ) + getAreaElement( x1, y1 );
+	}
+
+protected:
+	static float getAreaElement( float x, float y )
+	{
+		return std::atan2( x * y, std::sqrt( x * x + y * y + 1.0f ) );
+	}
+
+	float mCoefficients[27];
+};
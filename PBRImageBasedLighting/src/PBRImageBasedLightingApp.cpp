@@ -1,10 +1,15 @@
 #include "cinder/app/App.h"
 #include "cinder/app/RendererGl.h"
 #include "cinder/gl/gl.h"
+#include "cinder/gl/Query.h"
 #include "cinder/CameraUi.h"
 #include "cinder/Log.h"
 
 #include "CinderImGui.h"
+#include "CubeMapCache.h"
+#include "BrdfLut.h"
+#include "MeshCache.h"
+#include "HdrTarget.h"
 
 using namespace ci;
 using namespace ci::app;
@@ -17,16 +22,67 @@ public:
 	void draw() override;
 	void resize() override;
 	
+	void setModel( int primitive, int subdivisions );
+	void updateModel();
+	void createBatches();
+	void createLodBatches();
+	void loadEnvironment( const string &name );
+	void updateEnvironment();
+	void updateInstances();
+	void renderScene();
+	void renderOverdraw();
+	
+	//! the models are drawn with the same vertex shader in each pass
+	enum Pass { PASS_SHADING, PASS_DEPTH, PASS_OVERDRAW, NUM_PASSES };
+	void renderModels( Pass pass );
+	void renderModelPasses( Pass pass );
+	
+	//! per-model data of the instanced grid
+	struct ModelInstance {
+		mat4				mModelMatrix;
+		vec2				mMaterial; // roughness and metallic before being scaled by the ui values
+	};
+	//! grid cell, level and view depth of a model, in drawing order
+	struct ModelDraw {
+		int					mX, mZ, mLod;
+		float				mDepth;
+	};
+	
 	CameraPersp				mCamera;
 	CameraUi				mCameraUi;
-	gl::BatchRef			mModelBatch, mSkyBoxBatch;
+	MeshCache::Lods			mModelLods;
+	gl::GlslProgRef			mModelShaders[NUM_PASSES], mInstancedModelShaders[NUM_PASSES];
+	vector<gl::BatchRef>	mModelBatches[NUM_PASSES], mInstancedModelBatches[NUM_PASSES];
+	gl::BatchRef			mSkyBoxBatch;
+	vector<gl::VboRef>		mInstanceVbos;
+	vector<ModelDraw>		mModelDraws;
+	vector<int>				mInstanceOrder, mNumLodInstances;
+	std::unique_ptr<MeshCache>	mMeshCache;
+	uint64_t				mModelKey;
+	int						mPrimitive, mSubdivisions;
 	gl::TextureCubeMapRef	mIrradianceMap, mRadianceMap;
+	gl::UboRef				mSphericalHarmonicsUbo;
+	gl::Texture2dRef		mBrdfLut;
+	CubeMapCache			mCubeMapCache;
+	string					mEnvironment;
+	fs::path				mRadiancePath, mIrradiancePath;
+	bool					mEnvironmentPending;
 	
-	int						mGridSize;
-	bool					mShowUi, mRotateModel;
-	float					mRoughness, mMetallic, mSpecular;
+	int						mGridSize, mNumInstances, mNumTriangles, mNumFullTriangles;
+	bool					mShowUi, mRotateModel, mInstancing, mSphericalHarmonics, mCompressed, mIntegratedBrdf, mLod;
+	float					mRoughness, mMetallic, mSpecular, mLodPixels;
 	Color					mBaseColor;
-	float					mGamma, mExposure, mTime;
+	float					mGamma, mExposure, mTime, mPrevTime, mModelsTime;
+	gl::QueryTimeSwappedRef	mModelsTimer;
+	
+	bool					mSortModels, mDepthPrepass, mShowOverdraw;
+	gl::QueryRef			mSamplesQueries[2];
+	int						mSamplesQuery;
+	double					mShadedSamples, mShadedPerPixel;
+	
+	HdrTarget				mHdrTarget;
+	bool					mHdr, mColorGrading;
+	AntiAliasingComparison	mComparison;
 };
 
 void PBRImageBasedLightingApp::setup()
@@ -38,19 +94,43 @@ void PBRImageBasedLightingApp::setup()
 	mCamera		= CameraPersp( getWindowWidth(), getWindowHeight(), 50.0f, 1.0f, 1000.0f ).calcFraming( Sphere( vec3( 0.0f ), 12.0f ) );
 	mCameraUi	= CameraUi( &mCamera, getWindow(), -1 );
 	
-	// prepare ou rendering objects and shaders
-	auto pbrShader		= gl::GlslProg::create( gl::GlslProg::Format().vertex( loadAsset( "PBR.vert" ) ).fragment( loadAsset( "PBR.frag" ) ) );
-	auto skyBoxShader	= gl::GlslProg::create( gl::GlslProg::Format().vertex( loadAsset( "SkyBox.vert" ) ).fragment( loadAsset( "SkyBox.frag" ) ) );
-	mModelBatch			= gl::Batch::create( geom::Sphere().subdivisions( 32 ), pbrShader );
-	mSkyBoxBatch		= gl::Batch::create( geom::Cube().size( vec3( 500 ) ), skyBoxShader );
+	// the hdr mode renders the scene with linear colors to a multisampled float target,
+	// a single post pass then does the tone-mapping, the gamma and the color grading.
+	// --aa taa replaces the samples with a jittered single sample target resolved with
+	// the reprojected history, and --compare-aa measures all the modes one after the other
+	auto antiAliasing	= HdrTarget::parseAntiAliasing( getCommandLineArgs() );
+	bool comparison		= HdrTarget::parseComparison( getCommandLineArgs() );
+	mHdr				= antiAliasing == HdrTarget::TAA || comparison;
+	mColorGrading		= true;
+	mHdrTarget			= HdrTarget( toPixels( getWindowSize() ), antiAliasing, gl::GlslProg::Format().vertex( loadAsset( "Post.vert" ) ).fragment( loadAsset( "Post.frag" ) ), gl::GlslProg::Format().vertex( loadAsset( "Post.vert" ) ).fragment( loadAsset( "TemporalAA.frag" ) ) );
+	mHdrTarget.setLookupTable( LookupTable( Surface8u( loadImage( loadAsset( "colorGrading.png" ) ) ), ivec3( 32 ) ) );
+	if( comparison ) {
+		mComparison		= AntiAliasingComparison( &mHdrTarget );
+	}
+	
+	// the models come with simplified levels of detail that the ones far from the camera switch to
+	mMeshCache.reset( new MeshCache( MeshCache::Options().lods( 4 ) ) );
+	setModel( 0, 32 );
+	
+	// the spherical harmonics irradiance is read from a uniform block instead of a cubemap
+	mSphericalHarmonics		= true;
+	mSphericalHarmonicsUbo	= gl::Ubo::create( 9 * sizeof( vec4 ), nullptr, GL_DYNAMIC_DRAW );
+	// the environment BRDF uses the analytic approximation until the integrated table is enabled in the ui
+	mIntegratedBrdf			= false;
+	createBatches();
 	
-	// load the prefiltered IBL Cubemaps
-	auto cubeMapFormat	= gl::TextureCubeMap::Format().mipmap().internalFormat( GL_RGB16F ).minFilter( GL_LINEAR_MIPMAP_LINEAR ).magFilter( GL_LINEAR );
-	mIrradianceMap		= gl::TextureCubeMap::createFromDds( loadAsset( "WellsIrradiance.dds" ), cubeMapFormat );
-	mRadianceMap		= gl::TextureCubeMap::createFromDds( loadAsset( "WellsRadiance.dds" ), cubeMapFormat );
+	// load the prefiltered IBL Cubemaps, compressed by tools/Compress
+	mCompressed				= true;
+	loadEnvironment( "Wells" );
 	
 	// set the initial parameters and setup the ui
 	mGridSize			= 5;
+	mNumInstances		= 0;
+	mNumTriangles		= 0;
+	mNumFullTriangles	= 0;
+	mInstancing			= true;
+	mLod				= true;
+	mLodPixels			= 1.0f;
 	mRoughness			= 1.0f;
 	mMetallic			= 1.0f;
 	mSpecular			= 1.0f;
@@ -58,7 +138,21 @@ void PBRImageBasedLightingApp::setup()
 	mGamma				= 2.2f;
 	mExposure			= 4.0f;
 	mTime				= 0.0f;
+	mPrevTime			= 0.0f;
+	mModelsTime			= 0.0f;
+	mModelsTimer		= gl::QueryTimeSwapped::create();
 	mShowUi				= false;
+	
+	// the models are sorted front to back and can be preceded by a depth only pass so each sample
+	// is only shaded once, the shaded samples are counted with occlusion queries read a frame late
+	mSortModels			= true;
+	mDepthPrepass		= false;
+	mShowOverdraw		= false;
+	mSamplesQueries[0]	= gl::Query::create( GL_SAMPLES_PASSED );
+	mSamplesQueries[1]	= gl::Query::create( GL_SAMPLES_PASSED );
+	mSamplesQuery		= 0;
+	mShadedSamples		= 0.0;
+	mShadedPerPixel		= 0.0;
 	mRotateModel		= false;
 	
 	// prepare ui
@@ -71,6 +165,7 @@ void PBRImageBasedLightingApp::setup()
 void PBRImageBasedLightingApp::resize()
 {
 	mCamera.setAspectRatio( getWindowAspectRatio() );
+	mHdrTarget.setSize( toPixels( getWindowSize() ) );
 }
 
 void PBRImageBasedLightingApp::update()
@@ -85,55 +180,374 @@ void PBRImageBasedLightingApp::update()
 			ui::ColorEdit3( "Color", &mBaseColor[0] );
 		}
 		if( ui::CollapsingHeader( "Model", nullptr, true, true ) ) {
-			static int currentPrimitive = 0;
 			const static vector<string> primitives = { "Sphere", "Teapot", "Cube", "Capsule", "Torus", "TorusKnot" };
-			if( ui::Combo( "Primitive", &currentPrimitive, primitives ) ) {
-				switch ( currentPrimitive ) {
-					case 0: mModelBatch->replaceVboMesh( gl::VboMesh::create( geom::Sphere().subdivisions( 32 ) ) ); break;
-					case 1: mModelBatch->replaceVboMesh( gl::VboMesh::create( geom::Teapot().subdivisions( 16 ) >> geom::Transform( glm::scale( vec3( 1.5f ) ) ) ) ); break;
-					case 2: mModelBatch->replaceVboMesh( gl::VboMesh::create( geom::Cube() ) ); break;
-					case 3: mModelBatch->replaceVboMesh( gl::VboMesh::create( geom::Capsule().subdivisionsAxis( 32 ).subdivisionsHeight( 32 ) ) ); break;
-					case 4: mModelBatch->replaceVboMesh( gl::VboMesh::create( geom::Torus().subdivisionsAxis( 32 ).subdivisionsHeight( 32 ) ) ); break;
-					case 5: mModelBatch->replaceVboMesh( gl::VboMesh::create( geom::TorusKnot().subdivisionsAxis( 128 ).subdivisionsHeight( 128 ).scale( vec3( 0.5f ) ) ) ); break;
-				}
+			const static int defaultSubdivisions[] = { 32, 16, 1, 32, 32, 128 };
+			int primitive = mPrimitive, subdivisions = mSubdivisions;
+			if( ui::Combo( "Primitive", &primitive, primitives ) ) {
+				subdivisions = defaultSubdivisions[primitive];
+			}
+			ui::DragInt( "Subdivisions", &subdivisions, 0.5f, 1, 256 );
+			if( primitive != mPrimitive || subdivisions != mSubdivisions ) {
+				setModel( primitive, subdivisions );
 			}
 			ui::Checkbox( "Rotate", &mRotateModel );
+			ui::Checkbox( "LOD", &mLod );
+			ui::DragFloat( "LOD Error (px)", &mLodPixels, 0.05f, 0.0f, 16.0f );
+			ui::Text( "%d lods, %d / %d triangles", (int) mModelLods.mMeshes.size(), mNumTriangles, mNumFullTriangles );
+			ui::Text( "%d meshes cached, %.1f MB", (int) mMeshCache->getNumEntries(), mMeshCache->getResidentBytes() / ( 1024.0f * 1024.0f ) );
 		}
 		if( ui::CollapsingHeader( "Environment", nullptr, true, true ) ) {
 			static int currentEnvironment = 1;
 			const static vector<string> environments = { "Bolonga", "Wells", "Cathedral" };
 			if( ui::Combo( "###Environments", &currentEnvironment, environments ) ) {
-				auto cubeMapFormat	= gl::TextureCubeMap::Format().mipmap().internalFormat( GL_RGB16F ).minFilter( GL_LINEAR_MIPMAP_LINEAR ).magFilter( GL_LINEAR );
-				mIrradianceMap		= gl::TextureCubeMap::createFromDds( loadAsset( environments[currentEnvironment] + "Irradiance.dds" ), cubeMapFormat );
-				mRadianceMap		= gl::TextureCubeMap::createFromDds( loadAsset( environments[currentEnvironment] + "Radiance.dds" ), cubeMapFormat );
+				loadEnvironment( environments[currentEnvironment] );
+			}
+			if( ui::Checkbox( "Spherical Harmonics", &mSphericalHarmonics ) ) {
+				loadEnvironment( mEnvironment );
+			}
+			if( ui::Checkbox( "BC6H", &mCompressed ) ) {
+				loadEnvironment( mEnvironment );
 			}
+			ui::Text( "%d cubemaps cached, %.1f MB", (int) mCubeMapCache.getNumEntries(), mCubeMapCache.getResidentBytes() / ( 1024.0f * 1024.0f ) );
 		}
 		if( ui::CollapsingHeader( "Rendering", nullptr, true, true ) ) {
 			ui::DragFloat( "Gamma", &mGamma, 0.01f, 0.0f );
 			ui::DragFloat( "Exposure", &mExposure, 0.01f, 0.0f );
+			ui::DragInt( "Grid Size", &mGridSize, 0.1f, 1, 100 );
+			ui::Checkbox( "Instancing", &mInstancing );
+			if( ui::Checkbox( "BRDF LUT", &mIntegratedBrdf ) ) {
+				createBatches();
+			}
+			if( ! mHdrTarget.isTemporal() && ! mComparison.isRunning() && ui::Checkbox( "HDR Target", &mHdr ) ) {
+				createBatches();
+			}
+			if( mHdr ) {
+				ui::Checkbox( "Color Grading", &mColorGrading );
+				ui::Text( "%s target, %.1f MB", HdrTarget::getName( mHdrTarget.getAntiAliasing() ), mHdrTarget.getFramebufferBytes() / ( 1024.0f * 1024.0f ) );
+			}
+			if( mHdrTarget.isTemporal() ) {
+				float feedback = mHdrTarget.getFeedback();
+				if( ui::DragFloat( "History Feedback", &feedback, 0.005f, 0.0f, 0.98f ) ) {
+					mHdrTarget.setFeedback( feedback );
+				}
+			}
+			ui::Text( "%d models, %d draw calls", mNumInstances, mInstancing ? (int) count_if( mNumLodInstances.begin(), mNumLodInstances.end(), []( int n ) { return n > 0; } ) : mNumInstances );
+			ui::Text( "%.3f ms gpu", mModelsTime );
+			for( const auto &result : mComparison.getResults() ) {
+				ui::Text( "%s: %.2f ms gpu, %.1f MB", HdrTarget::getName( result.mAntiAliasing ), result.mGpuTime, result.mBytes / ( 1024.0f * 1024.0f ) );
+			}
+		}
+		if( ui::CollapsingHeader( "Overdraw", nullptr, true, true ) ) {
+			ui::Checkbox( "Front to Back", &mSortModels );
+			ui::Checkbox( "Depth Pre-Pass", &mDepthPrepass );
+			ui::Checkbox( "Show Overdraw", &mShowOverdraw );
+			ui::Text( "%.2fM samples shaded, %.2f per pixel", mShadedSamples / 1000000.0, mShadedPerPixel );
 		}
 	}
 	
+	// the velocity of the models needs their rotation of the previous frame
+	mPrevTime = mTime;
 	if( mRotateModel ){
 		mTime += 0.025f;
 	}
+	
+	// stream the environment cubemaps and the model and switch when ready
+	updateEnvironment();
+	updateModel();
+	
+	// pick the level of each model for the current camera
+	updateInstances();
+}
+
+void PBRImageBasedLightingApp::setModel( int primitive, int subdivisions )
+{
+	// the geometry is built by the cache thread, the current model stays on screen until it is uploaded.
+	// the key holds the primitive and its parameters, a model generated before is available right away
+	mPrimitive		= primitive;
+	mSubdivisions	= subdivisions;
+	mModelKey		= MeshCache::getKey( "Primitive", primitive, subdivisions );
+	mMeshCache->request( mModelKey, [primitive, subdivisions]() -> TriMeshRef {
+		switch( primitive ) {
+			case 0: return TriMesh::create( geom::Sphere().subdivisions( subdivisions ) );
+			case 1: return TriMesh::create( geom::Teapot().subdivisions( subdivisions ) >> geom::Transform( glm::scale( vec3( 1.5f ) ) ) );
+			case 2: return TriMesh::create( geom::Cube().subdivisions( subdivisions ) );
+			case 3: return TriMesh::create( geom::Capsule().subdivisionsAxis( subdivisions ).subdivisionsHeight( subdivisions ) );
+			case 4: return TriMesh::create( geom::Torus().subdivisionsAxis( subdivisions ).subdivisionsHeight( subdivisions ) );
+			default: return TriMesh::create( geom::TorusKnot().subdivisionsAxis( subdivisions ).subdivisionsHeight( subdivisions ).scale( vec3( 0.5f ) ) );
+		}
+	} );
+}
+
+void PBRImageBasedLightingApp::updateModel()
+{
+	mMeshCache->update();
+	auto lods = mMeshCache->getLods( mModelKey );
+	if( lods.mMeshes.empty() || ( ! mModelLods.mMeshes.empty() && lods.mMeshes.front() == mModelLods.mMeshes.front() ) ) {
+		return;
+	}
+	
+	mModelLods = lods;
+	if( mModelShaders[PASS_SHADING] ) {
+		createLodBatches();
+	}
+	else {
+		createBatches();
+	}
+}
+
+void PBRImageBasedLightingApp::createBatches()
+{
+	// the skybox and the models output linear colors when the hdr target does the tone-mapping
+	// and also write their velocity when it is temporally anti-aliased
+	auto skyBoxFormat = gl::GlslProg::Format().vertex( loadAsset( "SkyBox.vert" ) ).fragment( loadAsset( "SkyBox.frag" ) );
+	if( mHdr ) {
+		skyBoxFormat.define( "HDR_TARGET" );
+	}
+	if( mHdr && mHdrTarget.isTemporal() ) {
+		skyBoxFormat.define( "TEMPORAL" ).fragDataLocation( 0, "oColor" ).fragDataLocation( 1, "oVelocity" );
+	}
+	
+	// the skybox is a single triangle covering the screen at the far plane, drawn last so it is only shaded where no model is
+	const vec2 skyBoxVertices[3] = { vec2( -1.0f, -1.0f ), vec2( 3.0f, -1.0f ), vec2( -1.0f, 3.0f ) };
+	geom::BufferLayout skyBoxLayout;
+	skyBoxLayout.append( geom::Attrib::POSITION, 2, 0, 0 );
+	auto skyBoxMesh	= gl::VboMesh::create( 3, GL_TRIANGLES, { { skyBoxLayout, gl::Vbo::create( GL_ARRAY_BUFFER, sizeof( skyBoxVertices ), skyBoxVertices, GL_STATIC_DRAW ) } } );
+	mSkyBoxBatch	= gl::Batch::create( skyBoxMesh, gl::GlslProg::create( skyBoxFormat ) );
+	
+	// the batches are created with the first model
+	if( mModelLods.mMeshes.empty() ) {
+		return;
+	}
+	
+	// the same shaders are used for both paths, the instanced one, the spherical harmonics irradiance,
+	// the integrated environment BRDF and the linear output of the hdr target are enabled with defines
+	auto format = gl::GlslProg::Format().vertex( loadAsset( "PBR.vert" ) ).fragment( loadAsset( "PBR.frag" ) );
+	if( mHdr ) {
+		format.define( "HDR_TARGET" );
+	}
+	if( mHdr && mHdrTarget.isTemporal() ) {
+		format.define( "TEMPORAL" ).fragDataLocation( 0, "oColor" ).fragDataLocation( 1, "oVelocity" );
+	}
+	if( mSphericalHarmonics ) {
+		format.define( "SPHERICAL_HARMONICS" );
+	}
+	if( mIntegratedBrdf ) {
+		format.define( "BRDF_LUT" );
+		// the table is integrated the first time and read back from the app folder on the next launches
+		if( ! mBrdfLut ) {
+			BrdfLut lut = BrdfLut::load( getAppPath().string() );
+			mBrdfLut = gl::Texture2d::create( lut.getData(), GL_RG, lut.getSize(), lut.getSize(), gl::Texture2d::Format().internalFormat( GL_RG16F ).dataType( GL_HALF_FLOAT ).minFilter( GL_LINEAR ).magFilter( GL_LINEAR ).wrap( GL_CLAMP_TO_EDGE ) );
+		}
+	}
+	
+	// the depth pre-pass and the overdraw visualisation keep the vertex shader and its defines so the positions are the same
+	const char *fragmentShaders[NUM_PASSES] = { "PBR.frag", "Depth.frag", "Overdraw.frag" };
+	for( int pass = 0; pass < NUM_PASSES; ++pass ) {
+		auto passFormat = format;
+		passFormat.fragment( loadAsset( fragmentShaders[pass] ) );
+		auto instancedFormat = passFormat;
+		instancedFormat.define( "INSTANCED" );
+		mModelShaders[pass]				= gl::GlslProg::create( passFormat );
+		mInstancedModelShaders[pass]	= gl::GlslProg::create( instancedFormat );
+	}
+	createLodBatches();
+}
+
+void PBRImageBasedLightingApp::createLodBatches()
+{
+	// the instanced version of the grid reads each model transform and material from an instance buffer. each level
+	// has its own buffer, filled with the models that use it, and the non-instanced shader simply ignores the instance attributes
+	geom::BufferLayout instanceLayout;
+	instanceLayout.append( geom::Attrib::CUSTOM_0, 16, sizeof( ModelInstance ), offsetof( ModelInstance, mModelMatrix ), 1 );
+	instanceLayout.append( geom::Attrib::CUSTOM_1, 2, sizeof( ModelInstance ), offsetof( ModelInstance, mMaterial ), 1 );
+	
+	for( int pass = 0; pass < NUM_PASSES; ++pass ) {
+		mModelBatches[pass].clear();
+		mInstancedModelBatches[pass].clear();
+	}
+	for( size_t lod = 0; lod < mModelLods.mMeshes.size(); ++lod ) {
+		if( lod == mInstanceVbos.size() ) {
+			mInstanceVbos.push_back( gl::Vbo::create( GL_ARRAY_BUFFER, 0, nullptr, GL_DYNAMIC_DRAW ) );
+		}
+		auto mesh = mModelLods.mMeshes[lod];
+		auto vbos = mesh->getVertexArrayLayoutVbos();
+		vbos.push_back( make_pair( instanceLayout, mInstanceVbos[lod] ) );
+		auto instancedMesh = gl::VboMesh::create( mesh->getNumVertices(), mesh->getGlPrimitive(), vbos, mesh->getNumIndices(), mesh->getIndexDataType(), mesh->getIndexVbo() );
+		for( int pass = 0; pass < NUM_PASSES; ++pass ) {
+			mModelBatches[pass].push_back( gl::Batch::create( mesh, mModelShaders[pass] ) );
+			mInstancedModelBatches[pass].push_back( gl::Batch::create( instancedMesh, mInstancedModelShaders[pass], { { geom::Attrib::CUSTOM_0, "aInstanceMatrix" }, { geom::Attrib::CUSTOM_1, "aInstanceMaterial" } } ) );
+		}
+	}
+	
+	// the instance buffers are refilled for the new levels
+	mInstanceOrder.clear();
+}
+
+void PBRImageBasedLightingApp::loadEnvironment( const string &name )
+{
+	// the cache parses the files on its own thread and streams them to the gpu over the next frames,
+	// the current environment stays on screen until then. resident environments are available right away
+	mEnvironment		= name;
+	// the BC6H versions take 1 byte per texel on the gpu instead of 8, their blocks are copied as they are
+	string suffix		= mCompressed ? "BC6H.dds" : ".dds";
+	mRadiancePath		= getAssetPath( name + "Radiance" + suffix );
+	mIrradiancePath		= getAssetPath( name + "Irradiance" + suffix );
+	mEnvironmentPending	= true;
+	mCubeMapCache.request( mRadiancePath );
+	
+	// the spherical harmonics are projected from the radiance by the cache, the irradiance cubemap isn't needed then
+	if( ! mSphericalHarmonics ) {
+		mCubeMapCache.request( mIrradiancePath );
+	}
+}
+
+void PBRImageBasedLightingApp::updateEnvironment()
+{
+	mCubeMapCache.update();
+	if( ! mEnvironmentPending ) {
+		return;
+	}
+	
+	// the radiance can be displayed as soon as its smallest mip is uploaded, the sharper ones follow
+	SphericalHarmonics sphericalHarmonics;
+	auto radiance	= mCubeMapCache.get( mRadiancePath );
+	auto irradiance	= mSphericalHarmonics ? nullptr : mCubeMapCache.get( mIrradiancePath );
+	if( ! radiance || ( mSphericalHarmonics ? ! mCubeMapCache.getSphericalHarmonics( mRadiancePath, &sphericalHarmonics ) : ! irradiance ) ) {
+		return;
+	}
+	
+	if( mSphericalHarmonics ) {
+		vec4 coefficients[9];
+		sphericalHarmonics.getStd140( &coefficients[0].x );
+		mSphericalHarmonicsUbo->bufferSubData( 0, sizeof( coefficients ), coefficients );
+	}
+	// the shaders only change with the irradiance they read from
+	if( ! irradiance != ! mIrradianceMap ) {
+		createBatches();
+	}
+	mRadianceMap		= radiance;
+	mIrradianceMap		= irradiance;
+	mEnvironmentPending	= false;
+}
+
+void PBRImageBasedLightingApp::updateInstances()
+{
+	if( mModelLods.mMeshes.empty() ) {
+		return;
+	}
+	
+	// each model uses the coarsest level whose error covers less than mLodPixels once projected,
+	// measured from the closest point of its bounding sphere
+	float pixelsPerUnit = getWindowHeight() / ( 2.0f * tan( toRadians( mCamera.getFov() ) * 0.5f ) );
+	mat4 view			= mCamera.getViewMatrix();
+	mModelDraws.clear();
+	mNumTriangles = 0;
+	for( int x = -mGridSize; x <= mGridSize; x++ ){
+		for( int z = -mGridSize; z <= mGridSize; z++ ){
+			vec3 position	= vec3( x, 0, z ) * 2.25f;
+			float distance	= glm::max( glm::distance( mCamera.getEyePoint(), position ) - mModelLods.mRadius, mCamera.getNearClip() );
+			ModelDraw draw;
+			draw.mX			= x;
+			draw.mZ			= z;
+			draw.mLod		= mLod ? (int) MeshSimplifier::selectLod( mModelLods.mErrors, pixelsPerUnit / distance, mLodPixels ) : 0;
+			draw.mDepth		= -( view * vec4( position, 1.0f ) ).z;
+			mNumTriangles	+= mModelLods.mMeshes[draw.mLod]->getNumIndices() / 3;
+			mModelDraws.push_back( draw );
+		}
+	}
+	mNumFullTriangles = (int) mModelDraws.size() * mModelLods.mMeshes.front()->getNumIndices() / 3;
+	
+	// the closest models are drawn first so the depth test rejects most of the ones behind them before they are shaded
+	if( mSortModels ) {
+		stable_sort( mModelDraws.begin(), mModelDraws.end(), []( const ModelDraw &a, const ModelDraw &b ) { return a.mDepth < b.mDepth; } );
+	}
+	
+	// the instance buffers only need to be rebuilt when the grid, the order or a level changes
+	vector<int> order;
+	order.reserve( mModelDraws.size() * 3 );
+	for( const auto &draw : mModelDraws ) {
+		order.insert( order.end(), { draw.mX, draw.mZ, draw.mLod } );
+	}
+	if( order == mInstanceOrder ) {
+		return;
+	}
+	vector<vector<ModelInstance>> instances( mModelLods.mMeshes.size() );
+	for( const auto &draw : mModelDraws ) {
+		ModelInstance instance;
+		instance.mModelMatrix	= glm::translate( vec3( draw.mX, 0, draw.mZ ) * 2.25f );
+		instance.mMaterial		= vec2( lmap( (float) draw.mZ, (float) -mGridSize, (float) mGridSize, 0.02f, 1.0f ), lmap( (float) draw.mX, (float) -mGridSize, (float) mGridSize, 1.0f, 0.0f ) );
+		instances[draw.mLod].push_back( instance );
+	}
+	mNumLodInstances.resize( instances.size() );
+	for( size_t i = 0; i < instances.size(); ++i ) {
+		mInstanceVbos[i]->bufferData( instances[i].size() * sizeof( ModelInstance ), instances[i].data(), GL_DYNAMIC_DRAW );
+		mNumLodInstances[i] = (int) instances[i].size();
+	}
+	mInstanceOrder	= order;
+	mNumInstances	= (int) mModelDraws.size();
 }
 
 void PBRImageBasedLightingApp::draw()
 {
-	// clear window and set matrices
-	gl::clear( Color( 1, 0, 0 ) );
+	// the comparison switches the anti-aliasing of the target between frames
+	if( mComparison.begin() ) {
+		createBatches();
+	}
+	
+	// in the hdr mode the tone-mapping runs once per pixel on the resolved target instead of once per shaded fragment
+	if( mShowOverdraw ) {
+		gl::clear( Color( 0, 0, 0 ) );
+		renderOverdraw();
+	}
+	else if( mHdr ) {
+		{
+			gl::ScopedFramebuffer scopedFbo( mHdrTarget.getFbo() );
+			gl::ScopedViewport scopedViewport( mHdrTarget.getFbo()->getSize() );
+			mHdrTarget.clear( Color( 1, 0, 0 ) );
+			mHdrTarget.beginFrame( mCamera );
+			renderScene();
+		}
+		mHdrTarget.draw( mExposure, mGamma, 20.0f, mColorGrading );
+	}
+	else {
+		gl::clear( Color( 1, 0, 0 ) );
+		renderScene();
+	}
+	mComparison.end();
+}
+
+void PBRImageBasedLightingApp::renderScene()
+{
+	// set matrices, jittered by the hdr target in the temporal mode
 	gl::setMatrices( mCamera );
+	if( mHdr ) {
+		gl::setProjectionMatrix( mHdrTarget.getProjectionMatrix() );
+	}
+	
+	// nothing to render until the first environment and model are streamed in
+	if( ! mRadianceMap || mModelBatches[PASS_SHADING].empty() ) {
+		return;
+	}
 	
 	// enable depth testing
 	gl::ScopedDepth scopedDepth( true );
 	
-	// bind the cubemap textures
+	// bind the cubemap textures, the irradiance comes from the uniform block when using spherical harmonics
 	gl::ScopedTextureBind scopedTexBind0( mRadianceMap, 0 );
-	gl::ScopedTextureBind scopedTexBind1( mIrradianceMap, 1 );
-	auto shader = mModelBatch->getGlslProg();
+	gl::ScopedTextureBind scopedTexBind1( GL_TEXTURE_CUBE_MAP, mIrradianceMap ? mIrradianceMap->getId() : 0, 1 );
+	gl::ScopedTextureBind scopedTexBind2( GL_TEXTURE_2D, mIntegratedBrdf ? mBrdfLut->getId() : 0, 2 );
+	auto shader = mInstancing ? mInstancedModelShaders[PASS_SHADING] : mModelShaders[PASS_SHADING];
 	shader->uniform( "uRadianceMap", 0 );
-	shader->uniform( "uIrradianceMap", 1 );
+	if( ! mIrradianceMap ) {
+		mSphericalHarmonicsUbo->bindBufferBase( 0 );
+		shader->uniformBlock( "SphericalHarmonics", 0 );
+	}
+	else {
+		shader->uniform( "uIrradianceMap", 1 );
+	}
+	if( mIntegratedBrdf ) {
+		shader->uniform( "uBrdfLut", 2 );
+	}
 	
 	// sends the base color, the specular opacity,
 	// the light position, color and radius to the shader
@@ -144,32 +558,134 @@ void PBRImageBasedLightingApp::draw()
 	shader->uniform( "uExposure", mExposure );
 	shader->uniform( "uGamma", mGamma );
 	
-	// render a grid of sphere with different roughness/metallic values and colors
+	// time the models to compare the analytic and the integrated environment BRDF,
+	// the timer queries can't be nested in the one of the anti-aliasing comparison
+	bool timed = ! mComparison.isRunning();
+	if( timed ) {
+		mModelsTimer->begin();
+	}
+	renderModelPasses( PASS_SHADING );
+	if( timed ) {
+		mModelsTimer->end();
+		mModelsTime = mModelsTimer->getElapsedMilliseconds();
+	}
+	
+	// render the skybox where the depth is still at the far plane
+	shader = mSkyBoxBatch->getGlslProg();
+	shader->uniform( "uExposure", mExposure );
+	shader->uniform( "uGamma", mGamma );
+	if( mHdr && mHdrTarget.isTemporal() ) {
+		shader->uniform( "uViewProjection", mHdrTarget.getViewProjection() );
+		shader->uniform( "uPrevViewProjection", mHdrTarget.getPrevViewProjection() );
+	}
+	gl::ScopedDepthWrite scopedDepthWrite( false );
+	glDepthFunc( GL_LEQUAL );
+	mSkyBoxBatch->draw();
+	glDepthFunc( GL_LESS );
+}
+
+void PBRImageBasedLightingApp::renderOverdraw()
+{
+	gl::setMatrices( mCamera );
+	if( mModelBatches[PASS_OVERDRAW].empty() ) {
+		return;
+	}
+	
+	// each fragment that passes the depth test adds the same amount, the brightness is the number of times a pixel is shaded
+	gl::ScopedDepth scopedDepth( true );
+	gl::ScopedBlendAdditive scopedBlend;
+	renderModelPasses( PASS_OVERDRAW );
+}
+
+void PBRImageBasedLightingApp::renderModelPasses( Pass pass )
+{
+	// the pre-pass only fills the depth, the shading pass then only
+	// runs on the samples whose depth is exactly the closest one
+	if( mDepthPrepass ) {
+		glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+		renderModels( PASS_DEPTH );
+		glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+		glDepthFunc( GL_EQUAL );
+	}
+	
+	// count the samples that pass the depth test, the result of the previous frame is read to avoid waiting on this one
+	GLint samples = 0;
+	glGetIntegerv( GL_SAMPLES, &samples );
+	auto &query = mSamplesQueries[mSamplesQuery];
+	mSamplesQuery = ( mSamplesQuery + 1 ) % 2;
+	if( mSamplesQueries[mSamplesQuery]->isValid() ) {
+		mShadedSamples	= (double) mSamplesQueries[mSamplesQuery]->getValueInt64();
+		mShadedPerPixel	= mShadedSamples / ( (double) gl::getViewport().second.x * gl::getViewport().second.y * std::max( 1, samples ) );
+	}
+	query->begin();
 	{
+		gl::ScopedDepthWrite scopedDepthWrite( ! mDepthPrepass );
+		renderModels( pass );
+	}
+	query->end();
+	glDepthFunc( GL_LESS );
+}
+
+void PBRImageBasedLightingApp::renderModels( Pass pass )
+{
+	// the material and the velocity are only needed when shading
+	auto shader		= mInstancing ? mInstancedModelShaders[pass] : mModelShaders[pass];
+	bool shading	= pass == PASS_SHADING;
+	bool temporal	= shading && mHdr && mHdrTarget.isTemporal();
+	
+	// the velocity is computed with the matrices of this frame and the previous one, without the jitter
+	if( temporal ) {
+		shader->uniform( "uViewProjection", mHdrTarget.getViewProjection() );
+		shader->uniform( "uPrevViewProjection", mHdrTarget.getPrevViewProjection() );
+	}
+	
+	// render a grid of sphere with different roughness/metallic values and colors
+	if( mInstancing ) {
+		// the per-model values are in the instance buffer and only get scaled by the material values
+		if( shading ) {
+			shader->uniform( "uRoughness", mRoughness );
+			shader->uniform( "uMetallic", mMetallic );
+		}
+		shader->uniform( "uRotationMatrix", glm::rotate( mTime, vec3( 0.123, 0.456, 0.789 ) ) );
+		if( temporal ) {
+			shader->uniform( "uPrevRotationMatrix", glm::rotate( mPrevTime, vec3( 0.123, 0.456, 0.789 ) ) );
+		}
+		// one draw per level in use, the closest levels first
+		for( size_t lod = 0; lod < mNumLodInstances.size(); ++lod ) {
+			if( mNumLodInstances[lod] ) {
+				mInstancedModelBatches[pass][lod]->drawInstanced( mNumLodInstances[lod] );
+			}
+		}
+	}
+	else {
 		gl::ScopedMatrices scopedMatrices;
-		for( int x = -mGridSize; x <= mGridSize; x++ ){
-			for( int z = -mGridSize; z <= mGridSize; z++ ){
-				float roughness = lmap( (float) z, (float) -mGridSize, (float) mGridSize, 0.02f, 1.0f );
-				float metallic	= lmap( (float) x, (float) -mGridSize, (float) mGridSize, 1.0f, 0.0f );
+		for( const auto &draw : mModelDraws ) {
+			if( shading ) {
+				float roughness = lmap( (float) draw.mZ, (float) -mGridSize, (float) mGridSize, 0.02f, 1.0f );
+				float metallic	= lmap( (float) draw.mX, (float) -mGridSize, (float) mGridSize, 1.0f, 0.0f );
 				
 				shader->uniform( "uRoughness", roughness * mRoughness );
 				shader->uniform( "uRoughness4", pow( roughness * mRoughness, 4.0f ) );
 				shader->uniform( "uMetallic", metallic * mMetallic );
-				
-				gl::setModelMatrix( glm::translate( vec3( x, 0, z ) * 2.25f ) * glm::rotate( mTime, vec3( 0.123, 0.456, 0.789 ) ) );
-				mModelBatch->draw();
 			}
+			
+			gl::setModelMatrix( glm::translate( vec3( draw.mX, 0, draw.mZ ) * 2.25f ) * glm::rotate( mTime, vec3( 0.123, 0.456, 0.789 ) ) );
+			if( temporal ) {
+				shader->uniform( "uPrevModelMatrix", glm::translate( vec3( draw.mX, 0, draw.mZ ) * 2.25f ) * glm::rotate( mPrevTime, vec3( 0.123, 0.456, 0.789 ) ) );
+			}
+			mModelBatches[pass][draw.mLod]->draw();
 		}
 	}
-	
-	// render skybox
-	shader = mSkyBoxBatch->getGlslProg();
-	shader->uniform( "uExposure", mExposure );
-	shader->uniform( "uGamma", mGamma );
-	mSkyBoxBatch->draw();
 }
 
-CINDER_APP( PBRImageBasedLightingApp, RendererGl( RendererGl::Options().msaa( 16 ) ) )
+CINDER_APP( PBRImageBasedLightingApp, RendererGl( RendererGl::Options().msaa( 16 ) ), []( App::Settings *settings ) {
+	// the samples of the window are only used when rendering to it directly,
+	// which neither the temporal anti-aliasing nor the comparison do
+	const auto &args	= settings->getCommandLineArgs();
+	auto antiAliasing	= HdrTarget::parseAntiAliasing( args );
+	int samples			= antiAliasing == HdrTarget::TAA || HdrTarget::parseComparison( args ) ? 0 : HdrTarget::getSamples( antiAliasing );
+	settings->setDefaultRenderer( RendererGl::create( RendererGl::Options().msaa( samples ) ) );
+} )
 /*
 #include "cinder/app/App.h"
 #include "cinder/app/RendererGl.h"
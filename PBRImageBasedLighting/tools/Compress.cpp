@@ -0,0 +1,85 @@
+/*
+ Command line front end of BC6H.h, compresses the RGBA16F cubemaps written by Prefilter
+ to BC6H, 1 byte per texel instead of 8. Only needs a C++11 compiler:
+
+	g++ -std=c++11 -O2 -msse2 -I../include Compress.cpp -o Compress -lpthread
+	cl /EHsc /O2 /I..\include Compress.cpp
+
+ Usage:
+	Compress <input.dds> <output.dds> [options]
+
+	--quality <fast|normal|high>	normal by default
+	--threads <n>					number of threads, all cores by default
+
+ Keeps every mip of the input and prints the PSNR of the compressed values against the
+ input, with the largest input value as the peak.
+ */
+
+#include <iostream>
+#include <cstdlib>
+
+#include "BC6H.h"
+
+using namespace std;
+
+int main( int argc, char **argv )
+{
+	if( argc < 3 ) {
+		cerr << "Usage: Compress <input.dds> <output.dds> [--quality fast|normal|high] [--threads n]" << endl;
+		return 1;
+	}
+
+	string input = argv[1], output = argv[2];
+	BC6H::Options options;
+	for( int i = 3; i < argc; ++i ) {
+		string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if( arg == "--quality" && hasValue ) {
+			string quality = argv[++i];
+			if( quality == "fast" ) options.quality( BC6H::QUALITY_FAST );
+			else if( quality == "normal" ) options.quality( BC6H::QUALITY_NORMAL );
+			else if( quality == "high" ) options.quality( BC6H::QUALITY_HIGH );
+			else {
+				cerr << "Unknown quality " << quality << endl;
+				return 1;
+			}
+		}
+		else if( arg == "--threads" && hasValue ) options.threads( atoi( argv[++i] ) );
+		else {
+			cerr << "Unknown option " << arg << endl;
+			return 1;
+		}
+	}
+	options.log( []( const string &message ) { cout << message << endl; } );
+
+	try {
+		CubeMapData source = CubeMapPrefilter::loadDds( input, true );
+		cout << "Loaded " << input << " (" << source.getSize() << "x" << source.getSize() << " faces, " << source.getNumMips() << " mips) using " << options.mNumThreads << " threads" << endl;
+
+		auto start = chrono::steady_clock::now();
+		BC6HCubeMap compressed = BC6H::encode( source, options );
+		double seconds = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+		BC6H::writeDds( compressed, output );
+
+		// the error is measured on the values as stored, before PBR.frag linearizes them
+		CubeMapData decoded = BC6H::decode( compressed );
+		double peak = 0.0, squaredError = 0.0, numTexels = 0.0;
+		for( int mip = 0; mip < source.getNumMips(); ++mip ) {
+			for( int face = 0; face < 6; ++face ) {
+				const float *a = source.getFace( face, mip ), *b = decoded.getFace( face, mip );
+				for( int i = 0; i < source.getSize( mip ) * source.getSize( mip ) * 3; ++i ) {
+					peak = max<double>( peak, a[i] );
+					squaredError += ( a[i] - b[i] ) * ( a[i] - b[i] );
+				}
+				numTexels += source.getSize( mip ) * source.getSize( mip );
+			}
+		}
+		double psnr = 10.0 * log10( peak * peak / max( 1e-20, squaredError / ( numTexels * 3.0 ) ) );
+		cout << "Wrote " << output << " in " << seconds << "s, " << numTexels / seconds / 1.0e6 << " Mtexels/s, PSNR " << psnr << " dB" << endl;
+	}
+	catch( const CubeMapPrefilterExc &exc ) {
+		cerr << exc.what() << endl;
+		return 1;
+	}
+	return 0;
+}
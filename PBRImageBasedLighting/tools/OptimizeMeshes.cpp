@@ -0,0 +1,293 @@
+/*
+ Headless benchmark of MeshOptimizer.h and MeshSimplifier.h on the meshes of the samples. Only needs a C++11 compiler:
+
+	g++ -std=c++11 -O2 -I../include OptimizeMeshes.cpp -o OptimizeMeshes
+	cl /EHsc /O2 /I..\include OptimizeMeshes.cpp
+
+ Usage:
+	OptimizeMeshes [mesh.obj ...] [options]
+
+	--cache <n>			size of the fifo vertex cache, 16 by default
+	--threshold <t>		cache misses traded for overdraw, 1.05 by default
+	--no-overdraw		skips the cluster sort
+	--lods <n>			number of levels of detail built after the optimization, 4 by default
+
+ Always runs on grids built in the row by row order of geom::Sphere, geom::TorusKnot
+ and a 256x256 height field, then on each obj file, for instance:
+
+	OptimizeMeshes ../../ParallaxCorrectedCubemap/assets/model.obj ../../CascadedShadowMapping/assets/terrain.obj
+
+ There's no geom::Teapot case, its bezier patches only come with Cinder. ViewportArray logs the ACMR and ATVR
+ of its teapot at startup instead.
+
+ The obj files are split into vertices the way ObjLoader does, one per distinct v/vt/vn.
+ Prints the ACMR and ATVR for the option cache size and for 32 entries, and the overdraw
+ averaged over 14 orthographic views, before and after the optimization. Then prints the
+ triangles and the error of each level of detail, relative to the size of the mesh.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <map>
+#include <functional>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include "MeshSimplifier.h"
+
+using namespace std;
+
+struct Mesh {
+	string				mName;
+	vector<float>		mPositions;
+	vector<uint32_t>	mIndices;
+	size_t getNumVertices() const { return mPositions.size() / 3; }
+};
+
+// a grid of (columns + 1) x (rows + 1) vertices emitted row by row, with two triangles per cell
+static Mesh createGrid( const string &name, int columns, int rows, const function<void(float,float,float*)> &position )
+{
+	Mesh mesh;
+	mesh.mName = name;
+	for( int y = 0; y <= rows; ++y ) {
+		for( int x = 0; x <= columns; ++x ) {
+			float p[3];
+			position( static_cast<float>( x ) / columns, static_cast<float>( y ) / rows, p );
+			mesh.mPositions.insert( mesh.mPositions.end(), p, p + 3 );
+		}
+	}
+	for( int y = 0; y < rows; ++y ) {
+		for( int x = 0; x < columns; ++x ) {
+			uint32_t i0 = y * ( columns + 1 ) + x, i1 = i0 + 1, i2 = i0 + columns + 1, i3 = i2 + 1;
+			uint32_t quad[6] = { i0, i1, i3, i0, i3, i2 };
+			mesh.mIndices.insert( mesh.mIndices.end(), quad, quad + 6 );
+		}
+	}
+	return mesh;
+}
+
+static Mesh loadObj( const string &path )
+{
+	ifstream file( path.c_str() );
+	if( ! file ) {
+		throw runtime_error( "Can't open " + path );
+	}
+	Mesh mesh;
+	mesh.mName = path.substr( path.find_last_of( "/\\" ) + 1 );
+	vector<float> positions;
+	map<string,uint32_t> vertices;
+	string line;
+	while( getline( file, line ) ) {
+		istringstream stream( line );
+		string type;
+		stream >> type;
+		if( type == "v" ) {
+			float p[3] = { 0.0f, 0.0f, 0.0f };
+			stream >> p[0] >> p[1] >> p[2];
+			positions.insert( positions.end(), p, p + 3 );
+		}
+		else if( type == "f" ) {
+			// polygons are split in fans, each distinct v/vt/vn is a vertex
+			vector<uint32_t> face;
+			string corner;
+			while( stream >> corner ) {
+				auto it = vertices.find( corner );
+				if( it == vertices.end() ) {
+					long index = strtol( corner.c_str(), nullptr, 10 );
+					size_t position = index < 0 ? positions.size() / 3 + index : index - 1;
+					it = vertices.insert( make_pair( corner, static_cast<uint32_t>( mesh.getNumVertices() ) ) ).first;
+					mesh.mPositions.insert( mesh.mPositions.end(), &positions[position * 3], &positions[position * 3] + 3 );
+				}
+				face.push_back( it->second );
+			}
+			for( size_t i = 2; i < face.size(); ++i ) {
+				uint32_t triangle[3] = { face[0], face[i - 1], face[i] };
+				mesh.mIndices.insert( mesh.mIndices.end(), triangle, triangle + 3 );
+			}
+		}
+	}
+	return mesh;
+}
+
+// ratio of the pixels shaded to the pixels covered, drawing the triangles in order with a depth test and back face culling
+static float analyzeOverdraw( const Mesh &mesh )
+{
+	const int size = 256;
+	float min[3] = { 1e30f, 1e30f, 1e30f }, max[3] = { -1e30f, -1e30f, -1e30f };
+	for( size_t v = 0; v < mesh.getNumVertices(); ++v ) {
+		for( int c = 0; c < 3; ++c ) {
+			min[c] = std::min( min[c], mesh.mPositions[v * 3 + c] );
+			max[c] = std::max( max[c], mesh.mPositions[v * 3 + c] );
+		}
+	}
+	float center[3], radius = 0.0f;
+	for( int c = 0; c < 3; ++c ) {
+		center[c] = ( min[c] + max[c] ) * 0.5f;
+		radius += ( max[c] - min[c] ) * ( max[c] - min[c] ) * 0.25f;
+	}
+	radius = std::sqrt( radius );
+
+	size_t shaded = 0, covered = 0;
+	vector<float> depth( size * size );
+	for( int view = 0; view < 14; ++view ) {
+		// the 6 axes and the 8 diagonals
+		float forward[3] = { 0.0f, 0.0f, 0.0f };
+		if( view < 6 ) forward[view / 2] = view % 2 ? -1.0f : 1.0f;
+		else for( int c = 0; c < 3; ++c ) forward[c] = ( ( view - 6 ) >> c & 1 ? -1.0f : 1.0f ) / std::sqrt( 3.0f );
+		float up[3] = { 0.0f, 1.0f, 0.0f };
+		if( std::abs( forward[1] ) > 0.9f ) { up[1] = 0.0f; up[2] = 1.0f; }
+		float right[3] = { up[1] * forward[2] - up[2] * forward[1], up[2] * forward[0] - up[0] * forward[2], up[0] * forward[1] - up[1] * forward[0] };
+		float length = std::sqrt( right[0] * right[0] + right[1] * right[1] + right[2] * right[2] );
+		for( int c = 0; c < 3; ++c ) right[c] /= length;
+		up[0] = forward[1] * right[2] - forward[2] * right[1];
+		up[1] = forward[2] * right[0] - forward[0] * right[2];
+		up[2] = forward[0] * right[1] - forward[1] * right[0];
+
+		fill( depth.begin(), depth.end(), 1e30f );
+		vector<bool> hit( size * size, false );
+		for( size_t t = 0; t < mesh.mIndices.size() / 3; ++t ) {
+			float screen[3][3], normal[3], e1[3], e2[3];
+			const float *p[3];
+			for( int i = 0; i < 3; ++i ) p[i] = &mesh.mPositions[mesh.mIndices[t * 3 + i] * 3];
+			for( int c = 0; c < 3; ++c ) {
+				e1[c] = p[1][c] - p[0][c];
+				e2[c] = p[2][c] - p[0][c];
+			}
+			normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+			normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+			normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+			if( normal[0] * forward[0] + normal[1] * forward[1] + normal[2] * forward[2] >= 0.0f ) continue;
+			for( int i = 0; i < 3; ++i ) {
+				float d[3] = { p[i][0] - center[0], p[i][1] - center[1], p[i][2] - center[2] };
+				screen[i][0] = ( ( d[0] * right[0] + d[1] * right[1] + d[2] * right[2] ) / radius * 0.5f + 0.5f ) * size;
+				screen[i][1] = ( ( d[0] * up[0] + d[1] * up[1] + d[2] * up[2] ) / radius * 0.5f + 0.5f ) * size;
+				screen[i][2] = d[0] * forward[0] + d[1] * forward[1] + d[2] * forward[2];
+			}
+			float area = ( screen[1][0] - screen[0][0] ) * ( screen[2][1] - screen[0][1] ) - ( screen[2][0] - screen[0][0] ) * ( screen[1][1] - screen[0][1] );
+			if( area == 0.0f ) continue;
+			int x0 = std::max( 0, static_cast<int>( std::floor( std::min( { screen[0][0], screen[1][0], screen[2][0] } ) ) ) );
+			int x1 = std::min( size - 1, static_cast<int>( std::ceil( std::max( { screen[0][0], screen[1][0], screen[2][0] } ) ) ) );
+			int y0 = std::max( 0, static_cast<int>( std::floor( std::min( { screen[0][1], screen[1][1], screen[2][1] } ) ) ) );
+			int y1 = std::min( size - 1, static_cast<int>( std::ceil( std::max( { screen[0][1], screen[1][1], screen[2][1] } ) ) ) );
+			for( int y = y0; y <= y1; ++y ) {
+				for( int x = x0; x <= x1; ++x ) {
+					float px = x + 0.5f, py = y + 0.5f, w[3];
+					for( int i = 0; i < 3; ++i ) {
+						const float *a = screen[( i + 1 ) % 3], *b = screen[( i + 2 ) % 3];
+						w[i] = ( ( b[0] - a[0] ) * ( py - a[1] ) - ( px - a[0] ) * ( b[1] - a[1] ) ) / area;
+					}
+					if( w[0] < 0.0f || w[1] < 0.0f || w[2] < 0.0f ) continue;
+					float z = w[0] * screen[0][2] + w[1] * screen[1][2] + w[2] * screen[2][2];
+					if( z < depth[y * size + x] ) {
+						depth[y * size + x] = z;
+						++shaded;
+						if( ! hit[y * size + x] ) {
+							hit[y * size + x] = true;
+							++covered;
+						}
+					}
+				}
+			}
+		}
+	}
+	return covered ? static_cast<float>( shaded ) / covered : 1.0f;
+}
+
+static void printStatistics( const string &label, const Mesh &mesh, size_t cacheSize )
+{
+	auto stats		= MeshOptimizer::analyzeVertexCache( mesh.mIndices.data(), mesh.mIndices.size(), mesh.getNumVertices(), cacheSize );
+	auto stats32	= MeshOptimizer::analyzeVertexCache( mesh.mIndices.data(), mesh.mIndices.size(), mesh.getNumVertices(), 32 );
+	cout << "  " << left << setw( 8 ) << label << right << fixed << setprecision( 3 )
+		<< "ACMR " << stats.mAcmr << "  ATVR " << stats.mAtvr
+		<< "  (32: " << stats32.mAcmr << " / " << stats32.mAtvr << ")"
+		<< "  overdraw " << analyzeOverdraw( mesh ) << endl;
+}
+
+int main( int argc, char **argv )
+{
+	MeshOptimizer::Options options;
+	MeshSimplifier::Options lodOptions;
+	vector<Mesh> meshes;
+	meshes.push_back( createGrid( "Sphere 64x32", 64, 32, []( float u, float v, float *p ) {
+		float theta = v * 3.14159265f, phi = u * 2.0f * 3.14159265f;
+		p[0] = std::sin( theta ) * std::cos( phi ); p[1] = std::cos( theta ); p[2] = std::sin( theta ) * std::sin( phi );
+	} ) );
+	meshes.push_back( createGrid( "TorusKnot 128x128", 128, 128, []( float u, float v, float *p ) {
+		// (2, 3) knot swept by a tube
+		auto knot = []( float t, float *k ) {
+			float a = t * 2.0f * 3.14159265f, r = 0.5f * ( 2.0f + std::cos( 3.0f * a ) );
+			k[0] = r * std::cos( 2.0f * a ); k[1] = r * std::sin( 2.0f * a ); k[2] = -0.5f * std::sin( 3.0f * a );
+		};
+		float k0[3], k1[3];
+		knot( u, k0 );
+		knot( u + 0.001f, k1 );
+		float tangent[3] = { k1[0] - k0[0], k1[1] - k0[1], k1[2] - k0[2] }, side[3] = { tangent[1], -tangent[0], 0.0f };
+		float length = std::sqrt( side[0] * side[0] + side[1] * side[1] );
+		side[0] /= length; side[1] /= length;
+		float binormal[3] = { tangent[1] * side[2] - tangent[2] * side[1], tangent[2] * side[0] - tangent[0] * side[2], tangent[0] * side[1] - tangent[1] * side[0] };
+		length = std::sqrt( binormal[0] * binormal[0] + binormal[1] * binormal[1] + binormal[2] * binormal[2] );
+		float angle = v * 2.0f * 3.14159265f;
+		for( int c = 0; c < 3; ++c ) p[c] = k0[c] + 0.15f * ( std::cos( angle ) * side[c] + std::sin( angle ) * binormal[c] / length );
+	} ) );
+	meshes.push_back( createGrid( "Terrain 256x256", 256, 256, []( float u, float v, float *p ) {
+		p[0] = u * 10.0f - 5.0f; p[2] = v * 10.0f - 5.0f;
+		p[1] = 0.5f * std::sin( u * 17.0f ) * std::cos( v * 13.0f ) + 0.2f * std::sin( u * 53.0f + v * 31.0f );
+	} ) );
+
+	try {
+		for( int i = 1; i < argc; ++i ) {
+			string arg = argv[i];
+			bool hasValue = i + 1 < argc;
+			if( arg == "--cache" && hasValue ) options.cacheSize( atoi( argv[++i] ) );
+			else if( arg == "--threshold" && hasValue ) options.overdrawThreshold( static_cast<float>( atof( argv[++i] ) ) );
+			else if( arg == "--no-overdraw" ) options.overdraw( false );
+			else if( arg == "--lods" && hasValue ) lodOptions.lods( atoi( argv[++i] ) );
+			else if( arg.size() > 2 && arg.compare( 0, 2, "--" ) == 0 ) {
+				cerr << "Unknown option " << arg << endl;
+				return 1;
+			}
+			else meshes.push_back( loadObj( arg ) );
+		}
+	}
+	catch( const exception &exc ) {
+		cerr << exc.what() << endl;
+		return 1;
+	}
+
+	for( auto &mesh : meshes ) {
+		cout << mesh.mName << ": " << mesh.mIndices.size() / 3 << " triangles, " << mesh.getNumVertices() << " vertices" << endl;
+		printStatistics( "before", mesh, options.mCacheSize );
+
+		auto start = chrono::steady_clock::now();
+		vector<uint32_t> remap;
+		auto report = MeshOptimizer::optimize( mesh.mIndices.data(), mesh.mIndices.size(), mesh.mPositions.data(), 3, mesh.getNumVertices(), &remap, options );
+		MeshOptimizer::remapVertices( mesh.mPositions.data(), 3, mesh.getNumVertices(), remap );
+		double milliseconds = chrono::duration<double,milli>( chrono::steady_clock::now() - start ).count();
+
+		printStatistics( "after", mesh, options.mCacheSize );
+		cout << "  " << report.mNumClusters << " clusters in " << setprecision( 2 ) << milliseconds << " ms" << endl;
+
+		start = chrono::steady_clock::now();
+		auto lods = MeshSimplifier::buildLods( mesh.mIndices.data(), mesh.mIndices.size(), mesh.mPositions.data(), 3, mesh.getNumVertices(), lodOptions );
+		milliseconds = chrono::duration<double,milli>( chrono::steady_clock::now() - start ).count();
+		float size = 0.0f;
+		for( int c = 0; c < 3; ++c ) {
+			float min = 1e30f, max = -1e30f;
+			for( size_t v = 0; v < mesh.getNumVertices(); ++v ) {
+				min = std::min( min, mesh.mPositions[v * 3 + c] );
+				max = std::max( max, mesh.mPositions[v * 3 + c] );
+			}
+			size += ( max - min ) * ( max - min );
+		}
+		cout << "  " << lods.size() << " lods in " << milliseconds << " ms:";
+		for( const auto &lod : lods ) {
+			cout << " " << lod.mIndices.size() / 3 << " (" << setprecision( 4 ) << lod.mError / std::sqrt( size ) << ")";
+		}
+		cout << endl;
+	}
+	return 0;
+}
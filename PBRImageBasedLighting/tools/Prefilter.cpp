@@ -0,0 +1,73 @@
+/*
+ Command line front end of CubeMapPrefilter.h, bakes the radiance and irradiance
+ cubemaps of an environment without a gpu or a window. Only needs a C++11 compiler:
+
+	g++ -std=c++11 -O2 -msse2 -I../include Prefilter.cpp -o Prefilter -lpthread
+	cl /EHsc /O2 /I..\include Prefilter.cpp
+
+ Usage:
+	Prefilter <input.hdr|input.dds> <output name> [options]
+
+	--size <n>				radiance size, 256 by default
+	--mips <n>				radiance mips, 7 by default
+	--irradiance-size <n>	irradiance size, 128 by default
+	--samples <n> <n>		radiance and irradiance samples per texel, 64 and 256 by default
+	--cube-size <n>			size of the cubemap an equirect input is resampled to, 512 by default
+	--input-gamma <g>		gamma of the input values, 1.0 by default
+	--threads <n>			number of threads, all cores by default
+
+ Writes <output name>Radiance.dds and <output name>Irradiance.dds, the format
+ expected by PBRImageBasedLightingApp and PBRTexturingBasicsApp.
+ */
+
+#include <iostream>
+#include <cstdlib>
+
+#include "CubeMapPrefilter.h"
+
+using namespace std;
+
+int main( int argc, char **argv )
+{
+	if( argc < 3 ) {
+		cerr << "Usage: Prefilter <input.hdr|input.dds> <output name> [--size n] [--mips n] [--irradiance-size n] [--samples n n] [--cube-size n] [--input-gamma g] [--threads n]" << endl;
+		return 1;
+	}
+
+	string input = argv[1], output = argv[2];
+	int cubeSize = 512;
+	float inputGamma = 1.0f;
+	CubeMapPrefilter::Options options;
+	for( int i = 3; i < argc; ++i ) {
+		string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if( arg == "--size" && hasValue ) options.mRadianceSize = atoi( argv[++i] );
+		else if( arg == "--mips" && hasValue ) options.mRadianceMips = atoi( argv[++i] );
+		else if( arg == "--irradiance-size" && hasValue ) options.mIrradianceSize = atoi( argv[++i] );
+		else if( arg == "--samples" && i + 2 < argc ) { options.mRadianceSamples = atoi( argv[++i] ); options.mIrradianceSamples = atoi( argv[++i] ); }
+		else if( arg == "--cube-size" && hasValue ) cubeSize = atoi( argv[++i] );
+		else if( arg == "--input-gamma" && hasValue ) inputGamma = (float) atof( argv[++i] );
+		else if( arg == "--threads" && hasValue ) options.threads( atoi( argv[++i] ) );
+		else {
+			cerr << "Unknown option " << arg << endl;
+			return 1;
+		}
+	}
+	options.log( []( const string &message ) { cout << message << endl; } );
+
+	try {
+		auto start = chrono::steady_clock::now();
+		CubeMapData source = CubeMapPrefilter::load( input, cubeSize, inputGamma );
+		cout << "Loaded " << input << " (" << source.getSize() << "x" << source.getSize() << " faces) using " << options.mNumThreads << " threads" << endl;
+
+		CubeMapPrefilter::writeDds( CubeMapPrefilter::prefilterRadiance( source, options ), output + "Radiance.dds" );
+		CubeMapPrefilter::writeDds( CubeMapPrefilter::prefilterIrradiance( source, options ), output + "Irradiance.dds" );
+
+		cout << "Done in " << chrono::duration<double>( chrono::steady_clock::now() - start ).count() << "s" << endl;
+	}
+	catch( const CubeMapPrefilterExc &exc ) {
+		cerr << exc.what() << endl;
+		return 1;
+	}
+	return 0;
+}
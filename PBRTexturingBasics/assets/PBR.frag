@@ -1,13 +1,21 @@
 #version 150
 
 uniform samplerCube uRadianceMap;
-uniform samplerCube uIrradianceMap;
 uniform float		uRadianceMapSize;
+#ifdef SPHERICAL_HARMONICS
+layout (std140) uniform SphericalHarmonics {
+	vec4			uSphericalHarmonics[9];
+};
+#else
+uniform samplerCube uIrradianceMap;
 uniform float		uIrradianceMapSize;
+#endif
+#ifdef BRDF_LUT
+uniform sampler2D	uBrdfLut;
+#endif
 
 uniform sampler2D 	uNormalMap;
-uniform sampler2D 	uRoughnessMap;
-uniform sampler2D 	uMetallicMap;
+uniform sampler2D 	uMaterialMap;
 
 uniform vec3		uBaseColor;
 uniform float		uRoughness;
@@ -26,6 +34,12 @@ in vec3				vWsPosition;
 
 out vec4            oColor;
 
+#ifdef TEMPORAL
+in vec4				vClipPosition;
+in vec4				vPrevClipPosition;
+out vec2			oVelocity;
+#endif
+
 #define saturate(x) clamp(x, 0.0, 1.0)
 #define PI 3.1415926535897932384626433832795
 
@@ -56,6 +70,23 @@ vec3 EnvBRDFApprox( vec3 SpecularColor, float Roughness, float NoV )
 	return SpecularColor * AB.x + AB.y;
 }
 
+#ifdef SPHERICAL_HARMONICS
+// irradiance from the 9 spherical harmonics coefficients, already convolved with the cosine lobe
+// http://graphics.stanford.edu/papers/envmap/envmap.pdf
+vec3 getIrradiance( vec3 n )
+{
+	vec3 irradiance	= uSphericalHarmonics[0].rgb * 0.282095
+					+ uSphericalHarmonics[1].rgb * 0.488603 * n.y
+					+ uSphericalHarmonics[2].rgb * 0.488603 * n.z
+					+ uSphericalHarmonics[3].rgb * 0.488603 * n.x
+					+ uSphericalHarmonics[4].rgb * 1.092548 * n.x * n.y
+					+ uSphericalHarmonics[5].rgb * 1.092548 * n.y * n.z
+					+ uSphericalHarmonics[6].rgb * 0.315392 * ( 3.0 * n.z * n.z - 1.0 )
+					+ uSphericalHarmonics[7].rgb * 1.092548 * n.x * n.z
+					+ uSphericalHarmonics[8].rgb * 0.546274 * ( n.x * n.x - n.y * n.y );
+	return max( irradiance, vec3( 0.0 ) );
+}
+#endif
 
 // http://the-witness.net/news/2012/02/seamless-cube-map-filtering/
 vec3 fix_cube_lookup( vec3 v, float cube_size, float lod ) {
@@ -87,13 +118,17 @@ vec3 blendNormals( vec3 n1, vec3 n2 )
 void main() {
 	
 	vec3 N 				= normalize( vWsNormal );
-	N 					= blendNormals( N, texture( uNormalMap, vUv ).xyz );
+	// the normal map only stores x and y, z is rebuilt from the unit length
+	vec3 normal			= vec3( texture( uNormalMap, vUv ).xy * 2.0 - 1.0, 0.0 );
+	normal.z			= sqrt( saturate( 1.0 - dot( normal.xy, normal.xy ) ) );
+	N 					= blendNormals( N, normal );
 
 	vec3 V 				= normalize( vEyePosition );
 	
-	// sample the roughness and metallic textures
-	float roughnessMask	= texture( uRoughnessMap, vUv ).r;
-	float metallicMask	= texture( uMetallicMap, vUv ).r;
+	// sample the roughness and metallic masks, packed in the red and green channels
+	vec2 material		= texture( uMaterialMap, vUv ).rg;
+	float roughnessMask	= material.r;
+	float metallicMask	= material.g;
 	
 	// deduce the diffuse and specular color from the baseColor and how metallic the material is
 	vec3 diffuseColor	= uBaseColor - uBaseColor * uMetallic * metallicMask;
@@ -106,18 +141,28 @@ void main() {
 	float mip			= numMips - 1 + log2( uRoughness * roughnessMask );
 	vec3 lookup			= -reflect( V, N );
 	vec3 radiance		= pow( textureLod( uRadianceMap, fix_cube_lookup( lookup, uRadianceMapSize, mip ), mip ).rgb, vec3( 2.2f ) );
+#ifdef SPHERICAL_HARMONICS
+	vec3 irradiance		= getIrradiance( N );
+#else
 	vec3 irradiance		= pow( texture( uIrradianceMap, fix_cube_lookup( N, uIrradianceMapSize, 0 ) ).rgb, vec3( 2.2f ) );
+#endif
 
 
-	// get the approximate reflectance
+	// get the reflectance from the integrated split sum or from its approximation
 	float NoV			= saturate( dot( N, V ) );
+#ifdef BRDF_LUT
+	vec2 AB				= texture( uBrdfLut, vec2( NoV, uRoughness * roughnessMask ) ).rg;
+	vec3 reflectance	= specularColor * AB.x + AB.y;
+#else
 	vec3 reflectance	= EnvBRDFApprox( specularColor, pow( uRoughness * roughnessMask, 4.0 ), NoV );
+#endif
 	
 	// combine the specular IBL and the BRDF
     vec3 diffuse  		= diffuseColor * irradiance;
     vec3 specular 		= radiance * reflectance;
 	color				= diffuse + specular;
 	
+#ifndef HDR_TARGET
 	// apply the tone-mapping
 	color				= Uncharted2Tonemap( color * uExposure );
 	// white balance
@@ -125,7 +170,13 @@ void main() {
 	
 	// gamma correction
 	color				= pow( color, vec3( 1.0f / uGamma ) );
+#endif
 	
 	// output the fragment color
     oColor				= vec4( color, 1.0 );
+	
+#ifdef TEMPORAL
+	// motion since the previous frame in texture coordinates
+	oVelocity			= ( vClipPosition.xy / vClipPosition.w - vPrevClipPosition.xy / vPrevClipPosition.w ) * 0.5;
+#endif
 }
\ No newline at end of file
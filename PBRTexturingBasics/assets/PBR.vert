@@ -18,6 +18,14 @@ out vec3		vWsNormal;
 out vec3		vEyePosition;
 out vec3		vWsPosition;
 
+#ifdef TEMPORAL
+uniform mat4	uViewProjection;		// the view projection of this frame and the previous one, without the jitter
+uniform mat4	uPrevViewProjection;
+uniform mat4	uPrevModelMatrix;
+out vec4		vClipPosition;
+out vec4		vPrevClipPosition;
+#endif
+
 
 void main(){
     vec4 worldSpacePosition	= ciModelMatrix * ciPosition;
@@ -33,4 +41,10 @@ void main(){
 	vWsNormal				= vec3( ciViewMatrixInverse * vec4( vNormal, 0.0 ) );
 	
     gl_Position				= ciProjectionMatrix * viewSpacePosition;
+	
+#ifdef TEMPORAL
+	// the model rotates, its previous position uses the model matrix of the previous frame
+	vClipPosition			= uViewProjection * worldSpacePosition;
+	vPrevClipPosition		= uPrevViewProjection * uPrevModelMatrix * ciPosition;
+#endif
 }
\ No newline at end of file
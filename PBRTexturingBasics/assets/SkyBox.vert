@@ -6,8 +6,21 @@ in vec4			ciPosition;
 
 out vec3		vDirection;
 
+#ifdef TEMPORAL
+uniform mat4	uViewProjection;
+uniform mat4	uPrevViewProjection;
+out vec4		vClipPosition;
+out vec4		vPrevClipPosition;
+#endif
+
 void main( void )
 {
 	vDirection 	= vec3( ciPosition );
 	gl_Position = ciModelViewProjection * ciPosition;
+	
+#ifdef TEMPORAL
+	// the cube stays at the origin, its motion only comes from the camera
+	vClipPosition		= uViewProjection * ciPosition;
+	vPrevClipPosition	= uPrevViewProjection * ciPosition;
+#endif
 }
@@ -0,0 +1,70 @@
+#version 150
+
+uniform sampler2D	uColor;
+uniform sampler2D	uHistory;
+uniform sampler2D	uVelocity;
+uniform vec2		uTexelSize;
+uniform float		uFeedback;
+
+in vec2				vTexCoord;
+out vec4			oColor;
+
+// the neighbourhood is bounded in YCoCg where the box fits the colors
+// more tightly than in RGB, and the luma is in the first component
+vec3 RGBToYCoCg( vec3 c )
+{
+	return vec3( 0.25 * c.r + 0.5 * c.g + 0.25 * c.b, 0.5 * c.r - 0.5 * c.b, -0.25 * c.r + 0.5 * c.g - 0.25 * c.b );
+}
+vec3 YCoCgToRGB( vec3 c )
+{
+	return vec3( c.x + c.y - c.z, c.x + c.z, c.x - c.y - c.z );
+}
+
+// the hdr colors are compressed by their luma before being clamped and
+// blended so a few very bright samples don't dominate and flicker
+vec3 compress( vec3 c )
+{
+	return c / ( 1.0 + c.x );
+}
+vec3 uncompress( vec3 c )
+{
+	return c / ( 1.0 - c.x );
+}
+
+vec3 fetch( vec2 uv )
+{
+	return compress( RGBToYCoCg( texture( uColor, uv ).rgb ) );
+}
+
+void main()
+{
+	// bounds of the 3x3 neighbourhood of the current frame, the longest
+	// velocity around the pixel is used so the edges of moving objects
+	// are reprojected with them rather than with the background
+	vec3 current	= fetch( vTexCoord );
+	vec3 minColor	= current;
+	vec3 maxColor	= current;
+	vec2 velocity	= texture( uVelocity, vTexCoord ).xy;
+	for( int y = -1; y <= 1; y++ ) {
+		for( int x = -1; x <= 1; x++ ) {
+			vec2 uv		= vTexCoord + vec2( x, y ) * uTexelSize;
+			vec3 color	= fetch( uv );
+			minColor	= min( minColor, color );
+			maxColor	= max( maxColor, color );
+			vec2 v		= texture( uVelocity, uv ).xy;
+			velocity	= dot( v, v ) > dot( velocity, velocity ) ? v : velocity;
+		}
+	}
+	
+	// reproject the history and clamp it to the neighbourhood, what was
+	// disoccluded or has changed falls outside and is pulled back in
+	vec2 previousUv	= vTexCoord - velocity;
+	vec3 history	= compress( RGBToYCoCg( texture( uHistory, previousUv ).rgb ) );
+	history			= clamp( history, minColor, maxColor );
+	
+	// there is no history for what was outside of the screen
+	bool onScreen	= all( equal( previousUv, clamp( previousUv, vec2( 0.0 ), vec2( 1.0 ) ) ) );
+	vec3 color		= mix( current, history, onScreen ? uFeedback : 0.0 );
+	
+	oColor			= vec4( YCoCgToRGB( uncompress( color ) ), 1.0 );
+}
@@ -0,0 +1,201 @@
+/*
+
+ BrdfLut
+
+ Copyright (c) 2015, Simon Geilfus
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "CubeMapPrefilter.h"
+
+//! Split sum environment BRDF of the image based lighting ( Karis, "Real Shading in Unreal Engine 4" ). Each texel holds the scale and
+//! bias applied to the specular color for a NoV (x) and a roughness (y), integrated on the cpu with the same GGX distribution and
+//! roughness as the radiance mips of CubeMapPrefilter. PBR.frag samples it instead of EnvBRDFApprox when BRDF_LUT is defined.
+class BrdfLut {
+public:
+	struct Options {
+		Options() : mSize( 128 ), mNumSamples( 1024 ), mNumThreads( std::max( 1u, std::thread::hardware_concurrency() ) ) {}
+
+		Options& size( int size ) { mSize = size; return *this; }
+		//! Number of importance samples per texel
+		Options& samples( int numSamples ) { mNumSamples = numSamples; return *this; }
+		Options& threads( size_t numThreads ) { mNumThreads = std::max<size_t>( 1, numThreads ); return *this; }
+
+		int		mSize, mNumSamples;
+		size_t	mNumThreads;
+	};
+
+	BrdfLut() : mSize( 0 ) {}
+
+	//! Integrates the table, the rows are spread over the threads
+	static BrdfLut integrate( const Options &options = Options() )
+	{
+		BrdfLut lut;
+		lut.mSize = options.mSize;
+		lut.mData.resize( options.mSize * options.mSize * 2 );
+		std::atomic<int> nextRow( 0 );
+		auto worker = [&]() {
+			int y;
+			while( ( y = nextRow++ ) < options.mSize ) {
+				float roughness = ( y + 0.5f ) / options.mSize;
+				for( int x = 0; x < options.mSize; ++x ) {
+					float scaleBias[2];
+					integrateTexel( ( x + 0.5f ) / options.mSize, roughness, options.mNumSamples, scaleBias );
+					lut.mData[( y * options.mSize + x ) * 2]		= CubeMapPrefilter::floatToHalf( scaleBias[0] );
+					lut.mData[( y * options.mSize + x ) * 2 + 1]	= CubeMapPrefilter::floatToHalf( scaleBias[1] );
+				}
+			}
+		};
+		std::vector<std::thread> threads;
+		for( size_t i = 1; i < options.mNumThreads; ++i ) {
+			threads.push_back( std::thread( worker ) );
+		}
+		worker();
+		for( auto &thread : threads ) thread.join();
+		return lut;
+	}
+
+	//! Returns the table cached in \a directory for these options, integrating and caching it first if needed.
+	//! The file name has a hash of the options, changing them gives a new file
+	static BrdfLut load( const std::string &directory, const Options &options = Options() )
+	{
+		std::ostringstream path;
+		path << directory << "/BrdfLut" << std::hex << getHash( options ) << ".dds";
+		try {
+			return loadDds( path.str(), options.mSize );
+		}
+		catch( const CubeMapPrefilterExc & ) {
+		}
+		BrdfLut lut = integrate( options );
+		try {
+			lut.writeDds( path.str() );
+		}
+		catch( const CubeMapPrefilterExc & ) {
+			// a read-only directory only costs the integration at each launch
+		}
+		return lut;
+	}
+
+	//! Writes a DX10 R16G16_FLOAT dds
+	void writeDds( const std::string &path ) const
+	{
+		std::ofstream file( path.c_str(), std::ios::binary );
+		if( ! file ) {
+			throw CubeMapPrefilterExc( "Can't write " + path );
+		}
+		uint32_t header[32] = {};
+		header[0]	= 0x20534444; // "DDS "
+		header[1]	= 124;
+		header[2]	= 0x1 | 0x2 | 0x4 | 0x8 | 0x1000;
+		header[3]	= mSize;
+		header[4]	= mSize;
+		header[5]	= mSize * 4;
+		header[7]	= 1;
+		header[19]	= 32;
+		header[20]	= 0x4; // fourcc
+		header[21]	= 0x30315844; // "DX10"
+		header[27]	= 0x1000;
+		uint32_t dx10[5] = { 34, 3, 0, 1, 0 }; // R16G16_FLOAT, 2d texture
+		file.write( reinterpret_cast<const char*>( header ), sizeof( header ) );
+		file.write( reinterpret_cast<const char*>( dx10 ), sizeof( dx10 ) );
+		file.write( reinterpret_cast<const char*>( mData.data() ), mData.size() * sizeof( uint16_t ) );
+	}
+	//! Reads a R16G16_FLOAT dds written by writeDds, a table that isn't \a size texels wide is rejected before allocating anything
+	static BrdfLut loadDds( const std::string &path, int size )
+	{
+		std::ifstream file( path.c_str(), std::ios::binary );
+		uint32_t header[32], dx10[5];
+		if( ! file.read( reinterpret_cast<char*>( header ), sizeof( header ) ) || header[0] != 0x20534444 || header[21] != 0x30315844
+		   || ! file.read( reinterpret_cast<char*>( dx10 ), sizeof( dx10 ) ) || dx10[0] != 34 || header[3] != header[4] ) {
+			throw CubeMapPrefilterExc( "Not a R16G16_FLOAT dds file: " + path );
+		}
+		if( header[3] != static_cast<uint32_t>( size ) ) {
+			throw CubeMapPrefilterExc( "Unexpected size in " + path );
+		}
+		BrdfLut lut;
+		lut.mSize = header[3];
+		lut.mData.resize( lut.mSize * lut.mSize * 2 );
+		if( ! file.read( reinterpret_cast<char*>( lut.mData.data() ), lut.mData.size() * sizeof( uint16_t ) ) ) {
+			throw CubeMapPrefilterExc( "Truncated dds file: " + path );
+		}
+		return lut;
+	}
+
+	int getSize() const { return mSize; }
+	//! Returns the scale and bias of each texel as half floats, rows of increasing roughness
+	const uint16_t* getData() const { return mData.data(); }
+
+	//! Integrates the scale and bias of the specular color for a NoV and a roughness, with the importance samples of a GGX distribution
+	static void integrateTexel( float NoV, float roughness, int numSamples, float *scaleBias )
+	{
+		// the view vector in the tangent space of the normal (0, 0, 1)
+		float V[3]	= { std::sqrt( 1.0f - NoV * NoV ), 0.0f, NoV };
+		float a		= roughness * roughness;
+		float k		= a * 0.5f;
+		double scale = 0.0, bias = 0.0;
+		for( int i = 0; i < numSamples; ++i ) {
+			float u, v;
+			hammersley( i, numSamples, &u, &v );
+			float phi		= 2.0f * 3.14159265f * u;
+			float cosTheta	= std::sqrt( ( 1.0f - v ) / ( 1.0f + ( a * a - 1.0f ) * v ) );
+			float sinTheta	= std::sqrt( 1.0f - cosTheta * cosTheta );
+			float H[3]		= { sinTheta * std::cos( phi ), sinTheta * std::sin( phi ), cosTheta };
+			float VoH		= V[0] * H[0] + V[1] * H[1] + V[2] * H[2];
+			float NoL		= 2.0f * VoH * H[2] - V[2];
+			if( NoL <= 0.0f ) continue;
+
+			// Smith visibility with the Schlick approximation and k = a / 2, weighted by the pdf of the sample
+			float G		= ( NoV / ( NoV * ( 1.0f - k ) + k ) ) * ( NoL / ( NoL * ( 1.0f - k ) + k ) );
+			float GVis	= G * std::max( VoH, 0.0f ) / ( H[2] * NoV );
+			float Fc	= std::pow( 1.0f - std::max( VoH, 0.0f ), 5.0f );
+			scale		+= ( 1.0f - Fc ) * GVis;
+			bias		+= Fc * GVis;
+		}
+		scaleBias[0] = static_cast<float>( scale / numSamples );
+		scaleBias[1] = static_cast<float>( bias / numSamples );
+	}
+
+protected:
+	static void hammersley( uint32_t i, uint32_t count, float *u, float *v )
+	{
+		uint32_t bits = i;
+		bits = ( bits << 16 ) | ( bits >> 16 );
+		bits = ( ( bits & 0x55555555 ) << 1 ) | ( ( bits & 0xAAAAAAAA ) >> 1 );
+		bits = ( ( bits & 0x33333333 ) << 2 ) | ( ( bits & 0xCCCCCCCC ) >> 2 );
+		bits = ( ( bits & 0x0F0F0F0F ) << 4 ) | ( ( bits & 0xF0F0F0F0 ) >> 4 );
+		bits = ( ( bits & 0x00FF00FF ) << 8 ) | ( ( bits & 0xFF00FF00 ) >> 8 );
+		*u = static_cast<float>( i ) / count;
+		*v = bits * 2.3283064365386963e-10f;
+	}
+	//! FNV-1a hash of the options that change the table, and of a version to bump when the integration changes
+	static uint64_t getHash( const Options &options )
+	{
+		const int values[3] = { 1, options.mSize, options.mNumSamples };
+		uint64_t hash = 14695981039346656037ull;
+		const unsigned char *bytes = reinterpret_cast<const unsigned char*>( values );
+		for( size_t i = 0; i < sizeof( values ); ++i ) {
+			hash = ( hash ^ bytes[i] ) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	int						mSize;
+	std::vector<uint16_t>	mData;
+};
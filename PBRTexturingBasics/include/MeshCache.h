@@ -0,0 +1,299 @@
+/*
+
+ MeshCache
+
+ Copyright (c) 2015, Simon Geilfus
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <list>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <functional>
+#include <iterator>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <type_traits>
+
+#include "cinder/TriMesh.h"
+#include "cinder/gl/VboMesh.h"
+#include "cinder/Log.h"
+
+#include "MeshSimplifier.h"
+
+//! Generates procedural meshes on a worker thread and keeps the most recently used ones on the gpu. Meshes are identified by a hash of
+//! the parameters of their geom::Source, a mesh requested again is available right away and a new one never blocks the gl thread:
+//! the TriMesh is built and run through MeshOptimizer by the worker, and uploaded by the next update. The worker can also build
+//! simplified levels of detail with MeshSimplifier, that share the vertex buffers of the full detail mesh.
+class MeshCache {
+public:
+	struct Options {
+		Options() : mBudget( 64 * 1024 * 1024 ), mOptimize( true ), mNumLods( 1 ) {}
+
+		//! Maximum size in bytes of the resident meshes
+		Options& budget( size_t bytes ) { mBudget = bytes; return *this; }
+		//! Whether the triangles and vertices of the generated meshes are reordered for the vertex cache, overdraw and vertex fetch
+		Options& optimize( bool optimize = true ) { mOptimize = optimize; return *this; }
+		//! Number of levels of detail of each mesh, including the full detail one
+		Options& lods( size_t numLods ) { mNumLods = std::max<size_t>( 1, numLods ); return *this; }
+		//! Creates the VboMesh of a generated TriMesh, a plain gl::VboMesh::create by default. Called from the gl thread
+		Options& upload( const std::function<ci::gl::VboMeshRef(const ci::TriMesh&)> &upload ) { mUpload = upload; return *this; }
+
+		size_t	mBudget;
+		bool	mOptimize;
+		size_t	mNumLods;
+		std::function<ci::gl::VboMeshRef(const ci::TriMesh&)> mUpload;
+	};
+
+	//! The levels of detail of a mesh, the first one is the full detail mesh
+	struct Lods {
+		Lods() : mRadius( 0.0f ) {}
+
+		std::vector<ci::gl::VboMeshRef>	mMeshes;
+		//! Error of each level in the units of the mesh, for MeshSimplifier::selectLod
+		std::vector<float>				mErrors;
+		//! Radius of the bounding sphere of the mesh around its origin
+		float							mRadius;
+	};
+
+	MeshCache( const Options &options = Options() )
+	: mOptions( options ), mResidentBytes( 0 ), mRunning( true )
+	{
+		mThread = std::thread( &MeshCache::generateRequests, this );
+	}
+	~MeshCache()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mRunning = false;
+		}
+		mCondition.notify_one();
+		mThread.join();
+	}
+
+	//! Returns an FNV-1a hash of the parameters a geom::Source is built with, for instance getKey( "TorusKnot", 128, 0.5f )
+	template<typename... Params>
+	static uint64_t getKey( const std::string &name, const Params&... params )
+	{
+		uint64_t key = 14695981039346656037ull;
+		hash( &key, name.data(), name.size() );
+		hashParams( &key, params... );
+		return key;
+	}
+
+	//! Starts generating the mesh of \a key with \a generate on the worker thread, unless it is already resident or generating. Call from the gl thread
+	void request( uint64_t key, const std::function<ci::TriMeshRef()> &generate )
+	{
+		auto it = mEntries.find( key );
+		if( it != mEntries.end() ) {
+			touch( it->second );
+			return;
+		}
+
+		Entry &entry = mEntries[key];
+		mLru.push_front( key );
+		entry.mLruIt = mLru.begin();
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mRequests.push_back( std::make_pair( key, generate ) );
+		}
+		mCondition.notify_one();
+	}
+	//! Returns the mesh of \a key once it is uploaded, nullptr if it hasn't been requested or isn't ready yet
+	ci::gl::VboMeshRef get( uint64_t key )
+	{
+		Lods lods = getLods( key );
+		return lods.mMeshes.empty() ? nullptr : lods.mMeshes.front();
+	}
+	//! Returns the levels of detail of \a key once they are uploaded, no mesh if it hasn't been requested or isn't ready yet
+	Lods getLods( uint64_t key )
+	{
+		auto it = mEntries.find( key );
+		if( it == mEntries.end() || it->second.mLods.mMeshes.empty() ) {
+			return Lods();
+		}
+		touch( it->second );
+		return it->second.mLods;
+	}
+
+	//! Uploads the meshes generated since the last update and releases the least recently used ones. Call once per frame from the gl thread
+	void update()
+	{
+		std::deque<Generated> generated;
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			generated.swap( mGenerated );
+		}
+		for( const auto &result : generated ) {
+			// the entry might have been released, or already filled by an earlier generation of the same key
+			auto it = mEntries.find( result.mKey );
+			if( it == mEntries.end() || ! it->second.mLods.mMeshes.empty() ) {
+				continue;
+			}
+			if( ! result.mTriMesh ) {
+				// generation failed, a later request tries again
+				mLru.erase( it->second.mLruIt );
+				mEntries.erase( it );
+				continue;
+			}
+			const ci::TriMesh &triMesh	= *result.mTriMesh;
+			Lods &lods					= it->second.mLods;
+			auto mesh					= mOptions.mUpload ? mOptions.mUpload( triMesh ) : ci::gl::VboMesh::create( triMesh );
+			lods.mMeshes.push_back( mesh );
+			lods.mErrors.push_back( 0.0f );
+			lods.mRadius				= result.mRadius;
+			it->second.mBytes			= getBytes( triMesh );
+
+			// the simplified levels only have their own indices
+			for( size_t i = 1; i < result.mLods.size(); ++i ) {
+				const auto &indices = result.mLods[i].mIndices;
+				auto indexVbo = ci::gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof( uint32_t ), indices.data(), GL_STATIC_DRAW );
+				lods.mMeshes.push_back( ci::gl::VboMesh::create( mesh->getNumVertices(), GL_TRIANGLES, mesh->getVertexArrayLayoutVbos(), static_cast<uint32_t>( indices.size() ), GL_UNSIGNED_INT, indexVbo ) );
+				lods.mErrors.push_back( result.mLods[i].mError );
+				it->second.mBytes += indices.size() * sizeof( uint32_t );
+			}
+			mResidentBytes += it->second.mBytes;
+		}
+
+		// release the least recently used meshes, the most recent one is always kept. The entries still generating
+		// don't use any memory yet and are skipped, releasing them would queue a second generation when requested again
+		auto lru = mLru.end();
+		while( mResidentBytes > mOptions.mBudget && ! mLru.empty() && std::prev( lru ) != mLru.begin() ) {
+			--lru;
+			auto it = mEntries.find( *lru );
+			if( it->second.mLods.mMeshes.empty() ) {
+				continue;
+			}
+			mResidentBytes -= it->second.mBytes;
+			mEntries.erase( it );
+			lru = mLru.erase( lru );
+		}
+	}
+
+	//! Returns the number of bytes used by the resident meshes
+	size_t getResidentBytes() const { return mResidentBytes; }
+	//! Returns the number of meshes in the cache, including the ones still generating
+	size_t getNumEntries() const { return mEntries.size(); }
+
+protected:
+	struct Entry {
+		Entry() : mBytes( 0 ) {}
+
+		Lods						mLods;
+		size_t						mBytes;
+		std::list<uint64_t>::iterator mLruIt;
+	};
+
+	struct Generated {
+		uint64_t							mKey;
+		ci::TriMeshRef						mTriMesh;
+		std::vector<MeshSimplifier::Lod>	mLods;
+		float								mRadius;
+	};
+
+	void touch( Entry &entry )
+	{
+		mLru.splice( mLru.begin(), mLru, entry.mLruIt );
+	}
+
+	static void hash( uint64_t *key, const void *data, size_t size )
+	{
+		const unsigned char *bytes = reinterpret_cast<const unsigned char*>( data );
+		for( size_t i = 0; i < size; ++i ) {
+			*key = ( *key ^ bytes[i] ) * 1099511628211ull;
+		}
+	}
+	static void hashParams( uint64_t * ) {}
+	template<typename Param, typename... Params>
+	static void hashParams( uint64_t *key, const Param &param, const Params&... params )
+	{
+		static_assert( std::is_arithmetic<Param>::value || std::is_enum<Param>::value, "MeshCache keys are built from numbers" );
+		hash( key, &param, sizeof( Param ) );
+		hashParams( key, params... );
+	}
+
+	//! Size of the vertex attributes and indices uploaded from \a triMesh
+	static size_t getBytes( const ci::TriMesh &triMesh )
+	{
+		size_t bytes = triMesh.getNumIndices() * sizeof( uint32_t );
+		for( const auto &attrib : triMesh.getAvailableAttribs() ) {
+			bytes += triMesh.getNumVertices() * triMesh.getAttribDims( attrib ) * sizeof( float );
+		}
+		return bytes;
+	}
+
+	//! Worker thread, generates the requested meshes in order
+	void generateRequests()
+	{
+		while( true ) {
+			std::pair<uint64_t,std::function<ci::TriMeshRef()>> request;
+			{
+				std::unique_lock<std::mutex> lock( mMutex );
+				mCondition.wait( lock, [this]() { return ! mRunning || ! mRequests.empty(); } );
+				if( ! mRunning ) {
+					return;
+				}
+				request = mRequests.front();
+				mRequests.pop_front();
+			}
+
+			Generated result;
+			result.mKey		= request.first;
+			result.mRadius	= 0.0f;
+			try {
+				result.mTriMesh = request.second();
+				if( result.mTriMesh && mOptions.mOptimize ) {
+					auto report = MeshOptimizer::optimize( result.mTriMesh.get() );
+					CI_LOG_I( "Optimized mesh " << std::hex << request.first << std::dec << ", ACMR " << report.mBefore.mAcmr << " -> " << report.mAfter.mAcmr << ", ATVR " << report.mBefore.mAtvr << " -> " << report.mAfter.mAtvr );
+				}
+				if( result.mTriMesh && mOptions.mNumLods > 1 ) {
+					result.mLods = MeshSimplifier::buildLods( *result.mTriMesh, MeshSimplifier::Options().lods( mOptions.mNumLods ) );
+				}
+				if( result.mTriMesh && result.mTriMesh->getPositionsDims() == 3 ) {
+					const ci::vec3 *positions = result.mTriMesh->getPositions<3>();
+					for( size_t i = 0; i < result.mTriMesh->getNumVertices(); ++i ) {
+						result.mRadius = std::max( result.mRadius, glm::length( positions[i] ) );
+					}
+				}
+			}
+			catch( const std::exception &exc ) {
+				CI_LOG_E( exc.what() );
+				result.mTriMesh.reset();
+			}
+			std::lock_guard<std::mutex> lock( mMutex );
+			mGenerated.push_back( result );
+		}
+	}
+
+	Options												mOptions;
+	std::unordered_map<uint64_t,Entry>					mEntries;
+	std::list<uint64_t>									mLru;
+	size_t												mResidentBytes;
+
+	std::thread											mThread;
+	std::mutex											mMutex;
+	std::condition_variable								mCondition;
+	bool												mRunning;
+	std::deque<std::pair<uint64_t,std::function<ci::TriMeshRef()>>>	mRequests;
+	std::deque<Generated>								mGenerated;
+};
@@ -0,0 +1,433 @@
+/*
+
+ MeshSimplifier
+
+ Copyright (c) 2015, Simon Geilfus
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <unordered_map>
+#include <array>
+#include <iterator>
+#include <cstring>
+
+#include "MeshOptimizer.h"
+
+//! Builds the levels of detail of an indexed mesh with quadric error edge collapses ( Garland and Heckbert, "Surface Simplification
+//! Using Quadric Error Metrics" ). Vertices only collapse onto one of their neighbors, so every level is a new index buffer over
+//! the vertices of the full detail mesh and all the levels can share its vertex buffers. The vertices split along uv or normal seams
+//! are welded by position and only collapse along the seam, the borders only along the border.
+class MeshSimplifier {
+public:
+	struct Options {
+		Options() : mNumLods( 4 ), mRatio( 0.5f ), mMaxError( 0.05f ) {}
+
+		//! Number of levels, including the full detail mesh
+		Options& lods( size_t numLods ) { mNumLods = std::max<size_t>( 1, numLods ); return *this; }
+		//! Fraction of the triangles of the previous level that each level aims for
+		Options& ratio( float ratio ) { mRatio = ratio; return *this; }
+		//! Largest error of a level relative to the size of the mesh, the chain stops earlier if it is reached
+		Options& maxError( float maxError ) { mMaxError = maxError; return *this; }
+
+		size_t	mNumLods;
+		float	mRatio, mMaxError;
+	};
+
+	struct Lod {
+		Lod() : mError( 0.0f ) {}
+
+		std::vector<uint32_t>	mIndices;
+		//! Distance between the surface of this level and the full detail mesh, in the units of the positions
+		float					mError;
+	};
+
+	//! Builds the levels of \a mesh, a ci::TriMesh with 3d positions
+	template<typename TriMeshT>
+	static std::vector<Lod> buildLods( const TriMeshT &mesh, const Options &options = Options() )
+	{
+		const auto &indices = mesh.getIndices();
+		const float *positions = mesh.getPositionsDims() == 3 ? reinterpret_cast<const float*>( mesh.template getPositions<3>() ) : nullptr;
+		if( ! positions ) {
+			std::vector<Lod> lods( 1 );
+			lods[0].mIndices = indices;
+			return lods;
+		}
+		return buildLods( indices.data(), indices.size(), positions, 3, mesh.getNumVertices(), options );
+	}
+
+	//! Builds the levels of an index buffer, the first one is a copy of \a indices. Each level is simplified from the previous one and
+	//! reordered for the vertex cache and overdraw. The chain stops when a level can't get under the ratio without passing the error limit
+	static std::vector<Lod> buildLods( const uint32_t *indices, size_t numIndices, const float *positions, size_t positionStride, size_t numVertices, const Options &options = Options() )
+	{
+		std::vector<Lod> lods( 1 );
+		lods[0].mIndices.assign( indices, indices + numIndices );
+		float size = getSize( indices, numIndices, positions, positionStride );
+		while( lods.size() < options.mNumLods ) {
+			const Lod &previous = lods.back();
+			size_t target = static_cast<size_t>( previous.mIndices.size() / 3 * options.mRatio ) * 3;
+			float remainingError = options.mMaxError * size - previous.mError;
+			if( target == 0 || remainingError <= 0.0f ) {
+				break;
+			}
+
+			Lod lod;
+			lod.mIndices = previous.mIndices;
+			float error = 0.0f;
+			lod.mIndices.resize( simplify( lod.mIndices.data(), lod.mIndices.size(), positions, positionStride, numVertices, target, remainingError, &error ) );
+			// a level that barely removes anything isn't worth its memory
+			if( lod.mIndices.empty() || lod.mIndices.size() > previous.mIndices.size() * ( 1.0f + options.mRatio ) * 0.5f ) {
+				break;
+			}
+			lod.mError = previous.mError + error;
+
+			std::vector<uint32_t> clusters;
+			MeshOptimizer::optimizeVertexCache( lod.mIndices.data(), lod.mIndices.size(), numVertices, 16, &clusters );
+			MeshOptimizer::optimizeOverdraw( lod.mIndices.data(), lod.mIndices.size(), positions, positionStride, numVertices, &clusters, 16, 1.05f );
+			lods.push_back( std::move( lod ) );
+		}
+		return lods;
+	}
+
+	//! Returns the coarsest level whose error covers at most \a maxPixels on screen, \a pixelsPerUnit being the size in pixels of one
+	//! unit at the distance of the mesh
+	static size_t selectLod( const std::vector<float> &errors, float pixelsPerUnit, float maxPixels )
+	{
+		size_t lod = 0;
+		while( lod + 1 < errors.size() && errors[lod + 1] * pixelsPerUnit <= maxPixels ) {
+			++lod;
+		}
+		return lod;
+	}
+
+	//! Collapses edges of \a indices in place until \a targetIndices is reached or the next collapse would move the surface by more than
+	//! \a maxError, in the units of the positions. Returns the new number of indices, \a error receives the largest distance reached
+	static size_t simplify( uint32_t *indices, size_t numIndices, const float *positions, size_t positionStride, size_t numVertices, size_t targetIndices, float maxError, float *error )
+	{
+		*error = 0.0f;
+		if( numIndices <= targetIndices ) {
+			return numIndices;
+		}
+
+		// work on positions normalized to the unit cube, and weld the vertices that only differ by their other attributes
+		float min[3] = { 1e30f, 1e30f, 1e30f }, max[3] = { -1e30f, -1e30f, -1e30f };
+		for( size_t i = 0; i < numIndices; ++i ) {
+			const float *p = positions + indices[i] * positionStride;
+			for( int c = 0; c < 3; ++c ) {
+				min[c] = std::min( min[c], p[c] );
+				max[c] = std::max( max[c], p[c] );
+			}
+		}
+		float extent = std::max( max[0] - min[0], std::max( max[1] - min[1], max[2] - min[2] ) );
+		float scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+		std::vector<uint32_t> welded = weld( positions, positionStride, numVertices );
+		auto position = [&]( uint32_t v, double *p ) {
+			for( int c = 0; c < 3; ++c ) p[c] = ( positions[v * positionStride + c] - min[c] ) * scale;
+		};
+
+		size_t count = removeDegenerates( indices, numIndices, welded );
+
+		// the error of moving a vertex is measured against the planes of its triangles and of the ones already collapsed into it.
+		// the open borders get planes perpendicular to their triangles so they keep their outline
+		std::vector<Quadric> quadrics( numVertices );
+		std::unordered_map<uint64_t,int> halfEdges;
+		for( size_t i = 0; i < count; ++i ) {
+			halfEdges[edgeKey( welded[indices[i]], welded[indices[i - i % 3 + ( i + 1 ) % 3]] )]++;
+		}
+		for( size_t t = 0; t < count / 3; ++t ) {
+			double p[3][3];
+			for( int c = 0; c < 3; ++c ) position( welded[indices[t * 3 + c]], p[c] );
+			double n[3];
+			double area = cross( p[0], p[1], p[2], n );
+			if( area <= 0.0 ) continue;
+			for( int c = 0; c < 3; ++c ) n[c] /= area;
+			Quadric plane( n, -dot( n, p[0] ), area );
+			for( int c = 0; c < 3; ++c ) quadrics[welded[indices[t * 3 + c]]].add( plane );
+
+			for( int c = 0; c < 3; ++c ) {
+				uint32_t a = welded[indices[t * 3 + c]], b = welded[indices[t * 3 + ( c + 1 ) % 3]];
+				if( halfEdges.count( edgeKey( b, a ) ) ) continue;
+				double edge[3] = { p[( c + 1 ) % 3][0] - p[c][0], p[( c + 1 ) % 3][1] - p[c][1], p[( c + 1 ) % 3][2] - p[c][2] }, side[3];
+				side[0] = edge[1] * n[2] - edge[2] * n[1];
+				side[1] = edge[2] * n[0] - edge[0] * n[2];
+				side[2] = edge[0] * n[1] - edge[1] * n[0];
+				double length = std::sqrt( dot( side, side ) );
+				if( length <= 0.0 ) continue;
+				for( int k = 0; k < 3; ++k ) side[k] /= length;
+				Quadric border( side, -dot( side, p[c] ), length * length * 4.0 );
+				quadrics[a].add( border );
+				quadrics[b].add( border );
+			}
+		}
+
+		std::vector<uint32_t> remap( numVertices );
+		for( size_t v = 0; v < numVertices; ++v ) remap[v] = static_cast<uint32_t>( v );
+		std::vector<bool> locked( numVertices, false );
+		double limit = maxError * scale * maxError * scale, reached = 0.0;
+
+		// each pass collapses the cheapest edges whose vertices haven't moved yet in the pass, then rebuilds the topology
+		while( count > targetIndices ) {
+			Topology topology( indices, count, welded, numVertices );
+
+			struct Collapse { uint32_t mFrom, mTo; double mCost; };
+			std::vector<Collapse> collapses;
+			for( size_t i = 0; i < count; ++i ) {
+				uint32_t a = welded[indices[i]], b = welded[indices[i - i % 3 + ( i + 1 ) % 3]];
+				for( int direction = 0; direction < 2; ++direction ) {
+					uint32_t from = direction ? b : a, to = direction ? a : b;
+					if( topology.mKinds[from] == LOCKED || ( topology.mKinds[from] == BORDER && ! topology.isBorder( from, to ) ) ) continue;
+					double p[3];
+					position( to, p );
+					Collapse collapse = { from, to, quadrics[from].getError( p ) };
+					collapses.push_back( collapse );
+				}
+			}
+			std::sort( collapses.begin(), collapses.end(), []( const Collapse &a, const Collapse &b ) { return a.mCost < b.mCost; } );
+
+			size_t removedGoal = ( count - targetIndices ) / 3, removed = 0;
+			std::vector<uint32_t> moved;
+			for( const auto &collapse : collapses ) {
+				if( removed >= removedGoal || collapse.mCost > limit ) break;
+				if( locked[collapse.mFrom] || locked[collapse.mTo] ) continue;
+				int shared = 0;
+				if( ! canCollapse( collapse.mFrom, collapse.mTo, indices, welded, remap, topology, positions, positionStride, &shared ) ) continue;
+
+				// the wedges of the collapsed vertex were mapped by canCollapse
+				quadrics[collapse.mTo].add( quadrics[collapse.mFrom] );
+				locked[collapse.mFrom] = locked[collapse.mTo] = true;
+				moved.push_back( collapse.mFrom );
+				moved.push_back( collapse.mTo );
+				removed += shared;
+				reached = std::max( reached, collapse.mCost );
+			}
+			if( moved.empty() ) {
+				break;
+			}
+
+			for( size_t i = 0; i < count; ++i ) indices[i] = remap[indices[i]];
+			for( size_t v = 0; v < numVertices; ++v ) remap[v] = static_cast<uint32_t>( v );
+			for( uint32_t v : moved ) locked[v] = false;
+			count = removeDegenerates( indices, count, welded );
+		}
+
+		*error = static_cast<float>( std::sqrt( reached ) / scale );
+		return count;
+	}
+
+protected:
+	enum VertexKind { MANIFOLD, BORDER, LOCKED };
+
+	//! Symmetric 4x4 matrix of the squared distances to a set of weighted planes
+	struct Quadric {
+		Quadric() : mA00( 0 ), mA11( 0 ), mA22( 0 ), mA01( 0 ), mA02( 0 ), mA12( 0 ), mB0( 0 ), mB1( 0 ), mB2( 0 ), mC( 0 ), mWeight( 0 ) {}
+		Quadric( const double *n, double d, double weight )
+		: mA00( weight * n[0] * n[0] ), mA11( weight * n[1] * n[1] ), mA22( weight * n[2] * n[2] ),
+		mA01( weight * n[0] * n[1] ), mA02( weight * n[0] * n[2] ), mA12( weight * n[1] * n[2] ),
+		mB0( weight * n[0] * d ), mB1( weight * n[1] * d ), mB2( weight * n[2] * d ), mC( weight * d * d ), mWeight( weight ) {}
+
+		void add( const Quadric &q )
+		{
+			mA00 += q.mA00; mA11 += q.mA11; mA22 += q.mA22; mA01 += q.mA01; mA02 += q.mA02; mA12 += q.mA12;
+			mB0 += q.mB0; mB1 += q.mB1; mB2 += q.mB2; mC += q.mC; mWeight += q.mWeight;
+		}
+		//! Weighted mean of the squared distances of \a p to the planes
+		double getError( const double *p ) const
+		{
+			double rx = mA00 * p[0] + mA01 * p[1] + mA02 * p[2] + mB0;
+			double ry = mA01 * p[0] + mA11 * p[1] + mA12 * p[2] + mB1;
+			double rz = mA02 * p[0] + mA12 * p[1] + mA22 * p[2] + mB2;
+			double error = rx * p[0] + ry * p[1] + rz * p[2] + mB0 * p[0] + mB1 * p[1] + mB2 * p[2] + mC;
+			return mWeight > 0.0 ? std::max( 0.0, error / mWeight ) : 0.0;
+		}
+
+		double mA00, mA11, mA22, mA01, mA02, mA12, mB0, mB1, mB2, mC, mWeight;
+	};
+
+	//! Triangles around each welded vertex and the kind of each vertex, for one pass
+	struct Topology {
+		Topology( const uint32_t *indices, size_t count, const std::vector<uint32_t> &welded, size_t numVertices )
+		: mOffsets( numVertices + 1, 0 ), mTriangles( count ), mKinds( numVertices, MANIFOLD )
+		{
+			for( size_t i = 0; i < count; ++i ) mOffsets[welded[indices[i]] + 1]++;
+			for( size_t v = 0; v < numVertices; ++v ) mOffsets[v + 1] += mOffsets[v];
+			std::vector<uint32_t> fill( mOffsets.begin(), mOffsets.end() - 1 );
+			for( size_t i = 0; i < count; ++i ) {
+				mTriangles[fill[welded[indices[i]]]++] = static_cast<uint32_t>( i / 3 );
+				mHalfEdges[edgeKey( welded[indices[i]], welded[indices[i - i % 3 + ( i + 1 ) % 3]] )]++;
+			}
+
+			// a vertex with two border edges is on a border, an edge shared by more than two triangles or a vertex
+			// where several borders meet make it non manifold
+			std::vector<int> borders( numVertices, 0 );
+			for( const auto &halfEdge : mHalfEdges ) {
+				uint32_t a = static_cast<uint32_t>( halfEdge.first >> 32 ), b = static_cast<uint32_t>( halfEdge.first );
+				auto opposite = mHalfEdges.find( edgeKey( b, a ) );
+				if( halfEdge.second > 1 || ( opposite != mHalfEdges.end() && opposite->second > 1 ) ) {
+					mKinds[a] = mKinds[b] = LOCKED;
+				}
+				else if( opposite == mHalfEdges.end() ) {
+					borders[a]++;
+					borders[b]++;
+				}
+			}
+			for( size_t v = 0; v < numVertices; ++v ) {
+				if( mKinds[v] == MANIFOLD && borders[v] ) {
+					mKinds[v] = borders[v] == 2 ? BORDER : LOCKED;
+				}
+			}
+		}
+
+		bool isBorder( uint32_t a, uint32_t b ) const
+		{
+			return ! mHalfEdges.count( edgeKey( a, b ) ) || ! mHalfEdges.count( edgeKey( b, a ) );
+		}
+
+		std::vector<uint32_t>				mOffsets, mTriangles;
+		std::vector<VertexKind>				mKinds;
+		std::unordered_map<uint64_t,int>	mHalfEdges;
+	};
+
+	//! Checks that moving \a from onto \a to keeps the mesh manifold, doesn't flip any triangle and that each wedge of \a from has a
+	//! single wedge of \a to across the collapsed edge, and maps them in \a remap. \a shared receives the number of triangles removed
+	static bool canCollapse( uint32_t from, uint32_t to, const uint32_t *indices, const std::vector<uint32_t> &welded, std::vector<uint32_t> &remap, const Topology &topology, const float *positions, size_t positionStride, int *shared )
+	{
+		std::vector<std::pair<uint32_t,uint32_t>> wedges;
+		std::vector<uint32_t> neighbors, toNeighbors;
+		*shared = 0;
+		for( uint32_t a = topology.mOffsets[from]; a < topology.mOffsets[from + 1]; ++a ) {
+			const uint32_t *triangle = indices + topology.mTriangles[a] * 3;
+			int corner = 0, toCorner = -1;
+			for( int c = 0; c < 3; ++c ) {
+				uint32_t w = welded[remap[triangle[c]]];
+				if( w == from ) corner = c;
+				else if( w == to ) toCorner = c;
+				else neighbors.push_back( w );
+			}
+			uint32_t wedge = triangle[corner];
+			if( toCorner >= 0 ) {
+				++*shared;
+				uint32_t target = remap[triangle[toCorner]];
+				for( const auto &mapping : wedges ) {
+					if( mapping.first == wedge && mapping.second != target ) return false;
+				}
+				wedges.push_back( std::make_pair( wedge, target ) );
+				continue;
+			}
+
+			// the triangle stays, it must roughly keep facing the same way once the vertex moves. turning by more than
+			// 60 degrees is as good as a fold on a curved surface
+			const float *p[3], *moved = positions + to * positionStride;
+			for( int c = 0; c < 3; ++c ) p[c] = positions + remap[triangle[c]] * positionStride;
+			double before[3], after[3];
+			double beforeLength = cross( p[0], p[1], p[2], before );
+			const float *q[3] = { p[0], p[1], p[2] };
+			q[corner] = moved;
+			double afterLength = cross( q[0], q[1], q[2], after );
+			if( dot( before, after ) <= 0.5 * beforeLength * afterLength ) return false;
+		}
+		if( *shared == 0 ) return false;
+		for( uint32_t a = topology.mOffsets[from]; a < topology.mOffsets[from + 1]; ++a ) {
+			const uint32_t *triangle = indices + topology.mTriangles[a] * 3;
+			for( int c = 0; c < 3; ++c ) {
+				if( welded[remap[triangle[c]]] != from ) continue;
+				bool mapped = false;
+				for( const auto &mapping : wedges ) mapped = mapped || mapping.first == triangle[c];
+				if( ! mapped ) return false;
+			}
+		}
+
+		// link condition, the vertices around both ends of the edge are only the ones of the removed triangles
+		for( uint32_t a = topology.mOffsets[to]; a < topology.mOffsets[to + 1]; ++a ) {
+			const uint32_t *triangle = indices + topology.mTriangles[a] * 3;
+			for( int c = 0; c < 3; ++c ) {
+				uint32_t w = welded[remap[triangle[c]]];
+				if( w != from && w != to ) toNeighbors.push_back( w );
+			}
+		}
+		std::sort( neighbors.begin(), neighbors.end() );
+		neighbors.erase( std::unique( neighbors.begin(), neighbors.end() ), neighbors.end() );
+		std::sort( toNeighbors.begin(), toNeighbors.end() );
+		toNeighbors.erase( std::unique( toNeighbors.begin(), toNeighbors.end() ), toNeighbors.end() );
+		std::vector<uint32_t> common;
+		std::set_intersection( neighbors.begin(), neighbors.end(), toNeighbors.begin(), toNeighbors.end(), std::back_inserter( common ) );
+		if( common.size() > static_cast<size_t>( *shared ) ) return false;
+
+		for( const auto &mapping : wedges ) remap[mapping.first] = mapping.second;
+		return true;
+	}
+
+	//! Returns the first vertex with the same position as each vertex
+	static std::vector<uint32_t> weld( const float *positions, size_t positionStride, size_t numVertices )
+	{
+		struct Hash {
+			size_t operator()( const std::array<uint32_t,3> &p ) const { return ( p[0] * 73856093u ) ^ ( p[1] * 19349663u ) ^ ( p[2] * 83492791u ); }
+		};
+		std::unordered_map<std::array<uint32_t,3>,uint32_t,Hash> firsts;
+		std::vector<uint32_t> welded( numVertices );
+		for( size_t v = 0; v < numVertices; ++v ) {
+			std::array<uint32_t,3> key;
+			for( int c = 0; c < 3; ++c ) {
+				float value = positions[v * positionStride + c] + 0.0f; // -0 and 0 weld
+				std::memcpy( &key[c], &value, sizeof( float ) );
+			}
+			welded[v] = firsts.insert( std::make_pair( key, static_cast<uint32_t>( v ) ) ).first->second;
+		}
+		return welded;
+	}
+
+	//! Removes the triangles with two corners at the same position, returns the new number of indices
+	static size_t removeDegenerates( uint32_t *indices, size_t count, const std::vector<uint32_t> &welded )
+	{
+		size_t kept = 0;
+		for( size_t t = 0; t < count / 3; ++t ) {
+			uint32_t a = welded[indices[t * 3]], b = welded[indices[t * 3 + 1]], c = welded[indices[t * 3 + 2]];
+			if( a == b || b == c || a == c ) continue;
+			for( int k = 0; k < 3; ++k ) indices[kept++] = indices[t * 3 + k];
+		}
+		return kept;
+	}
+
+	//! Diagonal of the bounding box of the vertices used by \a indices
+	static float getSize( const uint32_t *indices, size_t numIndices, const float *positions, size_t positionStride )
+	{
+		float min[3] = { 1e30f, 1e30f, 1e30f }, max[3] = { -1e30f, -1e30f, -1e30f };
+		for( size_t i = 0; i < numIndices; ++i ) {
+			for( int c = 0; c < 3; ++c ) {
+				min[c] = std::min( min[c], positions[indices[i] * positionStride + c] );
+				max[c] = std::max( max[c], positions[indices[i] * positionStride + c] );
+			}
+		}
+		double size = 0.0;
+		for( int c = 0; c < 3 && numIndices; ++c ) size += ( max[c] - min[c] ) * ( max[c] - min[c] );
+		return static_cast<float>( std::sqrt( size ) );
+	}
+
+	static uint64_t edgeKey( uint32_t a, uint32_t b ) { return ( static_cast<uint64_t>( a ) << 32 ) | b; }
+	static double dot( const double *a, const double *b ) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+	//! Writes the normal of the triangle scaled by twice its area and returns its length
+	template<typename T>
+	static double cross( const T *p0, const T *p1, const T *p2, double *n )
+	{
+		double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] }, e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+		return std::sqrt( dot( n, n ) );
+	}
+};
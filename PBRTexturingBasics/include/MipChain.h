@@ -0,0 +1,182 @@
+/*
+
+ MipChain
+
+ Copyright (c) 2015, Simon Geilfus
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "CubeMapPrefilter.h"
+
+//! Floating point image of 1 to 4 interleaved channels in the [0, 1] range and its mips
+class MipChain {
+public:
+	struct Options {
+		Options() : mNormalMap( false ), mWrap( true ), mNumThreads( std::max( 1u, std::thread::hardware_concurrency() ) ) {}
+
+		//! The first three channels are a tangent space normal stored as n * 0.5 + 0.5, renormalized at each mip
+		Options& normalMap( bool normalMap = true ) { mNormalMap = normalMap; return *this; }
+		//! Whether the filter wraps around the borders of a tiling texture or clamps to them
+		Options& wrap( bool wrap = true ) { mWrap = wrap; return *this; }
+		Options& threads( size_t numThreads ) { mNumThreads = std::max<size_t>( 1, numThreads ); return *this; }
+
+		bool	mNormalMap, mWrap;
+		size_t	mNumThreads;
+	};
+
+	MipChain() : mWidth( 0 ), mHeight( 0 ), mNumChannels( 0 ) {}
+	MipChain( int width, int height, int numChannels, int numMips = 1 )
+	: mWidth( width ), mHeight( height ), mNumChannels( numChannels ), mMips( numMips )
+	{
+		for( int mip = 0; mip < numMips; ++mip ) {
+			mMips[mip].resize( getWidth( mip ) * getHeight( mip ) * numChannels );
+		}
+	}
+
+	int getWidth( int mip = 0 ) const { return std::max( 1, mWidth >> mip ); }
+	int getHeight( int mip = 0 ) const { return std::max( 1, mHeight >> mip ); }
+	int getNumChannels() const { return mNumChannels; }
+	int getNumMips() const { return static_cast<int>( mMips.size() ); }
+	float* getData( int mip = 0 ) { return mMips[mip].data(); }
+	const float* getData( int mip = 0 ) const { return mMips[mip].data(); }
+
+	//! Returns the number of levels of a full chain down to 1x1
+	static int getNumMips( int width, int height )
+	{
+		int numMips = 1;
+		while( ( width | height ) >> numMips ) ++numMips;
+		return numMips;
+	}
+
+	//! Replaces the mips below the first level by a full chain down to 1x1. Each level is reduced from the previous one with a
+	//! separable Kaiser windowed sinc, sharper than the box filter of glGenerateMipmap and without its aliasing
+	void buildMips( const Options &options = Options() )
+	{
+		mMips.resize( 1 );
+		for( int mip = 1; mip < getNumMips( mWidth, mHeight ); ++mip ) {
+			int srcWidth = getWidth( mip - 1 ), srcHeight = getHeight( mip - 1 ), width = getWidth( mip ), height = getHeight( mip );
+			std::vector<Tap> tapsX = getTaps( srcWidth, width, options.mWrap ), tapsY = getTaps( srcHeight, height, options.mWrap );
+			std::vector<float> rows( width * srcHeight * mNumChannels );
+			mMips.push_back( std::vector<float>( width * height * mNumChannels ) );
+			const float *src = mMips[mip - 1].data();
+			float *dst = mMips[mip].data();
+
+			// horizontal pass over every source row, then vertical pass
+			runRows( srcHeight, options.mNumThreads, [&]( int y ) {
+				for( int x = 0; x < width; ++x ) {
+					float *texel = &rows[( y * width + x ) * mNumChannels];
+					for( int c = 0; c < mNumChannels; ++c ) texel[c] = 0.0f;
+					for( int t = tapsX[x].mFirst; t < tapsX[x].mLast; ++t ) {
+						const float *srcTexel = &src[( y * srcWidth + tapsX[t].mIndex ) * mNumChannels];
+						for( int c = 0; c < mNumChannels; ++c ) texel[c] += tapsX[t].mWeight * srcTexel[c];
+					}
+				}
+			} );
+			runRows( height, options.mNumThreads, [&]( int y ) {
+				for( int x = 0; x < width; ++x ) {
+					float *texel = &dst[( y * width + x ) * mNumChannels];
+					for( int c = 0; c < mNumChannels; ++c ) texel[c] = 0.0f;
+					for( int t = tapsY[y].mFirst; t < tapsY[y].mLast; ++t ) {
+						const float *rowTexel = &rows[( tapsY[t].mIndex * width + x ) * mNumChannels];
+						for( int c = 0; c < mNumChannels; ++c ) texel[c] += tapsY[t].mWeight * rowTexel[c];
+					}
+					// the negative lobes can overshoot, and filtered normals get shorter
+					if( options.mNormalMap && mNumChannels >= 3 ) {
+						float n[3], length = 0.0f;
+						for( int c = 0; c < 3; ++c ) {
+							n[c] = texel[c] * 2.0f - 1.0f;
+							length += n[c] * n[c];
+						}
+						length = length > 0.0f ? 1.0f / std::sqrt( length ) : 0.0f;
+						for( int c = 0; c < 3; ++c ) texel[c] = length > 0.0f ? n[c] * length * 0.5f + 0.5f : ( c == 2 ? 1.0f : 0.5f );
+					}
+					for( int c = 0; c < mNumChannels; ++c ) texel[c] = std::min( 1.0f, std::max( 0.0f, texel[c] ) );
+				}
+			} );
+		}
+	}
+
+protected:
+	//! The taps of a destination texel are the entries mFirst to mLast of the same array, which start with one entry per destination texel
+	struct Tap {
+		int		mIndex, mFirst, mLast;
+		float	mWeight;
+	};
+
+	static double besselI0( double x )
+	{
+		double sum = 1.0, term = 1.0;
+		for( int k = 1; k < 32; ++k ) {
+			term *= ( x * 0.5 / k ) * ( x * 0.5 / k );
+			sum += term;
+		}
+		return sum;
+	}
+	//! Kaiser windowed sinc of width 3 and alpha 4, \a x is in destination texels
+	static double kaiser( double x )
+	{
+		const double width = 3.0, alpha = 4.0;
+		if( std::abs( x ) >= width ) return 0.0;
+		double sinc = x == 0.0 ? 1.0 : std::sin( 3.14159265358979 * x ) / ( 3.14159265358979 * x );
+		return sinc * besselI0( alpha * std::sqrt( 1.0 - ( x / width ) * ( x / width ) ) ) / besselI0( alpha );
+	}
+	//! Returns the normalized weights of the source texels of each destination texel along an axis
+	static std::vector<Tap> getTaps( int srcSize, int size, bool wrap )
+	{
+		std::vector<Tap> taps( size );
+		double scale = static_cast<double>( srcSize ) / size;
+		for( int i = 0; i < size; ++i ) {
+			double center = ( i + 0.5 ) * scale;
+			int first = static_cast<int>( std::floor( center - 3.0 * scale ) ), last = static_cast<int>( std::ceil( center + 3.0 * scale ) );
+			taps[i].mFirst = static_cast<int>( taps.size() );
+			double sum = 0.0;
+			for( int j = first; j <= last; ++j ) {
+				double weight = kaiser( ( j + 0.5 - center ) / scale );
+				if( weight == 0.0 ) continue;
+				Tap tap;
+				tap.mIndex	= wrap ? ( ( j % srcSize ) + srcSize ) % srcSize : std::min( srcSize - 1, std::max( 0, j ) );
+				tap.mWeight	= static_cast<float>( weight );
+				taps.push_back( tap );
+				sum += weight;
+			}
+			taps[i].mLast = static_cast<int>( taps.size() );
+			for( int t = taps[i].mFirst; t < taps[i].mLast; ++t ) taps[t].mWeight = static_cast<float>( taps[t].mWeight / sum );
+		}
+		return taps;
+	}
+	//! Spreads the rows over the threads
+	static void runRows( int numRows, size_t numThreads, const std::function<void(int)> &row )
+	{
+		std::atomic<int> nextRow( 0 );
+		auto worker = [&](){
+			int y;
+			while( ( y = nextRow++ ) < numRows ) row( y );
+		};
+		std::vector<std::thread> threads;
+		for( size_t i = 1; i < numThreads; ++i ) {
+			threads.push_back( std::thread( worker ) );
+		}
+		worker();
+		for( auto &thread : threads ) thread.join();
+	}
+
+	int								mWidth, mHeight, mNumChannels;
+	std::vector<std::vector<float>>	mMips;
+};
@@ -0,0 +1,324 @@
+/*
+
+ RGTC
+
+ Copyright (c) 2015, Simon Geilfus
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <limits>
+
+#include "MipChain.h"
+
+//! BC4 or BC5 texture, the blocks of each mip
+class RGTCTexture {
+public:
+	enum Format {
+		//! one channel, 8 bytes per block
+		BC4,
+		//! two channels, 16 bytes per block
+		BC5
+	};
+
+	RGTCTexture() : mFormat( BC4 ), mWidth( 0 ), mHeight( 0 ) {}
+	RGTCTexture( Format format, int width, int height, int numMips )
+	: mFormat( format ), mWidth( width ), mHeight( height ), mMips( numMips )
+	{
+		for( int mip = 0; mip < numMips; ++mip ) {
+			mMips[mip].resize( getMipBytes( mip ) );
+		}
+	}
+
+	Format getFormat() const { return mFormat; }
+	int getNumChannels() const { return mFormat == BC4 ? 1 : 2; }
+	int getBlockBytes() const { return mFormat == BC4 ? 8 : 16; }
+	int getWidth( int mip = 0 ) const { return std::max( 1, mWidth >> mip ); }
+	int getHeight( int mip = 0 ) const { return std::max( 1, mHeight >> mip ); }
+	//! Returns the number of blocks of a row and of a column of a mip
+	int getNumBlocksX( int mip = 0 ) const { return ( getWidth( mip ) + 3 ) / 4; }
+	int getNumBlocksY( int mip = 0 ) const { return ( getHeight( mip ) + 3 ) / 4; }
+	size_t getMipBytes( int mip ) const { return getNumBlocksX( mip ) * getNumBlocksY( mip ) * getBlockBytes(); }
+	int getNumMips() const { return static_cast<int>( mMips.size() ); }
+	uint8_t* getData( int mip = 0 ) { return mMips[mip].data(); }
+	const uint8_t* getData( int mip = 0 ) const { return mMips[mip].data(); }
+
+protected:
+	Format								mFormat;
+	int									mWidth, mHeight;
+	std::vector<std::vector<uint8_t>>	mMips;
+};
+
+//! BC4 and BC5 ( RGTC1 and RGTC2 ) unsigned encoder and decoder. BC4 keeps the first channel of an image at half a byte per texel,
+//! BC5 the first two at one byte per texel, which suits a packed pair of masks or the x and y of a normal map.
+//! Each channel of a block has two 8 bits endpoints and 3 bits indices, the encoder tries both palette modes of the format
+//! and refines the endpoints with least squares and a small search around them.
+class RGTC {
+public:
+	struct Options {
+		Options() : mNumThreads( std::max( 1u, std::thread::hardware_concurrency() ) ) {}
+
+		Options& threads( size_t numThreads ) { mNumThreads = std::max<size_t>( 1, numThreads ); return *this; }
+		//! Called with progress messages and per mip timings
+		Options& log( const std::function<void(const std::string&)> &log ) { mLog = log; return *this; }
+
+		size_t		mNumThreads;
+		std::function<void(const std::string&)> mLog;
+	};
+
+	//! Compresses every mip of \a image, the first channel to BC4 or the first two to BC5
+	static RGTCTexture encode( const MipChain &image, RGTCTexture::Format format, const Options &options = Options() )
+	{
+		RGTCTexture compressed( format, image.getWidth(), image.getHeight(), image.getNumMips() );
+		if( image.getNumChannels() < compressed.getNumChannels() ) {
+			throw CubeMapPrefilterExc( "BC5 needs an image of at least two channels" );
+		}
+		for( int mip = 0; mip < image.getNumMips(); ++mip ) {
+			auto start = std::chrono::steady_clock::now();
+			int width = image.getWidth( mip ), height = image.getHeight( mip ), numChannels = image.getNumChannels();
+			const float *data = image.getData( mip );
+
+			// the rows of blocks are spread over the threads
+			std::atomic<int> nextRow( 0 );
+			auto worker = [&](){
+				int by;
+				while( ( by = nextRow++ ) < compressed.getNumBlocksY( mip ) ) {
+					for( int bx = 0; bx < compressed.getNumBlocksX( mip ); ++bx ) {
+						uint8_t *block = compressed.getData( mip ) + ( by * compressed.getNumBlocksX( mip ) + bx ) * compressed.getBlockBytes();
+						for( int c = 0; c < compressed.getNumChannels(); ++c ) {
+							// blocks of the smallest mips repeat their texels
+							float values[16];
+							for( int i = 0; i < 16; ++i ) {
+								int x = std::min( bx * 4 + i % 4, width - 1 ), y = std::min( by * 4 + i / 4, height - 1 );
+								values[i] = data[( y * width + x ) * numChannels + c];
+							}
+							encodeBlock( values, block + c * 8 );
+						}
+					}
+				}
+			};
+			std::vector<std::thread> threads;
+			for( size_t i = 1; i < options.mNumThreads; ++i ) {
+				threads.push_back( std::thread( worker ) );
+			}
+			worker();
+			for( auto &thread : threads ) thread.join();
+
+			if( options.mLog ) {
+				double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+				std::ostringstream message;
+				message << ( format == RGTCTexture::BC4 ? "BC4" : "BC5" ) << " mip " << mip << " (" << width << "x" << height << "): " << static_cast<int>( seconds * 1000.0 ) << "ms";
+				options.mLog( message.str() );
+			}
+		}
+		return compressed;
+	}
+
+	//! Decompresses every mip of \a compressed to an image of one or two channels
+	static MipChain decode( const RGTCTexture &compressed )
+	{
+		MipChain image( compressed.getWidth(), compressed.getHeight(), compressed.getNumChannels(), compressed.getNumMips() );
+		for( int mip = 0; mip < compressed.getNumMips(); ++mip ) {
+			int width = compressed.getWidth( mip ), height = compressed.getHeight( mip ), numChannels = compressed.getNumChannels();
+			for( int by = 0; by < compressed.getNumBlocksY( mip ); ++by ) {
+				for( int bx = 0; bx < compressed.getNumBlocksX( mip ); ++bx ) {
+					const uint8_t *block = compressed.getData( mip ) + ( by * compressed.getNumBlocksX( mip ) + bx ) * compressed.getBlockBytes();
+					for( int c = 0; c < numChannels; ++c ) {
+						float values[16];
+						decodeBlock( block + c * 8, values );
+						for( int i = 0; i < 16; ++i ) {
+							int x = bx * 4 + i % 4, y = by * 4 + i / 4;
+							if( x < width && y < height ) image.getData( mip )[( y * width + x ) * numChannels + c] = values[i];
+						}
+					}
+				}
+			}
+		}
+		return image;
+	}
+
+	//! Writes a DX10 BC4_UNORM or BC5_UNORM dds
+	static void writeDds( const RGTCTexture &compressed, const std::string &path )
+	{
+		std::ofstream file( path.c_str(), std::ios::binary );
+		if( ! file ) {
+			throw CubeMapPrefilterExc( "Can't write " + path );
+		}
+		uint32_t header[32] = {};
+		header[0]	= 0x20534444; // "DDS "
+		header[1]	= 124;
+		header[2]	= 0x1 | 0x2 | 0x4 | 0x1000 | 0x80000 | ( compressed.getNumMips() > 1 ? 0x20000 : 0 );
+		header[3]	= compressed.getHeight();
+		header[4]	= compressed.getWidth();
+		header[5]	= static_cast<uint32_t>( compressed.getMipBytes( 0 ) );
+		header[7]	= compressed.getNumMips();
+		header[19]	= 32;
+		header[20]	= 0x4; // fourcc
+		header[21]	= 0x30315844; // "DX10"
+		header[27]	= 0x1000 | ( compressed.getNumMips() > 1 ? 0x400008 : 0 );
+		uint32_t dx10[5] = { compressed.getFormat() == RGTCTexture::BC4 ? 80u : 83u, 3, 0, 1, 0 }; // BC4_UNORM or BC5_UNORM, 2d texture
+		file.write( reinterpret_cast<const char*>( header ), sizeof( header ) );
+		file.write( reinterpret_cast<const char*>( dx10 ), sizeof( dx10 ) );
+		for( int mip = 0; mip < compressed.getNumMips(); ++mip ) {
+			file.write( reinterpret_cast<const char*>( compressed.getData( mip ) ), compressed.getMipBytes( mip ) );
+		}
+	}
+
+	//! Compresses the 16 values of a channel, clamped to [0, 1], to an 8 bytes BC4 block
+	static void encodeBlock( const float *values, uint8_t *block )
+	{
+		float texels[16], minValue = 255.0f, maxValue = 0.0f, minInner = 255.0f, maxInner = 0.0f;
+		for( int i = 0; i < 16; ++i ) {
+			texels[i] = std::min( 1.0f, std::max( 0.0f, values[i] ) ) * 255.0f;
+			minValue = std::min( minValue, texels[i] );
+			maxValue = std::max( maxValue, texels[i] );
+			// the 6 values mode has explicit 0 and 255 entries, its endpoints only need to cover the values in between
+			if( texels[i] > 0.5f && texels[i] < 254.5f ) {
+				minInner = std::min( minInner, texels[i] );
+				maxInner = std::max( maxInner, texels[i] );
+			}
+		}
+
+		// the 8 values mode needs the first endpoint above the second, the 6 values mode the opposite
+		int best[2] = { quantize( maxValue ), quantize( minValue ) }, indices[16];
+		float bestError = std::numeric_limits<float>::max();
+		if( best[0] == best[1] ) {
+			bestError = fitEndpoints( texels, best, indices );
+		}
+		else {
+			int endpoints[2] = { best[0], best[1] };
+			bestError = refineEndpoints( texels, endpoints, best );
+			if( minInner <= maxInner ) {
+				endpoints[0] = quantize( minInner );
+				endpoints[1] = quantize( maxInner );
+				refineEndpoints( texels, endpoints, best, &bestError );
+			}
+			fitEndpoints( texels, best, indices );
+		}
+
+		uint64_t bits = static_cast<uint64_t>( best[0] ) | ( static_cast<uint64_t>( best[1] ) << 8 );
+		for( int i = 0; i < 16; ++i ) {
+			bits |= static_cast<uint64_t>( indices[i] ) << ( 16 + i * 3 );
+		}
+		for( int i = 0; i < 8; ++i ) {
+			block[i] = static_cast<uint8_t>( bits >> ( i * 8 ) );
+		}
+	}
+	//! Decompresses an 8 bytes BC4 block to 16 values in [0, 1]
+	static void decodeBlock( const uint8_t *block, float *values )
+	{
+		uint64_t bits = 0;
+		for( int i = 0; i < 8; ++i ) {
+			bits |= static_cast<uint64_t>( block[i] ) << ( i * 8 );
+		}
+		float palette[8];
+		buildPalette( block[0], block[1], palette );
+		for( int i = 0; i < 16; ++i ) {
+			values[i] = palette[( bits >> ( 16 + i * 3 ) ) & 0x7] / 255.0f;
+		}
+	}
+
+protected:
+	static int quantize( float value )
+	{
+		return std::min( 255, std::max( 0, static_cast<int>( value + 0.5f ) ) );
+	}
+	//! The palette the hardware decodes from the endpoints, the mode depends on their order
+	static void buildPalette( int red0, int red1, float *palette )
+	{
+		palette[0] = static_cast<float>( red0 );
+		palette[1] = static_cast<float>( red1 );
+		if( red0 > red1 ) {
+			for( int k = 1; k < 7; ++k ) palette[k + 1] = ( ( 7 - k ) * red0 + k * red1 ) / 7.0f;
+		}
+		else {
+			for( int k = 1; k < 5; ++k ) palette[k + 1] = ( ( 5 - k ) * red0 + k * red1 ) / 5.0f;
+			palette[6] = 0.0f;
+			palette[7] = 255.0f;
+		}
+	}
+	//! Picks the closest palette entry of each texel. Returns the total error
+	static float fitEndpoints( const float *texels, const int *endpoints, int *indices )
+	{
+		float palette[8], error = 0.0f;
+		buildPalette( endpoints[0], endpoints[1], palette );
+		for( int i = 0; i < 16; ++i ) {
+			float bestDistance = std::numeric_limits<float>::max();
+			for( int k = 0; k < 8; ++k ) {
+				float distance = ( texels[i] - palette[k] ) * ( texels[i] - palette[k] );
+				if( distance < bestDistance ) {
+					bestDistance	= distance;
+					indices[i]		= k;
+				}
+			}
+			error += bestDistance;
+		}
+		return error;
+	}
+	//! Least squares endpoints for the indices of \a endpoints, followed by a search of the endpoints around them that keeps their mode.
+	//! Keeps the result in \a best when its error is below \a bestError. Returns the error of the result
+	static float refineEndpoints( const float *texels, const int *endpoints, int *best, float *bestError = nullptr )
+	{
+		bool eightValues = endpoints[0] > endpoints[1];
+		int indices[16];
+		fitEndpoints( texels, endpoints, indices );
+
+		// weights of the second endpoint of each index, the explicit 0 and 255 of the 6 values mode don't take part
+		static const float weights8[8] = { 0.0f, 1.0f, 1.0f / 7.0f, 2.0f / 7.0f, 3.0f / 7.0f, 4.0f / 7.0f, 5.0f / 7.0f, 6.0f / 7.0f };
+		static const float weights6[6] = { 0.0f, 1.0f, 1.0f / 5.0f, 2.0f / 5.0f, 3.0f / 5.0f, 4.0f / 5.0f };
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax = 0.0f, bx = 0.0f;
+		for( int i = 0; i < 16; ++i ) {
+			if( ! eightValues && indices[i] > 5 ) continue;
+			float w = eightValues ? weights8[indices[i]] : weights6[indices[i]];
+			aa += ( 1.0f - w ) * ( 1.0f - w );
+			ab += ( 1.0f - w ) * w;
+			bb += w * w;
+			ax += ( 1.0f - w ) * texels[i];
+			bx += w * texels[i];
+		}
+		int center[2] = { endpoints[0], endpoints[1] };
+		float determinant = aa * bb - ab * ab;
+		if( std::abs( determinant ) > 1e-6f ) {
+			center[0] = quantize( ( ax * bb - bx * ab ) / determinant );
+			center[1] = quantize( ( bx * aa - ax * ab ) / determinant );
+		}
+
+		int result[2] = { endpoints[0], endpoints[1] };
+		float error = fitEndpoints( texels, result, indices );
+		for( int d0 = -2; d0 <= 2; ++d0 ) {
+			for( int d1 = -2; d1 <= 2; ++d1 ) {
+				int candidate[2] = { center[0] + d0, center[1] + d1 };
+				if( candidate[0] < 0 || candidate[0] > 255 || candidate[1] < 0 || candidate[1] > 255 ) continue;
+				if( eightValues ? candidate[0] <= candidate[1] : candidate[0] > candidate[1] ) continue;
+				float candidateError = fitEndpoints( texels, candidate, indices );
+				if( candidateError < error ) {
+					error		= candidateError;
+					result[0]	= candidate[0];
+					result[1]	= candidate[1];
+				}
+			}
+		}
+		if( ! bestError || error < *bestError ) {
+			best[0] = result[0];
+			best[1] = result[1];
+			if( bestError ) *bestError = error;
+		}
+		return error;
+	}
+};
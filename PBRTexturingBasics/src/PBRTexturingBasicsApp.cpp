@@ -5,6 +5,10 @@
 #include "cinder/Log.h"
 
 #include "CinderImGui.h"
+#include "CubeMapCache.h"
+#include "BrdfLut.h"
+#include "MeshCache.h"
+#include "HdrTarget.h"
 
 using namespace ci;
 using namespace ci::app;
@@ -17,17 +21,37 @@ public:
 	void draw() override;
 	void resize() override;
 	
+	void createBatch();
+	void setModel( int primitive, int subdivisions );
+	void updateModel();
+	void loadEnvironment( const string &name );
+	void updateEnvironment();
+	void renderScene();
+	
 	CameraPersp				mCamera;
 	CameraUi				mCameraUi;
 	gl::BatchRef			mModelBatch, mSkyBoxBatch;
+	gl::VboMeshRef			mModelMesh;
+	MeshCache				mMeshCache;
+	uint64_t				mModelKey;
+	int						mPrimitive, mSubdivisions;
 	gl::TextureCubeMapRef	mIrradianceMap, mRadianceMap;
-	gl::Texture2dRef		mNormalMap, mRoughnessMap, mMetallicMap;
+	gl::Texture2dRef		mNormalMap, mMaterialMap, mBrdfLut;
+	gl::UboRef				mSphericalHarmonicsUbo;
+	CubeMapCache			mCubeMapCache;
+	string					mEnvironment;
+	fs::path				mRadiancePath, mIrradiancePath;
+	bool					mEnvironmentPending;
 	
 	int						mGridSize;
-	bool					mShowUi, mRotateModel;
+	bool					mShowUi, mRotateModel, mSphericalHarmonics, mCompressed, mIntegratedBrdf;
 	float					mRoughness, mMetallic, mSpecular;
 	Color					mBaseColor;
-	float					mGamma, mExposure, mTime;
+	float					mGamma, mExposure, mTime, mPrevTime;
+	
+	HdrTarget				mHdrTarget;
+	bool					mHdr, mColorGrading;
+	AntiAliasingComparison	mComparison;
 };
 
 void PBRTexturingBasicsApp::setup()
@@ -39,22 +63,38 @@ void PBRTexturingBasicsApp::setup()
 	mCamera		= CameraPersp( getWindowWidth(), getWindowHeight(), 50.0f, 0.1f, 200.0f ).calcFraming( Sphere( vec3( 0.0f ), 2.0f ) );
 	mCameraUi	= CameraUi( &mCamera, getWindow(), -1 );
 	
-	// prepare ou rendering objects and shaders
-	auto pbrShader		= gl::GlslProg::create( gl::GlslProg::Format().vertex( loadAsset( "PBR.vert" ) ).fragment( loadAsset( "PBR.frag" ) ) );
-	auto skyBoxShader	= gl::GlslProg::create( gl::GlslProg::Format().vertex( loadAsset( "SkyBox.vert" ) ).fragment( loadAsset( "SkyBox.frag" ) ) );
-	mModelBatch			= gl::Batch::create( geom::Teapot().subdivisions( 16 ) >> geom::Transform( glm::scale( vec3( 1.5f ) ) ), pbrShader );
-	mSkyBoxBatch		= gl::Batch::create( geom::Cube().size( vec3( 100 ) ), skyBoxShader );
+	// the hdr mode renders the scene with linear colors to a multisampled float target,
+	// a single post pass then does the tone-mapping, the gamma and the color grading.
+	// it is always used by the temporal anti-aliasing (--aa taa) and by --compare-aa
+	auto antiAliasing	= HdrTarget::parseAntiAliasing( getCommandLineArgs() );
+	bool comparison		= HdrTarget::parseComparison( getCommandLineArgs() );
+	mHdr				= antiAliasing == HdrTarget::TAA || comparison;
+	mColorGrading		= true;
+	mHdrTarget			= HdrTarget( toPixels( getWindowSize() ), antiAliasing, gl::GlslProg::Format().vertex( loadAsset( "Post.vert" ) ).fragment( loadAsset( "Post.frag" ) ), gl::GlslProg::Format().vertex( loadAsset( "Post.vert" ) ).fragment( loadAsset( "TemporalAA.frag" ) ) );
+	mHdrTarget.setLookupTable( LookupTable( Surface8u( loadImage( loadAsset( "colorGrading.png" ) ) ), ivec3( 32 ) ) );
+	if( comparison ) {
+		mComparison		= AntiAliasingComparison( &mHdrTarget );
+	}
+	
+	// the spherical harmonics irradiance is read from a uniform block instead of a cubemap
+	mSphericalHarmonics		= true;
+	mSphericalHarmonicsUbo	= gl::Ubo::create( 9 * sizeof( vec4 ), nullptr, GL_DYNAMIC_DRAW );
+	// the environment BRDF uses the analytic approximation until the integrated table is enabled in the ui
+	mIntegratedBrdf			= false;
+	createBatch();
+	
+	// the model is generated by the mesh cache thread, the batch is created once it is uploaded
+	setModel( 1, 16 );
 	
-	// load the prefiltered IBL Cubemaps
-	auto cubeMapFormat	= gl::TextureCubeMap::Format().mipmap().internalFormat( GL_RGB16F ).minFilter( GL_LINEAR_MIPMAP_LINEAR ).magFilter( GL_LINEAR );
-	mIrradianceMap		= gl::TextureCubeMap::createFromDds( loadAsset( "CathedralIrradiance.dds" ), cubeMapFormat );
-	mRadianceMap		= gl::TextureCubeMap::createFromDds( loadAsset( "CathedralRadiance.dds" ), cubeMapFormat );
+	// load the prefiltered IBL Cubemaps, compressed by tools/Compress
+	mCompressed				= true;
+	loadEnvironment( "Cathedral" );
 	
-	// load the material textures
+	// load the material textures, packed by tools/PackTextures. the normal map keeps its x and y in BC5 and
+	// the roughness and metallic masks share the channels of another one. their filtered mips come from the files
 	auto textureFormat	= gl::Texture2d::Format().mipmap().minFilter( GL_LINEAR_MIPMAP_LINEAR ).magFilter( GL_LINEAR );
-	mNormalMap			= gl::Texture2d::create( loadImage( loadAsset( "normal.png" ) ) );
-	mRoughnessMap		= gl::Texture2d::create( loadImage( loadAsset( "roughness.png" ) ), textureFormat );
-	mMetallicMap		= gl::Texture2d::create( loadImage( loadAsset( "metallic.png" ) ), textureFormat );
+	mNormalMap			= gl::Texture2d::createFromDds( loadAsset( "normalBC5.dds" ), textureFormat );
+	mMaterialMap		= gl::Texture2d::createFromDds( loadAsset( "MaterialBC5.dds" ), textureFormat );
 	
 	// set the initial parameters and setup the ui
 	mGridSize			= 5;
@@ -65,6 +105,7 @@ void PBRTexturingBasicsApp::setup()
 	mGamma				= 2.2f;
 	mExposure			= 4.0f;
 	mTime				= 0.0f;
+	mPrevTime			= 0.0f;
 	mShowUi				= false;
 	mRotateModel		= false;
 	
@@ -78,6 +119,7 @@ void PBRTexturingBasicsApp::setup()
 void PBRTexturingBasicsApp::resize()
 {
 	mCamera.setAspectRatio( getWindowAspectRatio() );
+	mHdrTarget.setSize( toPixels( getWindowSize() ) );
 }
 
 void PBRTexturingBasicsApp::update()
@@ -92,64 +134,264 @@ void PBRTexturingBasicsApp::update()
 			ui::ColorEdit3( "Color", &mBaseColor[0] );
 		}
 		if( ui::CollapsingHeader( "Model", nullptr, true, true ) ) {
-			static int currentPrimitive = 1;
 			const static vector<string> primitives = { "Sphere", "Teapot", "Cube", "Capsule", "Torus", "TorusKnot" };
-			if( ui::Combo( "Primitive", &currentPrimitive, primitives ) ) {
-				switch ( currentPrimitive ) {
-					case 0: mModelBatch->replaceVboMesh( gl::VboMesh::create( geom::Sphere().subdivisions( 64 ) ) ); break;
-					case 1: mModelBatch->replaceVboMesh( gl::VboMesh::create( geom::Teapot().subdivisions( 16 ) >> geom::Transform( glm::scale( vec3( 1.5f ) ) ) ) ); break;
-					case 2: mModelBatch->replaceVboMesh( gl::VboMesh::create( geom::Cube() ) ); break;
-					case 3: mModelBatch->replaceVboMesh( gl::VboMesh::create( geom::Capsule().subdivisionsAxis( 32 ).subdivisionsHeight( 32 ) ) ); break;
-					case 4: mModelBatch->replaceVboMesh( gl::VboMesh::create( geom::Torus().subdivisionsAxis( 32 ).subdivisionsHeight( 32 ) ) ); break;
-					case 5: mModelBatch->replaceVboMesh( gl::VboMesh::create( geom::TorusKnot().subdivisionsAxis( 128 ).subdivisionsHeight( 128 ).scale( vec3( 0.5f ) ) ) ); break;
-				}
+			const static int defaultSubdivisions[] = { 64, 16, 1, 32, 32, 128 };
+			int primitive = mPrimitive, subdivisions = mSubdivisions;
+			if( ui::Combo( "Primitive", &primitive, primitives ) ) {
+				subdivisions = defaultSubdivisions[primitive];
+			}
+			ui::DragInt( "Subdivisions", &subdivisions, 0.5f, 1, 256 );
+			if( primitive != mPrimitive || subdivisions != mSubdivisions ) {
+				setModel( primitive, subdivisions );
 			}
 			ui::Checkbox( "Rotate", &mRotateModel );
+			ui::Text( "%d meshes cached, %.1f MB", (int) mMeshCache.getNumEntries(), mMeshCache.getResidentBytes() / ( 1024.0f * 1024.0f ) );
 		}
 		if( ui::CollapsingHeader( "Environment", nullptr, true, true ) ) {
 			static int currentEnvironment = 2;
 			const static vector<string> environments = { "Bolonga", "Wells", "Cathedral" };
 			if( ui::Combo( "###Environments", &currentEnvironment, environments ) ) {
-				auto cubeMapFormat	= gl::TextureCubeMap::Format().mipmap().internalFormat( GL_RGB16F ).minFilter( GL_LINEAR_MIPMAP_LINEAR ).magFilter( GL_LINEAR );
-				mIrradianceMap		= gl::TextureCubeMap::createFromDds( loadAsset( environments[currentEnvironment] + "Irradiance.dds" ), cubeMapFormat );
-				mRadianceMap		= gl::TextureCubeMap::createFromDds( loadAsset( environments[currentEnvironment] + "Radiance.dds" ), cubeMapFormat );
+				loadEnvironment( environments[currentEnvironment] );
+			}
+			if( ui::Checkbox( "Spherical Harmonics", &mSphericalHarmonics ) ) {
+				loadEnvironment( mEnvironment );
 			}
+			if( ui::Checkbox( "BC6H", &mCompressed ) ) {
+				loadEnvironment( mEnvironment );
+			}
+			ui::Text( "%d cubemaps cached, %.1f MB", (int) mCubeMapCache.getNumEntries(), mCubeMapCache.getResidentBytes() / ( 1024.0f * 1024.0f ) );
 		}
 		if( ui::CollapsingHeader( "Rendering", nullptr, true, true ) ) {
 			ui::DragFloat( "Gamma", &mGamma, 0.01f, 0.0f );
 			ui::DragFloat( "Exposure", &mExposure, 0.01f, 0.0f );
+			if( ui::Checkbox( "BRDF LUT", &mIntegratedBrdf ) ) {
+				createBatch();
+			}
+			if( ! mHdrTarget.isTemporal() && ! mComparison.isRunning() && ui::Checkbox( "HDR Target", &mHdr ) ) {
+				createBatch();
+			}
+			if( mHdr ) {
+				ui::Checkbox( "Color Grading", &mColorGrading );
+				ui::Text( "%s, %.1f MB of framebuffers", HdrTarget::getName( mHdrTarget.getAntiAliasing() ), mHdrTarget.getFramebufferBytes() / ( 1024.0f * 1024.0f ) );
+			}
+			if( mHdrTarget.isTemporal() ) {
+				float feedback = mHdrTarget.getFeedback();
+				if( ui::DragFloat( "History Feedback", &feedback, 0.005f, 0.0f, 0.98f ) ) {
+					mHdrTarget.setFeedback( feedback );
+				}
+			}
+			for( const auto &result : mComparison.getResults() ) {
+				ui::Text( "%s: %.2f ms, %.1f MB", HdrTarget::getName( result.mAntiAliasing ), result.mGpuTime, result.mBytes / ( 1024.0f * 1024.0f ) );
+			}
 		}
 	}
 	
+	// the rotation of the previous frame gives the velocity of the model
+	mPrevTime = mTime;
 	if( mRotateModel ){
 		mTime += 0.025f;
 	}
+	
+	// stream the environment cubemaps and the model and switch when ready
+	updateEnvironment();
+	updateModel();
+}
+
+void PBRTexturingBasicsApp::createBatch()
+{
+	// the skybox and the model output linear colors when the hdr target does the tone-mapping
+	// and their velocity when it is temporally anti-aliased
+	auto skyBoxFormat = gl::GlslProg::Format().vertex( loadAsset( "SkyBox.vert" ) ).fragment( loadAsset( "SkyBox.frag" ) );
+	if( mHdr ) {
+		skyBoxFormat.define( "HDR_TARGET" );
+	}
+	if( mHdr && mHdrTarget.isTemporal() ) {
+		skyBoxFormat.define( "TEMPORAL" ).fragDataLocation( 0, "oColor" ).fragDataLocation( 1, "oVelocity" );
+	}
+	mSkyBoxBatch = gl::Batch::create( geom::Cube().size( vec3( 100 ) ), gl::GlslProg::create( skyBoxFormat ) );
+	
+	// the batch is created with the first model
+	if( ! mModelMesh ) {
+		return;
+	}
+	
+	// the spherical harmonics irradiance, the integrated environment BRDF and the linear output of the hdr target are enabled with defines
+	auto format = gl::GlslProg::Format().vertex( loadAsset( "PBR.vert" ) ).fragment( loadAsset( "PBR.frag" ) );
+	if( mHdr ) {
+		format.define( "HDR_TARGET" );
+	}
+	if( mHdr && mHdrTarget.isTemporal() ) {
+		format.define( "TEMPORAL" ).fragDataLocation( 0, "oColor" ).fragDataLocation( 1, "oVelocity" );
+	}
+	if( mSphericalHarmonics ) {
+		format.define( "SPHERICAL_HARMONICS" );
+	}
+	if( mIntegratedBrdf ) {
+		format.define( "BRDF_LUT" );
+		// the table is integrated the first time and read back from the app folder on the next launches
+		if( ! mBrdfLut ) {
+			BrdfLut lut = BrdfLut::load( getAppPath().string() );
+			mBrdfLut = gl::Texture2d::create( lut.getData(), GL_RG, lut.getSize(), lut.getSize(), gl::Texture2d::Format().internalFormat( GL_RG16F ).dataType( GL_HALF_FLOAT ).minFilter( GL_LINEAR ).magFilter( GL_LINEAR ).wrap( GL_CLAMP_TO_EDGE ) );
+		}
+	}
+	auto shader = gl::GlslProg::create( format );
+	if( mModelBatch ) {
+		mModelBatch->replaceGlslProg( shader );
+	}
+	else {
+		mModelBatch = gl::Batch::create( mModelMesh, shader );
+	}
+}
+
+void PBRTexturingBasicsApp::setModel( int primitive, int subdivisions )
+{
+	// the geometry is built by the cache thread, the current model stays on screen until it is uploaded.
+	// the key holds the primitive and its parameters, a model generated before is available right away
+	mPrimitive		= primitive;
+	mSubdivisions	= subdivisions;
+	mModelKey		= MeshCache::getKey( "Primitive", primitive, subdivisions );
+	mMeshCache.request( mModelKey, [primitive, subdivisions]() -> TriMeshRef {
+		switch( primitive ) {
+			case 0: return TriMesh::create( geom::Sphere().subdivisions( subdivisions ) );
+			case 1: return TriMesh::create( geom::Teapot().subdivisions( subdivisions ) >> geom::Transform( glm::scale( vec3( 1.5f ) ) ) );
+			case 2: return TriMesh::create( geom::Cube().subdivisions( subdivisions ) );
+			case 3: return TriMesh::create( geom::Capsule().subdivisionsAxis( subdivisions ).subdivisionsHeight( subdivisions ) );
+			case 4: return TriMesh::create( geom::Torus().subdivisionsAxis( subdivisions ).subdivisionsHeight( subdivisions ) );
+			default: return TriMesh::create( geom::TorusKnot().subdivisionsAxis( subdivisions ).subdivisionsHeight( subdivisions ).scale( vec3( 0.5f ) ) );
+		}
+	} );
+}
+
+void PBRTexturingBasicsApp::updateModel()
+{
+	mMeshCache.update();
+	auto mesh = mMeshCache.get( mModelKey );
+	if( ! mesh || mesh == mModelMesh ) {
+		return;
+	}
+	
+	mModelMesh = mesh;
+	if( mModelBatch ) {
+		mModelBatch->replaceVboMesh( mModelMesh );
+	}
+	else {
+		createBatch();
+	}
+}
+
+void PBRTexturingBasicsApp::loadEnvironment( const string &name )
+{
+	// the cache parses the files on its own thread and streams them to the gpu over the next frames,
+	// the current environment stays on screen until then. resident environments are available right away
+	mEnvironment		= name;
+	// the BC6H versions take 1 byte per texel on the gpu instead of 8, their blocks are copied as they are
+	string suffix		= mCompressed ? "BC6H.dds" : ".dds";
+	mRadiancePath		= getAssetPath( name + "Radiance" + suffix );
+	mIrradiancePath		= getAssetPath( name + "Irradiance" + suffix );
+	mEnvironmentPending	= true;
+	mCubeMapCache.request( mRadiancePath );
+	
+	// the spherical harmonics are projected from the radiance by the cache, the irradiance cubemap isn't needed then
+	if( ! mSphericalHarmonics ) {
+		mCubeMapCache.request( mIrradiancePath );
+	}
+}
+
+void PBRTexturingBasicsApp::updateEnvironment()
+{
+	mCubeMapCache.update();
+	if( ! mEnvironmentPending ) {
+		return;
+	}
+	
+	// the radiance can be displayed as soon as its smallest mip is uploaded, the sharper ones follow
+	SphericalHarmonics sphericalHarmonics;
+	auto radiance	= mCubeMapCache.get( mRadiancePath );
+	auto irradiance	= mSphericalHarmonics ? nullptr : mCubeMapCache.get( mIrradiancePath );
+	if( ! radiance || ( mSphericalHarmonics ? ! mCubeMapCache.getSphericalHarmonics( mRadiancePath, &sphericalHarmonics ) : ! irradiance ) ) {
+		return;
+	}
+	
+	if( mSphericalHarmonics ) {
+		vec4 coefficients[9];
+		sphericalHarmonics.getStd140( &coefficients[0].x );
+		mSphericalHarmonicsUbo->bufferSubData( 0, sizeof( coefficients ), coefficients );
+	}
+	// the shader only changes with the irradiance it reads from
+	if( ! irradiance != ! mIrradianceMap ) {
+		createBatch();
+	}
+	mRadianceMap		= radiance;
+	mIrradianceMap		= irradiance;
+	mEnvironmentPending	= false;
 }
 
 void PBRTexturingBasicsApp::draw()
 {
-	// clear window and set matrices
-	gl::clear( Color( 1, 0, 0 ) );
+	// the comparison switches the anti-aliasing of the target between frames
+	if( mComparison.begin() ) {
+		createBatch();
+	}
+	
+	// in the hdr mode the tone-mapping runs once per pixel on the resolved target instead of once per shaded fragment
+	if( mHdr ) {
+		{
+			gl::ScopedFramebuffer scopedFbo( mHdrTarget.getFbo() );
+			gl::ScopedViewport scopedViewport( mHdrTarget.getFbo()->getSize() );
+			mHdrTarget.clear( Color( 1, 0, 0 ) );
+			mHdrTarget.beginFrame( mCamera );
+			renderScene();
+		}
+		mHdrTarget.draw( mExposure, mGamma, 20.0f, mColorGrading );
+	}
+	else {
+		gl::clear( Color( 1, 0, 0 ) );
+		renderScene();
+	}
+	mComparison.end();
+}
+
+void PBRTexturingBasicsApp::renderScene()
+{
+	// set matrices, the hdr target jitters the projection in the temporal mode
 	gl::setMatrices( mCamera );
+	if( mHdr ) {
+		gl::setProjectionMatrix( mHdrTarget.getProjectionMatrix() );
+	}
+	
+	// nothing to render until the first environment and model are streamed in
+	if( ! mRadianceMap || ! mModelBatch ) {
+		return;
+	}
 	
 	// enable depth testing
 	gl::ScopedDepth scopedDepth( true );
 	
 	// bind the textures
 	gl::ScopedTextureBind scopedTexBind0( mRadianceMap, 0 );
-	gl::ScopedTextureBind scopedTexBind1( mIrradianceMap, 1 );
+	gl::ScopedTextureBind scopedTexBind1( GL_TEXTURE_CUBE_MAP, mIrradianceMap ? mIrradianceMap->getId() : 0, 1 );
 	gl::ScopedTextureBind scopedTexBind2( mNormalMap, 2 );
-	gl::ScopedTextureBind scopedTexBind3( mRoughnessMap, 3 );
-	gl::ScopedTextureBind scopedTexBind4( mMetallicMap, 4 );
+	gl::ScopedTextureBind scopedTexBind3( mMaterialMap, 3 );
+	gl::ScopedTextureBind scopedTexBind4( GL_TEXTURE_2D, mIntegratedBrdf ? mBrdfLut->getId() : 0, 4 );
 	
 	auto shader = mModelBatch->getGlslProg();
 	shader->uniform( "uRadianceMap", 0 );
-	shader->uniform( "uIrradianceMap", 1 );
 	shader->uniform( "uNormalMap", 2 );
-	shader->uniform( "uRoughnessMap", 3 );
-	shader->uniform( "uMetallicMap", 4 );
+	shader->uniform( "uMaterialMap", 3 );
+	if( mIntegratedBrdf ) {
+		shader->uniform( "uBrdfLut", 4 );
+	}
 	shader->uniform( "uRadianceMapSize", (float) mRadianceMap->getWidth() );
-	shader->uniform( "uIrradianceMapSize", (float) mIrradianceMap->getWidth() );
+	
+	// the irradiance comes from the uniform block when using spherical harmonics
+	if( ! mIrradianceMap ) {
+		mSphericalHarmonicsUbo->bindBufferBase( 0 );
+		shader->uniformBlock( "SphericalHarmonics", 0 );
+	}
+	else {
+		shader->uniform( "uIrradianceMap", 1 );
+		shader->uniform( "uIrradianceMapSize", (float) mIrradianceMap->getWidth() );
+	}
 	
 	// sends the base color, the specular opacity, roughness and metallic to the shader
 	shader->uniform( "uBaseColor", mBaseColor );
@@ -161,6 +403,14 @@ void PBRTexturingBasicsApp::draw()
 	shader->uniform( "uExposure", mExposure );
 	shader->uniform( "uGamma", mGamma );
 	
+	// the velocity uses the unjittered matrices of this frame and the previous one
+	bool temporal = mHdr && mHdrTarget.isTemporal();
+	if( temporal ) {
+		shader->uniform( "uViewProjection", mHdrTarget.getViewProjection() );
+		shader->uniform( "uPrevViewProjection", mHdrTarget.getPrevViewProjection() );
+		shader->uniform( "uPrevModelMatrix", glm::rotate( mPrevTime, vec3( 0.123, 0.456, 0.789 ) ) );
+	}
+	
 	// render our test model
 	{
 		gl::ScopedMatrices scopedMatrices;
@@ -172,7 +422,17 @@ void PBRTexturingBasicsApp::draw()
 	shader = mSkyBoxBatch->getGlslProg();
 	shader->uniform( "uExposure", mExposure );
 	shader->uniform( "uGamma", mGamma );
+	if( temporal ) {
+		shader->uniform( "uViewProjection", mHdrTarget.getViewProjection() );
+		shader->uniform( "uPrevViewProjection", mHdrTarget.getPrevViewProjection() );
+	}
 	mSkyBoxBatch->draw();
 }
 
-CINDER_APP( PBRTexturingBasicsApp, RendererGl( RendererGl::Options().msaa( 16 ) ) )
\ No newline at end of file
+CINDER_APP( PBRTexturingBasicsApp, RendererGl( RendererGl::Options().msaa( 16 ) ), []( App::Settings *settings ) {
+	// a multisampled window is only needed by the msaa modes rendering to it without the hdr target
+	const auto &args	= settings->getCommandLineArgs();
+	auto antiAliasing	= HdrTarget::parseAntiAliasing( args );
+	int samples			= antiAliasing == HdrTarget::TAA || HdrTarget::parseComparison( args ) ? 0 : HdrTarget::getSamples( antiAliasing );
+	settings->setDefaultRenderer( RendererGl::create( RendererGl::Options().msaa( samples ) ) );
+} )
\ No newline at end of file
@@ -0,0 +1,323 @@
+/*
+ Command line front end of MipChain.h and RGTC.h, packs the material textures of
+ PBRTexturingBasicsApp into BC4 or BC5 dds files with their mips. Only needs a C++11 compiler:
+
+	g++ -std=c++11 -O2 -I../include PackTextures.cpp -o PackTextures -lpthread
+	cl /EHsc /O2 /I..\include PackTextures.cpp
+
+ Usage:
+	PackTextures <output.dds> <red.png> [green.png] [options]
+
+	--normal		the input is a tangent space normal map, its x and y are kept in BC5
+	--clamp			clamps the mip filter to the borders instead of wrapping around them
+	--threads <n>	number of threads, all cores by default
+
+ A single input is compressed to BC4 from its first channel, two inputs to BC5 with
+ the first channel of each. The textures of the sample are packed with:
+
+	PackTextures ../assets/MaterialBC5.dds ../assets/roughness.png ../assets/metallic.png
+	PackTextures ../assets/normalBC5.dds normal.png --normal
+
+ The normal map source isn't in the repository, normal.png stands for the one you supply.
+
+ Reads non interlaced 8 or 16 bits png files and prints the PSNR of each channel.
+ */
+
+#include <iostream>
+#include <cstdlib>
+
+#include "RGTC.h"
+
+using namespace std;
+
+// inflates a zlib stream, with the canonical huffman decoding of the deflate specification
+class Inflater {
+public:
+	Inflater( const vector<uint8_t> &input ) : mInput( input ), mPosition( 2 * 8 ) {}
+
+	vector<uint8_t> inflate()
+	{
+		vector<uint8_t> output;
+		bool last = false;
+		while( ! last ) {
+			last = getBits( 1 ) != 0;
+			int type = getBits( 2 );
+			if( type == 0 ) {
+				// stored block, aligned on a byte
+				mPosition = ( mPosition + 7 ) & ~7;
+				int length = getBits( 16 );
+				getBits( 16 );
+				if( mPosition / 8 + length > mInput.size() ) throw CubeMapPrefilterExc( "Truncated deflate stream" );
+				output.insert( output.end(), mInput.begin() + mPosition / 8, mInput.begin() + mPosition / 8 + length );
+				mPosition += length * 8;
+			}
+			else if( type == 1 ) {
+				Huffman lengths, distances;
+				int lengthSizes[288], distanceSizes[30];
+				for( int i = 0; i < 288; ++i ) lengthSizes[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+				for( int i = 0; i < 30; ++i ) distanceSizes[i] = 5;
+				lengths.build( lengthSizes, 288 );
+				distances.build( distanceSizes, 30 );
+				inflateBlock( lengths, distances, output );
+			}
+			else if( type == 2 ) {
+				int numLengths = getBits( 5 ) + 257, numDistances = getBits( 5 ) + 1, numCodes = getBits( 4 ) + 4;
+				static const int order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+				int codeSizes[19] = {}, sizes[320] = {};
+				for( int i = 0; i < numCodes; ++i ) codeSizes[order[i]] = getBits( 3 );
+				Huffman codes;
+				codes.build( codeSizes, 19 );
+				for( int i = 0; i < numLengths + numDistances; ) {
+					int symbol = decode( codes );
+					if( symbol < 16 ) {
+						sizes[i++] = symbol;
+						continue;
+					}
+					int repeat = symbol == 16 ? 3 + getBits( 2 ) : symbol == 17 ? 3 + getBits( 3 ) : 11 + getBits( 7 );
+					int value = symbol == 16 && i > 0 ? sizes[i - 1] : 0;
+					if( i + repeat > numLengths + numDistances ) throw CubeMapPrefilterExc( "Invalid deflate code lengths" );
+					while( repeat-- ) sizes[i++] = value;
+				}
+				Huffman lengths, distances;
+				lengths.build( sizes, numLengths );
+				distances.build( sizes + numLengths, numDistances );
+				inflateBlock( lengths, distances, output );
+			}
+			else {
+				throw CubeMapPrefilterExc( "Invalid deflate block" );
+			}
+		}
+		return output;
+	}
+
+protected:
+	struct Huffman {
+		int mCounts[16], mSymbols[320];
+
+		void build( const int *sizes, int numSymbols )
+		{
+			int offsets[16] = {};
+			for( int i = 0; i < 16; ++i ) mCounts[i] = 0;
+			for( int i = 0; i < numSymbols; ++i ) mCounts[sizes[i]]++;
+			mCounts[0] = 0;
+			for( int i = 1; i < 15; ++i ) offsets[i + 1] = offsets[i] + mCounts[i];
+			for( int i = 0; i < numSymbols; ++i ) {
+				if( sizes[i] ) mSymbols[offsets[sizes[i]]++] = i;
+			}
+		}
+	};
+
+	int getBits( int count )
+	{
+		int value = 0;
+		for( int i = 0; i < count; ++i, ++mPosition ) {
+			if( mPosition / 8 >= mInput.size() ) throw CubeMapPrefilterExc( "Truncated deflate stream" );
+			value |= ( ( mInput[mPosition / 8] >> ( mPosition % 8 ) ) & 1 ) << i;
+		}
+		return value;
+	}
+	// huffman codes are stored from their most significant bit
+	int decode( const Huffman &huffman )
+	{
+		int code = 0, first = 0, index = 0;
+		for( int size = 1; size < 16; ++size ) {
+			code |= getBits( 1 );
+			int count = huffman.mCounts[size];
+			if( code - count < first ) return huffman.mSymbols[index + code - first];
+			index += count;
+			first = ( first + count ) << 1;
+			code <<= 1;
+		}
+		throw CubeMapPrefilterExc( "Invalid huffman code" );
+	}
+	void inflateBlock( const Huffman &lengths, const Huffman &distances, vector<uint8_t> &output )
+	{
+		static const int lengthBase[29]		= { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const int lengthExtra[29]	= { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		static const int distanceBase[30]	= { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static const int distanceExtra[30]	= { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+		for(;;) {
+			int symbol = decode( lengths );
+			if( symbol < 256 ) {
+				output.push_back( static_cast<uint8_t>( symbol ) );
+			}
+			else if( symbol == 256 ) {
+				return;
+			}
+			else {
+				symbol -= 257;
+				if( symbol >= 29 ) throw CubeMapPrefilterExc( "Invalid deflate length" );
+				int length = lengthBase[symbol] + getBits( lengthExtra[symbol] );
+				int distanceSymbol = decode( distances );
+				if( distanceSymbol >= 30 ) throw CubeMapPrefilterExc( "Invalid deflate distance" );
+				size_t distance = distanceBase[distanceSymbol] + getBits( distanceExtra[distanceSymbol] );
+				if( distance > output.size() ) throw CubeMapPrefilterExc( "Invalid deflate distance" );
+				for( int i = 0; i < length; ++i ) output.push_back( output[output.size() - distance] );
+			}
+		}
+	}
+
+	const vector<uint8_t>	&mInput;
+	size_t					mPosition;
+};
+
+// loads a non interlaced grayscale, rgb or rgba png to floats in [0, 1], alpha is dropped
+MipChain loadPng( const string &path )
+{
+	ifstream file( path.c_str(), ios::binary );
+	vector<uint8_t> data( ( istreambuf_iterator<char>( file ) ), istreambuf_iterator<char>() );
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	if( data.size() < 8 || memcmp( data.data(), signature, 8 ) != 0 ) {
+		throw CubeMapPrefilterExc( "Not a png file: " + path );
+	}
+
+	auto readUint = []( const uint8_t *bytes ) { return ( uint32_t( bytes[0] ) << 24 ) | ( uint32_t( bytes[1] ) << 16 ) | ( uint32_t( bytes[2] ) << 8 ) | bytes[3]; };
+	int width = 0, height = 0, bitDepth = 0, colorType = 0;
+	vector<uint8_t> compressed;
+	for( size_t position = 8; position + 8 <= data.size(); ) {
+		uint32_t length = readUint( &data[position] );
+		string type( reinterpret_cast<const char*>( &data[position + 4] ), 4 );
+		const uint8_t *chunk = &data[position + 8];
+		if( position + 12 + length > data.size() ) throw CubeMapPrefilterExc( "Truncated png file: " + path );
+		if( type == "IHDR" ) {
+			width		= readUint( chunk );
+			height		= readUint( chunk + 4 );
+			bitDepth	= chunk[8];
+			colorType	= chunk[9];
+			if( chunk[12] != 0 ) throw CubeMapPrefilterExc( "Interlaced png files aren't supported: " + path );
+		}
+		else if( type == "IDAT" ) compressed.insert( compressed.end(), chunk, chunk + length );
+		else if( type == "IEND" ) break;
+		position += 12 + length;
+	}
+	static const int channelsPerType[7] = { 1, 0, 3, 0, 2, 0, 4 };
+	if( colorType > 6 || ! channelsPerType[colorType] || ( bitDepth != 8 && bitDepth != 16 ) ) {
+		throw CubeMapPrefilterExc( "Only 8 or 16 bits grayscale, rgb and rgba png files are supported: " + path );
+	}
+
+	// undo the filter of each row
+	int numChannels = channelsPerType[colorType], bytesPerPixel = numChannels * bitDepth / 8, stride = width * bytesPerPixel;
+	vector<uint8_t> rows = Inflater( compressed ).inflate();
+	if( rows.size() < size_t( ( stride + 1 ) * height ) ) throw CubeMapPrefilterExc( "Truncated png data: " + path );
+	vector<uint8_t> pixels( stride * height );
+	for( int y = 0; y < height; ++y ) {
+		int filter = rows[y * ( stride + 1 )];
+		const uint8_t *row = &rows[y * ( stride + 1 ) + 1];
+		uint8_t *current = &pixels[y * stride], *previous = y ? &pixels[( y - 1 ) * stride] : nullptr;
+		for( int i = 0; i < stride; ++i ) {
+			int a = i >= bytesPerPixel ? current[i - bytesPerPixel] : 0, b = previous ? previous[i] : 0, c = previous && i >= bytesPerPixel ? previous[i - bytesPerPixel] : 0;
+			int predictor = 0;
+			switch( filter ) {
+				case 1: predictor = a; break;
+				case 2: predictor = b; break;
+				case 3: predictor = ( a + b ) / 2; break;
+				case 4: {
+					int p = a + b - c, pa = abs( p - a ), pb = abs( p - b ), pc = abs( p - c );
+					predictor = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+				} break;
+			}
+			current[i] = static_cast<uint8_t>( row[i] + predictor );
+		}
+	}
+
+	int numColors = numChannels == 1 || numChannels == 2 ? 1 : 3;
+	MipChain image( width, height, numColors );
+	for( int i = 0; i < width * height; ++i ) {
+		for( int c = 0; c < numColors; ++c ) {
+			const uint8_t *sample = &pixels[i * bytesPerPixel + c * bitDepth / 8];
+			image.getData()[i * numColors + c] = bitDepth == 8 ? sample[0] / 255.0f : ( ( sample[0] << 8 ) | sample[1] ) / 65535.0f;
+		}
+	}
+	return image;
+}
+
+int main( int argc, char **argv )
+{
+	if( argc < 3 ) {
+		cerr << "Usage: PackTextures <output.dds> <red.png> [green.png] [--normal] [--clamp] [--threads n]" << endl;
+		return 1;
+	}
+
+	string output = argv[1];
+	vector<string> inputs;
+	MipChain::Options mipOptions;
+	RGTC::Options options;
+	for( int i = 2; i < argc; ++i ) {
+		string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if( arg == "--normal" ) mipOptions.normalMap();
+		else if( arg == "--clamp" ) mipOptions.wrap( false );
+		else if( arg == "--threads" && hasValue ) {
+			int numThreads = atoi( argv[++i] );
+			mipOptions.threads( numThreads );
+			options.threads( numThreads );
+		}
+		else if( arg.compare( 0, 2, "--" ) != 0 && inputs.size() < 2 ) inputs.push_back( arg );
+		else {
+			cerr << "Unknown option " << arg << endl;
+			return 1;
+		}
+	}
+	if( inputs.empty() || ( mipOptions.mNormalMap && inputs.size() > 1 ) ) {
+		cerr << "Expected one or two inputs, or a single normal map" << endl;
+		return 1;
+	}
+	options.log( []( const string &message ) { cout << message << endl; } );
+
+	try {
+		auto start = chrono::steady_clock::now();
+		vector<MipChain> sources;
+		for( const auto &input : inputs ) {
+			sources.push_back( loadPng( input ) );
+			cout << "Loaded " << input << " (" << sources.back().getWidth() << "x" << sources.back().getHeight() << ", " << sources.back().getNumChannels() << " channels)" << endl;
+		}
+
+		// the normal map keeps its three channels for the renormalization of the mips, the masks are packed first
+		MipChain image;
+		if( mipOptions.mNormalMap ) {
+			if( sources[0].getNumChannels() < 3 ) throw CubeMapPrefilterExc( "A normal map needs three channels" );
+			image = sources[0];
+		}
+		else {
+			int width = sources[0].getWidth(), height = sources[0].getHeight(), numChannels = static_cast<int>( sources.size() );
+			image = MipChain( width, height, numChannels );
+			for( int c = 0; c < numChannels; ++c ) {
+				if( sources[c].getWidth() != width || sources[c].getHeight() != height ) throw CubeMapPrefilterExc( "The inputs don't have the same size" );
+				for( int i = 0; i < width * height; ++i ) {
+					image.getData()[i * numChannels + c] = sources[c].getData()[i * sources[c].getNumChannels()];
+				}
+			}
+		}
+		image.buildMips( mipOptions );
+
+		RGTCTexture::Format format = mipOptions.mNormalMap || inputs.size() > 1 ? RGTCTexture::BC5 : RGTCTexture::BC4;
+		RGTCTexture compressed = RGTC::encode( image, format, options );
+		RGTC::writeDds( compressed, output );
+		double seconds = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+
+		// the error of the values as stored, over every mip
+		MipChain decoded = RGTC::decode( compressed );
+		size_t bytes = 0, rgbaBytes = 0;
+		for( int c = 0; c < compressed.getNumChannels(); ++c ) {
+			double squaredError = 0.0, numTexels = 0.0;
+			for( int mip = 0; mip < image.getNumMips(); ++mip ) {
+				for( int i = 0; i < image.getWidth( mip ) * image.getHeight( mip ); ++i ) {
+					double error = image.getData( mip )[i * image.getNumChannels() + c] - decoded.getData( mip )[i * decoded.getNumChannels() + c];
+					squaredError += error * error;
+				}
+				numTexels += image.getWidth( mip ) * image.getHeight( mip );
+			}
+			cout << "Channel " << c << " PSNR " << 10.0 * log10( 1.0 / max( 1e-20, squaredError / numTexels ) ) << " dB" << endl;
+		}
+		for( int mip = 0; mip < compressed.getNumMips(); ++mip ) {
+			bytes += compressed.getMipBytes( mip );
+			rgbaBytes += compressed.getWidth( mip ) * compressed.getHeight( mip ) * 4 * inputs.size();
+		}
+		cout << "Wrote " << output << " in " << seconds << "s, " << bytes / 1024 << " KB instead of " << rgbaBytes / 1024 << " KB of RGBA8 textures" << endl;
+	}
+	catch( const CubeMapPrefilterExc &exc ) {
+		cerr << exc.what() << endl;
+		return 1;
+	}
+	return 0;
+}
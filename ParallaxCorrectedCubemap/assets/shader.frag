@@ -1,8 +1,11 @@
 #version 410 core
 
-uniform samplerCube	uCubeMap;
-uniform vec3 		uCubeMapSize;
-uniform vec3 		uCubeMapPosition;
+uniform samplerCubeArray	uProbeCubeMaps;
+uniform samplerBuffer	uProbes;			// capture position, parallax box center and size, influence box center and inverse half size of each probe
+uniform usamplerBuffer	uProbeGrid;			// the offsets of the cells of ProbeGrid followed by their probes
+uniform ivec3		uProbeGridCells;
+uniform vec3		uProbeGridMin;
+uniform vec3		uProbeGridInvCellSize;
 uniform vec3		uCameraPosition;
 uniform mat3 	ciNormalMatrix;
 
@@ -19,10 +22,12 @@ uniform float 		uLight3Intensity;
 
 uniform float 		uReflections;
 
-in vec2				vUv;
-in vec3				vPosition;
-in vec3				vNormal;
-in vec3				vReflection;
+in Vertex {
+	vec3			vPosition;
+	vec3			vNormal;
+	vec3			vReflection;
+	vec2			vUv;
+};
 
 out vec4			oColor;
 
@@ -77,6 +82,68 @@ vec3 blendNormals( vec3 baseNormal, vec3 detailsNormal )
     return normalize( detailsNormal.x*nBasis[0] + detailsNormal.y*nBasis[1] + detailsNormal.z*nBasis[2] );
 }
 
+// The two probes with the most influence on \a position and their normalized weights, same as ProbeGrid::query
+void selectProbes( vec3 position, out ivec2 probes, out vec2 weights )
+{
+	probes			= ivec2( -1 );
+	weights			= vec2( 0.0 );
+	vec3 coord		= ( position - uProbeGridMin ) * uProbeGridInvCellSize;
+	if( any( lessThan( coord, vec3( 0.0 ) ) ) || any( greaterThan( coord, vec3( uProbeGridCells ) ) ) ) {
+		return;
+	}
+	ivec3 cellCoord	= min( ivec3( coord ), uProbeGridCells - 1 );
+	int cell		= ( cellCoord.z * uProbeGridCells.y + cellCoord.y ) * uProbeGridCells.x + cellCoord.x;
+	int first		= int( texelFetch( uProbeGrid, cell ).r );
+	int last		= int( texelFetch( uProbeGrid, cell + 1 ).r );
+	for( int i = first; i < last; ++i ) {
+		int probe			= int( texelFetch( uProbeGrid, i ).r );
+		vec3 center			= texelFetch( uProbes, probe * 5 + 3 ).xyz;
+		vec3 invHalfSize	= texelFetch( uProbes, probe * 5 + 4 ).xyz;
+		vec3 distance		= abs( position - center ) * invHalfSize;
+		float influence		= 1.0 - max( max( distance.x, distance.y ), distance.z );
+		if( influence > weights.x ) {
+			probes			= ivec2( probe, probes.x );
+			weights			= vec2( influence, weights.x );
+		}
+		else if( influence > weights.y ) {
+			probes.y		= probe;
+			weights.y		= influence;
+		}
+	}
+	float sum = weights.x + weights.y;
+	if( sum > 0.0 ) {
+		weights /= sum;
+	}
+}
+
+// Parallax corrected reflection of the probe at \a index for the reflection vector \a R
+vec3 sampleProbe( int index, vec3 R, float roughness )
+{
+	vec3 capturePos	= texelFetch( uProbes, index * 5 ).xyz;
+	vec3 boxPos		= texelFetch( uProbes, index * 5 + 1 ).xyz;
+	vec3 boxSize	= texelFetch( uProbes, index * 5 + 2 ).xyz;
+	vec3 boxInters 	= getBoxIntersection( vPosition, R, boxSize, boxPos );
+	vec3 lookup 	= boxInters - capturePos;
+	
+	// calculate the mip level from roughness
+	float distRough = computeDistanceBaseRoughness( 
+		length( vPosition - boxInters ), 
+		length( capturePos - boxInters ), 
+		0.09f + roughness );
+	// the curve was tuned on 1024 pixels cubemaps whose roughest reflections used the 7th mip, it is
+	// offset by the size of the probes so a roughness keeps the same texel size at any resolution
+	float cubeSize	= float( textureSize( uProbeCubeMaps, 0 ).x );
+	float numMips	= 7.0;
+	float mip		= 1.0 - 1.2 * log2( distRough );
+	mip				= numMips - 1.0 - mip + log2( cubeSize / 1024.0 );
+
+	// fix the lookup vector
+	lookup			= fix_cube_lookup( lookup, cubeSize, mip );
+
+	// sample the layer of the probe in the cubemap array
+	return pow( textureLod( uProbeCubeMaps, vec4( lookup, float( index ) ), mip ).rgb, vec3( 2.2f ) );
+}
+
 void main() {
 	vec2 uv 		= vec2( vUv.x, 1.0 + vUv.y );
 
@@ -89,24 +156,21 @@ void main() {
 		normalize( vNormal ), 
 		( texture( uNormalMap, uv ).xyz * 2.0f - 1.0f ) * vec3( 0.35f, 0.35f, 1.0f ) );
 	vec3 R			= reflect( V, N ); 
-	vec3 boxInters 	= getBoxIntersection( vPosition, R, uCubeMapSize, uCubeMapPosition );
-	vec3 lookup 	= boxInters - uCubeMapPosition;
-	
-	// calculate the mip level from roughness
 	float roughness = texture( uRoughnessMap, uv ).r;
-	float distRough = computeDistanceBaseRoughness( 
-		length( vPosition - boxInters ), 
-		length( uCubeMapPosition - boxInters ), 
-		0.09f + roughness );
-	float numMips	= 7.0;
-	float mip		= 1.0 - 1.2 * log2( distRough );
-	mip				= numMips - 1.0 - mip;
-
-	// fix the lookup vector
-	lookup			= fix_cube_lookup( lookup, 1024.0, mip );
 
-	// sample cubemap
-	vec3 reflection	= pow( textureLod( uCubeMap, lookup, mip ).rgb, vec3( 2.2f ) ) * pow( 1.0 - roughness, 1.8f ); 
+	// blend the reflections of the two probes around the fragment, none is sampled when rendering the cubemaps
+	vec3 reflection	= vec3( 0.0f );
+	if( uReflections > 0.0f ) {
+		ivec2 probes;
+		vec2 weights;
+		selectProbes( vPosition, probes, weights );
+		for( int i = 0; i < 2; ++i ) {
+			if( weights[i] > 0.0f ) {
+				reflection += sampleProbe( probes[i], R, roughness ) * weights[i];
+			}
+		}
+	}
+	reflection		*= pow( 1.0 - roughness, 1.8f ); 
 	
 	// output the lighting and the reflection
     oColor 			= vec4( lighting + mix( vec3( 0.0f ), reflection, uReflections ), 1.0 );
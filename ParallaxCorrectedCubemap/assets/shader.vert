@@ -1,6 +1,7 @@
 #version 410 core
 
 uniform mat4 	ciModelView;
+uniform mat4 	ciModelMatrix;
 uniform mat4 	ciProjectionMatrix;
 uniform mat3 	ciNormalMatrix;
 uniform vec3	uCameraPosition;
@@ -9,10 +10,12 @@ in vec4			ciPosition;
 in vec3			ciNormal;
 in vec2 		ciTexCoord0;
 
-out vec3		vPosition;
-out vec3		vNormal;
-out vec3		vReflection;
-out vec2		vUv;
+out Vertex {
+	vec3		vPosition;
+	vec3		vNormal;
+	vec3		vReflection;
+	vec2		vUv;
+};
 
 void main() {
 	vPosition	= ( ciPosition ).xyz;
@@ -20,5 +23,10 @@ void main() {
 	vec3 dir 	= normalize( ciPosition.xyz - uCameraPosition );
 	vReflection	= reflect( dir, normalize( ciNormal ) ); 
 	vUv 		= ciTexCoord0;
+#ifdef LAYERED
+	// shader.geom projects the world position on each face of the cubemap
+	gl_Position = ciModelMatrix * ciPosition;
+#else
 	gl_Position = ciProjectionMatrix * ciModelView * ciPosition;
+#endif
 } 
\ No newline at end of file
@@ -2,7 +2,9 @@
 
 uniform samplerCube	uCubeMap;
 
-in vec3		vPosition;
+in Vertex {
+	vec3	vPosition;
+};
 out vec4	oColor;
 
 void main() {
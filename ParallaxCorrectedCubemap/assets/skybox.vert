@@ -1,14 +1,21 @@
 #version 410 core
 
 uniform mat4 	ciModelView;
+uniform mat4 	ciModelMatrix;
 uniform mat4 	ciProjectionMatrix;
 uniform mat4 	uOrientation;
 
 in vec4			ciPosition;
 
-out vec3		vPosition;
+out Vertex {
+	vec3		vPosition;
+};
 
 void main() {
 	vPosition	= ( uOrientation * ciPosition ).xyz;
+#ifdef LAYERED
+	gl_Position = ciModelMatrix * ciPosition;
+#else
 	gl_Position = ciProjectionMatrix * ciModelView * ciPosition;
+#endif
 } 
\ No newline at end of file
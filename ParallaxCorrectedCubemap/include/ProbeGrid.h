@@ -0,0 +1,194 @@
+/*
+
+ ProbeGrid
+
+ Copyright (c) 2015, Simon Geilfus
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+//! Uniform grid over the influence boxes of reflection probes. A query returns the two probes with the most influence on a point
+//! and their blend weights: the influence of a probe fades linearly from its center to its faces, so a point leaving a probe
+//! hands over to its neighbours without popping. Doesn't depend on OpenGL so it can be used and benchmarked without a window.
+class ProbeGrid {
+public:
+	//! The probes of a query with their weights normalized, an unused entry has a -1 index and a zero weight
+	struct Selection {
+		Selection() { mProbes[0] = mProbes[1] = -1; mWeights[0] = mWeights[1] = 0.0f; }
+
+		int32_t	mProbes[2];
+		float	mWeights[2];
+	};
+
+	//! Creates a grid with at most \a maxCellsPerAxis cells on each axis
+	ProbeGrid( int maxCellsPerAxis = 64 )
+	: mMaxCellsPerAxis( maxCellsPerAxis )
+	{
+		build( nullptr, 0 );
+	}
+
+	//! Builds the grid from \a numProbes influence boxes packed as min x, y, z followed by max x, y, z
+	void build( const float *boxes, size_t numProbes )
+	{
+		mBoxes.resize( numProbes * 6 );
+		mCellOffsets.assign( 2, 0 );
+		mCellProbes.clear();
+		for( int i = 0; i < 3; ++i ) {
+			mMin[i]			= 0.0f;
+			mCells[i]		= 1;
+			mInvCellSize[i]	= 0.0f;
+		}
+		if( ! numProbes ) {
+			return;
+		}
+
+		// keep the boxes as center and inverse half size, and find the bounds of the grid and the average probe size
+		float max[3] = { -1e30f, -1e30f, -1e30f };
+		float averageSize = 0.0f;
+		for( int i = 0; i < 3; ++i ) mMin[i] = 1e30f;
+		for( size_t p = 0; p < numProbes; ++p ) {
+			const float *box = boxes + p * 6;
+			float *stored = &mBoxes[p * 6];
+			for( int i = 0; i < 3; ++i ) {
+				stored[i]		= ( box[i] + box[i + 3] ) * 0.5f;
+				stored[i + 3]	= 2.0f / std::max( box[i + 3] - box[i], 1e-6f );
+				mMin[i]			= std::min( mMin[i], box[i] );
+				max[i]			= std::max( max[i], box[i + 3] );
+				averageSize		+= ( box[i + 3] - box[i] ) / 3.0f;
+			}
+		}
+		averageSize /= numProbes;
+
+		// cells of half the average probe size, so a probe covers a few of them
+		float cellSize = std::max( averageSize * 0.5f, 1e-6f );
+		for( int i = 0; i < 3; ++i ) {
+			float extent	= std::max( max[i] - mMin[i], 1e-6f );
+			mCells[i]		= std::min( mMaxCellsPerAxis, std::max( 1, static_cast<int>( std::ceil( extent / cellSize ) ) ) );
+			mInvCellSize[i]	= mCells[i] / extent;
+		}
+
+		// count the probes of each cell, then fill the per cell lists in a single index list
+		size_t numCells = static_cast<size_t>( mCells[0] ) * mCells[1] * mCells[2];
+		mCellOffsets.assign( numCells + 1, 0 );
+		for( int pass = 0; pass < 2; ++pass ) {
+			if( pass == 1 ) {
+				for( size_t c = 0; c < numCells; ++c ) {
+					mCellOffsets[c + 1] += mCellOffsets[c];
+				}
+				mCellProbes.resize( mCellOffsets[numCells] );
+				mFill.assign( mCellOffsets.begin(), mCellOffsets.end() - 1 );
+			}
+			for( size_t p = 0; p < numProbes; ++p ) {
+				const float *box = boxes + p * 6;
+				int first[3], last[3];
+				for( int i = 0; i < 3; ++i ) {
+					first[i]	= getCell( box[i], i );
+					last[i]		= getCell( box[i + 3], i );
+				}
+				for( int z = first[2]; z <= last[2]; ++z ) {
+					for( int y = first[1]; y <= last[1]; ++y ) {
+						for( int x = first[0]; x <= last[0]; ++x ) {
+							size_t cell = ( static_cast<size_t>( z ) * mCells[1] + y ) * mCells[0] + x;
+							if( pass == 0 )
+								++mCellOffsets[cell + 1];
+							else
+								mCellProbes[mFill[cell]++] = static_cast<uint32_t>( p );
+						}
+					}
+				}
+			}
+		}
+	}
+
+	//! Returns the two probes with the most influence on \a x, \a y, \a z
+	Selection query( float x, float y, float z ) const
+	{
+		Selection selection;
+		const float point[3] = { x, y, z };
+		size_t cell = 0;
+		for( int i = 2; i >= 0; --i ) {
+			float coord = ( point[i] - mMin[i] ) * mInvCellSize[i];
+			if( coord < 0.0f || coord > mCells[i] ) {
+				// no probe reaches outside of the grid
+				return selection;
+			}
+			cell = cell * mCells[i] + std::min( static_cast<int>( coord ), mCells[i] - 1 );
+		}
+
+		float influences[2] = { 0.0f, 0.0f };
+		for( uint32_t c = mCellOffsets[cell]; c < mCellOffsets[cell + 1]; ++c ) {
+			uint32_t probe		= mCellProbes[c];
+			const float *box	= &mBoxes[probe * 6];
+			float distance		= std::max( std::max( std::abs( x - box[0] ) * box[3], std::abs( y - box[1] ) * box[4] ), std::abs( z - box[2] ) * box[5] );
+			float influence		= 1.0f - distance;
+			if( influence <= influences[1] ) {
+				continue;
+			}
+			if( influence > influences[0] ) {
+				selection.mProbes[1]	= selection.mProbes[0];
+				influences[1]			= influences[0];
+				selection.mProbes[0]	= static_cast<int32_t>( probe );
+				influences[0]			= influence;
+			}
+			else {
+				selection.mProbes[1]	= static_cast<int32_t>( probe );
+				influences[1]			= influence;
+			}
+		}
+
+		float sum = influences[0] + influences[1];
+		if( sum > 0.0f ) {
+			selection.mWeights[0] = influences[0] / sum;
+			selection.mWeights[1] = influences[1] / sum;
+		}
+		return selection;
+	}
+
+	size_t getNumProbes() const { return mBoxes.size() / 6; }
+	size_t getNumCells() const { return mCellOffsets.size() - 1; }
+
+	//! Returns the number of cells on each axis. The grid starts at getMin() and a cell is 1 / getInvCellSize() wide
+	const int* getCells() const { return mCells; }
+	const float* getMin() const { return mMin; }
+	const float* getInvCellSize() const { return mInvCellSize; }
+	//! Returns the center and inverse half size of each influence box, used to mirror query() in a shader
+	const std::vector<float>& getBoxes() const { return mBoxes; }
+	//! Returns the offset of each cell in getCellProbes(), followed by the total
+	const std::vector<uint32_t>& getCellOffsets() const { return mCellOffsets; }
+	const std::vector<uint32_t>& getCellProbes() const { return mCellProbes; }
+
+protected:
+	int getCell( float coord, int axis ) const
+	{
+		return std::max( 0, std::min( mCells[axis] - 1, static_cast<int>( ( coord - mMin[axis] ) * mInvCellSize[axis] ) ) );
+	}
+
+	int						mMaxCellsPerAxis;
+	int						mCells[3];
+	float					mMin[3], mInvCellSize[3];
+	// center and inverse half size of each probe
+	std::vector<float>		mBoxes;
+	// offset of each cell in the probe list, followed by the total
+	std::vector<uint32_t>	mCellOffsets, mCellProbes, mFill;
+};
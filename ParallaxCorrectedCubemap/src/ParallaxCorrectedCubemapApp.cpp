@@ -24,10 +24,16 @@
 #include "cinder/app/App.h"
 #include "cinder/app/RendererGl.h"
 #include "cinder/gl/gl.h"
+#include "cinder/gl/Query.h"
+#include "cinder/gl/BufferTexture.h"
 #include "cinder/CameraUi.h"
 #include "cinder/ObjLoader.h"
+#include "cinder/Log.h"
+#include "cinder/Timer.h"
 #include "glm/gtc/noise.hpp"
 #include "CinderImGui.h"
+#include "MeshOptimizer.h"
+#include "ProbeGrid.h"
 
 using namespace ci;
 using namespace ci::app;
@@ -38,20 +44,65 @@ class ParallaxCorrectedCubemapApp : public App {
 	ParallaxCorrectedCubemapApp();
 	void draw() override;
 	
-	void renderScene( bool withReflections = true );
-	void renderCubemap();
+	enum CapturePath { CAPTURE_FACES, CAPTURE_LAYERED, NUM_CAPTURE_PATHS };
+	
+	void renderScene( bool withReflections = true, bool layered = false );
+	void addProbe( const vec3 &position, const AxisAlignedBox &influence, const AxisAlignedBox &parallax );
+	void removeProbe( size_t index );
+	void reserveProbes( size_t count );
+	void copyProbe( GLuint src, int srcProbe, GLuint dst, int dstProbe );
+	void updateProbes();
+	void updateBake();
+	void startBake( int probe );
+	void finishBake();
+	void renderCubemap( CapturePath path, int firstFace, int numFaces );
+	void renderCubemapFaces( int firstFace, int numFaces );
+	void renderCubemapLayered( int firstFace, int numFaces );
+	void readCaptureQueries();
 	void userInterface();
 	
 	gl::BatchRef		mRoom, mSkyBox;
+	gl::BatchRef		mRoomLayered, mSkyBoxLayered;
 	gl::Texture2dRef	mLightMap, mRoughnessMap, mNormalMap;
+	gl::TextureCubeMapRef	mSkyBoxTexture, mDepthCubemap;
+	
+	struct Probe {
+		vec3			mPosition;		// where the cubemap is captured from
+		vec3			mBakedPosition;	// where the cubemap in use was captured from
+		AxisAlignedBox	mInfluence;		// the objects inside this box use the probe
+		AxisAlignedBox	mParallax;		// the box the reflections are projected on
+		bool			mDirty;
+	};
+	
+	// the probes, their influence boxes in a grid and their cubemaps in a cubemap array, see ProbeGrid.h
+	vector<Probe>		mProbes;
+	ProbeGrid		mProbeGrid;
+	ProbeGrid::Selection	mProbeSelection;
+	gl::Texture3dRef	mProbeCubemaps;
+	gl::VboRef		mProbesVbo, mProbeGridVbo;
+	gl::BufferTextureRef	mProbesTexture, mProbeGridTexture;
+	gl::FboRef		mFboCopy;
+	size_t			mProbeCapacity;
+	int			mProbeResolution, mProbeLevels, mSelectedProbe;
+	bool			mProbesChanged;
+	double			mProbeQueryTime;
+	
+	// a probe is baked in these fbos a few faces per frame, and copied to the cubemap array once its six faces and mipmaps are rendered
 	gl::FboCubeMapRef	mFboCubemap;
-	gl::TextureCubeMapRef	mSkyBoxTexture;
+	gl::FboRef		mFboLayered;
+	vec3			mBakePosition;
+	int			mBakeProbe, mLastBakedProbe, mBakeFace, mFacesPerFrame;
+	
+	// capture timings of each path, the queries are read once their results are available
+	gl::QueryRef		mCaptureTimeQueries[NUM_CAPTURE_PATHS], mCapturePrimitivesQueries[NUM_CAPTURE_PATHS];
+	bool			mCapturePending[NUM_CAPTURE_PATHS];
+	double			mCaptureGpuTimes[NUM_CAPTURE_PATHS], mCaptureCpuTimes[NUM_CAPTURE_PATHS];
+	int64_t			mCapturePrimitives[NUM_CAPTURE_PATHS];
+	int			mCaptureFaces[NUM_CAPTURE_PATHS];
+	CapturePath		mCapturePath;
 
 	CameraPersp		mCamera;
 	CameraUi		mCameraUi;
-	vec3			mCubemapPosition;
-	vec3			mCubemapSize;
-	AxisAlignedBox		mCubemapBounds;
 	
 	bool			mShowUi, mDrawCubemapBounds, mDrawCubemap;
 };
@@ -64,29 +115,77 @@ ParallaxCorrectedCubemapApp::ParallaxCorrectedCubemapApp()
 	mCamera.setPivotDistance( 0.0f );
 	mCameraUi = CameraUi( &mCamera, getWindow(), -1 );
 	
-	// load the test model, rescale it and create a batch with it
+	// load the test model, reorder it for the vertex cache, overdraw and vertex fetch, rescale it and create a batch with it
 	TriMesh model( ObjLoader( loadAsset( "model.obj" ) ) );
+	auto report = MeshOptimizer::optimize( &model );
+	CI_LOG_I( "Optimized model.obj, ACMR " << report.mBefore.mAcmr << " -> " << report.mAfter.mAcmr << ", ATVR " << report.mBefore.mAtvr << " -> " << report.mAfter.mAtvr );
 	auto bounds = model.calcBoundingBox();
 	auto shader = gl::GlslProg::create( loadAsset( "shader.vert" ), loadAsset( "shader.frag" ) );
 	mRoom = gl::Batch::create( model >> geom::Scale( vec3( 1.0f / bounds.getSize().y ) ), shader );
 	
+	// the layered version of the shader renders the six faces of the cubemap in one draw
+	auto layeredFormat = gl::GlslProg::Format().vertex( loadAsset( "shader.vert" ) ).geometry( loadAsset( "shader.geom" ) ).fragment( loadAsset( "shader.frag" ) ).define( "LAYERED" );
+	mRoomLayered = gl::Batch::create( mRoom->getVboMesh(), gl::GlslProg::create( layeredFormat ) );
+	
 	// load the material textures
 	auto texFormat = gl::Texture2d::Format().minFilter( GL_LINEAR_MIPMAP_LINEAR ).magFilter( GL_LINEAR ).mipmap();
 	mLightMap = gl::Texture2d::create( loadImage( loadAsset( "lightMap.jpg" ) ), texFormat );
 	mRoughnessMap = gl::Texture2d::create( loadImage( loadAsset( "roughness.jpg" ) ), texFormat );
 	mNormalMap = gl::Texture2d::create( loadImage( loadAsset( "normal.png" ) ), texFormat );
 	
-	// setup a cubemap fbo to render the environment
-	mFboCubemap = gl::FboCubeMap::create( 1024, 1024, gl::FboCubeMap::Format().textureCubeMapFormat( gl::TextureCubeMap::Format().mipmap().minFilter( GL_LINEAR_MIPMAP_LINEAR ).magFilter( GL_LINEAR ) ) );
+	// the probes are smaller than the single cubemap used to be so dozens of them fit in memory
+	mProbeResolution	= 256;
+	mProbeLevels		= 1 + (int) std::log2( mProbeResolution );
+	
+	// setup a cubemap fbo to bake the probes and a layered fbo rendering to the same cubemap. its depth buffer has
+	// to be a cubemap as well as every attachment of a layered framebuffer needs the same number of layers
+	mFboCubemap = gl::FboCubeMap::create( mProbeResolution, mProbeResolution, gl::FboCubeMap::Format().textureCubeMapFormat( gl::TextureCubeMap::Format().mipmap().minFilter( GL_LINEAR_MIPMAP_LINEAR ).magFilter( GL_LINEAR ) ) );
+	auto cubemap = mFboCubemap->getTextureCubeMap();
+	mDepthCubemap = gl::TextureCubeMap::create( mProbeResolution, mProbeResolution, gl::TextureCubeMap::Format().internalFormat( GL_DEPTH_COMPONENT24 ) );
+	mFboLayered = gl::Fbo::create( mProbeResolution, mProbeResolution, gl::Fbo::Format().attachment( GL_COLOR_ATTACHMENT0, cubemap ).attachment( GL_DEPTH_ATTACHMENT, mDepthCubemap ) );
+	{
+		// gl::Fbo attaches the first face of the cubemaps, attach them whole so gl_Layer selects the face
+		gl::ScopedFramebuffer scopedFbo( mFboLayered );
+		glFramebufferTexture( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, cubemap->getId(), 0 );
+		glFramebufferTexture( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mDepthCubemap->getId(), 0 );
+	}
+	
+	// the baked cubemaps are blitted to the cubemap array through this fbo, and the probes are sent to shader.frag in a buffer
+	// of five vec4 per probe: capture position, parallax box center and size, influence box center and inverse half size.
+	// the cells of the grid go in a second buffer so each fragment can select its own probes
+	mFboCopy			= gl::Fbo::create( 1, 1, gl::Fbo::Format().disableDepth() );
+	mProbesVbo			= gl::Vbo::create( GL_TEXTURE_BUFFER, sizeof( vec4 ) * 5, nullptr, GL_DYNAMIC_DRAW );
+	mProbesTexture		= gl::BufferTexture::create( mProbesVbo, GL_RGBA32F );
+	mProbeGridVbo		= gl::Vbo::create( GL_TEXTURE_BUFFER, sizeof( uint32_t ) * 2, nullptr, GL_DYNAMIC_DRAW );
+	mProbeGridTexture	= gl::BufferTexture::create( mProbeGridVbo, GL_R32UI );
+	mProbeCapacity	= 0;
 	
 	// load skybox texture and create a batch for it
 	mSkyBoxTexture = gl::TextureCubeMap::create( loadImage( loadAsset( "output_skybox.jpg" ) ) );
 	mSkyBox = gl::Batch::create( geom::Cube().size( vec3( 200.0f ) ), gl::GlslProg::create( loadAsset( "skybox.vert" ), loadAsset( "skybox.frag" ) ) );
+	mSkyBoxLayered = gl::Batch::create( mSkyBox->getVboMesh(), gl::GlslProg::create( gl::GlslProg::Format().vertex( loadAsset( "skybox.vert" ) ).geometry( loadAsset( "skybox.geom" ) ).fragment( loadAsset( "skybox.frag" ) ).define( "LAYERED" ) ) );
+	
+	// gpu timers and triangle counters of the two capture paths
+	for( int i = 0; i < NUM_CAPTURE_PATHS; ++i ) {
+		mCaptureTimeQueries[i]			= gl::Query::create( GL_TIME_ELAPSED );
+		mCapturePrimitivesQueries[i]	= gl::Query::create( GL_PRIMITIVES_GENERATED );
+		mCapturePending[i]				= false;
+		mCaptureGpuTimes[i]				= 0.0;
+		mCaptureCpuTimes[i]				= 0.0;
+		mCapturePrimitives[i]			= 0;
+		mCaptureFaces[i]				= 0;
+	}
 	
-	// set the environment map position and dimension
-	vec3 cubemapPos( 0.0f, 0.2f, 0.0f );
-	vec3 cubemapSize( 3.175f, 1.97f, 6.56f );
-	mCubemapBounds.set( cubemapPos - cubemapSize * 0.5f, cubemapPos + cubemapSize * 0.5f );
+	// split the room in three overlapping probes along its length, they all project their reflections on the walls of the room.
+	// the influence boxes go a bit past the walls, the influence of a probe is zero on the faces of its box
+	vec3 roomPos( 0.0f, 0.2f, 0.0f );
+	vec3 roomSize( 3.175f, 1.97f, 6.56f );
+	AxisAlignedBox room( roomPos - roomSize * 0.5f, roomPos + roomSize * 0.5f );
+	vec3 influenceSize( roomSize.x + 0.5f, roomSize.y + 0.5f, roomSize.z / 3.0f + 1.0f );
+	for( int i = -1; i <= 1; ++i ) {
+		vec3 position = roomPos + vec3( 0.0f, 0.0f, i * roomSize.z / 3.0f );
+		addProbe( position, AxisAlignedBox( position - influenceSize * 0.5f, position + influenceSize * 0.5f ), room );
+	}
 	
 	// setup ui
 	ui::initialize();
@@ -98,13 +197,34 @@ ParallaxCorrectedCubemapApp::ParallaxCorrectedCubemapApp()
 	mShowUi			= false;
 	mDrawCubemapBounds	= false;
 	mDrawCubemap		= false;
+	mCapturePath		= CAPTURE_LAYERED;
+	mFacesPerFrame		= 2;
+	mSelectedProbe		= 1;
+	mProbeQueryTime		= 0.0;
+	mBakeProbe			= -1;
+	mLastBakedProbe		= -1;
 	
-	// renders the environment map
-	renderCubemap();
+	// bakes the probes right away, the next bakes are spread over several frames
+	for( size_t i = 0; i < mProbes.size(); ++i ) {
+		startBake( i );
+		renderCubemap( mCapturePath, 0, 6 );
+		finishBake();
+	}
+	updateProbes();
 }
 
 void ParallaxCorrectedCubemapApp::draw()
 {
+	readCaptureQueries();
+	updateBake();
+	updateProbes();
+	
+	// each fragment of the room selects its probes in shader.frag, the selection at the camera is only shown in the ui
+	Timer timer( true );
+	vec3 eye = mCamera.getEyePoint();
+	mProbeSelection = mProbeGrid.query( eye.x, eye.y, eye.z );
+	mProbeQueryTime = timer.getSeconds() * 1000.0;
+	
 	// clear the screen
 	gl::clear( Color( 0, 0, 0 ) );
 	
@@ -112,11 +232,19 @@ void ParallaxCorrectedCubemapApp::draw()
 	gl::setMatrices( mCamera );
 	renderScene();
 	
-	// render the cubemap bounds
-	if( mDrawCubemapBounds )
-		gl::drawStrokedCube( mCubemapBounds );
+	// render the influence boxes of the probes, the parallax box and capture position of the selected one
+	if( mDrawCubemapBounds ) {
+		gl::ScopedColor scopedColor;
+		for( size_t i = 0; i < mProbes.size(); ++i ) {
+			gl::color( (int) i == mSelectedProbe ? Color( 1.0f, 1.0f, 1.0f ) : Color( 0.4f, 0.4f, 0.4f ) );
+			gl::drawStrokedCube( mProbes[i].mInfluence );
+		}
+		gl::color( Color( 1.0f, 0.8f, 0.0f ) );
+		gl::drawStrokedCube( mProbes[mSelectedProbe].mParallax );
+		gl::drawStrokedCube( mProbes[mSelectedProbe].mPosition, vec3( 0.05f ) );
+	}
 	
-	// render the cubemap texture
+	// render the last baked cubemap
 	if( mDrawCubemap ) {
 		gl::ScopedDepth disableDepth( false );
 		gl::setMatricesWindow( getWindowSize() );
@@ -130,15 +258,19 @@ void ParallaxCorrectedCubemapApp::draw()
 	getWindow()->setTitle( "Parallax Corrected Environment Mapping | " + to_string( (int) getAverageFps() ) + " fps" );
 }
 
-void ParallaxCorrectedCubemapApp::renderScene( bool withReflections )
+void ParallaxCorrectedCubemapApp::renderScene( bool withReflections, bool layered )
 {
 	// bind the different textures
 	gl::ScopedTextureBind texBind0( mLightMap, 0 );
-	gl::ScopedTextureBind texBind1( mFboCubemap->getTextureCubeMap(), 1 );
+	gl::ScopedTextureBind texBind1( mProbeCubemaps, 1 );
 	gl::ScopedTextureBind texBind2( mRoughnessMap, 2 );
 	gl::ScopedTextureBind texBind3( mNormalMap, 3 );
+	gl::ScopedTextureBind texBind4( GL_TEXTURE_BUFFER, mProbesTexture->getId(), 4 );
+	gl::ScopedTextureBind texBind5( GL_TEXTURE_BUFFER, mProbeGridTexture->getId(), 5 );
 	
-	auto shader = mRoom->getGlslProg();
+	auto room	= layered ? mRoomLayered : mRoom;
+	auto skyBox	= layered ? mSkyBoxLayered : mSkyBox;
+	auto shader	= room->getGlslProg();
 	
 	// disable reflections when rendering the cubemap
 	if( withReflections )
@@ -148,12 +280,20 @@ void ParallaxCorrectedCubemapApp::renderScene( bool withReflections )
 	
 	// update the shader uniforms
 	shader->uniform( "uLightMap", 0 );
-	shader->uniform( "uCubeMap", 1 );
+	shader->uniform( "uProbeCubeMaps", 1 );
 	shader->uniform( "uRoughnessMap", 2 );
 	shader->uniform( "uNormalMap", 3 );
+	shader->uniform( "uProbes", 4 );
+	shader->uniform( "uProbeGrid", 5 );
 	shader->uniform( "uCameraPosition", vec3( mCamera.getEyePoint() ) );
-	shader->uniform( "uCubeMapSize", mCubemapBounds.getSize() );
-	shader->uniform( "uCubeMapPosition", mCubemapBounds.getCenter() );
+	
+	// the bounds of the probe grid
+	const int *cells			= mProbeGrid.getCells();
+	const float *gridMin		= mProbeGrid.getMin();
+	const float *invCellSize	= mProbeGrid.getInvCellSize();
+	shader->uniform( "uProbeGridCells", ivec3( cells[0], cells[1], cells[2] ) );
+	shader->uniform( "uProbeGridMin", vec3( gridMin[0], gridMin[1], gridMin[2] ) );
+	shader->uniform( "uProbeGridInvCellSize", vec3( invCellSize[0], invCellSize[1], invCellSize[2] ) );
 
 	// enable backface culling and depth testing
 	// GL_FRONT because the .obj model is wrong
@@ -161,53 +301,362 @@ void ParallaxCorrectedCubemapApp::renderScene( bool withReflections )
 	gl::ScopedDepth enableDepth( true );
 	
 	// render the room
-	mRoom->draw();
+	room->draw();
 	
 	// remove the scale and translation from the view matrix
-	// so the cubemap feels like infinitely far
+	// so the cubemap feels like infinitely far, the caller gets its view matrix back
 	gl::ScopedFaceCulling disableCulling( false );
+	gl::ScopedViewMatrix scopedView;
 	gl::setViewMatrix( mat4( mat3( gl::getViewMatrix() ) ) );
-	gl::ScopedTextureBind texBind4( mSkyBoxTexture, 0 );
-	mSkyBox->getGlslProg()->uniform( "uOrientation", glm::rotate( -2.32f, vec3( 0, 1, 0 ) ) );
-	mSkyBox->draw();
+	gl::ScopedTextureBind texBind6( mSkyBoxTexture, 0 );
+	skyBox->getGlslProg()->uniform( "uOrientation", glm::rotate( -2.32f, vec3( 0, 1, 0 ) ) );
+	skyBox->draw();
+}
+
+void ParallaxCorrectedCubemapApp::addProbe( const vec3 &position, const AxisAlignedBox &influence, const AxisAlignedBox &parallax )
+{
+	reserveProbes( mProbes.size() + 1 );
+	
+	Probe probe;
+	probe.mPosition			= position;
+	probe.mBakedPosition	= position;
+	probe.mInfluence		= influence;
+	probe.mParallax			= parallax;
+	probe.mDirty			= true;
+	mProbes.push_back( probe );
+	mProbesChanged			= true;
+}
+
+void ParallaxCorrectedCubemapApp::removeProbe( size_t index )
+{
+	// the last probe takes the place of the removed one in the cubemap array
+	size_t last = mProbes.size() - 1;
+	if( mBakeProbe == (int) index ) {
+		mBakeProbe = -1;
+	}
+	if( index != last ) {
+		mProbes[index] = mProbes[last];
+		copyProbe( mProbeCubemaps->getId(), last, mProbeCubemaps->getId(), index );
+		if( mBakeProbe == (int) last ) {
+			mBakeProbe = index;
+		}
+	}
+	mProbes.pop_back();
+	mSelectedProbe	= std::min( mSelectedProbe, (int) mProbes.size() - 1 );
+	mProbesChanged	= true;
 }
 
-void ParallaxCorrectedCubemapApp::renderCubemap()
+void ParallaxCorrectedCubemapApp::reserveProbes( size_t count )
+{
+	if( count <= mProbeCapacity ) {
+		return;
+	}
+	
+	// allocate every level of the six faces of each probe in the array
+	size_t capacity = std::max( count, mProbeCapacity * 2 );
+	auto format		= gl::Texture3d::Format().target( GL_TEXTURE_CUBE_MAP_ARRAY ).internalFormat( GL_RGBA8 ).minFilter( GL_LINEAR_MIPMAP_LINEAR ).magFilter( GL_LINEAR ).wrap( GL_CLAMP_TO_EDGE );
+	auto cubemaps	= gl::Texture3d::create( mProbeResolution, mProbeResolution, 6 * capacity, format );
+	{
+		gl::ScopedTextureBind scopedTexture( cubemaps );
+		for( int level = 0; level < mProbeLevels; ++level ) {
+			int size = mProbeResolution >> level;
+			glTexImage3D( GL_TEXTURE_CUBE_MAP_ARRAY, level, GL_RGBA8, size, size, 6 * capacity, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+		}
+		glTexParameteri( GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAX_LEVEL, mProbeLevels - 1 );
+	}
+	
+	// and keep the probes already baked
+	for( size_t i = 0; i < mProbes.size(); ++i ) {
+		copyProbe( mProbeCubemaps->getId(), i, cubemaps->getId(), i );
+	}
+	mProbeCubemaps = cubemaps;
+	mProbeCapacity = capacity;
+}
+
+void ParallaxCorrectedCubemapApp::copyProbe( GLuint src, int srcProbe, GLuint dst, int dstProbe )
+{
+	// blits every level of the six faces from the layers of srcProbe, or from a plain cubemap when srcProbe is negative
+	gl::ScopedFramebuffer scopedFbo( mFboCopy );
+	GLenum drawBuffer = GL_COLOR_ATTACHMENT1;
+	glReadBuffer( GL_COLOR_ATTACHMENT0 );
+	glDrawBuffers( 1, &drawBuffer );
+	for( int level = 0; level < mProbeLevels; ++level ) {
+		int size = mProbeResolution >> level;
+		for( int face = 0; face < 6; ++face ) {
+			if( srcProbe < 0 )
+				glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, src, level );
+			else
+				glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, src, level, srcProbe * 6 + face );
+			glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, dst, level, dstProbe * 6 + face );
+			glBlitFramebuffer( 0, 0, size, size, 0, 0, size, size, GL_COLOR_BUFFER_BIT, GL_NEAREST );
+		}
+	}
+	
+	// detach the textures so the fbo doesn't keep a replaced array alive
+	glFramebufferTexture( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 0, 0 );
+	glFramebufferTexture( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, 0, 0 );
+	drawBuffer = GL_COLOR_ATTACHMENT0;
+	glDrawBuffers( 1, &drawBuffer );
+}
+
+void ParallaxCorrectedCubemapApp::updateProbes()
+{
+	if( ! mProbesChanged ) {
+		return;
+	}
+	
+	// rebuild the grid from the influence boxes
+	vector<float> boxes;
+	for( const auto &probe : mProbes ) {
+		vec3 min = probe.mInfluence.getMin(), max = probe.mInfluence.getMax();
+		boxes.insert( boxes.end(), { min.x, min.y, min.z, max.x, max.y, max.z } );
+	}
+	mProbeGrid.build( boxes.data(), mProbes.size() );
+	
+	// upload the probes with the influence boxes of the grid so the shader computes the same weights as ProbeGrid::query
+	const auto &influences = mProbeGrid.getBoxes();
+	vector<vec4> data;
+	for( size_t i = 0; i < mProbes.size(); ++i ) {
+		data.push_back( vec4( mProbes[i].mBakedPosition, 0.0f ) );
+		data.push_back( vec4( mProbes[i].mParallax.getCenter(), 0.0f ) );
+		data.push_back( vec4( mProbes[i].mParallax.getSize(), 0.0f ) );
+		data.push_back( vec4( influences[i * 6], influences[i * 6 + 1], influences[i * 6 + 2], 0.0f ) );
+		data.push_back( vec4( influences[i * 6 + 3], influences[i * 6 + 4], influences[i * 6 + 5], 0.0f ) );
+	}
+	mProbesVbo->bufferData( data.size() * sizeof( vec4 ), data.data(), GL_DYNAMIC_DRAW );
+	
+	// and the cells, their offsets are moved past the offsets themselves to index the probe lists in the same buffer
+	const auto &offsets	= mProbeGrid.getCellOffsets();
+	const auto &probes	= mProbeGrid.getCellProbes();
+	vector<uint32_t> grid;
+	grid.reserve( offsets.size() + probes.size() );
+	for( auto offset : offsets ) {
+		grid.push_back( offset + (uint32_t) offsets.size() );
+	}
+	grid.insert( grid.end(), probes.begin(), probes.end() );
+	mProbeGridVbo->bufferData( grid.size() * sizeof( uint32_t ), grid.data(), GL_DYNAMIC_DRAW );
+	mProbesChanged = false;
+}
+
+void ParallaxCorrectedCubemapApp::updateBake()
+{
+	// start baking the next probe that moved, the changes made to a probe while it is baking are coalesced into its next bake
+	if( mBakeProbe < 0 ) {
+		for( size_t i = 1; i <= mProbes.size(); ++i ) {
+			size_t probe = ( mLastBakedProbe + i ) % mProbes.size();
+			if( mProbes[probe].mDirty ) {
+				startBake( probe );
+				break;
+			}
+		}
+	}
+	
+	// render a few faces each frame and copy the cubemap to the array once they are all done
+	if( mBakeProbe >= 0 ) {
+		int numFaces = std::min( mFacesPerFrame, 6 - mBakeFace );
+		renderCubemap( mCapturePath, mBakeFace, numFaces );
+		mBakeFace += numFaces;
+		if( mBakeFace == 6 ) {
+			finishBake();
+		}
+	}
+}
+
+void ParallaxCorrectedCubemapApp::startBake( int probe )
+{
+	// an interrupted bake is started again later
+	if( mBakeProbe >= 0 && mBakeProbe != probe ) {
+		mProbes[mBakeProbe].mDirty = true;
+	}
+	mBakeProbe				= probe;
+	mBakePosition			= mProbes[probe].mPosition;
+	mBakeFace				= 0;
+	mProbes[probe].mDirty	= false;
+}
+
+void ParallaxCorrectedCubemapApp::finishBake()
+{
+	// force the rendering of the mipmaps as we are using them to have cheap blurry reflections
+	auto cubemap = mFboCubemap->getTextureCubeMap();
+	{
+		gl::ScopedTextureBind textureBind( cubemap );
+		glGenerateMipmap( cubemap->getTarget() );
+	}
+	
+	// and replace the previous cubemap of the probe
+	copyProbe( cubemap->getId(), -1, mProbeCubemaps->getId(), mBakeProbe );
+	mProbes[mBakeProbe].mBakedPosition	= mBakePosition;
+	mProbesChanged						= true;
+	mLastBakedProbe						= mBakeProbe;
+	mBakeProbe							= -1;
+}
+
+void ParallaxCorrectedCubemapApp::renderCubemap( CapturePath path, int firstFace, int numFaces )
+{
+	// time the capture on the cpu and the gpu and count the triangles sent to the rasterizer
+	Timer timer( true );
+	mCaptureTimeQueries[path]->begin();
+	mCapturePrimitivesQueries[path]->begin();
+	
+	if( path == CAPTURE_LAYERED )
+		renderCubemapLayered( firstFace, numFaces );
+	else
+		renderCubemapFaces( firstFace, numFaces );
+	
+	mCapturePrimitivesQueries[path]->end();
+	mCaptureTimeQueries[path]->end();
+	mCaptureCpuTimes[path]	= timer.getSeconds() * 1000.0;
+	mCaptureFaces[path]		= numFaces;
+	mCapturePending[path]	= true;
+}
+
+void ParallaxCorrectedCubemapApp::renderCubemapFaces( int firstFace, int numFaces )
 {
 	// bind the cubemap fbo and set matrices and options
-	gl::ScopedFramebuffer scopedFbo( mFboCubemap );
-	gl::ScopedViewport scopedViewport( ivec2( 0 ), mFboCubemap->getSize() );
+	auto fbo = mFboCubemap;
+	gl::ScopedFramebuffer scopedFbo( fbo );
+	gl::ScopedViewport scopedViewport( ivec2( 0 ), fbo->getSize() );
 	gl::ScopedMatrices scopedMatrices;
 	gl::ScopedBlend disableBlend( false );
 	gl::ScopedDepth enableDepth( true );
 	
 	// render each face of the cubemap
-	for( GLenum dir = GL_TEXTURE_CUBE_MAP_POSITIVE_X; dir < GL_TEXTURE_CUBE_MAP_POSITIVE_X + 6; ++dir ) {
-		mFboCubemap->bindFramebufferFace( dir );
+	for( GLenum dir = GL_TEXTURE_CUBE_MAP_POSITIVE_X + firstFace; dir < GL_TEXTURE_CUBE_MAP_POSITIVE_X + firstFace + numFaces; ++dir ) {
+		fbo->bindFramebufferFace( dir );
 		
 		gl::clear();
-		gl::setProjectionMatrix( ci::CameraPersp( mFboCubemap->getWidth(), mFboCubemap->getHeight(), 90.0f, mCamera.getNearClip(), mCamera.getFarClip() ).getProjectionMatrix() );
-		gl::setViewMatrix( mFboCubemap->calcViewMatrix( dir, mCubemapBounds.getCenter() ) );
+		gl::setProjectionMatrix( ci::CameraPersp( fbo->getWidth(), fbo->getHeight(), 90.0f, mCamera.getNearClip(), mCamera.getFarClip() ).getProjectionMatrix() );
+		gl::setViewMatrix( fbo->calcViewMatrix( dir, mBakePosition ) );
 		renderScene( false );
 	}
+}
+
+void ParallaxCorrectedCubemapApp::renderCubemapLayered( int firstFace, int numFaces )
+{
+	auto fbo		= mFboLayered;
+	auto cubemap	= mFboCubemap;
+	gl::ScopedFramebuffer scopedFbo( fbo );
+	gl::ScopedViewport scopedViewport( ivec2( 0 ), fbo->getSize() );
+	gl::ScopedMatrices scopedMatrices;
+	gl::ScopedBlend disableBlend( false );
+	gl::ScopedDepth enableDepth( true );
 	
-	// force the rendering of the mipmaps as we are using them to have cheap blurry reflections
-	gl::ScopedTextureBind textureBind( mFboCubemap->getTextureCubeMap() );
-	glGenerateMipmap( mFboCubemap->getTextureCubeMap()->getTarget() );
+	// clearing the layered fbo clears the six faces, when only some of them are rendered
+	// they are attached and cleared one by one to keep the faces rendered in the previous frames
+	if( numFaces == 6 ) {
+		gl::clear();
+	}
+	else {
+		GLuint colorId = cubemap->getTextureCubeMap()->getId();
+		for( int face = firstFace; face < firstFace + numFaces; ++face ) {
+			glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, colorId, 0 );
+			glFramebufferTexture2D( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mDepthCubemap->getId(), 0 );
+			gl::clear();
+		}
+		glFramebufferTexture( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorId, 0 );
+		glFramebufferTexture( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mDepthCubemap->getId(), 0 );
+	}
+	
+	// the geometry shaders get the view projection of every face instead of the current matrices,
+	// the skybox ones without the translation so it stays infinitely far
+	mat4 projection = ci::CameraPersp( fbo->getWidth(), fbo->getHeight(), 90.0f, mCamera.getNearClip(), mCamera.getFarClip() ).getProjectionMatrix();
+	vector<mat4> roomMatrices, skyBoxMatrices;
+	for( GLenum dir = GL_TEXTURE_CUBE_MAP_POSITIVE_X; dir < GL_TEXTURE_CUBE_MAP_POSITIVE_X + 6; ++dir ) {
+		mat4 view = cubemap->calcViewMatrix( dir, mBakePosition );
+		roomMatrices.push_back( projection * view );
+		skyBoxMatrices.push_back( projection * mat4( mat3( view ) ) );
+	}
+	
+	// and skip the invocations of the faces that aren't rendered this time
+	int faceMask = ( ( 1 << numFaces ) - 1 ) << firstFace;
+	mRoomLayered->getGlslProg()->uniform( "uFaceViewProjections", roomMatrices.data(), 6 );
+	mRoomLayered->getGlslProg()->uniform( "uFaceMask", faceMask );
+	mSkyBoxLayered->getGlslProg()->uniform( "uFaceViewProjections", skyBoxMatrices.data(), 6 );
+	mSkyBoxLayered->getGlslProg()->uniform( "uFaceMask", faceMask );
+	renderScene( false, true );
+}
+
+void ParallaxCorrectedCubemapApp::readCaptureQueries()
+{
+	for( int i = 0; i < NUM_CAPTURE_PATHS; ++i ) {
+		if( mCapturePending[i] && mCaptureTimeQueries[i]->isReady() && mCapturePrimitivesQueries[i]->isReady() ) {
+			mCaptureGpuTimes[i]		= mCaptureTimeQueries[i]->getValueInt64() / 1000000.0;
+			mCapturePrimitives[i]	= mCapturePrimitivesQueries[i]->getValueInt64();
+			mCapturePending[i]		= false;
+			CI_LOG_V( ( i == CAPTURE_LAYERED ? "Layered" : "Per face" ) << " capture of " << mCaptureFaces[i] << " faces: " << mCaptureGpuTimes[i] << "ms gpu, " << mCaptureCpuTimes[i] << "ms cpu, " << mCapturePrimitives[i] << " triangles" );
+		}
+	}
 }
+
 void ParallaxCorrectedCubemapApp::userInterface()
 {
 	ui::ScopedWindow window( "Parallax Corrected Environment Mapping" );
 	
 	ui::Checkbox( "Draw Cubemap Bounds", &mDrawCubemapBounds );
 	ui::Checkbox( "Draw Cubemap", &mDrawCubemap );
-	vec3 cubemapPos = mCubemapBounds.getCenter();
-	vec3 cubemapSize = mCubemapBounds.getSize();
+	
+	// capture paths
+	if( ui::CollapsingHeader( "Capture" ) ) {
+		bool layered = mCapturePath == CAPTURE_LAYERED;
+		if( ui::Checkbox( "Layered Capture", &layered ) ) {
+			mCapturePath = layered ? CAPTURE_LAYERED : CAPTURE_FACES;
+			mProbes[mSelectedProbe].mDirty = true;
+		}
+		ui::SliderInt( "Faces Per Frame", &mFacesPerFrame, 1, 6 );
+		if( ui::Button( "Capture With Both Paths" ) ) {
+			// full captures of the selected probe outside of the time slicing, the current path renders last so its cubemap is the one in use
+			startBake( mSelectedProbe );
+			renderCubemap( mCapturePath == CAPTURE_LAYERED ? CAPTURE_FACES : CAPTURE_LAYERED, 0, 6 );
+			renderCubemap( mCapturePath, 0, 6 );
+			finishBake();
+		}
+		ui::Text( "Per face: %.2fms gpu, %.2fms cpu, %d faces, %lld triangles", mCaptureGpuTimes[CAPTURE_FACES], mCaptureCpuTimes[CAPTURE_FACES], mCaptureFaces[CAPTURE_FACES], (long long) mCapturePrimitives[CAPTURE_FACES] );
+		ui::Text( "Layered: %.2fms gpu, %.2fms cpu, %d faces, %lld triangles", mCaptureGpuTimes[CAPTURE_LAYERED], mCaptureCpuTimes[CAPTURE_LAYERED], mCaptureFaces[CAPTURE_LAYERED], (long long) mCapturePrimitives[CAPTURE_LAYERED] );
+		if( mBakeProbe >= 0 )
+			ui::Text( "Baking probe %d, %d/6 faces", mBakeProbe, mBakeFace );
+		else
+			ui::Text( "Baked" );
+	}
+	
+	// probes
+	ui::SliderInt( "Probe", &mSelectedProbe, 0, (int) mProbes.size() - 1 );
+	Probe &probe = mProbes[mSelectedProbe];
+	
+	// moving the capture position needs a new bake, the boxes only change the grid and the probes buffer
+	if( ui::DragFloat3( "capturePos", &probe.mPosition[0], 0.01f ) ) {
+		probe.mDirty = true;
+	}
+	vec3 influencePos = probe.mInfluence.getCenter();
+	vec3 influenceSize = probe.mInfluence.getSize();
+	if( ui::DragFloat3( "influencePos", &influencePos[0], 0.01f ) ||
+	   ui::DragFloat3( "influenceSize", &influenceSize[0], 0.01f ) ) {
+		probe.mInfluence.set( influencePos - influenceSize * 0.5f, influencePos + influenceSize * 0.5f );
+		mProbesChanged = true;
+	}
+	vec3 cubemapPos = probe.mParallax.getCenter();
+	vec3 cubemapSize = probe.mParallax.getSize();
 	if( ui::DragFloat3( "cubemapPos", &cubemapPos[0], 0.01f ) ||
 	   ui::DragFloat3( "cubemapSize", &cubemapSize[0], 0.01f ) ) {
-		mCubemapBounds.set( cubemapPos - cubemapSize * 0.5f, cubemapPos + cubemapSize * 0.5f );
-		renderCubemap();
+		probe.mParallax.set( cubemapPos - cubemapSize * 0.5f, cubemapPos + cubemapSize * 0.5f );
+		mProbesChanged = true;
+	}
+	if( ui::Button( "Add Probe" ) ) {
+		// the new probe starts as a copy of the selected one, cubemap included
+		Probe copy = probe;
+		addProbe( copy.mPosition, copy.mInfluence, copy.mParallax );
+		copyProbe( mProbeCubemaps->getId(), mSelectedProbe, mProbeCubemaps->getId(), (int) mProbes.size() - 1 );
+		mProbes.back().mBakedPosition	= copy.mBakedPosition;
+		mProbes.back().mDirty			= copy.mPosition != copy.mBakedPosition;
+		mSelectedProbe					= (int) mProbes.size() - 1;
+	}
+	if( mProbes.size() > 1 ) {
+		ui::SameLine();
+		if( ui::Button( "Remove Probe" ) ) {
+			removeProbe( mSelectedProbe );
+		}
 	}
+	ui::Text( "%d probes, camera query %.2fus", (int) mProbes.size(), mProbeQueryTime * 1000.0 );
+	ui::Text( "Camera probes %d (%.2f) and %d (%.2f)", mProbeSelection.mProbes[0], mProbeSelection.mWeights[0], mProbeSelection.mProbes[1], mProbeSelection.mWeights[1] );
 }
 
 CINDER_APP( ParallaxCorrectedCubemapApp, RendererGl( RendererGl::Options().msaa( 8 ) ), []( App::Settings* settings ) {
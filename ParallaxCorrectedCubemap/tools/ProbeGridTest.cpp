@@ -0,0 +1,156 @@
+/*
+ Headless test and benchmark of ProbeGrid.h. Only needs a C++11 compiler:
+
+	g++ -std=c++11 -O2 -I../include ProbeGridTest.cpp -o ProbeGridTest
+	cl /EHsc /O2 /I..\include ProbeGridTest.cpp
+
+ Usage:
+	ProbeGridTest [options]
+
+	--probes <n>		number of probes of the last run, 1000 by default
+	--queries <n>		number of random points queried by each run, 100000 by default
+	--seed <n>			seed of the boxes and points, 1 by default
+
+ Runs with 0, 1, 3 and the option number of probes. The influence boxes have random centers in a 100 units
+ cube and half sizes between 1 and 5, the points are spread over the same cube and a bit past it. Each
+ query is checked against a brute force search of all the boxes, two probes with the same influence are
+ both accepted. Prints the build time, the average query time and the number of mismatching queries.
+ Returns 1 if any query doesn't match.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <string>
+#include <cstdlib>
+
+#include "ProbeGrid.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// the influence of the box \a probe on \a point, computed from its min and max rather than from the grid
+static float getInfluence( const vector<float> &boxes, int probe, const float *point )
+{
+	if( probe < 0 ) {
+		return 0.0f;
+	}
+	const float *box	= &boxes[probe * 6];
+	float distance		= 0.0f;
+	for( int i = 0; i < 3; ++i ) {
+		float center	= ( box[i] + box[i + 3] ) * 0.5f;
+		float halfSize	= ( box[i + 3] - box[i] ) * 0.5f;
+		distance		= std::max( distance, std::abs( point[i] - center ) / halfSize );
+	}
+	return std::max( 0.0f, 1.0f - distance );
+}
+
+// returns the number of queries whose probes or weights differ from the brute force ones
+static size_t validate( const ProbeGrid &grid, const vector<float> &boxes, const vector<float> &points )
+{
+	int numProbes		= static_cast<int>( boxes.size() / 6 );
+	size_t mismatches	= 0;
+	for( size_t q = 0; q < points.size() / 3; ++q ) {
+		const float *point = &points[q * 3];
+		int expected[2]			= { -1, -1 };
+		float influences[2]		= { 0.0f, 0.0f };
+		for( int p = 0; p < numProbes; ++p ) {
+			float influence = getInfluence( boxes, p, point );
+			if( influence > influences[0] ) {
+				expected[1]		= expected[0];
+				influences[1]	= influences[0];
+				expected[0]		= p;
+				influences[0]	= influence;
+			}
+			else if( influence > influences[1] ) {
+				expected[1]		= p;
+				influences[1]	= influence;
+			}
+		}
+
+		// the grid and the brute force search round the influences differently, so ties may be broken either way
+		auto selection	= grid.query( point[0], point[1], point[2] );
+		bool matches	= true;
+		for( int i = 0; i < 2; ++i ) {
+			if( std::abs( getInfluence( boxes, selection.mProbes[i], point ) - influences[i] ) > 1e-5f ) {
+				matches = false;
+			}
+		}
+		float sum = influences[0] + influences[1];
+		for( int i = 0; i < 2 && sum > 0.0f; ++i ) {
+			if( std::abs( selection.mWeights[i] - influences[i] / sum ) > 1e-4f ) {
+				matches = false;
+			}
+		}
+		if( sum == 0.0f && ( selection.mProbes[0] >= 0 || selection.mWeights[0] != 0.0f ) ) {
+			matches = false;
+		}
+		if( ! matches ) {
+			if( mismatches < 10 ) {
+				cout << "  mismatch at " << point[0] << ", " << point[1] << ", " << point[2] << ": " << selection.mProbes[0] << " and " << selection.mProbes[1]
+					<< " instead of " << expected[0] << " and " << expected[1] << endl;
+			}
+			++mismatches;
+		}
+	}
+	return mismatches;
+}
+
+int main( int argc, char **argv )
+{
+	size_t numProbes	= 1000;
+	size_t numQueries	= 100000;
+	unsigned seed		= 1;
+	for( int i = 1; i < argc; ++i ) {
+		string arg = argv[i];
+		if( arg == "--probes" && i + 1 < argc ) numProbes = strtoul( argv[++i], nullptr, 10 );
+		else if( arg == "--queries" && i + 1 < argc ) numQueries = strtoul( argv[++i], nullptr, 10 );
+		else if( arg == "--seed" && i + 1 < argc ) seed = static_cast<unsigned>( strtoul( argv[++i], nullptr, 10 ) );
+		else {
+			cerr << "Unknown option " << arg << ", see the top of ProbeGridTest.cpp" << endl;
+			return 1;
+		}
+	}
+
+	mt19937 rng( seed );
+	uniform_real_distribution<float> centers( 0.0f, 100.0f ), halfSizes( 1.0f, 5.0f ), coords( -2.0f, 102.0f );
+	cout << fixed << setprecision( 3 );
+
+	size_t mismatches = 0;
+	for( size_t count : { static_cast<size_t>( 0 ), static_cast<size_t>( 1 ), static_cast<size_t>( 3 ), numProbes } ) {
+		// min x, y, z followed by max x, y, z, the layout ProbeGrid::build takes
+		vector<float> boxes( count * 6 );
+		for( size_t p = 0; p < count; ++p ) {
+			for( int i = 0; i < 3; ++i ) {
+				float center = centers( rng ), halfSize = halfSizes( rng );
+				boxes[p * 6 + i]		= center - halfSize;
+				boxes[p * 6 + i + 3]	= center + halfSize;
+			}
+		}
+		vector<float> points( numQueries * 3 );
+		for( auto &coord : points ) {
+			coord = coords( rng );
+		}
+
+		ProbeGrid grid;
+		auto start = steady_clock::now();
+		grid.build( boxes.data(), count );
+		double buildTime = duration<double,milli>( steady_clock::now() - start ).count();
+
+		// sum the weights so the queries aren't optimized away
+		double weights = 0.0;
+		start = steady_clock::now();
+		for( size_t q = 0; q < numQueries; ++q ) {
+			weights += grid.query( points[q * 3], points[q * 3 + 1], points[q * 3 + 2] ).mWeights[0];
+		}
+		double queryTime = duration<double,nano>( steady_clock::now() - start ).count() / std::max<size_t>( numQueries, 1 );
+
+		size_t runMismatches = validate( grid, boxes, points );
+		mismatches += runMismatches;
+		cout << count << " probes, " << grid.getNumCells() << " cells: build " << buildTime << " ms, " << queryTime << " ns per query, "
+			<< runMismatches << " mismatching queries (weight sum " << weights << ")" << endl;
+	}
+	return mismatches ? 1 : 0;
+}
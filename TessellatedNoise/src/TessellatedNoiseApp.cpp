@@ -40,10 +40,11 @@ TessellatedNoiseApp::TessellatedNoiseApp()
 	auto shader	= gl::GlslProg::create( format );
 	mBatch = gl::Batch::create( geom::Icosphere().subdivisions( 3 ), shader );
 	
-	// load the prefiltered IBL Cubemaps
-	auto cubeMapFormat	= gl::TextureCubeMap::Format().mipmap().internalFormat( GL_RGB16F ).minFilter( GL_LINEAR_MIPMAP_LINEAR ).magFilter( GL_LINEAR );
-	mIrradianceMap		= gl::TextureCubeMap::createFromDds( loadAsset( "WellsIrradiance.dds" ), cubeMapFormat );
-	mRadianceMap		= gl::TextureCubeMap::createFromDds( loadAsset( "WellsRadiance.dds" ), cubeMapFormat );
+	// load the prefiltered IBL Cubemaps. the BC6H blocks are uploaded as they are, the radiance mips come from
+	// the file and the irradiance has a single level as compressed textures can't generate their mips
+	auto cubeMapFormat	= gl::TextureCubeMap::Format().mipmap().minFilter( GL_LINEAR_MIPMAP_LINEAR ).magFilter( GL_LINEAR );
+	mIrradianceMap		= gl::TextureCubeMap::createFromDds( loadAsset( "WellsIrradianceBC6H.dds" ), gl::TextureCubeMap::Format().minFilter( GL_LINEAR ).magFilter( GL_LINEAR ) );
+	mRadianceMap		= gl::TextureCubeMap::createFromDds( loadAsset( "WellsRadianceBC6H.dds" ), cubeMapFormat );
 	
 	mInnerLevel = 8.0f;
 	mOuterLevel = 6.0f;
@@ -0,0 +1,140 @@
+/*
+
+ DynamicResolution
+
+ Copyright (c) 2015, Simon Geilfus
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "cinder/Vector.h"
+#include "cinder/gl/Query.h"
+
+//! Picks the resolution the scene is rendered at from the gpu time of the passes that depend on it, so a frame time target is held
+//! on any machine without tuning. The time is measured with timer queries, averaged over a few frames and compared to the target:
+//! above the upper threshold the scale drops right away to the one expected to land in the middle of the thresholds, below the lower
+//! one it only goes up a step at a time and only if the larger resolution is expected to stay under the upper threshold. The gap
+//! between both thresholds, the quantized scales and the frames skipped after each change keep it from oscillating. The image is
+//! upscaled to the window when presented.
+class DynamicResolution {
+public:
+	struct Options {
+		Options() : mTargetTime( 1000.0f / 60.0f ), mMinScale( 0.5f ), mMaxScale( 1.0f ), mStep( 0.05f ), mLowerThreshold( 0.75f ), mUpperThreshold( 0.95f ), mFrames( 10 ), mCooldown( 20 ) {}
+
+		//! Gpu time in milliseconds the timed passes have to fit in
+		Options& targetTime( float milliseconds ) { mTargetTime = milliseconds; return *this; }
+		//! Range of the scale applied to both sides of the full resolution
+		Options& scale( float minScale, float maxScale ) { mMinScale = minScale; mMaxScale = maxScale; return *this; }
+		//! The scale is a multiple of \a step, small variations of the time don't recreate the render targets
+		Options& step( float step ) { mStep = step; return *this; }
+		//! Fractions of the target time under which the resolution goes up and over which it goes down
+		Options& thresholds( float lower, float upper ) { mLowerThreshold = lower; mUpperThreshold = upper; return *this; }
+		//! Number of frames averaged for each decision, and number of frames ignored after a change while the timings settle
+		Options& frames( int frames, int cooldown ) { mFrames = frames; mCooldown = cooldown; return *this; }
+
+		float	mTargetTime, mMinScale, mMaxScale, mStep, mLowerThreshold, mUpperThreshold;
+		int		mFrames, mCooldown;
+	};
+
+	DynamicResolution( const Options &options = Options() )
+	: mOptions( options ), mScale( options.mMaxScale ), mTime( 0.0 ), mAverageTime( 0.0 ), mTimes( 0.0 ), mNumTimes( 0 ), mCooldown( 0 )
+	{
+	}
+
+	//! Starts timing the passes that scale with the resolution. Call from the gl thread, the queries are created on first use
+	void begin()
+	{
+		if( ! mTimer ) {
+			mTimer = ci::gl::QueryTimeSwapped::create();
+		}
+		mTimer->begin();
+	}
+	//! Ends the timing started by begin and adjusts the scale, returns true when the render targets need to be resized
+	bool end()
+	{
+		mTimer->end();
+		return update( mTimer->getElapsedMilliseconds() );
+	}
+
+	//! Adds the gpu time of a frame in milliseconds and adjusts the scale, returns true when it changed. begin and end call it with the
+	//! time of the queries, which are one frame late
+	bool update( double milliseconds )
+	{
+		mTime = milliseconds;
+		if( mCooldown > 0 ) {
+			--mCooldown;
+			return false;
+		}
+		mTimes += milliseconds;
+		if( ++mNumTimes < mOptions.mFrames ) {
+			return false;
+		}
+		mAverageTime	= mTimes / mNumTimes;
+		mTimes			= 0.0;
+		mNumTimes		= 0;
+
+		// the cost of the passes is mostly proportional to the number of pixels, the scale of each side goes with its square root
+		float scale = mScale;
+		if( mAverageTime > mOptions.mTargetTime * mOptions.mUpperThreshold ) {
+			double target	= mOptions.mTargetTime * ( mOptions.mLowerThreshold + mOptions.mUpperThreshold ) * 0.5;
+			scale			= std::min( quantize( mScale * static_cast<float>( std::sqrt( target / mAverageTime ) ) ), mScale - mOptions.mStep );
+		}
+		else if( mAverageTime < mOptions.mTargetTime * mOptions.mLowerThreshold ) {
+			float next		= quantize( mScale + mOptions.mStep );
+			double expected	= mAverageTime * ( next * next ) / ( mScale * mScale );
+			if( expected < mOptions.mTargetTime * mOptions.mUpperThreshold ) {
+				scale = next;
+			}
+		}
+		scale = std::max( mOptions.mMinScale, std::min( mOptions.mMaxScale, scale ) );
+		if( std::abs( scale - mScale ) < mOptions.mStep * 0.5f ) {
+			return false;
+		}
+		mScale		= scale;
+		mCooldown	= mOptions.mCooldown;
+		return true;
+	}
+
+	//! Returns the scale of the resolution on each side
+	float		getScale() const { return mScale; }
+	//! Returns \a size scaled by the current scale, the size to render at for a full resolution of \a size
+	ci::ivec2	getSize( const ci::ivec2 &size ) const { return glm::max( ci::ivec2( 1 ), ci::ivec2( ci::vec2( size ) * mScale + ci::vec2( 0.5f ) ) ); }
+	//! Returns the last time measured and the average of the last decision, in milliseconds
+	double		getTime() const { return mTime; }
+	double		getAverageTime() const { return mAverageTime; }
+
+	void			setTargetTime( float milliseconds ) { mOptions.mTargetTime = milliseconds; }
+	const Options&	getOptions() const { return mOptions; }
+
+protected:
+	float quantize( float scale ) const
+	{
+		// the epsilon keeps exact multiples from rounding down to the previous step
+		return std::floor( scale / mOptions.mStep + 1e-3f ) * mOptions.mStep;
+	}
+
+	Options							mOptions;
+	float							mScale;
+	double							mTime, mAverageTime, mTimes;
+	int								mNumTimes, mCooldown;
+	ci::gl::QueryTimeSwappedRef		mTimer;
+};
@@ -2,7 +2,12 @@
 #include "cinder/app/RendererGl.h"
 #include "cinder/gl/gl.h"
 #include "cinder/CameraUi.h"
+#include "cinder/Log.h"
 #include "cinder/Rand.h"
+#include "cinder/Text.h"
+
+#include "DynamicResolution.h"
+#include "MeshOptimizer.h"
 
 using namespace ci;
 using namespace ci::app;
@@ -20,6 +25,7 @@ public:
 	void mouseUp( MouseEvent event ) override;
 	void mouseWheel( MouseEvent event ) override;
 	
+	void updateFbo();
 	void updateViewports();
 	
 	gl::FboRef		mFbo;
@@ -28,6 +34,11 @@ public:
 	array<CameraPersp,4>	mCameras;
 	CameraUi		mCameraUi;
 	vector<Rectf>		mViewports;
+	vector<float>		mFboViewports;
+	
+	DynamicResolution	mResolution;
+	string			mResolutionText;
+	gl::TextureRef		mResolutionTexture;
 };
 
 void ViewportArrayApp::setup()
@@ -36,7 +47,12 @@ void ViewportArrayApp::setup()
 	auto shForm = gl::GlslProg::Format().vertex( loadAsset( "shader.vert" ) ).geometry( loadAsset( "shader.geom" ) ).fragment( loadAsset( "shader.frag" ) );
 	auto shader = gl::GlslProg::create( shForm );
 	auto geom = geom::Teapot().subdivisions(10) >> geom::ColorFromAttrib(geom::Attrib::NORMAL, (const std::function<Colorf(vec3)>&) [](vec3 v){ return Colorf(v.x, v.y, v.z); });
-	mTeapot = gl::Batch::create( geom, shader );
+	
+	// and reorder it for the vertex cache, overdraw and vertex fetch
+	TriMesh teapot( geom );
+	auto report = MeshOptimizer::optimize( &teapot );
+	CI_LOG_I( "Optimized the teapot, ACMR " << report.mBefore.mAcmr << " -> " << report.mAfter.mAcmr << ", ATVR " << report.mBefore.mAtvr << " -> " << report.mAfter.mAtvr );
+	mTeapot = gl::Batch::create( teapot, shader );
 	
 	// create 4 cameras randomly spread around the teapot
 	randSeed( 12345 );
@@ -44,52 +60,98 @@ void ViewportArrayApp::setup()
 		camera = CameraPersp( getWindowWidth(), getWindowHeight(), 50, 0.1f, 100.0f );
 		camera.lookAt( randVec3() * randFloat( 1.5f, 3.0f ), vec3( 0.0f, 0.35f, 0.0f ) );
 	}
+	
+	// the fbo resolution follows the gpu time of the teapot pass, the target can
+	// be given in milliseconds on the command line, for instance --frame-time 8
+	auto options		= DynamicResolution::Options();
+	const auto &args	= getCommandLineArgs();
+	auto arg			= find( args.begin(), args.end(), "--frame-time" );
+	if( arg != args.end() && ++arg != args.end() ) {
+		options.targetTime( stof( *arg ) );
+	}
+	mResolution = DynamicResolution( options );
 }
 void ViewportArrayApp::resize()
 {
 	// update each aspect/resolution dependant objects
-	mFbo = gl::Fbo::create( getWindowWidth(), getWindowHeight(), gl::Fbo::Format().samples( 16 ) );
 	mCameraUi.setWindowSize( getWindowSize() / 2 );
 	for( auto &camera : mCameras ) {
 		camera.setAspectRatio( getWindowAspectRatio() );
 	}
-	// and recreate/upload each viewports
+	// and recreate the fbo and the viewports
+	updateFbo();
+}
+void ViewportArrayApp::updateFbo()
+{
+	// the fbo is a fraction of the window picked by the dynamic resolution
+	ivec2 size	= mResolution.getSize( getWindowSize() );
+	mFbo		= gl::Fbo::create( size.x, size.y, gl::Fbo::Format().samples( 16 ) );
 	updateViewports();
 }
 void ViewportArrayApp::update()
 {
-	// bind the fbo and enable depth testing
-	gl::ScopedFramebuffer scopedFbo( mFbo );
-	gl::ScopedDepth scopedDepthTest( true );
+	// time the pass that depends on the resolution
+	mResolution.begin();
+	{
+		// bind the fbo and enable depth testing
+		gl::ScopedFramebuffer scopedFbo( mFbo );
+		gl::ScopedDepth scopedDepthTest( true );
 	
-	// clear our fbo
-	gl::clear( Color( 0, 0, 0 ) );
+		// the viewports are in fbo pixels while the window is drawn with
+		// the full size ones, upload the array before rendering to the fbo
+		glViewportArrayv( 0, 5, &mFboViewports[0] );
 	
-	// create an array with the different cameras matrices
-	vector<mat4> matrices;
-	for( auto cam : mCameras ) {
-		matrices.push_back( cam.getProjectionMatrix() * cam.getViewMatrix() );
+		// clear our fbo
+		gl::clear( Color( 0, 0, 0 ) );
+	
+		// create an array with the different cameras matrices
+		vector<mat4> matrices;
+		for( auto cam : mCameras ) {
+			matrices.push_back( cam.getProjectionMatrix() * cam.getViewMatrix() );
+		}
+		// and send it to the shader
+		mTeapot->getGlslProg()->uniform( "uMatrices", &matrices[0], mCameras.size() );
+	
+		// render the teapot once (the geometry shader takes care of the rest)
+		mTeapot->draw();
 	}
-	// and send it to the shader
-	mTeapot->getGlslProg()->uniform( "uMatrices", &matrices[0], mCameras.size() );
 	
-	// render the teapot once (the geometry shader takes care of the rest)
-	mTeapot->draw();
+	// and change the fbo resolution when the teapot pass is over or well under the target
+	if( mResolution.end() ) {
+		updateFbo();
+	}
 }
 
 void ViewportArrayApp::draw()
 {
-	// clear the screen and set matrices
+	// clear the screen and set matrices, the main viewport
+	// was left to the size of the fbo by the update
+	glViewportIndexedf( 0, 0.0f, 0.0f, getWindowWidth(), getWindowHeight() );
 	gl::clear( Color( 0, 0, 0 ) );
 	gl::setMatricesWindow( getWindowSize() );
 	
-	// render our fbo texture
-	gl::draw( mFbo->getColorTexture() );
+	// render our fbo texture, upscaled to the window
+	gl::draw( mFbo->getColorTexture(), getWindowBounds() );
 	
 	// and viewport bounds
 	for( auto viewport : mViewports ) {
 		gl::drawStrokedRect( viewport );
 	}
+	
+	// and the current resolution with the time averaged by the last decision, the text is only rasterized
+	// again when it changes so the overlay doesn't add a texture upload per frame to what the sample measures
+	int time			= (int) round( mResolution.getAverageTime() * 10.0 );
+	string resolution	= to_string( mFbo->getWidth() ) + "x" + to_string( mFbo->getHeight() ) + ", " + to_string( (int) round( mResolution.getScale() * 100.0f ) ) + "%, " + to_string( time / 10 ) + "." + to_string( time % 10 ) + "ms gpu";
+	if( resolution != mResolutionText ) {
+		TextLayout layout;
+		layout.clear( ColorA( 0.0f, 0.0f, 0.0f, 0.0f ) );
+		layout.setColor( Color::white() );
+		layout.addLine( resolution );
+		mResolutionTexture	= gl::Texture::create( layout.render( true ) );
+		mResolutionText		= resolution;
+	}
+	gl::ScopedBlendAlpha scopedBlend;
+	gl::draw( mResolutionTexture, vec2( 10.0f, getWindowHeight() - 20.0f ) );
 }
 
 void ViewportArrayApp::updateViewports()
@@ -102,22 +164,20 @@ void ViewportArrayApp::updateViewports()
 		Rectf( vec2( getWindowCenter().x, getWindowCenter().y ), vec2( getWindowSize().x, getWindowSize().y ) )
 	};
 	
-	// transform it to a float array that opengl can understand
-	// the first viewport will be the main one used in the draw function
-	vector<float> viewportsf;
-	viewportsf.push_back( 0.0f );
-	viewportsf.push_back( 0.0f );
-	viewportsf.push_back( getWindowWidth() );
-	viewportsf.push_back( getWindowHeight() );
+	// transform it to a float array that opengl can understand, in the pixels of the fbo
+	// the first viewport will be the main one, covering the whole fbo
+	vec2 scale = vec2( mFbo->getSize() ) / vec2( getWindowSize() );
+	mFboViewports.clear();
+	mFboViewports.push_back( 0.0f );
+	mFboViewports.push_back( 0.0f );
+	mFboViewports.push_back( mFbo->getWidth() );
+	mFboViewports.push_back( mFbo->getHeight() );
 	for( auto viewport : mViewports ) {
-		viewportsf.push_back( viewport.getX1() );
-		viewportsf.push_back( getWindowHeight() - viewport.getY2() );
-		viewportsf.push_back( viewport.getWidth() );
-		viewportsf.push_back( viewport.getHeight() );
+		mFboViewports.push_back( viewport.getX1() * scale.x );
+		mFboViewports.push_back( ( getWindowHeight() - viewport.getY2() ) * scale.y );
+		mFboViewports.push_back( viewport.getWidth() * scale.x );
+		mFboViewports.push_back( viewport.getHeight() * scale.y );
 	}
-	
-	// upload the viewport array
-	glViewportArrayv( 0, 5, &viewportsf[0] );
 }
 
 